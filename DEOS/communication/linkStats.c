@@ -0,0 +1,219 @@
+/*!
+ *  \brief Statistics of the communication layers, from the UART over the
+ *         frames to the commands, of this node and of remote ones.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#include "linkStats.h"
+#include "../lib/terminal.h"
+#include "../os_scheduler.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! Where the reports of the active query are written to, NULL if there is none
+link_stats_t *linkStats_remote = NULL;
+
+//! Node the active query goes to
+address_t linkStats_remoteAddr;
+
+//! Page of the report expected next, LINK_STATS_PAGE_COUNT once all have arrived
+uint8_t linkStats_nextPage;
+
+//! If set, the node resets its statistics after the last page
+bool linkStats_remoteReset;
+
+//----------------------------------------------------------------------------
+// Implementation
+//----------------------------------------------------------------------------
+
+/*!
+ *  Copies the statistics of all layers at once
+ *
+ *  \param stats Reference parameter that receives the statistics
+ *  \param reset True to reset them afterwards, e.g. to measure the next interval
+ */
+void linkStats_snapshot(link_stats_t *stats, bool reset)
+{
+	os_enterCriticalSection();
+	xbee_getStats(&stats->xbee);
+	serialAdapter_getStats(&stats->serialAdapter);
+	rfAdapter_getStats(&stats->rfAdapter);
+	if (reset)
+	{
+		linkStats_reset();
+	}
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Resets the statistics of all layers, e.g. before a measurement
+ */
+void linkStats_reset(void)
+{
+	os_enterCriticalSection();
+	xbee_resetStats();
+	serialAdapter_resetStats();
+	rfAdapter_resetStats();
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Writes the statistics to the terminal, one line per topic and one per
+ *  received command
+ *
+ *  \param stats Statistics, e.g. from linkStats_snapshot or linkStats_query
+ */
+void linkStats_print(const link_stats_t *stats)
+{
+	xbee_stats_t const *const xbee = &stats->xbee;
+	serial_adapter_stats_t const *const serial = &stats->serialAdapter;
+	rf_adapter_stats_t const *const rf = &stats->rfAdapter;
+
+	INFO("UART: %lu B in, %lu B out, %u frame errors, %u overruns, %u overflows", xbee->rxBytes, xbee->txBytes, xbee->frameErrors, xbee->overruns, xbee->overflows);
+	INFO("UART: %u CTS pauses, %u read errors, %u B lost in loopback", xbee->ctsPauses, xbee->readErrors, xbee->loopbackLost);
+	INFO("Frames: %u in (%lu B), %u out (%lu B), %u foreign (%u B)", serial->rxFrames, serial->rxBytes, serial->txFrames, serial->txBytes, serial->foreignFrames, serial->foreignBytes);
+	INFO("Frames: %u checksum errors, %u length errors, %u timeouts, %u resyncs, %u B garbage", serial->checksumErrors, serial->lengthErrors, serial->timeouts, serial->resyncs, serial->garbageBytes);
+	INFO("Frames: %u times TX queue full", serial->txQueueFull);
+	INFO("Commands: %u unknown, %u ignored, %u deferred dropped, %u replies dropped, %u others", rf->unknownCommands, rf->ignoredCommands, rf->deferredDropped, rf->droppedReplies, rf->otherCommands);
+	for (uint8_t i = 0; i < rf->commandCount && i < RF_ADAPTER_STATS_COMMAND_COUNT; i++)
+	{
+		INFO("Command %x: %u", rf->commands[i].command, rf->commands[i].count);
+	}
+}
+
+/*!
+ *  Sends a frame with command CMD_STATS
+ *
+ *  \param destAddr The queried node
+ *  \param page Which page it reports
+ *  \param reset True to let it reset its statistics after the report
+ */
+static void linkStats_request(address_t destAddr, uint8_t page, bool reset)
+{
+	inner_frame_t innerFrame;
+	innerFrame.command = CMD_STATS;
+	cmd_stats_t payload;
+	payload.page = page;
+	payload.reset = reset ? 1 : 0;
+	memcpy(innerFrame.payload, &payload, sizeof(payload));
+
+	// Without acknowledgements and without waiting, the handlers that request the next page run in the worker
+	rfAdapter_reply(destAddr, sizeof(innerFrame.command) + sizeof(payload), &innerFrame);
+}
+
+/*!
+ *  Asks a node for its statistics. The pages are written to stats as their
+ *  reports arrive, see linkStats_hasArrived. A page that gets lost stops
+ *  the query, query again in that case.
+ *
+ *  \param destAddr A node address, this node's own address works with the loopback
+ *  \param stats Receives the statistics, must stay valid until the query is complete or stopped
+ *  \param reset True to let the node reset its statistics after the last page
+ */
+void linkStats_query(address_t destAddr, link_stats_t *stats, bool reset)
+{
+	os_enterCriticalSection();
+	memset(stats, 0, sizeof(*stats));
+	linkStats_remote = stats;
+	linkStats_remoteAddr = destAddr;
+	linkStats_remoteReset = reset;
+	linkStats_nextPage = 0;
+	os_leaveCriticalSection();
+
+	linkStats_request(destAddr, 0, reset && LINK_STATS_PAGE_COUNT == 1);
+}
+
+/*!
+ *  \return True once all pages of the last query have arrived
+ */
+bool linkStats_hasArrived(void)
+{
+	os_enterCriticalSection();
+	bool const arrived = linkStats_remote && linkStats_nextPage == LINK_STATS_PAGE_COUNT;
+	os_leaveCriticalSection();
+	return arrived;
+}
+
+/*!
+ *  Stops the query, the statistics passed to linkStats_query aren't written
+ *  any more
+ */
+void linkStats_stop(void)
+{
+	os_enterCriticalSection();
+	linkStats_remote = NULL;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Handler that's called when command CMD_STATS was received. Answers with
+ *  the requested page of a fresh snapshot.
+ *
+ *  \param frame Received frame with payload cmd_stats_t, its sender receives the report
+ */
+void linkStats_receiveQuery(const frame_view_t *frame)
+{
+	cmd_stats_t buffer;
+	cmd_stats_t const query = *(const cmd_stats_t *)serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
+	if (query.page >= LINK_STATS_PAGE_COUNT)
+	{
+		return;
+	}
+
+	link_stats_t stats;
+	linkStats_snapshot(&stats, false);
+
+	uint8_t const offset = query.page * LINK_STATS_PAGE_LENGTH;
+	uint8_t const length = sizeof(stats) - offset < LINK_STATS_PAGE_LENGTH ? sizeof(stats) - offset : LINK_STATS_PAGE_LENGTH;
+
+	inner_frame_t innerFrame;
+	innerFrame.command = CMD_STATS_REPORT;
+	innerFrame.payload[0] = query.page;
+	memcpy(&innerFrame.payload[sizeof(uint8_t)], (const uint8_t *)&stats + offset, length);
+	rfAdapter_reply(frame->header.srcAddr, sizeof(innerFrame.command) + sizeof(uint8_t) + length, &innerFrame);
+
+	if (query.reset)
+	{
+		linkStats_reset();
+	}
+}
+
+/*!
+ *  Handler that's called when command CMD_STATS_REPORT was received. Only
+ *  the page expected next from the queried node is taken, then the page
+ *  after it is requested.
+ *
+ *  \param frame Received frame with the page number and the bytes of the page
+ */
+void linkStats_receiveReport(const frame_view_t *frame)
+{
+	uint8_t buffer[sizeof(uint8_t) + LINK_STATS_PAGE_LENGTH];
+	uint8_t const length = frame->header.length - sizeof(command_t) - sizeof(uint8_t);
+	const uint8_t *data = serialAdapter_viewData(frame, sizeof(command_t), sizeof(uint8_t) + length, buffer);
+	uint8_t const page = data[0];
+	uint8_t const offset = page * LINK_STATS_PAGE_LENGTH;
+
+	os_enterCriticalSection();
+	if (!linkStats_remote || frame->header.srcAddr != linkStats_remoteAddr || page != linkStats_nextPage || page >= LINK_STATS_PAGE_COUNT
+		|| length != (sizeof(link_stats_t) - offset < LINK_STATS_PAGE_LENGTH ? sizeof(link_stats_t) - offset : LINK_STATS_PAGE_LENGTH))
+	{
+		os_leaveCriticalSection();
+		return;
+	}
+	memcpy((uint8_t *)linkStats_remote + offset, &data[sizeof(uint8_t)], length);
+	uint8_t const next = ++linkStats_nextPage;
+	bool const reset = linkStats_remoteReset && next + 1 == LINK_STATS_PAGE_COUNT;
+	os_leaveCriticalSection();
+
+	if (next < LINK_STATS_PAGE_COUNT)
+	{
+		linkStats_request(frame->header.srcAddr, next, reset);
+	}
+}
@@ -0,0 +1,77 @@
+/*!
+ *  \brief Statistics of the communication layers, from the UART over the
+ *         frames to the commands, of this node and of remote ones.
+ *
+ *  Every layer counts for itself: xbee_stats_t the bytes and errors of the
+ *  UART, serial_adapter_stats_t the frames and why candidates were dropped,
+ *  rf_adapter_stats_t the received commands. Here they are taken together,
+ *  printed to the terminal and queried from other nodes.
+ *
+ *  A node answers CMD_STATS with one CMD_STATS_REPORT frame that carries a
+ *  page of its link_stats_t. The querying node asks for the next page when
+ *  a report arrives, so the pages don't flood the receive buffer. The pages
+ *  are copied as they are, both nodes need to run the same build.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef LINK_STATS_H_
+#define LINK_STATS_H_
+
+#include "rfAdapter.h"
+#include "rfRouting.h"
+#include "xbee.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Statistics of all layers
+typedef struct LinkStats
+{
+	xbee_stats_t xbee;
+	serial_adapter_stats_t serialAdapter;
+	rf_adapter_stats_t rfAdapter;
+} link_stats_t;
+
+//! Bytes of link_stats_t per CMD_STATS_REPORT, the report fits into a routed frame
+#define LINK_STATS_PAGE_LENGTH (RF_ROUTING_MAX_INNER_FRAME_LENGTH - sizeof(command_t) - sizeof(uint8_t))
+
+//! Number of CMD_STATS_REPORT frames that make up link_stats_t
+#define LINK_STATS_PAGE_COUNT ((sizeof(link_stats_t) + LINK_STATS_PAGE_LENGTH - 1) / LINK_STATS_PAGE_LENGTH)
+
+//! Command payload of command CMD_STATS, the report is [page][up to LINK_STATS_PAGE_LENGTH bytes]
+typedef struct cmd_stats
+{
+	//! Which part of link_stats_t to report
+	uint8_t page;
+	//! If set, the statistics are reset after the report
+	uint8_t reset;
+} cmd_stats_t;
+
+//! Copies the statistics of all layers, they are reset afterwards if reset is set
+void linkStats_snapshot(link_stats_t *stats, bool reset);
+
+//! Resets the statistics of all layers
+void linkStats_reset(void);
+
+//! Writes the statistics to the terminal
+void linkStats_print(const link_stats_t *stats);
+
+//! Asks a node for its statistics, they are written to stats as the reports arrive
+void linkStats_query(address_t destAddr, link_stats_t *stats, bool reset);
+
+//! Returns true once all pages of the last query have arrived
+bool linkStats_hasArrived(void);
+
+//! Stops the query, reports are ignored from now on
+void linkStats_stop(void);
+
+//! Is called by the rfAdapter on CMD_STATS receive
+void linkStats_receiveQuery(const frame_view_t *frame);
+
+//! Is called by the rfAdapter on CMD_STATS_REPORT receive
+void linkStats_receiveReport(const frame_view_t *frame);
+
+#endif /* LINK_STATS_H_ */
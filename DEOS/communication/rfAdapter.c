@@ -6,10 +6,19 @@
  *  \version  1.0
  */
 
+#define LOG_MODULE RF_ADAPTER
+
 #include "rfAdapter.h"
 #include "../lib/lcd.h"
 #include "../os_core.h"
 #include "../lib/terminal.h"
+#include "linkStats.h"
+#include "rfProbe.h"
+#include "rfReliable.h"
+#include "rfRouting.h"
+#include "rfTransfer.h"
+#include "sensorBuffer.h"
+#include "sensorSamples.h"
 #include <string.h>
 
 
@@ -30,15 +39,108 @@ start_flag_t serialAdapter_startFlag = 0x5246; // "RF"
 //! Configuration what address this microcontroller has
 address_t serialAdapter_address = ADDRESS(1, 0);
 
+//! If set, the rfAdapter_send functions deliver their commands reliably
+bool rfAdapter_reliable = false;
+
+//! If set, the rfAdapter_send functions combine their commands into CMD_BATCH frames,
+//! the remote LCD commands are combined anyway unless RF_ADAPTER_BATCH_LCD is 0
+bool rfAdapter_batching = false;
+
+//! Commands that wait for the end of the batch window
+typedef struct RfAdapterBatch
+{
+	address_t destAddr;
+	//! Number of commands in the batch, 0 if it's empty
+	uint8_t count;
+	//! Time the first command was added
+	time_t startTime;
+	//! CMD_BATCH, the used payload bytes are length - sizeof(command_t)
+	inner_frame_length_t length;
+	inner_frame_t innerFrame;
+} rf_adapter_batch_t;
+
+rf_adapter_batch_t rfAdapter_batch;
+
+//! Handler of a command, the payload length has been checked before it's called
+typedef struct RfAdapterHandler
+{
+	command_t command;
+	rf_command_handler_t handler;
+	uint8_t minLength;
+	uint8_t maxLength : 7;
+	//! Set if the handler runs in rfAdapter_deferredWorker
+	uint8_t deferred : 1;
+} rf_adapter_handler_t;
+
+//! Handlers set by rfAdapter_registerHandler, they take precedence over rfAdapter_builtinHandlers
+rf_adapter_handler_t rfAdapter_handlers[RF_ADAPTER_HANDLER_COUNT];
+
+//! Number of entries in rfAdapter_handlers that are in use
+uint8_t rfAdapter_handlerCount = 0;
+
+//! One bit per command that has an entry in rfAdapter_handlers, the others skip the search
+uint8_t rfAdapter_overridden[(RF_ADAPTER_COMMAND_COUNT + 7) / 8];
+
+//! A received frame that waits for its deferred handler
+typedef struct RfAdapterDeferredFrame
+{
+	rf_command_handler_t handler;
+	frame_header_t header;
+	uint8_t data[COMM_MAX_INNER_FRAME_LENGTH];
+} rf_adapter_deferred_frame_t;
+
+rf_adapter_deferred_frame_t rfAdapter_deferredQueue[RF_ADAPTER_DEFERRED_QUEUE_LENGTH];
+uint8_t rfAdapter_deferredHead = 0;
+uint8_t rfAdapter_deferredCount = 0;
+
+rf_adapter_stats_t rfAdapter_stats;
+
 //----------------------------------------------------------------------------
 // Forward declarations
 //----------------------------------------------------------------------------
 
-void rfAdapter_receiveSetLed(cmd_setLed_t *);
-void rfAdapter_receiveToggleLed();
-void rfAdapter_receiveLcdGoto(cmd_lcdGoto_t *);
-void rfAdapter_receiveLcdPrint(cmd_lcdPrint_t *);
-void rfAdapter_receiveLcdClear();
+void rfAdapter_receiveSetLed(const frame_view_t *);
+void rfAdapter_receiveToggleLed(const frame_view_t *);
+void rfAdapter_receiveLcdGoto(const frame_view_t *);
+void rfAdapter_receiveLcdPrint(const frame_view_t *);
+void rfAdapter_receiveLcdClear(const frame_view_t *);
+void rfAdapter_receivePing(const frame_view_t *);
+void rfAdapter_receivePong(const frame_view_t *);
+static void rfAdapter_receiveBatch(const frame_view_t *);
+static bool rfAdapter_tryFlush(void);
+
+//! A command the rfAdapter handles itself, kept in flash
+typedef struct RfAdapterBuiltinHandler
+{
+	rf_command_handler_t handler;
+	uint8_t minLength;
+	uint8_t maxLength;
+} rf_adapter_builtin_handler_t;
+
+//! Indexed by command, the handler of the other commands is NULL
+static const rf_adapter_builtin_handler_t rfAdapter_builtinHandlers[RF_ADAPTER_COMMAND_COUNT] PROGMEM = {
+	[CMD_SET_LED] = {rfAdapter_receiveSetLed, sizeof(cmd_setLed_t), sizeof(cmd_setLed_t)},
+	[CMD_TOGGLE_LED] = {rfAdapter_receiveToggleLed, 0, 0},
+	[CMD_LCD_CLEAR] = {rfAdapter_receiveLcdClear, 0, 0},
+	[CMD_LCD_GOTO] = {rfAdapter_receiveLcdGoto, sizeof(cmd_lcdGoto_t), sizeof(cmd_lcdGoto_t)},
+	[CMD_LCD_PRINT] = {rfAdapter_receiveLcdPrint, sizeof(uint8_t), sizeof(cmd_lcdPrint_t)},
+	[CMD_PING] = {rfAdapter_receivePing, sizeof(cmd_ping_t), sizeof(cmd_ping_t)},
+	[CMD_PONG] = {rfAdapter_receivePong, sizeof(cmd_ping_t), sizeof(cmd_ping_t)},
+	[CMD_SENSOR_SAMPLES] = {sensorSamples_receive, SENSOR_SAMPLES_RECORD_LENGTH, COMM_MAX_PAYLOAD_LENGTH},
+	[CMD_SENSOR_BACKLOG] = {sensorSamples_receiveBacklog, sizeof(uint16_t) + SENSOR_SAMPLES_BACKLOG_RECORD_LENGTH, COMM_MAX_PAYLOAD_LENGTH},
+	// Sequence number, epoch and at least the command byte of the wrapped command
+	[CMD_RELIABLE] = {rfReliable_receiveData, 2 * sizeof(uint8_t) + sizeof(command_t), COMM_MAX_PAYLOAD_LENGTH},
+	[CMD_ACK] = {rfReliable_receiveAck, sizeof(cmd_ack_t), sizeof(cmd_ack_t)},
+	// At least one command with its length
+	[CMD_BATCH] = {rfAdapter_receiveBatch, sizeof(uint8_t) + sizeof(command_t), COMM_MAX_PAYLOAD_LENGTH},
+	[CMD_FRAGMENT] = {rfTransfer_receiveFragment, sizeof(rf_transfer_fragment_t) + 1, COMM_MAX_PAYLOAD_LENGTH},
+	[CMD_FRAGMENT_STATUS] = {rfTransfer_receiveStatus, sizeof(uint8_t) * 2, sizeof(uint8_t) + RF_TRANSFER_BITMAP_LENGTH},
+	// Routing header and at least the command byte of the wrapped command
+	[CMD_ROUTED] = {rfRouting_receive, sizeof(rf_routing_header_t) + sizeof(command_t), COMM_MAX_PAYLOAD_LENGTH},
+	[CMD_STATS] = {linkStats_receiveQuery, sizeof(cmd_stats_t), sizeof(cmd_stats_t)},
+	// Page number and at least one byte of the statistics
+	[CMD_STATS_REPORT] = {linkStats_receiveReport, sizeof(uint8_t) + 1, sizeof(uint8_t) + LINK_STATS_PAGE_LENGTH},
+};
 
 //----------------------------------------------------------------------------
 // Your Homework
@@ -71,100 +173,536 @@ uint8_t rfAdapter_isInitialized()
 void rfAdapter_worker()
 {
 	serialAdapter_worker();
+	rfReliable_worker();
+	sensorBuffer_worker();
+
+	// The worker must not wait for a free slot in the send window, only it processes the ACKs
+	if (rfAdapter_batch.count && getSystemTime_ms() - rfAdapter_batch.startTime >= RF_ADAPTER_BATCH_WINDOW_MS)
+	{
+		rfAdapter_tryFlush();
+	}
 }
 
 /*!
- *  Is called on command frame receive
+ *  Selects how the rfAdapter_send functions deliver their commands. Reliable
+ *  commands are acknowledged by the receiver and retransmitted if needed,
+ *  see rfReliable.h. Broadcasts and pings are never sent reliably, neither
+ *  are commands to destinations that are routed over other nodes.
  *
- *  \param frame Received frame
+ *  \param enable True to send reliably
  */
-void serialAdapter_processFrame(frame_t *frame)
+void rfAdapter_setReliable(bool enable)
 {
-	// Prfen, ob length mindestens 1 Byte fr command umfasst
-	if (frame->header.length < 1)
+	// The waiting commands may not fit into a reliable frame
+	rfAdapter_flush();
+	rfAdapter_reliable = enable;
+}
+
+/*!
+ *  Sends a command the way rfAdapter_setReliable selected, or over the
+ *  next hop if the destination has a route, see rfRouting.h
+ *
+ *  \param destAddr where to send the frame to
+ *  \param length how many bytes the innerFrame has
+ *  \param innerFrame the command
+ */
+static void rfAdapter_deliver(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame)
+{
+	if (rfRouting_isRouted(destAddr))
 	{
-		// Ungltiges Frame
+		rfRouting_send(destAddr, length, innerFrame);
+	}
+	else if (rfAdapter_reliable && destAddr != ADDRESS_BROADCAST)
+	{
+		rfReliable_send(destAddr, length, innerFrame);
+	}
+	else
+	{
+		serialAdapter_writeFrame(destAddr, length, innerFrame);
+	}
+}
+
+/*!
+ *  Sends the answer of a command handler without waiting, over the next hop
+ *  if the destination has a route. Handlers run in the worker, which must
+ *  not wait for the transmit queue: with TDMA only the worker restarts the
+ *  held frames. If there's no room, the answer is dropped and counted.
+ *
+ *  \param destAddr where to send the frame to, usually the sender of the command
+ *  \param length how many bytes the innerFrame has
+ *  \param innerFrame the answer
+ *  \return True if the answer has been queued
+ */
+bool rfAdapter_reply(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame)
+{
+	bool queued;
+	if (rfRouting_isRouted(destAddr))
+	{
+		uint8_t const status = rfRouting_trySend(destAddr, length, innerFrame);
+		// An answer that doesn't fit into CMD_ROUTED goes to the destination directly
+		queued = status == RF_ROUTING_SUCCESS || (status == RF_ROUTING_INVALID && serialAdapter_tryWriteFrame(destAddr, length, innerFrame) == SERIAL_ADAPTER_SUCCESS);
+	}
+	else
+	{
+		queued = serialAdapter_tryWriteFrame(destAddr, length, innerFrame) == SERIAL_ADAPTER_SUCCESS;
+	}
+
+	if (!queued)
+	{
+		os_enterCriticalSection();
+		rfAdapter_stats.droppedReplies++;
+		os_leaveCriticalSection();
+		DEBUG("Dropped reply %x, transmit queue full", innerFrame->command);
+	}
+	return queued;
+}
+
+/*!
+ *  Selects whether the rfAdapter_send functions wait RF_ADAPTER_BATCH_WINDOW_MS
+ *  for further commands to the same address and send them together in one
+ *  CMD_BATCH frame. Disabling sends the waiting commands. Batching is off
+ *  until an application enables it, as it delays every command and the
+ *  receivers have to know CMD_BATCH: implementations without it drop the
+ *  whole frame as unknown command, e.g. the sensor data. Only the remote LCD
+ *  commands (clear, goto, print), which usually come in a burst, are
+ *  combined regardless, see RF_ADAPTER_BATCH_LCD.
+ *
+ *  \param enable True to combine commands
+ */
+void rfAdapter_setBatching(bool enable)
+{
+	rfAdapter_batching = enable;
+	if (!enable)
+	{
+		rfAdapter_flush();
+	}
+}
+
+/*!
+ *  Tries to send the commands of the batch without waiting. A single command
+ *  is sent as it is, without the CMD_BATCH overhead. A batch is never wrapped
+ *  into CMD_ROUTED or CMD_RELIABLE, see rfAdapter_processWrapped, so it goes
+ *  to the destination directly even if a route has been added meanwhile.
+ *
+ *  \return True if the batch is empty now
+ */
+static bool rfAdapter_tryFlush(void)
+{
+	rf_adapter_batch_t *const batch = &rfAdapter_batch;
+	inner_frame_t *innerFrame = &batch->innerFrame;
+	inner_frame_length_t length = batch->length;
+	bool sent;
+
+	os_enterCriticalSection();
+	if (!batch->count)
+	{
+		os_leaveCriticalSection();
+		return true;
+	}
+
+	if (batch->count == 1)
+	{
+		length = batch->innerFrame.payload[0];
+		innerFrame = (inner_frame_t *)&batch->innerFrame.payload[1];
+	}
+
+	sent = serialAdapter_tryWriteFrame(batch->destAddr, length, innerFrame) == SERIAL_ADAPTER_SUCCESS;
+	if (sent)
+	{
+		batch->count = 0;
+	}
+	os_leaveCriticalSection();
+	return sent;
+}
+
+/*!
+ *  Sends the commands of the batch, yields while they can't be sent
+ */
+void rfAdapter_flush(void)
+{
+	while (!rfAdapter_tryFlush())
+	{
+		os_yield();
+	}
+}
+
+/*!
+ *  Sends a command the way rfAdapter_setReliable and rfAdapter_setBatching
+ *  selected. A command is added to the batch if it fits, otherwise the batch
+ *  is sent first, so the commands keep their order. Commands that are routed
+ *  or sent reliably are not batched.
+ *
+ *  \param destAddr where to send the frame to
+ *  \param length how many bytes the innerFrame has
+ *  \param innerFrame the command
+ *  \param batchable True to batch the command even if rfAdapter_batching is off
+ */
+static void rfAdapter_sendCommand(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame, bool batchable)
+{
+	rf_adapter_batch_t *const batch = &rfAdapter_batch;
+
+	// Receivers reject CMD_BATCH wrapped into CMD_ROUTED or CMD_RELIABLE
+	bool const wrapped = rfRouting_isRouted(destAddr) || (rfAdapter_reliable && destAddr != ADDRESS_BROADCAST);
+	// Each command in the batch is preceded by its length
+	inner_frame_length_t const entryLength = sizeof(uint8_t) + length;
+
+	if (!(rfAdapter_batching || batchable) || wrapped || sizeof(command_t) + entryLength > COMM_MAX_INNER_FRAME_LENGTH)
+	{
+		rfAdapter_flush();
+		rfAdapter_deliver(destAddr, length, innerFrame);
 		return;
 	}
 
-	command_t cmd = frame->innerFrame.command;
-	DEBUG("Frame with Command: %x", cmd);
-	switch (cmd)
+	os_enterCriticalSection();
+	while (batch->count && (batch->destAddr != destAddr || batch->length + entryLength > COMM_MAX_INNER_FRAME_LENGTH))
 	{
-		case CMD_SET_LED:
+		os_leaveCriticalSection();
+		rfAdapter_flush();
+		os_enterCriticalSection();
+	}
+
+	if (!batch->count)
+	{
+		batch->destAddr = destAddr;
+		batch->startTime = getSystemTime_ms();
+		batch->innerFrame.command = CMD_BATCH;
+		batch->length = sizeof(command_t);
+	}
+	((uint8_t *)&batch->innerFrame)[batch->length] = length;
+	memcpy((uint8_t *)&batch->innerFrame + batch->length + sizeof(uint8_t), innerFrame, length);
+	batch->length += entryLength;
+	batch->count++;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Executes the commands of a CMD_BATCH frame in order. Nothing is
+ *  executed if the lengths of the commands don't add up to the frame.
+ *
+ *  \param frame Received frame with command CMD_BATCH
+ */
+static void rfAdapter_receiveBatch(const frame_view_t *frame)
+{
+	uint8_t offset = sizeof(command_t);
+	while (offset < frame->header.length)
+	{
+		uint8_t const length = serialAdapter_viewByte(frame, offset);
+		if (!length || length >= frame->header.length - offset)
 		{
-			if (frame->header.length == sizeof(command_t) + sizeof(cmd_setLed_t))
-			{
-				cmd_setLed_t *data = (cmd_setLed_t *)(frame->innerFrame.payload);
-				rfAdapter_receiveSetLed(data);
-			}
-			break;
+			return;
 		}
-		case CMD_TOGGLE_LED:
+		offset += sizeof(uint8_t) + length;
+	}
+
+	offset = sizeof(command_t);
+	while (offset < frame->header.length)
+	{
+		frame_view_t command;
+		serialAdapter_subView(frame, offset + sizeof(uint8_t), &command);
+		command.header.length = serialAdapter_viewByte(frame, offset);
+		offset += sizeof(uint8_t) + command.header.length;
+		rfAdapter_processWrapped(&command);
+	}
+}
+
+/*!
+ *  Executes the command of a CMD_BATCH, CMD_RELIABLE or CMD_ROUTED frame.
+ *  These wrappers are ignored inside each other, the nested handlers would
+ *  exceed the stack of the worker.
+ *
+ *  \param frame The wrapped command
+ */
+void rfAdapter_processWrapped(const frame_view_t *frame)
+{
+	command_t const cmd = frame->header.length ? serialAdapter_viewByte(frame, 0) : CMD_BATCH;
+	if (cmd == CMD_BATCH || cmd == CMD_RELIABLE || cmd == CMD_ROUTED)
+	{
+		rfAdapter_stats.ignoredCommands++;
+		DEBUG("Ignored wrapped command %x", cmd);
+		return;
+	}
+	serialAdapter_processFrame(frame);
+}
+
+/*!
+ *  Looks up the handler of a command, a registered one before the builtin
+ *  one. Only commands with a registered handler are searched for in
+ *  rfAdapter_handlers, the others are read from the flash table right
+ *  away. Call within a critical section.
+ *
+ *  \param command The command, below RF_ADAPTER_COMMAND_COUNT
+ *  \param entry Receives the handler, its handler is NULL if the command is ignored
+ *  \return The registered entry, NULL if the command has none
+ */
+static rf_adapter_handler_t *rfAdapter_findHandler(command_t command, rf_adapter_handler_t *entry)
+{
+	if (rfAdapter_overridden[command / 8] & (1 << (command % 8)))
+	{
+		for (uint8_t i = 0; i < rfAdapter_handlerCount; i++)
 		{
-			// Keine Nutzdaten auer command_t erwartet
-			if (frame->header.length == sizeof(command_t))
+			if (rfAdapter_handlers[i].command == command)
 			{
-				rfAdapter_receiveToggleLed();
+				*entry = rfAdapter_handlers[i];
+				return &rfAdapter_handlers[i];
 			}
-			break;
 		}
-		case CMD_LCD_CLEAR:
+	}
+
+	rf_adapter_builtin_handler_t builtin;
+	memcpy_P(&builtin, &rfAdapter_builtinHandlers[command], sizeof(builtin));
+	entry->command = command;
+	entry->handler = builtin.handler;
+	entry->minLength = builtin.minLength;
+	entry->maxLength = builtin.maxLength;
+	entry->deferred = false;
+	return NULL;
+}
+
+/*!
+ *  Registers the handler of a command. Frames whose payload length is out
+ *  of the given range are dropped before the handler is called. Inline
+ *  handlers are called by the rfAdapter worker while the frame is still in
+ *  the receive buffer, so they should be quick. Deferred handlers get a copy
+ *  of the frame and are called by rfAdapter_deferredWorker, which an
+ *  application process has to run.
+ *
+ *  \param command The command, below RF_ADAPTER_COMMAND_COUNT
+ *  \param handler Is called with the received frame, NULL to ignore the command
+ *  \param minLength Smallest payload length (without the command byte)
+ *  \param maxLength Largest payload length, up to COMM_MAX_PAYLOAD_LENGTH
+ *  \param context Where the handler runs
+ *  \return False if the command or the lengths are out of range or
+ *          RF_ADAPTER_HANDLER_COUNT handlers are registered already
+ */
+bool rfAdapter_registerHandler(command_t command, rf_command_handler_t handler, uint8_t minLength, uint8_t maxLength, rf_handler_context_t context)
+{
+	if (command >= RF_ADAPTER_COMMAND_COUNT || minLength > maxLength || maxLength > COMM_MAX_PAYLOAD_LENGTH)
+	{
+		return false;
+	}
+
+	os_enterCriticalSection();
+	rf_adapter_handler_t builtin;
+	rf_adapter_handler_t *entry = rfAdapter_findHandler(command, &builtin);
+	if (!entry)
+	{
+		if (!handler && !builtin.handler)
 		{
-			// Keine Nutzdaten auer command_t erwartet
-			if (frame->header.length == sizeof(command_t))
-			{
-				rfAdapter_receiveLcdClear();
-			}
-			break;
+			os_leaveCriticalSection();
+			return true;
 		}
-		case CMD_LCD_GOTO:
+		if (rfAdapter_handlerCount == RF_ADAPTER_HANDLER_COUNT)
 		{
-			if (frame->header.length == sizeof(command_t) + sizeof(cmd_lcdGoto_t))
-			{
-				cmd_lcdGoto_t *data = (cmd_lcdGoto_t *)(frame->innerFrame.payload);
-				rfAdapter_receiveLcdGoto(data);
-			}
-			break;
+			os_leaveCriticalSection();
+			return false;
 		}
-		case CMD_LCD_PRINT:
+		entry = &rfAdapter_handlers[rfAdapter_handlerCount++];
+		entry->command = command;
+		rfAdapter_overridden[command / 8] |= 1 << (command % 8);
+	}
+	else if (!handler && !builtin.handler)
+	{
+		// Nothing to override, the entry is free again
+		rfAdapter_overridden[command / 8] &= ~(1 << (command % 8));
+		*entry = rfAdapter_handlers[--rfAdapter_handlerCount];
+		os_leaveCriticalSection();
+		return true;
+	}
+	entry->handler = handler;
+	entry->minLength = minLength;
+	entry->maxLength = maxLength;
+	entry->deferred = context == RF_HANDLER_DEFERRED;
+	os_leaveCriticalSection();
+	return true;
+}
+
+/*!
+ *  Copies a frame for its deferred handler. The frame is dropped if the
+ *  queue is full, the receive path never waits for rfAdapter_deferredWorker.
+ *
+ *  \param frame Received frame
+ *  \param handler Handler of its command
+ */
+static void rfAdapter_defer(const frame_view_t *frame, rf_command_handler_t handler)
+{
+	os_enterCriticalSection();
+	if (rfAdapter_deferredCount == RF_ADAPTER_DEFERRED_QUEUE_LENGTH)
+	{
+		rfAdapter_stats.deferredDropped++;
+		os_leaveCriticalSection();
+		WARN("Deferred queue full, dropped command %x", serialAdapter_viewByte(frame, 0));
+		return;
+	}
+
+	uint8_t const index = (rfAdapter_deferredHead + rfAdapter_deferredCount) % RF_ADAPTER_DEFERRED_QUEUE_LENGTH;
+	rf_adapter_deferred_frame_t *const deferred = &rfAdapter_deferredQueue[index];
+	deferred->handler = handler;
+	deferred->header = frame->header;
+	const void *data = serialAdapter_viewData(frame, 0, frame->header.length, deferred->data);
+	if (data != deferred->data)
+	{
+		memcpy(deferred->data, data, frame->header.length);
+	}
+	rfAdapter_deferredCount++;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Calls the handler of the oldest deferred frame. Needs to be called
+ *  periodically by an application process if deferred handlers are
+ *  registered. Yields if there is no frame.
+ */
+void rfAdapter_deferredWorker(void)
+{
+	if (!rfAdapter_deferredCount)
+	{
+		os_yield();
+		return;
+	}
+
+	// The frame stays in the queue until its handler returns
+	rf_adapter_deferred_frame_t *const deferred = &rfAdapter_deferredQueue[rfAdapter_deferredHead];
+	frame_view_t frame;
+	frame.header = deferred->header;
+	frame.segment[0] = deferred->data;
+	frame.segmentLength[0] = deferred->header.length;
+	frame.segmentLength[1] = 0;
+	deferred->handler(&frame);
+
+	os_enterCriticalSection();
+	rfAdapter_deferredHead = (rfAdapter_deferredHead + 1) % RF_ADAPTER_DEFERRED_QUEUE_LENGTH;
+	rfAdapter_deferredCount--;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Copies the statistics at once, they are updated by the worker
+ *
+ *  \param stats Reference parameter that receives rfAdapter_stats
+ */
+void rfAdapter_getStats(rf_adapter_stats_t *stats)
+{
+	os_enterCriticalSection();
+	*stats = rfAdapter_stats;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Resets the statistics, e.g. before a measurement
+ */
+void rfAdapter_resetStats(void)
+{
+	os_enterCriticalSection();
+	memset(&rfAdapter_stats, 0, sizeof(rfAdapter_stats));
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  \param stats Statistics, e.g. a copy of rfAdapter_stats
+ *  \param command A command ID
+ *  \return How often command has been received, 0 if it didn't get an entry in stats->commands
+ */
+uint16_t rfAdapter_getCommandCount(const rf_adapter_stats_t *stats, command_t command)
+{
+	for (uint8_t i = 0; i < stats->commandCount && i < RF_ADAPTER_STATS_COMMAND_COUNT; i++)
+	{
+		if (stats->commands[i].command == command)
 		{
-			// mind. command_t + length + payload
-			// Struktur: [command][length][message...]
-			if (frame->header.length >= sizeof(command_t) + sizeof(uint8_t))
-			{
-				cmd_lcdPrint_t *data = (cmd_lcdPrint_t *)frame->innerFrame.payload;
-				uint8_t length = data->length;
-				if (frame->header.length == sizeof(command_t) + sizeof(uint8_t) + length)
-				{
-					// Prfen, dass length <= 32
-					if (length <= 32)
-					{
-						rfAdapter_receiveLcdPrint(data);
-					}
-				}
-			}
-			break;
+			return stats->commands[i].count;
 		}
-		case CMD_SENSOR_DATA:
+	}
+	return 0;
+}
+
+/*!
+ *  Counts a received command. Only the first RF_ADAPTER_STATS_COMMAND_COUNT
+ *  different commands are counted one by one.
+ *
+ *  \param command The received command
+ */
+static void rfAdapter_countCommand(command_t command)
+{
+	rf_adapter_stats_t *const stats = &rfAdapter_stats;
+
+	for (uint8_t i = 0; i < stats->commandCount; i++)
+	{
+		if (stats->commands[i].command == command)
 		{
-			// Hier knnte man sensordaten verarbeiten, falls gefordert.
-			
-			break;
+			stats->commands[i].count++;
+			return;
 		}
-		default:
+	}
+
+	if (stats->commandCount == RF_ADAPTER_STATS_COMMAND_COUNT)
+	{
+		stats->otherCommands++;
+		return;
+	}
+	stats->commands[stats->commandCount].command = command;
+	stats->commands[stats->commandCount].count = 1;
+	stats->commandCount++;
+}
+
+/*!
+ *  Is called on command frame receive. Looks the handler of the command up
+ *  and checks the payload length before it's called. The payload is read
+ *  straight from the receive buffer, payloads that wrap around its end are
+ *  copied to the stack.
+ *
+ *  \param frame Received frame
+ */
+void serialAdapter_processFrame(const frame_view_t *frame)
+{
+	// Prfen, ob length mindestens 1 Byte fr command umfasst
+	if (frame->header.length < 1)
+	{
+		// Ungltiges Frame
+		rfAdapter_stats.ignoredCommands++;
+		return;
+	}
+
+	command_t cmd = serialAdapter_viewByte(frame, 0);
+	DEBUG("Frame with Command: %x", cmd);
+	if (cmd >= RF_ADAPTER_COMMAND_COUNT)
+	{
 		// Unbekannter Befehl
-		break;
+		rfAdapter_stats.unknownCommands++;
+		return;
+	}
+	rfAdapter_countCommand(cmd);
+
+	rf_adapter_handler_t entry;
+	os_enterCriticalSection();
+	rfAdapter_findHandler(cmd, &entry);
+	os_leaveCriticalSection();
+
+	uint8_t const payloadLength = frame->header.length - sizeof(command_t);
+	if (!entry.handler || payloadLength < entry.minLength || payloadLength > entry.maxLength)
+	{
+		rfAdapter_stats.ignoredCommands++;
+		DEBUG("Ignored command %x with %u bytes payload", cmd, payloadLength);
+		return;
+	}
+
+	if (entry.deferred)
+	{
+		rfAdapter_defer(frame, entry.handler);
+	}
+	else
+	{
+		entry.handler(frame);
 	}
 }
 
 /*!
  *  Handler that's called when command CMD_SET_LED was received
  *
- *  \param data Payload of received frame
+ *  \param frame Received frame with payload cmd_setLed_t
  */
-void rfAdapter_receiveSetLed(cmd_setLed_t *data)
+void rfAdapter_receiveSetLed(const frame_view_t *frame)
 {
+	cmd_setLed_t buffer;
+	const cmd_setLed_t *data = serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
 	if (data->enable)
 	{
 		PORTB |= (1 << PB7); // LED an
@@ -178,7 +716,7 @@ void rfAdapter_receiveSetLed(cmd_setLed_t *data)
 /*!
  *  Handler that's called when command CMD_TOGGLE_LED was received
  */
-void rfAdapter_receiveToggleLed()
+void rfAdapter_receiveToggleLed(const frame_view_t *frame)
 {
 	// LED Zustand umschalten
 	PORTB ^= (1 << PB7);
@@ -187,7 +725,7 @@ void rfAdapter_receiveToggleLed()
 /*!
  *  Handler that's called when command CMD_LCD_CLEAR was received
  */
-void rfAdapter_receiveLcdClear()
+void rfAdapter_receiveLcdClear(const frame_view_t *frame)
 {
 	lcd_clear();
 }
@@ -195,25 +733,68 @@ void rfAdapter_receiveLcdClear()
 /*!
  *  Handler that's called when command CMD_LCD_GOTO was received
  *
- *  \param data Payload of received frame
+ *  \param frame Received frame with payload cmd_lcdGoto_t
  */
-void rfAdapter_receiveLcdGoto(cmd_lcdGoto_t *data)
+void rfAdapter_receiveLcdGoto(const frame_view_t *frame)
 {
+	cmd_lcdGoto_t buffer;
+	const cmd_lcdGoto_t *data = serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
 	lcd_goto(data->x, data->y);
 }
 
 /*!
- *  Handler that's called when command CMD_LCD_PRINT was received
+ *  Handler that's called when command CMD_LCD_PRINT was received. The message
+ *  is written to the LCD straight from the receive buffer.
  *
- *  \param data Payload of received frame
+ *  \param frame Received frame with payload cmd_lcdPrint_t
  */
-void rfAdapter_receiveLcdPrint(cmd_lcdPrint_t *data)
+void rfAdapter_receiveLcdPrint(const frame_view_t *frame)
 {
-	// Wir mssen sicherstellen, dass ein Terminierungszeichen angehngt wird
-	char buffer[33]; // max 32 Zeichen + '\0'
-	memcpy(buffer, data->message, data->length);
-	buffer[data->length] = '\0';
-	lcd_writeString(buffer);
+	uint8_t const offset = sizeof(command_t) + sizeof(uint8_t);
+	uint8_t const length = serialAdapter_viewByte(frame, sizeof(command_t));
+
+	// Struktur: [command][length][message...]
+	if (frame->header.length != offset + length)
+	{
+		return;
+	}
+
+	os_enterCriticalSection();
+	for (uint8_t i = 0; i < length; i++)
+	{
+		lcd_writeChar(serialAdapter_viewByte(frame, offset + i));
+	}
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Handler that's called when command CMD_PING was received. Answers right
+ *  away, so the measured round-trip time contains as little processing as possible.
+ *
+ *  \param frame Received frame with payload cmd_ping_t, its sender receives the pong
+ */
+void rfAdapter_receivePing(const frame_view_t *frame)
+{
+	cmd_ping_t buffer;
+	const cmd_ping_t *data = serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
+
+	inner_frame_t innerFrame;
+	innerFrame.command = CMD_PONG;
+	memcpy(innerFrame.payload, data, sizeof(*data));
+
+	inner_frame_length_t length = sizeof(innerFrame.command) + sizeof(*data);
+	rfAdapter_reply(frame->header.srcAddr, length, &innerFrame);
+}
+
+/*!
+ *  Handler that's called when command CMD_PONG was received
+ *
+ *  \param frame Received frame with payload cmd_ping_t
+ */
+void rfAdapter_receivePong(const frame_view_t *frame)
+{
+	cmd_ping_t buffer;
+	rfProbe_receivePong(serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer));
 }
 
 /*!
@@ -231,7 +812,7 @@ void rfAdapter_sendSetLed(address_t destAddr, bool enable)
 	memcpy(innerFrame.payload, &payload, sizeof(payload));
 
 	inner_frame_length_t length = sizeof(innerFrame.command) + sizeof(payload);
-	serialAdapter_writeFrame(destAddr, length, &innerFrame);
+	rfAdapter_sendCommand(destAddr, length, &innerFrame, false);
 }
 
 /*!
@@ -244,7 +825,7 @@ void rfAdapter_sendToggleLed(address_t destAddr)
 	inner_frame_t innerFrame;
 	innerFrame.command = CMD_TOGGLE_LED;
 	inner_frame_length_t length = sizeof(innerFrame.command);
-	serialAdapter_writeFrame(destAddr, length, &innerFrame);
+	rfAdapter_sendCommand(destAddr, length, &innerFrame, false);
 }
 
 /*!
@@ -257,7 +838,7 @@ void rfAdapter_sendLcdClear(address_t destAddr)
 	inner_frame_t innerFrame;
 	innerFrame.command = CMD_LCD_CLEAR;
 	inner_frame_length_t length = sizeof(innerFrame.command);
-	serialAdapter_writeFrame(destAddr, length, &innerFrame);
+	rfAdapter_sendCommand(destAddr, length, &innerFrame, RF_ADAPTER_BATCH_LCD);
 }
 
 /*!
@@ -276,7 +857,7 @@ void rfAdapter_sendLcdGoto(address_t destAddr, uint8_t x, uint8_t y)
 	payload.y = y;
 	memcpy(innerFrame.payload, &payload, sizeof(payload));
 	inner_frame_length_t length = sizeof(innerFrame.command) + sizeof(payload);
-	serialAdapter_writeFrame(destAddr, length, &innerFrame);
+	rfAdapter_sendCommand(destAddr, length, &innerFrame, RF_ADAPTER_BATCH_LCD);
 }
 
 /*!
@@ -300,7 +881,7 @@ void rfAdapter_sendLcdPrint(address_t destAddr, const char *message)
 	memcpy(innerFrame.payload, &payload, sizeof(payload.length) + msgLength);
 
 	inner_frame_length_t length = sizeof(innerFrame.command) + sizeof(payload.length) + msgLength;
-	serialAdapter_writeFrame(destAddr, length, &innerFrame);
+	rfAdapter_sendCommand(destAddr, length, &innerFrame, RF_ADAPTER_BATCH_LCD);
 }
 
 /*!
@@ -325,6 +906,26 @@ void rfAdapter_sendLcdPrintProcMem(address_t destAddr, const char *message)
 	rfAdapter_sendLcdPrint(destAddr, buffer);
 }
 
+/*!
+ *  Sends a frame with command CMD_PING. The receiver answers with CMD_PONG
+ *  and the same payload.
+ *
+ *  \param destAddr Where to send the frame
+ *  \param sequence Sequence number to match the pong
+ */
+void rfAdapter_sendPing(address_t destAddr, uint16_t sequence)
+{
+	inner_frame_t innerFrame;
+	innerFrame.command = CMD_PING;
+	cmd_ping_t payload;
+	payload.sequence = sequence;
+	payload.timestamp = getSystemTime_us();
+	memcpy(innerFrame.payload, &payload, sizeof(payload));
+
+	inner_frame_length_t length = sizeof(innerFrame.command) + sizeof(payload);
+	serialAdapter_writeFrame(destAddr, length, &innerFrame);
+}
+
 void rfAdapter_sendSensorData(address_t destAddr, sensor_type_t sensorType, sensor_parameter_type_t paramType, float value) {
 	inner_frame_t innerFrame;
 	cmd_sensorData_t data;
@@ -338,5 +939,20 @@ void rfAdapter_sendSensorData(address_t destAddr, sensor_type_t sensorType, sens
 	memcpy(innerFrame.payload, &data, sizeof(data));
 
 	// ?????????? ?????? ????? serialAdapter
-	serialAdapter_writeFrame(destAddr, sizeof(innerFrame.command) + sizeof(data), &innerFrame);
+	rfAdapter_sendCommand(destAddr, sizeof(innerFrame.command) + sizeof(data), &innerFrame, false);
+}
+
+/*!
+ *  Sends encoded sensor samples, usually called by sensorSamples_flush
+ *
+ *  \param destAddr where to send the frame to
+ *  \param length number of bytes in samples
+ *  \param samples the encoded samples
+ */
+void rfAdapter_sendSensorSamples(address_t destAddr, uint8_t length, const uint8_t *samples)
+{
+	inner_frame_t innerFrame;
+	innerFrame.command = CMD_SENSOR_SAMPLES;
+	memcpy(innerFrame.payload, samples, length);
+	rfAdapter_sendCommand(destAddr, sizeof(innerFrame.command) + length, &innerFrame, false);
 }
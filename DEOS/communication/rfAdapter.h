@@ -9,6 +9,7 @@
 #ifndef RF_ADAPTER_H_
 #define RF_ADAPTER_H_
 
+#include "sensorData.h"
 #include "serialAdapter.h"
 
 #include <stdbool.h>
@@ -16,6 +17,37 @@
 #define ADDRESS(teamId, subId) ((address_t)((teamId << 3) & 0b11111000) | (subId & 0b00000111))
 #define INITIAL_CHECKSUM_VALUE ((checksum_t)0)
 
+//! Commands sent within this time (ms) to the same address are combined into one CMD_BATCH frame
+#ifndef RF_ADAPTER_BATCH_WINDOW_MS
+#define RF_ADAPTER_BATCH_WINDOW_MS 5
+#endif
+
+//! Set to 0 if the receivers of the remote LCD commands don't know CMD_BATCH, otherwise
+//! rfAdapter_sendLcdClear, rfAdapter_sendLcdGoto and rfAdapter_sendLcdPrint are always batched
+#ifndef RF_ADAPTER_BATCH_LCD
+#define RF_ADAPTER_BATCH_LCD 1
+#endif
+
+//! Commands below this ID can have a handler
+#ifndef RF_ADAPTER_COMMAND_COUNT
+#define RF_ADAPTER_COMMAND_COUNT 0x50
+#endif
+
+//! Handlers that can be registered in addition to those of the rfAdapter itself
+#ifndef RF_ADAPTER_HANDLER_COUNT
+#define RF_ADAPTER_HANDLER_COUNT 8
+#endif
+
+//! Received frames that can wait for their deferred handler
+#ifndef RF_ADAPTER_DEFERRED_QUEUE_LENGTH
+#define RF_ADAPTER_DEFERRED_QUEUE_LENGTH 2
+#endif
+
+//! Number of different commands rfAdapter_stats counts one by one, the others are counted together
+#ifndef RF_ADAPTER_STATS_COMMAND_COUNT
+#define RF_ADAPTER_STATS_COMMAND_COUNT 12
+#endif
+
 //! Unique command IDs
 typedef enum rfAdapterCommand
 {
@@ -24,7 +56,20 @@ typedef enum rfAdapterCommand
 	CMD_LCD_CLEAR = 0x10,
 	CMD_LCD_GOTO = 0x11,
 	CMD_LCD_PRINT = 0x12,
-	CMD_SENSOR_DATA = 0x20
+	CMD_SENSOR_DATA = 0x20,
+	CMD_SENSOR_SAMPLES = 0x21,
+	CMD_SENSOR_BACKLOG = 0x22,
+	CMD_PING = 0x30,
+	CMD_PONG = 0x31,
+	CMD_TIME_SYNC = 0x32,
+	CMD_STATS = 0x33,
+	CMD_STATS_REPORT = 0x34,
+	CMD_RELIABLE = 0x40,
+	CMD_ACK = 0x41,
+	CMD_BATCH = 0x42,
+	CMD_FRAGMENT = 0x43,
+	CMD_FRAGMENT_STATUS = 0x44,
+	CMD_ROUTED = 0x45
 } rfAdapterCommand_t;
 
 //! Command payload of command CMD_SET_LED
@@ -47,6 +92,65 @@ typedef struct cmd_lcdPrint
 	char message[32];
 } cmd_lcdPrint_t;
 
+//! Command payload of command CMD_PING and CMD_PONG (the pong echoes the ping)
+typedef struct cmd_ping
+{
+	uint16_t sequence;
+	uint32_t timestamp;
+} cmd_ping_t;
+
+//! Command payload of command CMD_ACK
+typedef struct cmd_ack
+{
+	//! Epoch of the acknowledged command, bit 7 is set if the receiver doesn't know the epoch
+	uint8_t epoch;
+	//! Every sequence number before next has been received
+	uint8_t next;
+	//! Bit n is set if next + n has been received
+	uint8_t mask;
+} cmd_ack_t;
+
+//! How often a command has been received
+typedef struct RfAdapterCommandCount
+{
+	command_t command;
+	uint16_t count;
+} rf_adapter_command_count_t;
+
+//! Statistics of the command layer since the last rfAdapter_resetStats
+typedef struct RfAdapterStats
+{
+	//! Received commands in the order they were seen first, those wrapped into CMD_BATCH,
+	//! CMD_RELIABLE and CMD_ROUTED included
+	rf_adapter_command_count_t commands[RF_ADAPTER_STATS_COMMAND_COUNT];
+	//! Number of entries in commands that are in use
+	uint8_t commandCount;
+	//! Received commands that didn't get an entry in commands
+	uint16_t otherCommands;
+	//! Commands with an ID of RF_ADAPTER_COMMAND_COUNT or above
+	uint16_t unknownCommands;
+	//! Commands without handler or with a payload length out of the range of their handler
+	uint16_t ignoredCommands;
+	//! Commands dropped since the deferred queue was full
+	uint16_t deferredDropped;
+	//! Answers of handlers dropped since the transmit queue was full, see rfAdapter_reply
+	uint16_t droppedReplies;
+} rf_adapter_stats_t;
+
+extern rf_adapter_stats_t rfAdapter_stats;
+
+//! Handler of a received command, the frame starts with the command byte
+typedef void (*rf_command_handler_t)(const frame_view_t *frame);
+
+//! Where a command handler is called
+typedef enum RfHandlerContext
+{
+	//! By the rfAdapter worker, straight from the receive buffer
+	RF_HANDLER_INLINE = 0,
+	//! By rfAdapter_deferredWorker, with a copy of the frame
+	RF_HANDLER_DEFERRED = 1
+} rf_handler_context_t;
+
 //! Initializes adapter
 void rfAdapter_init();
 
@@ -57,7 +161,37 @@ uint8_t rfAdapter_isInitialized();
 void rfAdapter_worker();
 
 //! Is called on command frame receive
-void serialAdapter_processFrame(frame_t *frame);
+void serialAdapter_processFrame(const frame_view_t *frame);
+
+//! Executes the command of a wrapper like CMD_BATCH, ignores wrappers inside wrappers
+void rfAdapter_processWrapped(const frame_view_t *frame);
+
+//! Sends the commands of the rfAdapter_send functions reliably to unicast addresses
+void rfAdapter_setReliable(bool enable);
+
+//! Combines commands to the same address into CMD_BATCH frames, disabled by default except for the remote LCD commands
+void rfAdapter_setBatching(bool enable);
+
+//! Sends the commands that wait for the batch window right away
+void rfAdapter_flush(void);
+
+//! Sends the answer of a command handler, drops it instead of waiting if the transmit queue is full
+bool rfAdapter_reply(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame);
+
+//! Sets the handler of a command and the payload lengths it accepts, NULL ignores the command
+bool rfAdapter_registerHandler(command_t command, rf_command_handler_t handler, uint8_t minLength, uint8_t maxLength, rf_handler_context_t context);
+
+//! Calls the handlers of deferred frames, needs to be called periodically by an application process
+void rfAdapter_deferredWorker(void);
+
+//! Copies rfAdapter_stats
+void rfAdapter_getStats(rf_adapter_stats_t *stats);
+
+//! Resets rfAdapter_stats
+void rfAdapter_resetStats(void);
+
+//! Returns how often command has been received since the last rfAdapter_resetStats
+uint16_t rfAdapter_getCommandCount(const rf_adapter_stats_t *stats, command_t command);
 
 //! Sends a frame with command CMD_SET_LED
 void rfAdapter_sendSetLed(address_t destAddr, bool enable);
@@ -77,6 +211,12 @@ void rfAdapter_sendLcdPrint(address_t destAddr, const char *message);
 //! Sends a frame with command CMD_LCD_PRINT with a message from program memory
 void rfAdapter_sendLcdPrintProcMem(address_t destAddr, const char *message);
 
+//! Sends a frame with command CMD_PING stamped with the current time
+void rfAdapter_sendPing(address_t destAddr, uint16_t sequence);
+
 void rfAdapter_sendSensorData(address_t destAddr, sensor_type_t sensorType, sensor_parameter_type_t paramType, float value);
 
+//! Sends a frame with command CMD_SENSOR_SAMPLES, see sensorSamples.h
+void rfAdapter_sendSensorSamples(address_t destAddr, uint8_t length, const uint8_t *samples);
+
 #endif /* RF_ADAPTER_H_ */
\ No newline at end of file
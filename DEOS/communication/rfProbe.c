@@ -0,0 +1,256 @@
+/*!
+ *  \brief Measures the round-trip time of the RF link with CMD_PING/CMD_PONG.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#define LOG_MODULE RF_ADAPTER
+
+#include "rfProbe.h"
+#include "../os_scheduler.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------------
+
+//! Round-trip times are counted in units of 2^RF_PROBE_UNIT_SHIFT us
+#define RF_PROBE_UNIT_SHIFT 4
+
+//! Buckets per power of two
+#define RF_PROBE_SUB_BUCKETS 4
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! Probe that receives the pongs, NULL if no measurement is running
+rf_probe_t *rfProbe_active = NULL;
+
+//----------------------------------------------------------------------------
+// Implementation
+//----------------------------------------------------------------------------
+
+/*!
+ *  Maps a round-trip time to its histogram bucket. The first four buckets are
+ *  linear (16 us each), after that every power of two is split into four
+ *  buckets, which keeps the relative error below 25 %.
+ *
+ *  \param rtt Round-trip time in us
+ *  \return Index of the bucket
+ */
+static uint8_t rfProbe_bucketOf(time_t rtt)
+{
+	time_t const units = rtt >> RF_PROBE_UNIT_SHIFT;
+	if (units < RF_PROBE_SUB_BUCKETS)
+	{
+		return (uint8_t)units;
+	}
+
+	uint8_t msb = 2;
+	while (units >> (msb + 1))
+	{
+		msb++;
+	}
+
+	uint16_t const bucket = (msb - 1) * RF_PROBE_SUB_BUCKETS + ((units >> (msb - 2)) & (RF_PROBE_SUB_BUCKETS - 1));
+	return bucket < RF_PROBE_BUCKET_COUNT ? bucket : RF_PROBE_BUCKET_COUNT - 1;
+}
+
+/*!
+ *  \param bucket Index of the bucket
+ *  \return The largest round-trip time (us) that falls into the bucket
+ */
+static time_t rfProbe_upperBoundOf(uint8_t bucket)
+{
+	if (bucket < RF_PROBE_SUB_BUCKETS)
+	{
+		return (((time_t)bucket + 1) << RF_PROBE_UNIT_SHIFT) - 1;
+	}
+
+	uint8_t const msb = bucket / RF_PROBE_SUB_BUCKETS + 1;
+	uint8_t const sub = bucket % RF_PROBE_SUB_BUCKETS;
+	return (((time_t)(RF_PROBE_SUB_BUCKETS + sub + 1) << (msb - 2)) << RF_PROBE_UNIT_SHIFT) - 1;
+}
+
+/*!
+ *  Clears the statistics and the histogram of a probe, without activating it
+ *
+ *  \param probe The probe to reset
+ */
+void rfProbe_reset(rf_probe_t *probe)
+{
+	memset(probe, 0, sizeof(*probe));
+	probe->minRtt = UINT32_MAX;
+}
+
+/*!
+ *  Resets the statistics of the probe and activates it, so it receives the
+ *  pongs from now on.
+ *
+ *  \param probe Storage for the statistics, must stay valid until rfProbe_stop
+ *  \param peer  Address the pings will be sent to (the own address in loopback mode)
+ */
+void rfProbe_start(rf_probe_t *probe, address_t peer)
+{
+	rfProbe_reset(probe);
+	probe->peer = peer;
+
+	os_enterCriticalSection();
+	rfProbe_active = probe;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Deactivates the probe, its statistics remain readable
+ */
+void rfProbe_stop(void)
+{
+	os_enterCriticalSection();
+	rfProbe_active = NULL;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Sends a ping with the next sequence number to the peer of the active probe
+ */
+void rfProbe_sendPing(void)
+{
+	rf_probe_t *const probe = rfProbe_active;
+	if (!probe)
+	{
+		return;
+	}
+
+	os_enterCriticalSection();
+	uint16_t const sequence = probe->nextSequence++;
+	probe->sent++;
+	os_leaveCriticalSection();
+
+	rfAdapter_sendPing(probe->peer, sequence);
+}
+
+/*!
+ *  Adds the round-trip time of a pong to the statistics of the active probe
+ *
+ *  \param pong Payload of the received CMD_PONG, the echoed ping
+ */
+void rfProbe_receivePong(const cmd_ping_t *pong)
+{
+	time_t const rtt = getSystemTime_us() - pong->timestamp;
+
+	os_enterCriticalSection();
+
+	rf_probe_t *const probe = rfProbe_active;
+	// Pong of a sequence number that has not been sent (by this measurement)
+	if (!probe || (uint16_t)(probe->nextSequence - pong->sequence) > probe->sent || pong->sequence == probe->nextSequence)
+	{
+		os_leaveCriticalSection();
+		return;
+	}
+
+	int16_t const ahead = (int16_t)(pong->sequence - probe->newestSequence);
+	if (!probe->received || ahead > 0)
+	{
+		probe->receivedMask = (!probe->received || ahead >= 32) ? 1 : (probe->receivedMask << ahead) | 1;
+		probe->newestSequence = pong->sequence;
+	}
+	else
+	{
+		uint8_t const behind = (uint8_t)-ahead;
+		if (behind >= 32)
+		{
+			probe->late++;
+			os_leaveCriticalSection();
+			return;
+		}
+		if (probe->receivedMask & ((uint32_t)1 << behind))
+		{
+			probe->duplicates++;
+			os_leaveCriticalSection();
+			return;
+		}
+		probe->receivedMask |= (uint32_t)1 << behind;
+		probe->reordered++;
+	}
+
+	rfProbe_addSample(probe, rtt);
+
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Adds a sample to the histogram and counts it as received. Pongs are added
+ *  by rfProbe_receivePong, other measurements can use the histogram of a
+ *  probe that isn't active, e.g. for one-way latencies.
+ *
+ *  \param probe  The probe to add to
+ *  \param sample The time in us
+ */
+void rfProbe_addSample(rf_probe_t *probe, time_t sample)
+{
+	os_enterCriticalSection();
+	probe->received++;
+	if (sample < probe->minRtt)
+	{
+		probe->minRtt = sample;
+	}
+	if (sample > probe->maxRtt)
+	{
+		probe->maxRtt = sample;
+	}
+	uint16_t *const bucket = &probe->buckets[rfProbe_bucketOf(sample)];
+	if (*bucket != UINT16_MAX)
+	{
+		(*bucket)++;
+	}
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Reads a percentile from the histogram. The result is the upper bound of
+ *  the bucket the percentile falls into, limited to the measured extremes.
+ *
+ *  \param probe   The probe to evaluate
+ *  \param percent Percentile, e.g. 50 for the median
+ *  \return The round-trip time in us, 0 if no pong was received
+ */
+time_t rfProbe_getPercentile(const rf_probe_t *probe, uint8_t percent)
+{
+	if (!probe->received)
+	{
+		return 0;
+	}
+
+	uint32_t const target = ((uint32_t)probe->received * percent + 99) / 100;
+	uint32_t count = 0;
+	for (uint8_t i = 0; i < RF_PROBE_BUCKET_COUNT; i++)
+	{
+		count += probe->buckets[i];
+		if (count >= target)
+		{
+			time_t const bound = rfProbe_upperBoundOf(i);
+			if (bound < probe->minRtt)
+			{
+				return probe->minRtt;
+			}
+			return bound < probe->maxRtt ? bound : probe->maxRtt;
+		}
+	}
+	return probe->maxRtt;
+}
+
+/*!
+ *  Pings whose pong is still on its way count as lost, so wait for the
+ *  last pong before evaluating.
+ *
+ *  \param probe The probe to evaluate
+ *  \return Number of pings without pong
+ */
+uint16_t rfProbe_getLost(const rf_probe_t *probe)
+{
+	return probe->sent - probe->received;
+}
@@ -0,0 +1,69 @@
+/*!
+ *  \brief Measures the round-trip time of the RF link with CMD_PING/CMD_PONG.
+ *
+ *  The round-trip times are collected in a histogram with logarithmic buckets
+ *  (four per power of two), so percentiles can be read without storing every
+ *  sample. The probe state is provided by the caller, e.g. on the stack of
+ *  the measuring process.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef RF_PROBE_H_
+#define RF_PROBE_H_
+
+#include "rfAdapter.h"
+
+#include <stdint.h>
+
+//! Number of histogram buckets, covers round-trip times up to about 2 s
+#define RF_PROBE_BUCKET_COUNT 64
+
+//! State and statistics of one measurement
+typedef struct RfProbe
+{
+	address_t peer;
+	uint16_t nextSequence;
+	uint16_t sent;
+	uint16_t received;
+	//! Pongs that arrived after a newer one
+	uint16_t reordered;
+	//! Pongs that were received before
+	uint16_t duplicates;
+	//! Pongs that are too old to tell whether they are duplicates, not counted as received
+	uint16_t late;
+	uint16_t newestSequence;
+	//! Bit n is set if pong newestSequence - n has been received
+	uint32_t receivedMask;
+	time_t minRtt;
+	time_t maxRtt;
+	uint16_t buckets[RF_PROBE_BUCKET_COUNT];
+} rf_probe_t;
+
+//! Clears the statistics of a probe without activating it
+void rfProbe_reset(rf_probe_t *probe);
+
+//! Resets the statistics and makes the probe receive the pongs
+void rfProbe_start(rf_probe_t *probe, address_t peer);
+
+//! Stops the measurement, pongs are ignored from now on
+void rfProbe_stop(void);
+
+//! Sends the next ping to the peer of the active probe
+void rfProbe_sendPing(void);
+
+//! Is called by the rfAdapter on CMD_PONG receive
+void rfProbe_receivePong(const cmd_ping_t *pong);
+
+//! Adds a time (us) to the histogram of a probe, e.g. a one-way latency
+void rfProbe_addSample(rf_probe_t *probe, time_t sample);
+
+//! Returns the round-trip time (us) that percent of the received pongs didn't exceed
+time_t rfProbe_getPercentile(const rf_probe_t *probe, uint8_t percent);
+
+//! Returns the number of pings without pong
+uint16_t rfProbe_getLost(const rf_probe_t *probe);
+
+#endif /* RF_PROBE_H_ */
@@ -0,0 +1,603 @@
+/*!
+ *  \brief Reliable delivery of commands with sequence numbers, ACKs and a send window.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#define LOG_MODULE RF_ADAPTER
+
+#include "rfReliable.h"
+#include "../lib/terminal.h"
+#include "../os_scheduler.h"
+
+#include <avr/eeprom.h>
+#include <string.h>
+
+//----------------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------------
+
+//! Sequence numbers from `next` on that an ACK can acknowledge selectively
+#define RF_RELIABLE_ACK_MASK_BITS 8
+
+//! Offset of the wrapped command in the inner frame of CMD_RELIABLE
+#define RF_RELIABLE_HEADER_LENGTH (sizeof(command_t) + 2 * sizeof(uint8_t))
+
+//! Offsets of the sequence number and the epoch in the inner frame of CMD_RELIABLE
+#define RF_RELIABLE_SEQUENCE_OFFSET 1
+#define RF_RELIABLE_EPOCH_OFFSET 2
+
+//! Bits of the epoch byte that identify the epoch, 0 is no epoch
+#define RF_RELIABLE_EPOCH_MASK 0x7F
+
+//! Set in the epoch byte of CMD_RELIABLE while the epoch has not been acknowledged
+#define RF_RELIABLE_FLAG_SYNC 0x80
+
+//! Set in the epoch byte of CMD_ACK if the receiver doesn't know the epoch
+#define RF_RELIABLE_FLAG_RESYNC 0x80
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! Sequence numbers and round-trip time of one peer
+typedef struct RfReliablePeer
+{
+	address_t address;
+	//! Epoch of the commands to this peer, 0 before the first command
+	uint8_t txEpoch;
+	//! True once the peer has acknowledged a command of txEpoch
+	bool txSynced;
+	//! Sequence number of the next command to this peer
+	uint8_t txSequence;
+	//! Epoch of the commands from this peer, 0 if unknown
+	uint8_t rxEpoch;
+	//! Lowest sequence number from this peer that has not been executed
+	uint8_t rxNext;
+	//! Bit n is set if rxNext + n has been executed
+	uint8_t rxMask;
+	//! Smoothed round-trip time in ms, scaled by 8
+	int16_t srtt;
+	//! Round-trip time variation in ms, scaled by 4
+	int16_t rttvar;
+	//! Current retransmission timeout in ms
+	uint16_t rto;
+} rf_reliable_peer_t;
+
+//! A sent command that waits for its ACK
+typedef struct RfReliableSlot
+{
+	address_t destAddr;
+	//! Length of data, 0 if the slot is free
+	inner_frame_length_t length;
+	uint8_t retries;
+	uint16_t timeout;
+	time_t sentTime;
+	//! Inner frame of CMD_RELIABLE as it's transmitted
+	uint8_t data[COMM_MAX_INNER_FRAME_LENGTH];
+} rf_reliable_slot_t;
+
+rf_reliable_peer_t rfReliable_peers[RF_RELIABLE_PEER_COUNT];
+
+//! Number of entries in rfReliable_peers that are in use
+uint8_t rfReliable_peerCount = 0;
+
+rf_reliable_slot_t rfReliable_window[RF_RELIABLE_WINDOW_SIZE];
+
+rf_reliable_stats_t rfReliable_stats;
+
+//! Epoch that was started last, 0 until it has been read from the EEPROM
+uint8_t rfReliable_epoch = 0;
+
+//! rfReliable_epoch across resets, so a peer never mistakes a new epoch for the old one
+static uint8_t rfReliable_storedEpoch EEMEM;
+
+//! Learns whether the commands were delivered, NULL if nobody is interested
+rf_reliable_result_handler_t rfReliable_resultHandler = NULL;
+
+//----------------------------------------------------------------------------
+// Implementation
+//----------------------------------------------------------------------------
+
+/*!
+ *  \param address Address of a peer
+ *  \return True if a command to the peer waits for its ACK
+ */
+static bool rfReliable_isInFlight(address_t address)
+{
+	for (uint8_t i = 0; i < RF_RELIABLE_WINDOW_SIZE; i++)
+	{
+		if (rfReliable_window[i].length && rfReliable_window[i].destAddr == address)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/*!
+ *  Looks up the state of a peer. Unknown peers replace the oldest entry
+ *  without commands in flight when the table is full. The replaced peer
+ *  loses its epochs, so both sides resynchronize on the next command.
+ *  Call within a critical section.
+ *
+ *  \param address Address of the peer
+ *  \param create Whether to add the peer if it's unknown
+ *  \return The entry of the peer, NULL if it's unknown and not added
+ */
+static rf_reliable_peer_t *rfReliable_getPeer(address_t address, bool create)
+{
+	for (uint8_t i = 0; i < rfReliable_peerCount; i++)
+	{
+		if (rfReliable_peers[i].address == address)
+		{
+			return &rfReliable_peers[i];
+		}
+	}
+
+	if (!create)
+	{
+		return NULL;
+	}
+
+	if (rfReliable_peerCount == RF_RELIABLE_PEER_COUNT)
+	{
+		uint8_t i = 0;
+		while (i < rfReliable_peerCount && rfReliable_isInFlight(rfReliable_peers[i].address))
+		{
+			i++;
+		}
+		if (i == rfReliable_peerCount)
+		{
+			return NULL;
+		}
+		memmove(&rfReliable_peers[i], &rfReliable_peers[i + 1], (rfReliable_peerCount - i - 1) * sizeof(rfReliable_peers[0]));
+		rfReliable_peerCount--;
+	}
+
+	rf_reliable_peer_t *const peer = &rfReliable_peers[rfReliable_peerCount++];
+	memset(peer, 0, sizeof(*peer));
+	peer->address = address;
+	peer->rto = RF_RELIABLE_INITIAL_RTO_MS;
+	return peer;
+}
+
+/*!
+ *  Updates the retransmission timeout with a round-trip time sample
+ *  (Jacobson/Karels, as in TCP)
+ *
+ *  \param peer The peer the sample was measured with
+ *  \param rtt  Round-trip time in ms of a command that was not retransmitted
+ */
+static void rfReliable_updateRto(rf_reliable_peer_t *peer, time_t rtt)
+{
+	int16_t const sample = rtt < RF_RELIABLE_MAX_RTO_MS ? (int16_t)rtt : RF_RELIABLE_MAX_RTO_MS;
+
+	if (!peer->srtt)
+	{
+		peer->srtt = sample << 3;
+		peer->rttvar = sample << 1;
+	}
+	else
+	{
+		int16_t delta = sample - (peer->srtt >> 3);
+		peer->srtt += delta;
+		if (delta < 0)
+		{
+			delta = -delta;
+		}
+		peer->rttvar += delta - (peer->rttvar >> 2);
+	}
+
+	int16_t const rto = (peer->srtt >> 3) + peer->rttvar;
+	peer->rto = rto < RF_RELIABLE_MIN_RTO_MS ? RF_RELIABLE_MIN_RTO_MS : (rto > RF_RELIABLE_MAX_RTO_MS ? RF_RELIABLE_MAX_RTO_MS : rto);
+}
+
+/*!
+ *  Starts a new epoch for the commands to a peer. The commands in flight
+ *  are renumbered from 0 in their order and retransmitted with
+ *  RF_RELIABLE_FLAG_SYNC, which makes the peer expect sequence number 0.
+ *  Is needed when the peer has lost its state or a command was given up,
+ *  as the peer would wait for the missing sequence number forever.
+ *  A command the peer executed before losing its state may be executed
+ *  again. Call within a critical section.
+ *
+ *  \param peer The peer
+ */
+static void rfReliable_startEpoch(rf_reliable_peer_t *peer)
+{
+	if (!rfReliable_epoch)
+	{
+		rfReliable_epoch = eeprom_read_byte(&rfReliable_storedEpoch);
+	}
+	rfReliable_epoch = rfReliable_epoch % RF_RELIABLE_EPOCH_MASK + 1;
+	// Epochs are rare, skipping the update when the EEPROM is busy only makes a collision after a reset possible
+	if (eeprom_is_ready())
+	{
+		eeprom_update_byte(&rfReliable_storedEpoch, rfReliable_epoch);
+	}
+
+	peer->txEpoch = rfReliable_epoch;
+	peer->txSynced = false;
+
+	// Commands that are older have a larger distance to txSequence
+	uint8_t sequences[RF_RELIABLE_WINDOW_SIZE];
+	for (uint8_t i = 0; i < RF_RELIABLE_WINDOW_SIZE; i++)
+	{
+		sequences[i] = rfReliable_window[i].data[RF_RELIABLE_SEQUENCE_OFFSET];
+	}
+	uint8_t count = 0;
+	for (uint8_t i = 0; i < RF_RELIABLE_WINDOW_SIZE; i++)
+	{
+		rf_reliable_slot_t *const slot = &rfReliable_window[i];
+		if (!slot->length || slot->destAddr != peer->address)
+		{
+			continue;
+		}
+		uint8_t const age = peer->txSequence - sequences[i];
+		uint8_t sequence = 0;
+		for (uint8_t j = 0; j < RF_RELIABLE_WINDOW_SIZE; j++)
+		{
+			if (rfReliable_window[j].length && rfReliable_window[j].destAddr == peer->address && (uint8_t)(peer->txSequence - sequences[j]) > age)
+			{
+				sequence++;
+			}
+		}
+		slot->data[RF_RELIABLE_SEQUENCE_OFFSET] = sequence;
+		slot->data[RF_RELIABLE_EPOCH_OFFSET] = peer->txEpoch | RF_RELIABLE_FLAG_SYNC;
+		// Sent by the worker right away, see rfReliable_trySend
+		slot->timeout = 0;
+		count++;
+	}
+	peer->txSequence = count;
+}
+
+/*!
+ *  Sends an inner frame reliably. It's wrapped into CMD_RELIABLE and kept
+ *  in the send window until it's acknowledged. Never yields, so it can be
+ *  called by the worker and within a critical section.
+ *
+ *  \param destAddr Where to send the frame, must not be ADDRESS_BROADCAST
+ *  \param length How many bytes the innerFrame has, up to RF_RELIABLE_MAX_INNER_FRAME_LENGTH
+ *  \param innerFrame The command, can be reused right away
+ *  \return RF_RELIABLE_SUCCESS, RF_RELIABLE_WINDOW_FULL or RF_RELIABLE_INVALID
+ */
+uint8_t rfReliable_trySend(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame)
+{
+	if (destAddr == ADDRESS_BROADCAST || !length || length > RF_RELIABLE_MAX_INNER_FRAME_LENGTH)
+	{
+		return RF_RELIABLE_INVALID;
+	}
+
+	os_enterCriticalSection();
+
+	// Every peer has commands in flight, one of them will be done soon
+	rf_reliable_peer_t *const peer = rfReliable_getPeer(destAddr, true);
+	if (!peer)
+	{
+		os_leaveCriticalSection();
+		return RF_RELIABLE_WINDOW_FULL;
+	}
+	if (!peer->txEpoch)
+	{
+		rfReliable_startEpoch(peer);
+	}
+
+	rf_reliable_slot_t *slot = NULL;
+	for (uint8_t i = 0; i < RF_RELIABLE_WINDOW_SIZE; i++)
+	{
+		rf_reliable_slot_t *const candidate = &rfReliable_window[i];
+		if (!candidate->length)
+		{
+			slot = candidate;
+		}
+		// The ACK can only report sequence numbers close to the oldest unacknowledged one
+		else if (candidate->destAddr == destAddr && (uint8_t)(peer->txSequence - candidate->data[RF_RELIABLE_SEQUENCE_OFFSET]) >= RF_RELIABLE_ACK_MASK_BITS)
+		{
+			slot = NULL;
+			break;
+		}
+	}
+	if (!slot)
+	{
+		os_leaveCriticalSection();
+		return RF_RELIABLE_WINDOW_FULL;
+	}
+
+	slot->destAddr = destAddr;
+	slot->length = RF_RELIABLE_HEADER_LENGTH + length;
+	slot->retries = 0;
+	slot->timeout = peer->rto;
+	slot->sentTime = getSystemTime_ms();
+	slot->data[0] = CMD_RELIABLE;
+	slot->data[RF_RELIABLE_SEQUENCE_OFFSET] = peer->txSequence++;
+	slot->data[RF_RELIABLE_EPOCH_OFFSET] = peer->txEpoch | (peer->txSynced ? 0 : RF_RELIABLE_FLAG_SYNC);
+	memcpy(&slot->data[RF_RELIABLE_HEADER_LENGTH], innerFrame, length);
+	rfReliable_stats.sent++;
+
+	// If the transmit queue is full, the worker transmits the command later
+	if (serialAdapter_tryWriteFrame(destAddr, slot->length, (inner_frame_t *)slot->data) != SERIAL_ADAPTER_SUCCESS)
+	{
+		slot->timeout = 0;
+	}
+
+	os_leaveCriticalSection();
+	return RF_RELIABLE_SUCCESS;
+}
+
+/*!
+ *  Sends an inner frame reliably. If the send window is full, the process
+ *  yields until a command has been acknowledged or given up.
+ *
+ *  \param destAddr Where to send the frame, must not be ADDRESS_BROADCAST
+ *  \param length How many bytes the innerFrame has, up to RF_RELIABLE_MAX_INNER_FRAME_LENGTH
+ *  \param innerFrame The command, can be reused right away
+ *  \return RF_RELIABLE_SUCCESS or RF_RELIABLE_INVALID
+ */
+uint8_t rfReliable_send(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame)
+{
+	uint8_t status;
+	while ((status = rfReliable_trySend(destAddr, length, innerFrame)) == RF_RELIABLE_WINDOW_FULL)
+	{
+		os_yield();
+	}
+	return status;
+}
+
+/*!
+ *  Retransmits every command whose ACK is overdue and doubles its timeout.
+ *  Gives a command up after RF_RELIABLE_MAX_RETRIES retransmissions. Commands
+ *  that didn't fit into the transmit queue on rfReliable_trySend are sent here.
+ */
+void rfReliable_worker(void)
+{
+	for (uint8_t i = 0; i < RF_RELIABLE_WINDOW_SIZE; i++)
+	{
+		rf_reliable_slot_t *const slot = &rfReliable_window[i];
+
+		os_enterCriticalSection();
+		if (!slot->length || getSystemTime_ms() - slot->sentTime < slot->timeout)
+		{
+			os_leaveCriticalSection();
+			continue;
+		}
+
+		if (slot->retries == RF_RELIABLE_MAX_RETRIES)
+		{
+			WARN("Giving up command %x to 0x%x", slot->data[RF_RELIABLE_HEADER_LENGTH], slot->destAddr);
+			slot->length = 0;
+			rfReliable_stats.failed++;
+			// The peer would wait for the sequence number forever
+			rfReliable_startEpoch(rfReliable_getPeer(slot->destAddr, false));
+			if (rfReliable_resultHandler)
+			{
+				rfReliable_resultHandler(slot->destAddr, slot->data[RF_RELIABLE_HEADER_LENGTH], false);
+			}
+			os_leaveCriticalSection();
+			continue;
+		}
+
+		// Try again later if the transmit queue is full
+		if (serialAdapter_tryWriteFrame(slot->destAddr, slot->length, (inner_frame_t *)slot->data) == SERIAL_ADAPTER_SUCCESS)
+		{
+			slot->sentTime = getSystemTime_ms();
+			if (!slot->timeout)
+			{
+				// First transmission, see rfReliable_trySend. Peers with commands in flight are never replaced.
+				slot->timeout = rfReliable_getPeer(slot->destAddr, false)->rto;
+			}
+			else
+			{
+				slot->retries++;
+				slot->timeout = slot->timeout < RF_RELIABLE_MAX_RTO_MS / 2 ? slot->timeout * 2 : RF_RELIABLE_MAX_RTO_MS;
+				rfReliable_stats.retransmissions++;
+			}
+		}
+		os_leaveCriticalSection();
+	}
+}
+
+/*!
+ *  \return True if no command is waiting for its ACK
+ */
+bool rfReliable_isIdle(void)
+{
+	for (uint8_t i = 0; i < RF_RELIABLE_WINDOW_SIZE; i++)
+	{
+		if (rfReliable_window[i].length)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/*!
+ *  Sets the function that is called when a command has been acknowledged
+ *  or given up. It's called by the worker within a critical section and
+ *  must not yield.
+ *
+ *  \param handler The function, NULL if nobody is interested
+ */
+void rfReliable_setResultHandler(rf_reliable_result_handler_t handler)
+{
+	os_enterCriticalSection();
+	rfReliable_resultHandler = handler;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Resets the statistics, e.g. before a measurement
+ */
+void rfReliable_resetStats(void)
+{
+	os_enterCriticalSection();
+	memset(&rfReliable_stats, 0, sizeof(rfReliable_stats));
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Executes the wrapped command unless it has been executed before and
+ *  acknowledges it either way, since the previous ACK may have been lost.
+ *  The first command of a new epoch carries RF_RELIABLE_FLAG_SYNC and
+ *  makes the receiver expect sequence number 0. A command of an unknown
+ *  epoch without the flag is not executed, the ACK asks the sender for a
+ *  new epoch instead.
+ *
+ *  \param frame Received frame with command CMD_RELIABLE
+ */
+void rfReliable_receiveData(const frame_view_t *frame)
+{
+	address_t const srcAddr = frame->header.srcAddr;
+	uint8_t const sequence = serialAdapter_viewByte(frame, RF_RELIABLE_SEQUENCE_OFFSET);
+	uint8_t const epoch = serialAdapter_viewByte(frame, RF_RELIABLE_EPOCH_OFFSET);
+
+	if (!(epoch & RF_RELIABLE_EPOCH_MASK))
+	{
+		return;
+	}
+
+	os_enterCriticalSection();
+	rf_reliable_peer_t *const peer = rfReliable_getPeer(srcAddr, true);
+	if (!peer)
+	{
+		// No ACK, the sender retransmits once a peer has no commands in flight anymore
+		os_leaveCriticalSection();
+		DEBUG("No room for peer 0x%x", srcAddr);
+		return;
+	}
+
+	if ((epoch & RF_RELIABLE_EPOCH_MASK) != peer->rxEpoch && (epoch & RF_RELIABLE_FLAG_SYNC))
+	{
+		peer->rxEpoch = epoch & RF_RELIABLE_EPOCH_MASK;
+		peer->rxNext = 0;
+		peer->rxMask = 0;
+	}
+
+	uint8_t const offset = sequence - peer->rxNext;
+	bool execute = false;
+	bool resync = false;
+
+	if ((epoch & RF_RELIABLE_EPOCH_MASK) != peer->rxEpoch)
+	{
+		// We lost the state of this epoch, e.g. by a reset
+		resync = true;
+	}
+	else if (offset >= 0x80)
+	{
+		// Older than rxNext, executed before
+		rfReliable_stats.duplicates++;
+	}
+	else if (offset >= RF_RELIABLE_ACK_MASK_BITS)
+	{
+		// Can't be in the sender's window, our state doesn't match the epoch
+		resync = true;
+	}
+	else
+	{
+		if (peer->rxMask & (1 << offset))
+		{
+			rfReliable_stats.duplicates++;
+		}
+		else
+		{
+			peer->rxMask |= 1 << offset;
+			while (peer->rxMask & 1)
+			{
+				peer->rxMask >>= 1;
+				peer->rxNext++;
+			}
+			rfReliable_stats.delivered++;
+			execute = true;
+		}
+	}
+
+	inner_frame_t ack;
+	ack.command = CMD_ACK;
+	if (resync)
+	{
+		((cmd_ack_t *)ack.payload)->epoch = (epoch & RF_RELIABLE_EPOCH_MASK) | RF_RELIABLE_FLAG_RESYNC;
+		((cmd_ack_t *)ack.payload)->next = 0;
+		((cmd_ack_t *)ack.payload)->mask = 0;
+	}
+	else
+	{
+		((cmd_ack_t *)ack.payload)->epoch = peer->rxEpoch;
+		((cmd_ack_t *)ack.payload)->next = peer->rxNext;
+		((cmd_ack_t *)ack.payload)->mask = peer->rxMask;
+	}
+	os_leaveCriticalSection();
+
+	// A lost ACK is like one lost on the air, the sender retransmits
+	rfAdapter_reply(srcAddr, sizeof(command_t) + sizeof(cmd_ack_t), &ack);
+
+	if (execute)
+	{
+		frame_view_t command;
+		serialAdapter_subView(frame, RF_RELIABLE_HEADER_LENGTH, &command);
+		rfAdapter_processWrapped(&command);
+	}
+}
+
+/*!
+ *  Frees the slots of all commands the ACK covers and measures the
+ *  round-trip time of those that were not retransmitted (Karn's algorithm).
+ *  ACKs of other epochs and from unknown peers are ignored, an ACK with
+ *  RF_RELIABLE_FLAG_RESYNC starts a new epoch.
+ *
+ *  \param frame Received frame with payload cmd_ack_t
+ */
+void rfReliable_receiveAck(const frame_view_t *frame)
+{
+	cmd_ack_t buffer;
+	const cmd_ack_t *ack = serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
+	address_t const srcAddr = frame->header.srcAddr;
+	time_t const now = getSystemTime_ms();
+
+	os_enterCriticalSection();
+	rf_reliable_peer_t *const peer = rfReliable_getPeer(srcAddr, false);
+	if (!peer || !peer->txEpoch || (ack->epoch & RF_RELIABLE_EPOCH_MASK) != peer->txEpoch)
+	{
+		os_leaveCriticalSection();
+		return;
+	}
+	if (ack->epoch & RF_RELIABLE_FLAG_RESYNC)
+	{
+		DEBUG("0x%x lost epoch %u", srcAddr, peer->txEpoch);
+		rfReliable_startEpoch(peer);
+		os_leaveCriticalSection();
+		return;
+	}
+	peer->txSynced = true;
+
+	for (uint8_t i = 0; i < RF_RELIABLE_WINDOW_SIZE; i++)
+	{
+		rf_reliable_slot_t *const slot = &rfReliable_window[i];
+		if (!slot->length || slot->destAddr != srcAddr)
+		{
+			continue;
+		}
+
+		uint8_t const offset = slot->data[RF_RELIABLE_SEQUENCE_OFFSET] - ack->next;
+		if (offset < 0x80 && (offset >= RF_RELIABLE_ACK_MASK_BITS || !(ack->mask & (1 << offset))))
+		{
+			continue;
+		}
+
+		if (!slot->retries)
+		{
+			rfReliable_updateRto(peer, now - slot->sentTime);
+		}
+		rfReliable_stats.acked++;
+		rfReliable_stats.ackedBytes += slot->length - RF_RELIABLE_HEADER_LENGTH;
+		slot->length = 0;
+		if (rfReliable_resultHandler)
+		{
+			rfReliable_resultHandler(srcAddr, slot->data[RF_RELIABLE_HEADER_LENGTH], true);
+		}
+	}
+
+	os_leaveCriticalSection();
+}
@@ -0,0 +1,107 @@
+/*!
+ *  \brief Reliable delivery of commands with sequence numbers, ACKs and a send window.
+ *
+ *  A reliable command is wrapped into CMD_RELIABLE together with a sequence
+ *  number and an epoch per destination. The receiver executes every sequence
+ *  number once and answers with CMD_ACK, which acknowledges everything before
+ *  `next` and the sequence numbers in `mask` (selective ACK). Unacknowledged
+ *  commands stay in a small send window and are retransmitted after a timeout
+ *  that follows the measured round-trip time.
+ *
+ *  An epoch starts at sequence number 0, its commands carry a sync flag
+ *  until the first ACK. A receiver that doesn't know the epoch of a command
+ *  without the flag, e.g. after a reset, asks for a new epoch instead of
+ *  acknowledging it. So restarted sequence numbers never make a command
+ *  look delivered.
+ *
+ *  Commands are executed in the order they arrive, a retransmitted command
+ *  may therefore be executed after a newer one.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef RF_RELIABLE_H_
+#define RF_RELIABLE_H_
+
+#include "rfAdapter.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Number of commands that can wait for their ACK
+#ifndef RF_RELIABLE_WINDOW_SIZE
+#define RF_RELIABLE_WINDOW_SIZE 4
+#endif
+
+//! Number of peers whose sequence numbers are tracked
+#ifndef RF_RELIABLE_PEER_COUNT
+#define RF_RELIABLE_PEER_COUNT 4
+#endif
+
+//! Retransmissions of a command before it's given up
+#ifndef RF_RELIABLE_MAX_RETRIES
+#define RF_RELIABLE_MAX_RETRIES 32
+#endif
+
+//! Limits of the retransmission timeout
+#define RF_RELIABLE_INITIAL_RTO_MS 250
+#define RF_RELIABLE_MIN_RTO_MS 20
+#define RF_RELIABLE_MAX_RTO_MS 1000
+
+//! Largest inner frame that can be sent reliably
+#define RF_RELIABLE_MAX_INNER_FRAME_LENGTH (COMM_MAX_INNER_FRAME_LENGTH - sizeof(command_t) - 2 * sizeof(uint8_t))
+
+// Status codes
+#define RF_RELIABLE_SUCCESS 0
+#define RF_RELIABLE_WINDOW_FULL 1
+#define RF_RELIABLE_INVALID 2
+
+//! Statistics since the last rfReliable_resetStats
+typedef struct RfReliableStats
+{
+	//! Commands that have been sent for the first time
+	uint16_t sent;
+	uint16_t retransmissions;
+	uint16_t acked;
+	//! Commands that were given up after RF_RELIABLE_MAX_RETRIES
+	uint16_t failed;
+	//! Received commands that have been executed
+	uint16_t delivered;
+	//! Received commands that had been executed before
+	uint16_t duplicates;
+	//! Inner frame bytes of the acked commands
+	uint32_t ackedBytes;
+} rf_reliable_stats_t;
+
+extern rf_reliable_stats_t rfReliable_stats;
+
+//! Is called within a critical section when a command has been acknowledged or given up
+typedef void (*rf_reliable_result_handler_t)(address_t destAddr, command_t command, bool acked);
+
+//! Sends an inner frame reliably, returns RF_RELIABLE_WINDOW_FULL instead of waiting
+uint8_t rfReliable_trySend(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame);
+
+//! Sends an inner frame reliably, yields while the send window is full
+uint8_t rfReliable_send(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame);
+
+//! Retransmits commands whose ACK is overdue, is called by the rfAdapter worker
+void rfReliable_worker(void);
+
+//! Returns true if no command is waiting for its ACK
+bool rfReliable_isIdle(void);
+
+//! Sets the function that learns whether the commands were delivered, NULL if none
+void rfReliable_setResultHandler(rf_reliable_result_handler_t handler);
+
+//! Resets rfReliable_stats
+void rfReliable_resetStats(void);
+
+//! Is called by the rfAdapter on CMD_RELIABLE receive
+void rfReliable_receiveData(const frame_view_t *frame);
+
+//! Is called by the rfAdapter on CMD_ACK receive
+void rfReliable_receiveAck(const frame_view_t *frame);
+
+#endif /* RF_RELIABLE_H_ */
@@ -0,0 +1,327 @@
+/*!
+ *  \brief Multi-hop forwarding of commands over nodes in between, with a
+ *         routing table, a hop limit and duplicate suppression.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#define LOG_MODULE RF_ADAPTER
+
+#include "rfRouting.h"
+#include "../lib/terminal.h"
+#include "../os_scheduler.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! Next hop of a destination
+typedef struct RfRoutingRoute
+{
+	address_t destination;
+	address_t nextHop;
+} rf_routing_route_t;
+
+//! A received frame, identified by its origin and sequence number
+typedef struct RfRoutingSeen
+{
+	address_t origin;
+	uint8_t sequence;
+} rf_routing_seen_t;
+
+rf_routing_route_t rfRouting_table[RF_ROUTING_TABLE_LENGTH];
+
+//! Number of entries in rfRouting_table that are in use
+uint8_t rfRouting_routeCount = 0;
+
+//! Ring of the frames seen last, entries from rfRouting_seenCount on are unused
+rf_routing_seen_t rfRouting_seen[RF_ROUTING_SEEN_COUNT];
+uint8_t rfRouting_seenCount = 0;
+uint8_t rfRouting_seenNext = 0;
+
+//! Sequence number of the next command routed from this node
+uint8_t rfRouting_sequence = 0;
+
+uint8_t rfRouting_ttl = RF_ROUTING_DEFAULT_TTL;
+
+rf_routing_stats_t rfRouting_stats;
+
+//----------------------------------------------------------------------------
+// Implementation
+//----------------------------------------------------------------------------
+
+/*!
+ *  Looks up the route of a destination. Call within a critical section.
+ *
+ *  \param destination A node or group address
+ *  \return The entry of the destination, NULL if it has none
+ */
+static rf_routing_route_t *rfRouting_findRoute(address_t destination)
+{
+	for (uint8_t i = 0; i < rfRouting_routeCount; i++)
+	{
+		if (rfRouting_table[i].destination == destination)
+		{
+			return &rfRouting_table[i];
+		}
+	}
+	return NULL;
+}
+
+/*!
+ *  Sets the next hop towards a destination, replacing its previous route
+ *
+ *  \param destination A node or group address, ADDRESS_BROADCAST changes where floods are passed on to
+ *  \param nextHop The neighbour the frames to destination are sent to
+ *  \return False if the table is full
+ */
+bool rfRouting_addRoute(address_t destination, address_t nextHop)
+{
+	os_enterCriticalSection();
+	rf_routing_route_t *route = rfRouting_findRoute(destination);
+	if (!route)
+	{
+		if (rfRouting_routeCount == RF_ROUTING_TABLE_LENGTH)
+		{
+			os_leaveCriticalSection();
+			return false;
+		}
+		route = &rfRouting_table[rfRouting_routeCount++];
+		route->destination = destination;
+	}
+	route->nextHop = nextHop;
+	os_leaveCriticalSection();
+	return true;
+}
+
+/*!
+ *  Removes the route of a destination, frames to it are sent to it
+ *  directly afterwards
+ *
+ *  \param destination A node or group address
+ */
+void rfRouting_removeRoute(address_t destination)
+{
+	os_enterCriticalSection();
+	rf_routing_route_t *const route = rfRouting_findRoute(destination);
+	if (route)
+	{
+		*route = rfRouting_table[--rfRouting_routeCount];
+	}
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  \param destination A node or group address
+ *  \return The neighbour frames to destination are sent to, destination itself if it has no route
+ */
+address_t rfRouting_getNextHop(address_t destination)
+{
+	os_enterCriticalSection();
+	rf_routing_route_t const *const route = rfRouting_findRoute(destination);
+	address_t const nextHop = route ? route->nextHop : destination;
+	os_leaveCriticalSection();
+	return nextHop;
+}
+
+/*!
+ *  \param destination A node or group address
+ *  \return True if the next hop towards destination is another node
+ */
+bool rfRouting_isRouted(address_t destination)
+{
+	return rfRouting_getNextHop(destination) != destination;
+}
+
+/*!
+ *  Sets how many hops the commands routed from this node may take. A
+ *  frame is passed on by at most ttl - 1 nodes.
+ *
+ *  \param ttl The hop limit, at least 1
+ */
+void rfRouting_setTtl(uint8_t ttl)
+{
+	os_enterCriticalSection();
+	rfRouting_ttl = ttl ? ttl : 1;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Routes an inner frame to a destination. It's wrapped into CMD_ROUTED and
+ *  sent to the next hop. Never yields, so it can be called by the worker
+ *  and within a critical section.
+ *
+ *  \param destination Where the command is executed, ADDRESS_BROADCAST floods it to every node within the TTL
+ *  \param length How many bytes the innerFrame has, up to RF_ROUTING_MAX_INNER_FRAME_LENGTH
+ *  \param innerFrame The command, can be reused right away
+ *  \return RF_ROUTING_SUCCESS, RF_ROUTING_TX_QUEUE_FULL or RF_ROUTING_INVALID
+ */
+uint8_t rfRouting_trySend(address_t destination, inner_frame_length_t length, inner_frame_t *innerFrame)
+{
+	if (!length || length > RF_ROUTING_MAX_INNER_FRAME_LENGTH)
+	{
+		return RF_ROUTING_INVALID;
+	}
+
+	uint8_t data[COMM_MAX_INNER_FRAME_LENGTH];
+	rf_routing_header_t header;
+
+	os_enterCriticalSection();
+	header.origin = serialAdapter_address;
+	header.destination = destination;
+	header.sequence = rfRouting_sequence;
+	header.ttl = rfRouting_ttl;
+
+	data[0] = CMD_ROUTED;
+	memcpy(&data[sizeof(command_t)], &header, sizeof(header));
+	memcpy(&data[RF_ROUTING_HEADER_LENGTH], innerFrame, length);
+
+	if (serialAdapter_tryWriteFrame(rfRouting_getNextHop(destination), RF_ROUTING_HEADER_LENGTH + length, (inner_frame_t *)data) != SERIAL_ADAPTER_SUCCESS)
+	{
+		os_leaveCriticalSection();
+		return RF_ROUTING_TX_QUEUE_FULL;
+	}
+	rfRouting_sequence++;
+	rfRouting_stats.sent++;
+	os_leaveCriticalSection();
+	return RF_ROUTING_SUCCESS;
+}
+
+/*!
+ *  Routes an inner frame to a destination. If the transmit queue is full,
+ *  the process yields until there's room.
+ *
+ *  \param destination Where the command is executed, ADDRESS_BROADCAST floods it to every node within the TTL
+ *  \param length How many bytes the innerFrame has, up to RF_ROUTING_MAX_INNER_FRAME_LENGTH
+ *  \param innerFrame The command, can be reused right away
+ *  \return RF_ROUTING_SUCCESS or RF_ROUTING_INVALID
+ */
+uint8_t rfRouting_send(address_t destination, inner_frame_length_t length, inner_frame_t *innerFrame)
+{
+	uint8_t status;
+	while ((status = rfRouting_trySend(destination, length, innerFrame)) == RF_ROUTING_TX_QUEUE_FULL)
+	{
+		os_yield();
+	}
+	return status;
+}
+
+/*!
+ *  Resets the statistics, e.g. before a measurement
+ */
+void rfRouting_resetStats(void)
+{
+	os_enterCriticalSection();
+	memset(&rfRouting_stats, 0, sizeof(rfRouting_stats));
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Checks whether a frame has been seen before and remembers it otherwise.
+ *  The own frames count as seen, floods return to their origin.
+ *
+ *  \param header Header of a received CMD_ROUTED
+ *  \return True if the frame has been seen before
+ */
+static bool rfRouting_checkSeen(const rf_routing_header_t *header)
+{
+	if (header->origin == serialAdapter_address)
+	{
+		return true;
+	}
+
+	for (uint8_t i = 0; i < rfRouting_seenCount; i++)
+	{
+		if (rfRouting_seen[i].origin == header->origin && rfRouting_seen[i].sequence == header->sequence)
+		{
+			return true;
+		}
+	}
+
+	rfRouting_seen[rfRouting_seenNext].origin = header->origin;
+	rfRouting_seen[rfRouting_seenNext].sequence = header->sequence;
+	rfRouting_seenNext = (rfRouting_seenNext + 1) % RF_ROUTING_SEEN_COUNT;
+	if (rfRouting_seenCount < RF_ROUTING_SEEN_COUNT)
+	{
+		rfRouting_seenCount++;
+	}
+	return false;
+}
+
+/*!
+ *  Passes a received frame on to the next hop with a decremented TTL
+ *
+ *  \param frame Received frame with command CMD_ROUTED
+ *  \param header Its header
+ */
+static void rfRouting_forward(const frame_view_t *frame, const rf_routing_header_t *header)
+{
+	if (header->ttl <= 1)
+	{
+		rfRouting_stats.ttlExpired++;
+		return;
+	}
+
+	uint8_t buffer[COMM_MAX_INNER_FRAME_LENGTH];
+	inner_frame_length_t const length = frame->header.length;
+	const uint8_t *data = serialAdapter_viewData(frame, 0, length, buffer);
+	if (data != buffer)
+	{
+		memcpy(buffer, data, length);
+	}
+	((rf_routing_header_t *)&buffer[sizeof(command_t)])->ttl = header->ttl - 1;
+
+	// The worker must not wait for the transmit queue, it has to keep receiving
+	if (serialAdapter_tryWriteFrame(rfRouting_getNextHop(header->destination), length, (inner_frame_t *)buffer) == SERIAL_ADAPTER_SUCCESS)
+	{
+		rfRouting_stats.forwarded++;
+	}
+	else
+	{
+		rfRouting_stats.dropped++;
+	}
+}
+
+/*!
+ *  Passes the frame on unless it's only meant for this node and executes
+ *  the wrapped command if it's meant for this node as well. The command
+ *  sees the origin as the source address of its frame.
+ *
+ *  \param frame Received frame with command CMD_ROUTED
+ */
+void rfRouting_receive(const frame_view_t *frame)
+{
+	rf_routing_header_t buffer;
+	rf_routing_header_t const header = *(const rf_routing_header_t *)serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
+
+	os_enterCriticalSection();
+	bool const seen = rfRouting_checkSeen(&header);
+	if (seen)
+	{
+		rfRouting_stats.duplicates++;
+	}
+	os_leaveCriticalSection();
+	if (seen)
+	{
+		return;
+	}
+
+	if (header.destination != serialAdapter_address)
+	{
+		rfRouting_forward(frame, &header);
+	}
+
+	if (serialAdapter_acceptsAddress(header.destination))
+	{
+		frame_view_t command;
+		serialAdapter_subView(frame, RF_ROUTING_HEADER_LENGTH, &command);
+		command.header.srcAddr = header.origin;
+		command.header.destAddr = header.destination;
+		rfRouting_stats.delivered++;
+		rfAdapter_processWrapped(&command);
+	}
+}
@@ -0,0 +1,132 @@
+/*!
+ *  \brief Multi-hop forwarding of commands over nodes in between, with a
+ *         routing table, a hop limit and duplicate suppression.
+ *
+ *  A routed command is wrapped into CMD_ROUTED together with its origin,
+ *  its final destination, a sequence number of the origin and a time to
+ *  live (TTL). The outer frame goes to the next hop of the destination,
+ *  which the routing table of every node on the way holds; destinations
+ *  without a route are their own next hop. A node that receives the frame
+ *  executes the wrapped command if the destination is its own address, a
+ *  group it has joined or ADDRESS_BROADCAST, as if it had been sent by the
+ *  origin. Unless the destination is its own address, it also decrements
+ *  the TTL and passes the frame on to the next hop. Broadcasts are
+ *  therefore flooded until their TTL runs out.
+ *
+ *  Forwarding happens in the receive handler, which the rfAdapter worker
+ *  calls, so no application process is woken up. It never waits: if the
+ *  transmit queue is full, the frame is dropped and counted.
+ *
+ *  Every node remembers the last RF_ROUTING_SEEN_COUNT pairs of origin and
+ *  sequence number and ignores frames it has seen before, which ends the
+ *  loops of floods and of inconsistent routes. A node that restarts its
+ *  sequence numbers may lose its first frames to nodes that still
+ *  remember the old ones.
+ *
+ *  The rfAdapter_send functions route commands to destinations with a
+ *  next hop of their own. Those commands are never sent reliably, the ACKs
+ *  of rfReliable only cover a single hop.
+ *
+ *  tools/routesim.py runs this module on the host in a chain of nodes
+ *  connected by virtual serial links and reports latency and throughput
+ *  per hop.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef RF_ROUTING_H_
+#define RF_ROUTING_H_
+
+#include "rfAdapter.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Number of destinations that can have a next hop of their own
+#ifndef RF_ROUTING_TABLE_LENGTH
+#define RF_ROUTING_TABLE_LENGTH 16
+#endif
+
+//! Number of received frames whose origin and sequence number are remembered
+#ifndef RF_ROUTING_SEEN_COUNT
+#define RF_ROUTING_SEEN_COUNT 8
+#endif
+
+//! Hops a routed command may take unless rfRouting_setTtl is used
+#ifndef RF_ROUTING_DEFAULT_TTL
+#define RF_ROUTING_DEFAULT_TTL 4
+#endif
+
+//! Header of the inner frame of CMD_ROUTED, followed by the wrapped command
+typedef struct RfRoutingHeader
+{
+	//! Node that has sent the command
+	address_t origin;
+	//! Node the command is meant for
+	address_t destination;
+	//! Sequence number of the origin
+	uint8_t sequence;
+	//! Hops the command may still take, including the one to the receiver
+	uint8_t ttl;
+} rf_routing_header_t;
+
+//! Offset of the wrapped command in the inner frame of CMD_ROUTED
+#define RF_ROUTING_HEADER_LENGTH (sizeof(command_t) + sizeof(rf_routing_header_t))
+
+//! Largest inner frame that can be routed
+#define RF_ROUTING_MAX_INNER_FRAME_LENGTH (COMM_MAX_INNER_FRAME_LENGTH - RF_ROUTING_HEADER_LENGTH)
+
+// Status codes
+#define RF_ROUTING_SUCCESS 0
+#define RF_ROUTING_TX_QUEUE_FULL 1
+#define RF_ROUTING_INVALID 2
+
+//! Statistics since the last rfRouting_resetStats
+typedef struct RfRoutingStats
+{
+	//! Commands that have been routed from this node
+	uint16_t sent;
+	//! Received frames that have been passed on
+	uint16_t forwarded;
+	//! Received commands that have been executed
+	uint16_t delivered;
+	//! Received frames that had been seen before
+	uint16_t duplicates;
+	//! Received frames that couldn't be passed on since their TTL ran out
+	uint16_t ttlExpired;
+	//! Received frames that couldn't be passed on since the transmit queue was full
+	uint16_t dropped;
+} rf_routing_stats_t;
+
+extern rf_routing_stats_t rfRouting_stats;
+
+//! Sets the next hop towards destination, returns false if the table is full
+bool rfRouting_addRoute(address_t destination, address_t nextHop);
+
+//! Removes the route of destination, which is its own next hop afterwards
+void rfRouting_removeRoute(address_t destination);
+
+//! Returns the next hop towards destination
+address_t rfRouting_getNextHop(address_t destination);
+
+//! Returns true if commands to destination are routed over another node
+bool rfRouting_isRouted(address_t destination);
+
+//! Sets the hops the commands routed from this node may take
+void rfRouting_setTtl(uint8_t ttl);
+
+//! Routes an inner frame to destination, returns RF_ROUTING_TX_QUEUE_FULL instead of waiting
+uint8_t rfRouting_trySend(address_t destination, inner_frame_length_t length, inner_frame_t *innerFrame);
+
+//! Routes an inner frame to destination, yields while the transmit queue is full
+uint8_t rfRouting_send(address_t destination, inner_frame_length_t length, inner_frame_t *innerFrame);
+
+//! Resets rfRouting_stats
+void rfRouting_resetStats(void);
+
+//! Is called by the rfAdapter on CMD_ROUTED receive
+void rfRouting_receive(const frame_view_t *frame);
+
+#endif /* RF_ROUTING_H_ */
@@ -0,0 +1,330 @@
+/*!
+ *  \brief Transfers buffers larger than a frame in numbered fragments.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#define LOG_MODULE RF_ADAPTER
+
+#include "rfTransfer.h"
+#include "../lib/terminal.h"
+#include "../os_scheduler.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------------
+
+#define RF_TRANSFER_IS_SET(bitmap, i) ((bitmap)[(i) / 8] & (1 << ((i) % 8)))
+#define RF_TRANSFER_SET(bitmap, i) ((bitmap)[(i) / 8] |= (1 << ((i) % 8)))
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! State of the running rfTransfer_send
+typedef struct RfTransferSender
+{
+	address_t destAddr;
+	uint8_t transferId;
+	//! Set by the worker when a status arrived
+	bool statusReceived;
+	//! Fragments the receiver reported as received
+	uint8_t acked[RF_TRANSFER_BITMAP_LENGTH];
+} rf_transfer_sender_t;
+
+//! Transfer that is being sent, NULL if none
+rf_transfer_sender_t *rfTransfer_sender = NULL;
+
+//! Receives the fragments, NULL if fragments are ignored
+rf_transfer_receiver_t *rfTransfer_receiver = NULL;
+
+//! Id of the next transfer
+uint8_t rfTransfer_nextId = 0;
+
+rf_transfer_stats_t rfTransfer_stats;
+
+//----------------------------------------------------------------------------
+// Implementation
+//----------------------------------------------------------------------------
+
+/*!
+ *  \param length Length of the transfer
+ *  \return Number of fragments of the transfer
+ */
+static uint16_t rfTransfer_fragmentCount(uint16_t length)
+{
+	return (length + RF_TRANSFER_FRAGMENT_LENGTH - 1) / RF_TRANSFER_FRAGMENT_LENGTH;
+}
+
+/*!
+ *  \param length Length of the transfer
+ *  \param index Index of the fragment
+ *  \return Number of data bytes in the fragment
+ */
+static uint8_t rfTransfer_fragmentLength(uint16_t length, uint8_t index)
+{
+	uint16_t const offset = (uint16_t)index * RF_TRANSFER_FRAGMENT_LENGTH;
+	return length - offset < RF_TRANSFER_FRAGMENT_LENGTH ? length - offset : RF_TRANSFER_FRAGMENT_LENGTH;
+}
+
+/*!
+ *  Sends one fragment. Yields afterwards, so the receiver keeps up in
+ *  loopback mode, where the fragments don't wait for the UART.
+ */
+static void rfTransfer_sendFragment(const rf_transfer_sender_t *sender, const uint8_t *data, uint16_t length, uint8_t index)
+{
+	inner_frame_t innerFrame;
+	rf_transfer_fragment_t header;
+	uint8_t const fragmentLength = rfTransfer_fragmentLength(length, index);
+
+	header.transferId = sender->transferId;
+	header.index = index;
+	header.length = length;
+	innerFrame.command = CMD_FRAGMENT;
+	memcpy(innerFrame.payload, &header, sizeof(header));
+	memcpy(innerFrame.payload + sizeof(header), data + (uint16_t)index * RF_TRANSFER_FRAGMENT_LENGTH, fragmentLength);
+
+	serialAdapter_writeFrame(sender->destAddr, sizeof(command_t) + sizeof(header) + fragmentLength, &innerFrame);
+	os_yield();
+}
+
+/*!
+ *  Sends a buffer in fragments and repeats the fragments the receiver is
+ *  missing until it has all of them. Yields while waiting, only one
+ *  transfer can be sent at a time.
+ *
+ *  \param destAddr Where to send the buffer, must not be ADDRESS_BROADCAST
+ *  \param data The buffer, must not change during the transfer
+ *  \param length Bytes in the buffer, 1 to RF_TRANSFER_MAX_LENGTH
+ *  \return RF_TRANSFER_SUCCESS, RF_TRANSFER_TIMEOUT if the receiver doesn't
+ *          report all fragments within RF_TRANSFER_MAX_ROUNDS, RF_TRANSFER_INVALID
+ *          or RF_TRANSFER_BUSY
+ */
+uint8_t rfTransfer_send(address_t destAddr, const void *data, uint16_t length)
+{
+	if (destAddr == ADDRESS_BROADCAST || !length || length > RF_TRANSFER_MAX_LENGTH)
+	{
+		return RF_TRANSFER_INVALID;
+	}
+
+	rf_transfer_sender_t sender;
+	memset(&sender, 0, sizeof(sender));
+	sender.destAddr = destAddr;
+
+	os_enterCriticalSection();
+	if (rfTransfer_sender)
+	{
+		os_leaveCriticalSection();
+		return RF_TRANSFER_BUSY;
+	}
+	sender.transferId = rfTransfer_nextId++;
+	rfTransfer_sender = &sender;
+	os_leaveCriticalSection();
+
+	uint16_t const count = rfTransfer_fragmentCount(length);
+	uint8_t const last = count - 1;
+	uint8_t status = RF_TRANSFER_TIMEOUT;
+
+	for (uint8_t round = 0; round < RF_TRANSFER_MAX_ROUNDS; round++)
+	{
+		rfTransfer_stats.rounds++;
+
+		// The last fragment is always sent, it asks the receiver for its status
+		for (uint16_t i = 0; i < count; i++)
+		{
+			if (!RF_TRANSFER_IS_SET(sender.acked, i) || i == last)
+			{
+				rfTransfer_sendFragment(&sender, data, length, i);
+				rfTransfer_stats.fragments++;
+				if (round)
+				{
+					rfTransfer_stats.repeatedFragments++;
+				}
+			}
+		}
+
+		time_t const pollTime = getSystemTime_ms();
+		while (!sender.statusReceived && getSystemTime_ms() - pollTime < RF_TRANSFER_STATUS_TIMEOUT_MS)
+		{
+			os_yield();
+		}
+
+		os_enterCriticalSection();
+		sender.statusReceived = false;
+		uint16_t acked = 0;
+		for (uint16_t i = 0; i < count; i++)
+		{
+			acked += !!RF_TRANSFER_IS_SET(sender.acked, i);
+		}
+		os_leaveCriticalSection();
+
+		if (acked == count)
+		{
+			status = RF_TRANSFER_SUCCESS;
+			break;
+		}
+	}
+
+	os_enterCriticalSection();
+	rfTransfer_sender = NULL;
+	os_leaveCriticalSection();
+
+	if (status != RF_TRANSFER_SUCCESS)
+	{
+		WARN("Transfer of %u bytes to 0x%x failed", length, destAddr);
+	}
+	return status;
+}
+
+/*!
+ *  Prepares the receiver and activates it. The first fragment that arrives
+ *  selects the transfer, fragments of other transfers are ignored until
+ *  receiving is started again.
+ *
+ *  \param receiver State of the reception, must stay valid until rfTransfer_stopReceiving
+ *  \param buffer Receives the data
+ *  \param size Size of buffer, longer transfers are ignored
+ */
+void rfTransfer_startReceiving(rf_transfer_receiver_t *receiver, uint8_t *buffer, uint16_t size)
+{
+	memset(receiver, 0, sizeof(*receiver));
+	receiver->buffer = buffer;
+	receiver->size = size;
+
+	os_enterCriticalSection();
+	rfTransfer_receiver = receiver;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Deactivates the receiver, fragments are ignored from now on
+ */
+void rfTransfer_stopReceiving(void)
+{
+	os_enterCriticalSection();
+	rfTransfer_receiver = NULL;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Resets the statistics, e.g. before a measurement
+ */
+void rfTransfer_resetStats(void)
+{
+	os_enterCriticalSection();
+	memset(&rfTransfer_stats, 0, sizeof(rfTransfer_stats));
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Copies a fragment into the buffer of the active receiver. The last
+ *  fragment of a transfer is answered with the bitmap of received
+ *  fragments, even if it has been received before, since the previous
+ *  status may have been lost.
+ *
+ *  \param frame Received frame with command CMD_FRAGMENT
+ */
+void rfTransfer_receiveFragment(const frame_view_t *frame)
+{
+	if (frame->header.length <= sizeof(command_t) + sizeof(rf_transfer_fragment_t))
+	{
+		return;
+	}
+
+	rf_transfer_fragment_t buffer;
+	rf_transfer_fragment_t const header = *(const rf_transfer_fragment_t *)serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
+	uint8_t const offset = sizeof(command_t) + sizeof(header);
+	uint8_t const fragmentLength = frame->header.length - offset;
+	uint16_t const count = rfTransfer_fragmentCount(header.length);
+
+	if (!header.length || header.length > RF_TRANSFER_MAX_LENGTH || header.index >= count || fragmentLength != rfTransfer_fragmentLength(header.length, header.index))
+	{
+		return;
+	}
+
+	os_enterCriticalSection();
+	rf_transfer_receiver_t *const receiver = rfTransfer_receiver;
+	if (!receiver)
+	{
+		os_leaveCriticalSection();
+		return;
+	}
+
+	if (!receiver->length)
+	{
+		if (header.length > receiver->size)
+		{
+			os_leaveCriticalSection();
+			return;
+		}
+		receiver->srcAddr = frame->header.srcAddr;
+		receiver->transferId = header.transferId;
+		receiver->length = header.length;
+	}
+	else if (receiver->srcAddr != frame->header.srcAddr || receiver->transferId != header.transferId || receiver->length != header.length)
+	{
+		os_leaveCriticalSection();
+		return;
+	}
+
+	if (!RF_TRANSFER_IS_SET(receiver->received, header.index))
+	{
+		uint8_t *const destination = receiver->buffer + (uint16_t)header.index * RF_TRANSFER_FRAGMENT_LENGTH;
+		const void *data = serialAdapter_viewData(frame, offset, fragmentLength, destination);
+		if (data != destination)
+		{
+			memcpy(destination, data, fragmentLength);
+		}
+		RF_TRANSFER_SET(receiver->received, header.index);
+		receiver->receivedCount++;
+		receiver->complete = receiver->receivedCount == count;
+	}
+
+	if (header.index != count - 1)
+	{
+		os_leaveCriticalSection();
+		return;
+	}
+
+	inner_frame_t status;
+	uint8_t const bitmapLength = (count + 7) / 8;
+	status.command = CMD_FRAGMENT_STATUS;
+	status.payload[0] = header.transferId;
+	memcpy(&status.payload[1], receiver->received, bitmapLength);
+	os_leaveCriticalSection();
+
+	// A lost status is polled again by the sender
+	rfAdapter_reply(frame->header.srcAddr, sizeof(command_t) + sizeof(uint8_t) + bitmapLength, &status);
+}
+
+/*!
+ *  Passes the bitmap of received fragments to the running rfTransfer_send
+ *
+ *  \param frame Received frame with command CMD_FRAGMENT_STATUS
+ */
+void rfTransfer_receiveStatus(const frame_view_t *frame)
+{
+	if (frame->header.length < sizeof(command_t) + sizeof(uint8_t) * 2)
+	{
+		return;
+	}
+
+	uint8_t const transferId = serialAdapter_viewByte(frame, sizeof(command_t));
+	uint8_t const bitmapLength = frame->header.length - sizeof(command_t) - sizeof(uint8_t);
+
+	os_enterCriticalSection();
+	rf_transfer_sender_t *const sender = rfTransfer_sender;
+	if (sender && sender->destAddr == frame->header.srcAddr && sender->transferId == transferId && bitmapLength <= RF_TRANSFER_BITMAP_LENGTH)
+	{
+		for (uint8_t i = 0; i < bitmapLength; i++)
+		{
+			sender->acked[i] |= serialAdapter_viewByte(frame, sizeof(command_t) + sizeof(uint8_t) + i);
+		}
+		sender->statusReceived = true;
+	}
+	os_leaveCriticalSection();
+}
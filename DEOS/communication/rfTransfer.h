@@ -0,0 +1,106 @@
+/*!
+ *  \brief Transfers buffers larger than a frame in numbered fragments.
+ *
+ *  The sender streams all fragments of a buffer as CMD_FRAGMENT frames and
+ *  polls the receiver with the last fragment. The receiver copies each
+ *  fragment into the buffer it provided, marks it in a bitmap and answers
+ *  the last fragment with CMD_FRAGMENT_STATUS, which contains the bitmap.
+ *  The sender then repeats only the missing fragments until the bitmap is
+ *  complete.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef RF_TRANSFER_H_
+#define RF_TRANSFER_H_
+
+#include "rfAdapter.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Header of a CMD_FRAGMENT frame, followed by the data of the fragment
+typedef struct RfTransferFragment
+{
+	uint8_t transferId;
+	uint8_t index;
+	//! Length of the whole buffer
+	uint16_t length;
+} rf_transfer_fragment_t;
+
+//! Data bytes per fragment
+#define RF_TRANSFER_FRAGMENT_LENGTH (COMM_MAX_PAYLOAD_LENGTH - sizeof(rf_transfer_fragment_t))
+
+//! Fragments of a transfer, limited by the 8 bit index
+#define RF_TRANSFER_MAX_FRAGMENTS 256
+
+//! Largest buffer that can be transferred
+#define RF_TRANSFER_MAX_LENGTH ((uint16_t)RF_TRANSFER_MAX_FRAGMENTS * RF_TRANSFER_FRAGMENT_LENGTH)
+
+//! Bytes of the bitmap of received fragments
+#define RF_TRANSFER_BITMAP_LENGTH (RF_TRANSFER_MAX_FRAGMENTS / 8)
+
+//! Time (ms) the sender waits for the status after the last fragment
+#ifndef RF_TRANSFER_STATUS_TIMEOUT_MS
+#define RF_TRANSFER_STATUS_TIMEOUT_MS 250
+#endif
+
+//! Rounds of sending the missing fragments before the transfer is given up
+#ifndef RF_TRANSFER_MAX_ROUNDS
+#define RF_TRANSFER_MAX_ROUNDS 16
+#endif
+
+// Status codes
+#define RF_TRANSFER_SUCCESS 0
+#define RF_TRANSFER_TIMEOUT 1
+#define RF_TRANSFER_INVALID 2
+#define RF_TRANSFER_BUSY 3
+
+//! Reception of one transfer into a buffer provided by the caller
+typedef struct RfTransferReceiver
+{
+	uint8_t *buffer;
+	uint16_t size;
+	address_t srcAddr;
+	uint8_t transferId;
+	//! Length of the transfer, 0 until its first fragment arrived
+	uint16_t length;
+	//! Number of fragments that have been received, up to RF_TRANSFER_MAX_FRAGMENTS
+	uint16_t receivedCount;
+	bool complete;
+	//! Bit i % 8 of byte i / 8 is set if fragment i has been received
+	uint8_t received[RF_TRANSFER_BITMAP_LENGTH];
+} rf_transfer_receiver_t;
+
+//! Statistics of the sent transfers since the last rfTransfer_resetStats
+typedef struct RfTransferStats
+{
+	uint16_t fragments;
+	//! Fragments that had to be sent again, including the polls
+	uint16_t repeatedFragments;
+	uint16_t rounds;
+} rf_transfer_stats_t;
+
+extern rf_transfer_stats_t rfTransfer_stats;
+
+//! Sends a buffer of up to RF_TRANSFER_MAX_LENGTH bytes, returns when it has been received completely or given up
+uint8_t rfTransfer_send(address_t destAddr, const void *data, uint16_t length);
+
+//! Receives the next transfer into buffer
+void rfTransfer_startReceiving(rf_transfer_receiver_t *receiver, uint8_t *buffer, uint16_t size);
+
+//! Stops receiving, the received data remain in the buffer
+void rfTransfer_stopReceiving(void);
+
+//! Resets rfTransfer_stats
+void rfTransfer_resetStats(void);
+
+//! Is called by the rfAdapter on CMD_FRAGMENT receive
+void rfTransfer_receiveFragment(const frame_view_t *frame);
+
+//! Is called by the rfAdapter on CMD_FRAGMENT_STATUS receive
+void rfTransfer_receiveStatus(const frame_view_t *frame);
+
+#endif /* RF_TRANSFER_H_ */
@@ -0,0 +1,383 @@
+/*!
+ *  \brief Store-and-forward of sensor samples across outages of the RF link.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#include "sensorBuffer.h"
+#include "rfReliable.h"
+#include "../os_scheduler.h"
+
+#include <avr/eeprom.h>
+#include <string.h>
+
+//----------------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------------
+
+//! Marks a sample that was stored while the link was down, CMD_SENSOR_BACKLOG doesn't use the age flag
+#define SENSOR_BUFFER_WAITED_FLAG 0x80
+
+//! Largest difference between the ages of the samples of one frame, in SENSOR_SAMPLES_BACKLOG_AGE_UNIT_MS
+#define SENSOR_BUFFER_MAX_AGE_SPREAD UINT8_MAX
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! A sample that waits for being delivered
+typedef struct SensorBufferRecord
+{
+	uint8_t code;
+	int16_t value;
+	time_t time;
+} sensor_buffer_record_t;
+
+sensor_buffer_record_t sensorBuffer_ram[SENSOR_BUFFER_LENGTH];
+
+//! Index of the oldest sample in sensorBuffer_ram
+uint8_t sensorBuffer_ramHead = 0;
+
+//! Number of samples in sensorBuffer_ram
+uint8_t sensorBuffer_ramCount = 0;
+
+#if SENSOR_BUFFER_EEPROM_LENGTH
+//! Samples that have been spilled, they are older than those in RAM
+static sensor_buffer_record_t sensorBuffer_eeprom[SENSOR_BUFFER_EEPROM_LENGTH] EEMEM;
+
+uint16_t sensorBuffer_eepromHead = 0;
+uint16_t sensorBuffer_eepromCount = 0;
+
+//! Counts the removals, so a spill notices that its sample has been delivered meanwhile
+uint8_t sensorBuffer_removals = 0;
+#endif
+
+//! Where the samples are sent to, ADDRESS_BROADCAST until it's set
+address_t sensorBuffer_destAddr = ADDRESS_BROADCAST;
+
+//! Number of the oldest samples that are in the frame on its way, 0 if there is none
+uint8_t sensorBuffer_inFlight = 0;
+
+//! Number of samples in the frame on its way that waited for the link
+uint8_t sensorBuffer_inFlightWaited = 0;
+
+//! Cleared when a frame is given up, set when a frame is acknowledged
+bool sensorBuffer_linkUp = true;
+
+//! When the last frame was sent or given up
+time_t sensorBuffer_lastSendTime = 0;
+
+sensor_buffer_stats_t sensorBuffer_stats;
+
+//----------------------------------------------------------------------------
+// Implementation
+//----------------------------------------------------------------------------
+
+/*!
+ *  Call within a critical section.
+ *
+ *  \return Number of samples in RAM and EEPROM
+ */
+static uint16_t sensorBuffer_count(void)
+{
+#if SENSOR_BUFFER_EEPROM_LENGTH
+	return sensorBuffer_eepromCount + sensorBuffer_ramCount;
+#else
+	return sensorBuffer_ramCount;
+#endif
+}
+
+/*!
+ *  Reads a buffered sample. Call within a critical section.
+ *
+ *  \param index Position of the sample, 0 is the oldest
+ *  \param record Receives the sample
+ */
+static void sensorBuffer_get(uint16_t index, sensor_buffer_record_t *record)
+{
+#if SENSOR_BUFFER_EEPROM_LENGTH
+	if (index < sensorBuffer_eepromCount)
+	{
+		eeprom_read_block(record, &sensorBuffer_eeprom[(sensorBuffer_eepromHead + index) % SENSOR_BUFFER_EEPROM_LENGTH], sizeof(*record));
+		return;
+	}
+	index -= sensorBuffer_eepromCount;
+#endif
+	*record = sensorBuffer_ram[(sensorBuffer_ramHead + index) % SENSOR_BUFFER_LENGTH];
+}
+
+/*!
+ *  Removes the oldest samples. Call within a critical section.
+ *
+ *  \param count Number of samples to remove
+ */
+static void sensorBuffer_remove(uint8_t count)
+{
+#if SENSOR_BUFFER_EEPROM_LENGTH
+	uint8_t const spilled = count < sensorBuffer_eepromCount ? count : sensorBuffer_eepromCount;
+	sensorBuffer_eepromHead = (sensorBuffer_eepromHead + spilled) % SENSOR_BUFFER_EEPROM_LENGTH;
+	sensorBuffer_eepromCount -= spilled;
+	sensorBuffer_removals++;
+	count -= spilled;
+#endif
+	sensorBuffer_ramHead = (sensorBuffer_ramHead + count) % SENSOR_BUFFER_LENGTH;
+	sensorBuffer_ramCount -= count;
+}
+
+#if SENSOR_BUFFER_EEPROM_LENGTH
+/*!
+ *  Moves the oldest sample in RAM behind the samples in the EEPROM. A byte
+ *  takes about 3.4 ms to write, the process yields in between instead of
+ *  blocking the scheduler.
+ *
+ *  \return False if the EEPROM is full
+ */
+static bool sensorBuffer_spill(void)
+{
+	os_enterCriticalSection();
+	if (sensorBuffer_eepromCount == SENSOR_BUFFER_EEPROM_LENGTH)
+	{
+		os_leaveCriticalSection();
+		return false;
+	}
+	uint8_t const removals = sensorBuffer_removals;
+	sensor_buffer_record_t const record = sensorBuffer_ram[sensorBuffer_ramHead];
+	// Removals don't move the slot behind the last spilled sample, nobody else reads it
+	uint8_t *const destination = (uint8_t *)&sensorBuffer_eeprom[(sensorBuffer_eepromHead + sensorBuffer_eepromCount) % SENSOR_BUFFER_EEPROM_LENGTH];
+	os_leaveCriticalSection();
+
+	for (uint8_t i = 0; i < sizeof(record); i++)
+	{
+		while (!eeprom_is_ready())
+		{
+			os_yield();
+		}
+		os_enterCriticalSection();
+		eeprom_update_byte(destination + i, ((const uint8_t *)&record)[i]);
+		os_leaveCriticalSection();
+	}
+
+	os_enterCriticalSection();
+	// If samples have been delivered meanwhile, the copy is dropped and the caller checks for room again
+	if (removals == sensorBuffer_removals)
+	{
+		sensorBuffer_eepromCount++;
+		sensorBuffer_ramHead = (sensorBuffer_ramHead + 1) % SENSOR_BUFFER_LENGTH;
+		sensorBuffer_ramCount--;
+	}
+	os_leaveCriticalSection();
+	return true;
+}
+#else
+static bool sensorBuffer_spill(void)
+{
+	return false;
+}
+#endif
+
+/*!
+ *  Learns whether the frame on its way has been delivered. Runs within a
+ *  critical section of the rfReliable worker.
+ *
+ *  \param destAddr Destination of the frame
+ *  \param command Command of the frame
+ *  \param acked True if the frame has been acknowledged, false if it was given up
+ */
+static void sensorBuffer_receiveResult(address_t destAddr, command_t command, bool acked)
+{
+	if (command != CMD_SENSOR_BACKLOG || destAddr != sensorBuffer_destAddr || !sensorBuffer_inFlight)
+	{
+		return;
+	}
+
+	if (acked)
+	{
+		sensorBuffer_remove(sensorBuffer_inFlight);
+		sensorBuffer_stats.replayed += sensorBuffer_inFlightWaited;
+		sensorBuffer_linkUp = true;
+	}
+	else
+	{
+		if (sensorBuffer_linkUp)
+		{
+			sensorBuffer_stats.outages++;
+		}
+		sensorBuffer_linkUp = false;
+		sensorBuffer_lastSendTime = getSystemTime_ms();
+
+		// The spilled samples have been in RAM when the link went down or were added afterwards
+		for (uint8_t i = 0; i < sensorBuffer_ramCount; i++)
+		{
+			sensorBuffer_ram[(sensorBuffer_ramHead + i) % SENSOR_BUFFER_LENGTH].code |= SENSOR_BUFFER_WAITED_FLAG;
+		}
+	}
+	sensorBuffer_inFlight = 0;
+}
+
+/*!
+ *  Sets where the samples are sent to and starts sending. Samples that are
+ *  buffered already are sent there as well.
+ *
+ *  \param destAddr The receiver, must not be ADDRESS_BROADCAST
+ */
+void sensorBuffer_setDestination(address_t destAddr)
+{
+	os_enterCriticalSection();
+	sensorBuffer_destAddr = destAddr;
+	// A frame to the previous destination is sent again
+	sensorBuffer_inFlight = 0;
+	sensorBuffer_linkUp = true;
+	rfReliable_setResultHandler(sensorBuffer_receiveResult);
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Stores a sample until its frame has been acknowledged. If RAM and EEPROM
+ *  are full, the new sample is dropped, so the buffered series stays
+ *  without gaps. Is meant to be called by one process, it may yield while
+ *  spilling into the EEPROM.
+ *
+ *  \param sensor Sensor that took the sample
+ *  \param paramType Parameter the value belongs to
+ *  \param value Mantissa of the value, e.g. 234 for 23.4 degree
+ *  \param exponent The value is value * 10^exponent, e.g. -1 for tenths
+ *  \return False if the sample can't be encoded or has been dropped
+ */
+bool sensorBuffer_add(sensor_type_t sensor, sensor_parameter_type_t paramType, int32_t value, int8_t exponent)
+{
+	sensor_buffer_record_t record;
+	if (!sensorSamples_encode(sensor, paramType, value, exponent, &record.code, &record.value))
+	{
+		return false;
+	}
+	record.time = getSystemTime_ms();
+
+	os_enterCriticalSection();
+	while (sensorBuffer_ramCount == SENSOR_BUFFER_LENGTH)
+	{
+		os_leaveCriticalSection();
+		bool const spilled = sensorBuffer_spill();
+		os_enterCriticalSection();
+
+		if (!spilled)
+		{
+			sensorBuffer_stats.dropped++;
+			os_leaveCriticalSection();
+			return false;
+		}
+	}
+
+	if (!sensorBuffer_linkUp)
+	{
+		record.code |= SENSOR_BUFFER_WAITED_FLAG;
+	}
+	sensorBuffer_ram[(sensorBuffer_ramHead + sensorBuffer_ramCount) % SENSOR_BUFFER_LENGTH] = record;
+	sensorBuffer_ramCount++;
+	sensorBuffer_stats.buffered++;
+	os_leaveCriticalSection();
+	return true;
+}
+
+/*!
+ *  \return Number of samples that have not been acknowledged yet
+ */
+uint16_t sensorBuffer_getCount(void)
+{
+	os_enterCriticalSection();
+	uint16_t const count = sensorBuffer_count();
+	os_leaveCriticalSection();
+	return count;
+}
+
+/*!
+ *  \return False from a given up frame until a frame is acknowledged again
+ */
+bool sensorBuffer_isLinkUp(void)
+{
+	return sensorBuffer_linkUp;
+}
+
+/*!
+ *  Resets the statistics, e.g. before a measurement
+ */
+void sensorBuffer_resetStats(void)
+{
+	os_enterCriticalSection();
+	memset(&sensorBuffer_stats, 0, sizeof(sensorBuffer_stats));
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Sends the oldest samples in one CMD_SENSOR_BACKLOG frame if no frame is
+ *  on its way and the interval since the last one has passed. A frame that
+ *  isn't full waits SENSOR_BUFFER_HOLD_MS for further samples. Never yields.
+ */
+void sensorBuffer_worker(void)
+{
+	os_enterCriticalSection();
+	uint16_t const count = sensorBuffer_count();
+	time_t const now = getSystemTime_ms();
+	time_t const interval = sensorBuffer_linkUp ? SENSOR_BUFFER_DRAIN_INTERVAL_MS : SENSOR_BUFFER_RETRY_MS;
+
+	if (!count || sensorBuffer_inFlight || sensorBuffer_destAddr == ADDRESS_BROADCAST || now - sensorBuffer_lastSendTime < interval)
+	{
+		os_leaveCriticalSection();
+		return;
+	}
+#if SENSOR_BUFFER_EEPROM_LENGTH
+	// Reading the EEPROM would wait for the spill in progress
+	if (sensorBuffer_eepromCount && !eeprom_is_ready())
+	{
+		os_leaveCriticalSection();
+		return;
+	}
+#endif
+
+	sensor_buffer_record_t record;
+	sensorBuffer_get(0, &record);
+	if (count < SENSOR_SAMPLES_BACKLOG_MAX_COUNT && now - record.time < SENSOR_BUFFER_HOLD_MS)
+	{
+		os_leaveCriticalSection();
+		return;
+	}
+
+	// The base age is the one of the oldest sample, the records tell how much newer they are
+	time_t const oldestAge = (now - record.time) / SENSOR_SAMPLES_BACKLOG_AGE_UNIT_MS;
+	uint16_t const baseAge = oldestAge < UINT16_MAX ? oldestAge : UINT16_MAX;
+	inner_frame_t innerFrame;
+	innerFrame.command = CMD_SENSOR_BACKLOG;
+	memcpy(innerFrame.payload, &baseAge, sizeof(baseAge));
+
+	uint8_t length = sizeof(baseAge);
+	uint8_t samples = 0;
+	uint8_t waited = 0;
+	for (; samples < count && samples < SENSOR_SAMPLES_BACKLOG_MAX_COUNT; samples++)
+	{
+		if (samples)
+		{
+			sensorBuffer_get(samples, &record);
+		}
+		time_t const newer = oldestAge - (now - record.time) / SENSOR_SAMPLES_BACKLOG_AGE_UNIT_MS;
+		if (newer > SENSOR_BUFFER_MAX_AGE_SPREAD)
+		{
+			break;
+		}
+
+		uint8_t *const entry = &innerFrame.payload[length];
+		entry[0] = record.code & ~SENSOR_BUFFER_WAITED_FLAG;
+		memcpy(&entry[1], &record.value, sizeof(record.value));
+		entry[SENSOR_SAMPLES_RECORD_LENGTH] = newer;
+		length += SENSOR_SAMPLES_BACKLOG_RECORD_LENGTH;
+		waited += !!(record.code & SENSOR_BUFFER_WAITED_FLAG);
+	}
+
+	if (rfReliable_trySend(sensorBuffer_destAddr, sizeof(command_t) + length, &innerFrame) == RF_RELIABLE_SUCCESS)
+	{
+		sensorBuffer_inFlight = samples;
+		sensorBuffer_inFlightWaited = waited;
+		sensorBuffer_lastSendTime = now;
+	}
+	os_leaveCriticalSection();
+}
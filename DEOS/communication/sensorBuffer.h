@@ -0,0 +1,92 @@
+/*!
+ *  \brief Store-and-forward of sensor samples across outages of the RF link.
+ *
+ *  Samples are stored with their timestamp in a RAM ring buffer and sent
+ *  reliably as CMD_SENSOR_BACKLOG frames, one frame at a time. They are
+ *  removed only after the receiver acknowledged their frame. If the frame is
+ *  given up, the link counts as down: the buffer keeps filling and the oldest
+ *  frame is retried every SENSOR_BUFFER_RETRY_MS. Once it gets through, the
+ *  backlog drains in full frames spaced by SENSOR_BUFFER_DRAIN_INTERVAL_MS, so
+ *  other traffic keeps its share of the link.
+ *
+ *  Ages are measured when a frame is built. The frame that gets through at
+ *  the end of an outage may have been retransmitted by rfReliable for a
+ *  while, its ages are short by that time. A frame whose ACKs are all lost is
+ *  delivered twice.
+ *
+ *  With SENSOR_BUFFER_EEPROM_LENGTH > 0 the oldest samples spill into the
+ *  EEPROM when the RAM is full. The spilled samples don't survive a reset,
+ *  since their timestamps don't.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef SENSOR_BUFFER_H_
+#define SENSOR_BUFFER_H_
+
+#include "sensorSamples.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Samples that are buffered in RAM
+#ifndef SENSOR_BUFFER_LENGTH
+#define SENSOR_BUFFER_LENGTH 48
+#endif
+
+//! Samples that are buffered in the EEPROM when the RAM is full, 0 disables the spill
+#ifndef SENSOR_BUFFER_EEPROM_LENGTH
+#define SENSOR_BUFFER_EEPROM_LENGTH 0
+#endif
+
+//! Time (ms) a sample waits for further samples that can share its frame
+#ifndef SENSOR_BUFFER_HOLD_MS
+#define SENSOR_BUFFER_HOLD_MS 10
+#endif
+
+//! Minimum time (ms) between two frames while the link is up, limits the rate the backlog drains with
+#ifndef SENSOR_BUFFER_DRAIN_INTERVAL_MS
+#define SENSOR_BUFFER_DRAIN_INTERVAL_MS 50
+#endif
+
+//! Time (ms) between two attempts while the link is down
+#ifndef SENSOR_BUFFER_RETRY_MS
+#define SENSOR_BUFFER_RETRY_MS 1000
+#endif
+
+//! Statistics since the last sensorBuffer_resetStats
+typedef struct SensorBufferStats
+{
+	//! Samples that have been stored
+	uint16_t buffered;
+	//! Samples that were rejected because the buffer was full
+	uint16_t dropped;
+	//! Samples that were delivered after waiting for the link
+	uint16_t replayed;
+	//! Number of times the link went down
+	uint16_t outages;
+} sensor_buffer_stats_t;
+
+extern sensor_buffer_stats_t sensorBuffer_stats;
+
+//! Sets where the buffered samples are sent to, must not be ADDRESS_BROADCAST
+void sensorBuffer_setDestination(address_t destAddr);
+
+//! Stores a sample with the value `value * 10^exponent`, returns false if it can't be encoded or the buffer is full
+bool sensorBuffer_add(sensor_type_t sensor, sensor_parameter_type_t paramType, int32_t value, int8_t exponent);
+
+//! Returns the number of samples that have not been delivered yet
+uint16_t sensorBuffer_getCount(void);
+
+//! Returns false while the link is down
+bool sensorBuffer_isLinkUp(void);
+
+//! Resets sensorBuffer_stats
+void sensorBuffer_resetStats(void);
+
+//! Sends the next frame if it's due, is called by the rfAdapter worker
+void sensorBuffer_worker(void);
+
+#endif /* SENSOR_BUFFER_H_ */
@@ -8,6 +8,8 @@
 #ifndef SENSORDATA_H_
 #define SENSORDATA_H_
 
+#include <stdint.h>
+
 //! Definition of sensor types
 typedef enum SensorType
 {
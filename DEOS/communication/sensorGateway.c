@@ -0,0 +1,483 @@
+/*!
+ *  \brief Gateway role: caches the last value of every sensor parameter in the
+ *         network and streams the updates to the USB terminal.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#include "sensorGateway.h"
+#include "../lib/crc16.h"
+#include "../lib/fmt.h"
+#include "../lib/terminal.h"
+#include "../lib/uart.h"
+#include "../os_scheduler.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------------
+
+//! Longest record of both formats, a CSV export line
+#define SENSOR_GATEWAY_RECORD_SIZE 96
+
+//! Fractional values are written with two decimals and limited to what fits a long then
+#define SENSOR_GATEWAY_FIXED_POINT_LIMIT 2.0e7f
+
+#define SENSOR_GATEWAY_RECORD_UPDATE 'U'
+#define SENSOR_GATEWAY_RECORD_EXPORT 'E'
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! Entry of the table, the values are in the unit of the parameter type
+typedef struct SensorGatewaySlot
+{
+	address_t srcAddr;
+	uint8_t sensor;
+	//! 0 if the entry is unused
+	uint8_t paramType;
+	//! Set while the entry waits for the feed
+	bool queued;
+	//! Number of values in sum, halved with it before it overflows
+	uint8_t count;
+	int16_t value;
+	int16_t min;
+	int16_t max;
+	//! System time (ms) the value was taken
+	time_t time;
+	//! Sum of the values, the mean is sum / count
+	int32_t sum;
+} sensor_gateway_slot_t;
+
+// STACK_OFFSET only covers SENSOR_GATEWAY_ENTRY_SIZE bytes per entry
+_Static_assert(sizeof(sensor_gateway_slot_t) + sizeof(uint8_t) <= SENSOR_GATEWAY_ENTRY_SIZE, "sensor_gateway_slot_t outgrew SENSOR_GATEWAY_ENTRY_SIZE");
+
+sensor_gateway_slot_t sensorGateway_table[SENSOR_GATEWAY_TABLE_LENGTH];
+
+//! Indices of the entries that wait for the feed, oldest first
+uint8_t sensorGateway_queue[SENSOR_GATEWAY_TABLE_LENGTH];
+uint8_t sensorGateway_queueHead = 0;
+uint8_t sensorGateway_queueCount = 0;
+
+sensor_gateway_format_t sensorGateway_format = SENSOR_GATEWAY_FORMAT_OFF;
+
+sensor_gateway_stats_t sensorGateway_stats;
+
+//----------------------------------------------------------------------------
+// Implementation
+//----------------------------------------------------------------------------
+
+static void sensorGateway_receiveSensorData(const frame_view_t *frame);
+static void sensorGateway_receiveSample(address_t srcAddr, const sensor_sample_t *sample);
+
+/*!
+ *  Clears the table and lets the rfAdapter pass all received sensor values
+ *  to the gateway
+ *
+ *  \param format How the feed and the export are written
+ */
+void sensorGateway_init(sensor_gateway_format_t format)
+{
+	os_enterCriticalSection();
+	memset(sensorGateway_table, 0, sizeof(sensorGateway_table));
+	sensorGateway_queueHead = 0;
+	sensorGateway_queueCount = 0;
+	sensorGateway_format = format;
+	os_leaveCriticalSection();
+
+	rfAdapter_registerHandler(CMD_SENSOR_DATA, sensorGateway_receiveSensorData, sizeof(cmd_sensorData_t), sizeof(cmd_sensorData_t), RF_HANDLER_INLINE);
+	sensorSamples_setReceiver(sensorGateway_receiveSample);
+}
+
+/*!
+ *  Looks an entry up, must be called in a critical section
+ *
+ *  \param create True to claim a free entry if there is none yet
+ *  \return The entry, NULL if there is none or the table is full
+ */
+static sensor_gateway_slot_t *sensorGateway_find(address_t srcAddr, uint8_t sensor, uint8_t paramType, bool create)
+{
+	uint8_t index = ((uint16_t)srcAddr * 13 + sensor * 7 + paramType) % SENSOR_GATEWAY_TABLE_LENGTH;
+
+	for (uint8_t i = 0; i < SENSOR_GATEWAY_TABLE_LENGTH; i++)
+	{
+		sensor_gateway_slot_t *const entry = &sensorGateway_table[index];
+		if (!entry->paramType)
+		{
+			// Entries are never removed, so the key isn't further on
+			if (!create)
+			{
+				return NULL;
+			}
+			entry->srcAddr = srcAddr;
+			entry->sensor = sensor;
+			entry->paramType = paramType;
+			return entry;
+		}
+		if (entry->srcAddr == srcAddr && entry->sensor == sensor && entry->paramType == paramType)
+		{
+			return entry;
+		}
+		index = index + 1 < SENSOR_GATEWAY_TABLE_LENGTH ? index + 1 : 0;
+	}
+	return NULL;
+}
+
+//! Appends an entry to the feed queue, must be called in a critical section
+static void sensorGateway_enqueue(sensor_gateway_slot_t *entry)
+{
+	uint8_t const tail = (sensorGateway_queueHead + sensorGateway_queueCount) % SENSOR_GATEWAY_TABLE_LENGTH;
+	sensorGateway_queue[tail] = entry - sensorGateway_table;
+	sensorGateway_queueCount++;
+	entry->queued = true;
+}
+
+/*!
+ *  Converts a value to the unit of its parameter type
+ *
+ *  \param paramType Parameter the value belongs to
+ *  \param value The value, a float with two decimals or an unsigned integer
+ *  \return The value in the unit of the parameter type
+ */
+static int16_t sensorGateway_encode(uint8_t paramType, float value)
+{
+	if (value > SENSOR_GATEWAY_FIXED_POINT_LIMIT)
+	{
+		value = SENSOR_GATEWAY_FIXED_POINT_LIMIT;
+	}
+	else if (value < -SENSOR_GATEWAY_FIXED_POINT_LIMIT)
+	{
+		value = -SENSOR_GATEWAY_FIXED_POINT_LIMIT;
+	}
+
+	if (!sensorSamples_isFractional(paramType))
+	{
+		return sensorSamples_encodeValue(paramType, value < 0 ? 0 : (int32_t)(value + 0.5f), 0);
+	}
+	return sensorSamples_encodeValue(paramType, (int32_t)(value * 100 + (value < 0 ? -0.5f : 0.5f)), -2);
+}
+
+//! \return A value in the unit of its parameter type as float
+static float sensorGateway_decode(uint8_t paramType, int16_t value)
+{
+	sensor_parameter_t param;
+	sensorSamples_decodeValue(paramType, value, &param);
+	return sensorSamples_isFractional(paramType) ? param.fValue : param.uValue;
+}
+
+//! Converts a copy of a table entry to what sensorGateway_get returns
+static void sensorGateway_expand(const sensor_gateway_slot_t *slot, sensor_gateway_entry_t *entry)
+{
+	entry->srcAddr = slot->srcAddr;
+	entry->sensor = slot->sensor;
+	entry->paramType = slot->paramType;
+	entry->value = sensorGateway_decode(slot->paramType, slot->value);
+	entry->time = slot->time;
+	entry->min = sensorGateway_decode(slot->paramType, slot->min);
+	entry->max = sensorGateway_decode(slot->paramType, slot->max);
+	entry->count = slot->count;
+
+	// The mean of values in the unit can't be out of its range
+	int32_t const half = slot->sum < 0 ? -(int32_t)(slot->count / 2) : slot->count / 2;
+	int16_t const mean = slot->count ? (slot->sum + half) / slot->count : 0;
+	entry->sum = sensorGateway_decode(slot->paramType, mean) * slot->count;
+}
+
+/*!
+ *  Updates the entry of a parameter in constant time. A value that is older
+ *  than the cached one, e.g. from a backlog, only counts for the statistics.
+ *
+ *  \param srcAddr Node that sent the value
+ *  \param sensor Sensor that took the value
+ *  \param paramType Parameter the value belongs to
+ *  \param value The value
+ *  \param age Time (ms) between taking and receiving the value
+ */
+void sensorGateway_ingest(address_t srcAddr, sensor_type_t sensor, sensor_parameter_type_t paramType, float value, time_t age)
+{
+	time_t const time = getSystemTime_ms() - age;
+	int16_t const encoded = sensorGateway_encode(paramType, value);
+
+	os_enterCriticalSection();
+	sensor_gateway_slot_t *const entry = sensorGateway_find(srcAddr, sensor, paramType, true);
+	if (!entry)
+	{
+		sensorGateway_stats.tableFull++;
+		os_leaveCriticalSection();
+		return;
+	}
+
+	bool const newer = !entry->count || (int32_t)(time - entry->time) >= 0;
+	if (!entry->count)
+	{
+		entry->min = encoded;
+		entry->max = encoded;
+	}
+	else if (encoded < entry->min)
+	{
+		entry->min = encoded;
+	}
+	else if (encoded > entry->max)
+	{
+		entry->max = encoded;
+	}
+
+	// Halving both keeps the mean
+	if (entry->count == UINT8_MAX)
+	{
+		entry->sum /= 2;
+		entry->count /= 2;
+	}
+	entry->sum += encoded;
+	entry->count++;
+	sensorGateway_stats.updates++;
+
+	if (newer)
+	{
+		entry->value = encoded;
+		entry->time = time;
+		if (entry->queued)
+		{
+			sensorGateway_stats.coalesced++;
+		}
+		else if (sensorGateway_format != SENSOR_GATEWAY_FORMAT_OFF)
+		{
+			sensorGateway_enqueue(entry);
+		}
+	}
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Copies the entry of a parameter
+ *
+ *  \return False if no value of the parameter has been received
+ */
+bool sensorGateway_get(address_t srcAddr, sensor_type_t sensor, sensor_parameter_type_t paramType, sensor_gateway_entry_t *entry)
+{
+	sensor_gateway_slot_t slot;
+	os_enterCriticalSection();
+	sensor_gateway_slot_t const *const found = sensorGateway_find(srcAddr, sensor, paramType, false);
+	if (found)
+	{
+		slot = *found;
+	}
+	os_leaveCriticalSection();
+
+	if (found)
+	{
+		sensorGateway_expand(&slot, entry);
+	}
+	return found;
+}
+
+/*!
+ *  Passes a value of a CMD_SENSOR_DATA frame to the table
+ *
+ *  \param frame Received frame with command CMD_SENSOR_DATA
+ */
+static void sensorGateway_receiveSensorData(const frame_view_t *frame)
+{
+	cmd_sensorData_t buffer;
+	const cmd_sensorData_t *const cmd = serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
+
+	if (cmd->sensor < SENSOR_MPL3115A2 || cmd->sensor > SENSOR_SGP30 || cmd->paramType < PARAM_TEMPERATURE_CELSIUS || cmd->paramType > PARAM_CO2_PPM)
+	{
+		return;
+	}
+	float const value = sensorSamples_isFractional(cmd->paramType) ? cmd->param.fValue : cmd->param.uValue;
+	sensorGateway_ingest(frame->header.srcAddr, cmd->sensor, cmd->paramType, value, 0);
+}
+
+//! Passes a decoded value of CMD_SENSOR_SAMPLES or CMD_SENSOR_BACKLOG to the table
+static void sensorGateway_receiveSample(address_t srcAddr, const sensor_sample_t *sample)
+{
+	float const value = sensorSamples_isFractional(sample->paramType) ? sample->param.fValue : sample->param.uValue;
+	sensorGateway_ingest(srcAddr, sample->sensor, sample->paramType, value, sample->age);
+}
+
+//! Writes a value as CSV field, fractional values with two decimals
+static void sensorGateway_writeCsvValue(fmt_buffer_t *record, bool fractional, float value)
+{
+	if (!fractional)
+	{
+		fmt_format_p(fmt_bufferSink, record, PSTR(",%lu"), (uint32_t)(value + 0.5f));
+		return;
+	}
+	if (value > SENSOR_GATEWAY_FIXED_POINT_LIMIT)
+	{
+		value = SENSOR_GATEWAY_FIXED_POINT_LIMIT;
+	}
+	else if (value < -SENSOR_GATEWAY_FIXED_POINT_LIMIT)
+	{
+		value = -SENSOR_GATEWAY_FIXED_POINT_LIMIT;
+	}
+	fmt_format_p(fmt_bufferSink, record, PSTR(",%.2lq"), (int32_t)(value * 100 + (value < 0 ? -0.5f : 0.5f)));
+}
+
+//! Appends bytes to a binary record
+static void sensorGateway_writeBinary(fmt_buffer_t *record, const void *data, uint8_t length)
+{
+	memcpy(record->buffer + record->length, data, length);
+	record->length += length;
+}
+
+/*!
+ *  Formats the record of an entry
+ *
+ *  \param entry Copy of the entry
+ *  \param type SENSOR_GATEWAY_RECORD_UPDATE or SENSOR_GATEWAY_RECORD_EXPORT
+ *  \param buffer Receives the record, SENSOR_GATEWAY_RECORD_SIZE bytes
+ *  \return Length of the record
+ */
+static uint8_t sensorGateway_formatRecord(const sensor_gateway_entry_t *entry, char type, char *buffer)
+{
+	fmt_buffer_t record = {buffer, SENSOR_GATEWAY_RECORD_SIZE, 0};
+
+	if (sensorGateway_format == SENSOR_GATEWAY_FORMAT_CSV)
+	{
+		bool const fractional = sensorSamples_isFractional(entry->paramType);
+		fmt_format_p(fmt_bufferSink, &record, PSTR("%c,%u,%u,%u,%lu"), type, entry->srcAddr, entry->sensor, entry->paramType, entry->time);
+		sensorGateway_writeCsvValue(&record, fractional, entry->value);
+		if (type == SENSOR_GATEWAY_RECORD_EXPORT)
+		{
+			sensorGateway_writeCsvValue(&record, fractional, entry->min);
+			sensorGateway_writeCsvValue(&record, fractional, entry->max);
+			sensorGateway_writeCsvValue(&record, fractional, entry->sum / entry->count);
+			fmt_format_p(fmt_bufferSink, &record, PSTR(",%u"), entry->count);
+		}
+		fmt_format_p(fmt_bufferSink, &record, PSTR("\r\n"));
+		return record.length;
+	}
+
+	buffer[record.length++] = SENSOR_GATEWAY_SYNC;
+	buffer[record.length++] = type;
+	sensorGateway_writeBinary(&record, &entry->srcAddr, sizeof(entry->srcAddr));
+	sensorGateway_writeBinary(&record, &entry->sensor, sizeof(entry->sensor));
+	sensorGateway_writeBinary(&record, &entry->paramType, sizeof(entry->paramType));
+	sensorGateway_writeBinary(&record, &entry->time, sizeof(entry->time));
+	sensorGateway_writeBinary(&record, &entry->value, sizeof(entry->value));
+	if (type == SENSOR_GATEWAY_RECORD_EXPORT)
+	{
+		float const mean = entry->sum / entry->count;
+		sensorGateway_writeBinary(&record, &entry->min, sizeof(entry->min));
+		sensorGateway_writeBinary(&record, &entry->max, sizeof(entry->max));
+		uint16_t const count = entry->count;
+		sensorGateway_writeBinary(&record, &mean, sizeof(mean));
+		sensorGateway_writeBinary(&record, &count, sizeof(count));
+	}
+	uint16_t const crc = crc16_updateBuffer(CRC16_INITIAL_VALUE, buffer + 1, record.length - 1);
+	sensorGateway_writeBinary(&record, &crc, sizeof(crc));
+	return record.length;
+}
+
+//! \return Bytes the UART2 transmit buffer can take
+static uint16_t sensorGateway_getTxSpace(void)
+{
+	return UART2_TX_BUFFER_SIZE - 1 - uart2_gettxcount();
+}
+
+/*!
+ *  Writes the queued entries in the order they were updated. Stops at the
+ *  first record that doesn't fit into the transmit buffer, it's written by
+ *  the next call. Never waits for the UART.
+ */
+void sensorGateway_worker(void)
+{
+	char buffer[SENSOR_GATEWAY_RECORD_SIZE];
+
+	while (sensorGateway_format != SENSOR_GATEWAY_FORMAT_OFF)
+	{
+		os_enterCriticalSection();
+		if (!sensorGateway_queueCount)
+		{
+			os_leaveCriticalSection();
+			return;
+		}
+		uint8_t const index = sensorGateway_queue[sensorGateway_queueHead];
+		sensor_gateway_slot_t const slot = sensorGateway_table[index];
+		os_leaveCriticalSection();
+
+		sensor_gateway_entry_t entry;
+		sensorGateway_expand(&slot, &entry);
+		uint8_t const length = sensorGateway_formatRecord(&entry, SENSOR_GATEWAY_RECORD_UPDATE, buffer);
+
+		// Whole records only, log messages must not get in between
+		terminal_lock();
+		if (sensorGateway_getTxSpace() < length)
+		{
+			terminal_unlock();
+			return;
+		}
+		for (uint8_t i = 0; i < length; i++)
+		{
+			uart2_tryputc(buffer[i]);
+		}
+		terminal_unlock();
+
+		os_enterCriticalSection();
+		sensor_gateway_slot_t *const current = &sensorGateway_table[index];
+		sensorGateway_queueHead = (sensorGateway_queueHead + 1) % SENSOR_GATEWAY_TABLE_LENGTH;
+		sensorGateway_queueCount--;
+		current->queued = false;
+		// Updated while it was written, the new value goes to the end of the queue
+		if (current->time != slot.time || current->count != slot.count || current->sum != slot.sum)
+		{
+			sensorGateway_enqueue(current);
+		}
+		sensorGateway_stats.records++;
+		os_leaveCriticalSection();
+	}
+}
+
+/*!
+ *  Writes all entries with their statistics, e.g. when a host connects.
+ *  Waits (yielding) while the transmit buffer is full.
+ */
+void sensorGateway_export(void)
+{
+	char buffer[SENSOR_GATEWAY_RECORD_SIZE];
+
+	if (sensorGateway_format == SENSOR_GATEWAY_FORMAT_OFF)
+	{
+		return;
+	}
+
+	for (uint8_t i = 0; i < SENSOR_GATEWAY_TABLE_LENGTH; i++)
+	{
+		os_enterCriticalSection();
+		sensor_gateway_slot_t const slot = sensorGateway_table[i];
+		os_leaveCriticalSection();
+		if (!slot.count)
+		{
+			continue;
+		}
+
+		sensor_gateway_entry_t entry;
+		sensorGateway_expand(&slot, &entry);
+		uint8_t const length = sensorGateway_formatRecord(&entry, SENSOR_GATEWAY_RECORD_EXPORT, buffer);
+		terminal_lock();
+		for (uint8_t j = 0; j < length; j++)
+		{
+			while (!uart2_tryputc(buffer[j]))
+			{
+				os_yield();
+			}
+		}
+		terminal_unlock();
+	}
+}
+
+/*!
+ *  Resets the statistics, e.g. before a measurement
+ */
+void sensorGateway_resetStats(void)
+{
+	os_enterCriticalSection();
+	memset(&sensorGateway_stats, 0, sizeof(sensorGateway_stats));
+	os_leaveCriticalSection();
+}
@@ -0,0 +1,107 @@
+/*!
+ *  \brief Gateway role: caches the last value of every sensor parameter in the
+ *         network and streams the updates to the USB terminal.
+ *
+ *  Values of CMD_SENSOR_DATA, CMD_SENSOR_SAMPLES and CMD_SENSOR_BACKLOG are
+ *  ingested by the rfAdapter worker into a hash table keyed by source
+ *  address, sensor and parameter type. An entry holds the last value with
+ *  its timestamp and the minimum, maximum and mean since it was created,
+ *  in the 16 bit unit of the parameter type (see sensorSamples.h) to keep
+ *  the table small. SENSOR_GATEWAY_TABLE_LENGTH (see defines.h) grows with
+ *  SENSOR_GATEWAY_ROLE, which STACK_OFFSET accounts for.
+ *  Ingesting only updates the entry and queues it, so the worker keeps up
+ *  with the channel however slow the terminal is.
+ *
+ *  sensorGateway_worker streams the queued entries through the interrupt
+ *  driven UART2, without ever waiting for it: an entry is only written if
+ *  its whole record fits into the transmit buffer. Updates of an entry that
+ *  is still queued are coalesced, the feed then skips intermediate values.
+ *  sensorGateway_export writes all entries with their statistics.
+ *
+ *  CSV records are lines:
+ *    U,<address>,<sensor>,<parameter>,<time ms>,<value>
+ *    E,<address>,<sensor>,<parameter>,<time ms>,<value>,<min>,<max>,<mean>,<count>
+ *  Binary records are [SENSOR_GATEWAY_SYNC][type 'U' or 'E'][address][sensor]
+ *  [parameter][time uint32][value float], 'E' adds [min float][max float]
+ *  [mean float][count uint16], all little endian and followed by the CRC-16
+ *  of the bytes between sync and CRC. tools/gatewayfeed.py decodes them.
+ *
+ *  Values of parameter types with a fractional unit are taken as floats,
+ *  the others as unsigned integers (see sensorSamples_isFractional).
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef SENSOR_GATEWAY_H_
+#define SENSOR_GATEWAY_H_
+
+#include "sensorSamples.h"
+#include "../lib/defines.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! First byte of a binary record, differs from TERMINAL_LOG_BINARY_SYNC
+#define SENSOR_GATEWAY_SYNC 0xA6
+
+//! How the records are written
+typedef enum SensorGatewayFormat
+{
+	SENSOR_GATEWAY_FORMAT_OFF,
+	SENSOR_GATEWAY_FORMAT_CSV,
+	SENSOR_GATEWAY_FORMAT_BINARY
+} sensor_gateway_format_t;
+
+//! Last value and statistics of one parameter of one node, as sensorGateway_get returns it
+typedef struct SensorGatewayEntry
+{
+	address_t srcAddr;
+	uint8_t sensor;
+	uint8_t paramType;
+	float value;
+	//! System time (ms) the value was taken
+	time_t time;
+	float min;
+	float max;
+	//! Sum of the values, the mean is sum / count
+	float sum;
+	//! Number of values, halved with the sum before it overflows
+	uint8_t count;
+} sensor_gateway_entry_t;
+
+//! Statistics since the last sensorGateway_resetStats
+typedef struct SensorGatewayStats
+{
+	//! Values that have been ingested
+	uint16_t updates;
+	//! Values that were dropped because the table was full
+	uint16_t tableFull;
+	//! Updates the feed skipped since the entry was still queued
+	uint16_t coalesced;
+	//! Records written by the feed
+	uint16_t records;
+} sensor_gateway_stats_t;
+
+extern sensor_gateway_stats_t sensorGateway_stats;
+
+//! Clears the table and starts ingesting the received values, call after rfAdapter_init
+void sensorGateway_init(sensor_gateway_format_t format);
+
+//! Stores a value, age is the time (ms) between taking and receiving it
+void sensorGateway_ingest(address_t srcAddr, sensor_type_t sensor, sensor_parameter_type_t paramType, float value, time_t age);
+
+//! Copies the entry of a parameter, returns false if there is none
+bool sensorGateway_get(address_t srcAddr, sensor_type_t sensor, sensor_parameter_type_t paramType, sensor_gateway_entry_t *entry);
+
+//! Writes the queued entries as far as the UART2 transmit buffer takes them without waiting, call regularly
+void sensorGateway_worker(void);
+
+//! Writes all entries with their statistics, yields while the transmit buffer is full
+void sensorGateway_export(void);
+
+//! Resets sensorGateway_stats
+void sensorGateway_resetStats(void);
+
+#endif /* SENSOR_GATEWAY_H_ */
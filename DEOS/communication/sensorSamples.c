@@ -0,0 +1,346 @@
+/*!
+ *  \brief Compact fixed-point encoding of sensor values, several samples per frame.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#define LOG_MODULE SENSOR
+
+#include "sensorSamples.h"
+#include "../lib/terminal.h"
+#include "../os_scheduler.h"
+
+#include <avr/pgmspace.h>
+#include <string.h>
+
+//----------------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------------
+
+//! Bits of the code of a sample: age flag, sensor type - 1, parameter type - 1
+#define SENSOR_SAMPLES_AGE_FLAG 0x80
+#define SENSOR_SAMPLES_SENSOR_SHIFT 3
+#define SENSOR_SAMPLES_TYPE_MASK 0x07
+
+//! Number of sensor and parameter types the code can hold
+#define SENSOR_SAMPLES_TYPE_COUNT 8
+
+//! Values beyond this can't be encoded in any unit and are not scaled further
+#define SENSOR_SAMPLES_VALUE_LIMIT 0x1000000L
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! Unit of the encoded value is 10^exponent, encoded value 0 means offset units
+typedef struct SensorSamplesScale
+{
+	int8_t exponent;
+	int32_t offset;
+} sensor_samples_scale_t;
+
+//! Scale per parameter type, indexed by sensor_parameter_type_t - 1
+static const sensor_samples_scale_t sensorSamples_scales[SENSOR_SAMPLES_TYPE_COUNT] PROGMEM = {
+	{-2, 0},	  // PARAM_TEMPERATURE_CELSIUS: 0.01 degree, +-327 degree
+	{-2, 0},	  // PARAM_HUMIDITY_PERCENT: 0.01 %
+	{-2, 0},	  // PARAM_LIGHT_INTENSITY_PERCENT: 0.01 %
+	{-1, 0},	  // PARAM_ALTITUDE_M: 0.1 m, +-3276 m
+	{0, 100000},  // PARAM_PRESSURE_PASCAL: 1 Pa, 67233 - 132767 Pa
+	{0, 32768},	  // PARAM_E_CO2_PPM: 1 ppm, 0 - 65535 ppm
+	{0, 32768},	  // PARAM_TVOC_PPB: 1 ppb, 0 - 65535 ppb
+	{0, 32768},	  // PARAM_CO2_PPM: 1 ppm, 0 - 65535 ppm
+};
+
+//! A sample that waits for sensorSamples_flush
+typedef struct SensorSamplesPending
+{
+	uint8_t code;
+	int16_t value;
+	time_t time;
+} sensor_samples_pending_t;
+
+sensor_samples_pending_t sensorSamples_pending[SENSOR_SAMPLES_MAX_COUNT];
+
+//! Number of entries in sensorSamples_pending
+uint8_t sensorSamples_count = 0;
+
+//! Where the pending samples are sent to
+address_t sensorSamples_destAddr;
+
+//! Is called for every received sample, NULL to log them
+void (*sensorSamples_receiver)(address_t srcAddr, const sensor_sample_t *sample) = NULL;
+
+//----------------------------------------------------------------------------
+// Implementation
+//----------------------------------------------------------------------------
+
+/*!
+ *  Converts a fixed-point value to the unit of its parameter type. The
+ *  result is rounded and limited to what the encoding can hold.
+ *
+ *  \param paramType Parameter type, selects the unit
+ *  \param value Mantissa of the value
+ *  \param exponent The value is value * 10^exponent
+ *  \return The encoded value
+ */
+int16_t sensorSamples_encodeValue(sensor_parameter_type_t paramType, int32_t value, int8_t exponent)
+{
+	sensor_samples_scale_t scale;
+	memcpy_P(&scale, &sensorSamples_scales[paramType - 1], sizeof(scale));
+
+	for (; exponent > scale.exponent && value < SENSOR_SAMPLES_VALUE_LIMIT && value > -SENSOR_SAMPLES_VALUE_LIMIT; exponent--)
+	{
+		value *= 10;
+	}
+	for (; exponent < scale.exponent; exponent++)
+	{
+		int8_t const remainder = value % 10;
+		value = value / 10 + (remainder >= 5) - (remainder <= -5);
+	}
+
+	if (value <= INT16_MIN + scale.offset)
+	{
+		return INT16_MIN;
+	}
+	if (value >= INT16_MAX + scale.offset)
+	{
+		return INT16_MAX;
+	}
+	return value - scale.offset;
+}
+
+/*!
+ *  Converts an encoded value back. Parameter types with a fractional unit
+ *  are decoded to fValue, the others to uValue.
+ *
+ *  \param paramType Parameter type, selects the unit
+ *  \param value The encoded value
+ *  \param param Receives the decoded value
+ */
+void sensorSamples_decodeValue(sensor_parameter_type_t paramType, int16_t value, sensor_parameter_t *param)
+{
+	sensor_samples_scale_t scale;
+	memcpy_P(&scale, &sensorSamples_scales[paramType - 1], sizeof(scale));
+
+	int32_t decoded = value + scale.offset;
+	if (scale.exponent < 0)
+	{
+		float fValue = decoded;
+		for (int8_t exponent = scale.exponent; exponent < 0; exponent++)
+		{
+			fValue /= 10;
+		}
+		param->fValue = fValue;
+	}
+	else
+	{
+		for (int8_t exponent = scale.exponent; exponent > 0; exponent--)
+		{
+			decoded *= 10;
+		}
+		param->uValue = decoded;
+	}
+}
+
+/*!
+ *  \param paramType A valid parameter type
+ *  \return True if values of the parameter type are decoded to fValue, false for uValue
+ */
+bool sensorSamples_isFractional(sensor_parameter_type_t paramType)
+{
+	return (int8_t)pgm_read_byte(&sensorSamples_scales[paramType - 1].exponent) < 0;
+}
+
+/*!
+ *  Encodes a sample without its age, e.g. to store it until it's sent
+ *
+ *  \param sensor Sensor that took the sample
+ *  \param paramType Parameter the value belongs to
+ *  \param value Mantissa of the value, e.g. 234 for 23.4 degree
+ *  \param exponent The value is value * 10^exponent, e.g. -1 for tenths
+ *  \param code Receives the code of sensor and parameter type
+ *  \param encoded Receives the value in the unit of the parameter type
+ *  \return False if sensor or parameter type can't be encoded
+ */
+bool sensorSamples_encode(sensor_type_t sensor, sensor_parameter_type_t paramType, int32_t value, int8_t exponent, uint8_t *code, int16_t *encoded)
+{
+	if (sensor < 1 || sensor > SENSOR_SAMPLES_TYPE_COUNT || paramType < 1 || paramType > SENSOR_SAMPLES_TYPE_COUNT)
+	{
+		return false;
+	}
+
+	*code = ((sensor - 1) << SENSOR_SAMPLES_SENSOR_SHIFT) | (paramType - 1);
+	*encoded = sensorSamples_encodeValue(paramType, value, exponent);
+	return true;
+}
+
+/*!
+ *  Adds a sample to the samples waiting for sensorSamples_flush. Samples
+ *  for another address and a full frame are sent first.
+ *
+ *  \param destAddr Where to send the sample
+ *  \param sensor Sensor that took the sample
+ *  \param paramType Parameter the value belongs to
+ *  \param value Mantissa of the value, e.g. 234 for 23.4 degree
+ *  \param exponent The value is value * 10^exponent, e.g. -1 for tenths
+ *  \return False if sensor or parameter type can't be encoded
+ */
+bool sensorSamples_add(address_t destAddr, sensor_type_t sensor, sensor_parameter_type_t paramType, int32_t value, int8_t exponent)
+{
+	uint8_t code;
+	int16_t encoded;
+	if (!sensorSamples_encode(sensor, paramType, value, exponent, &code, &encoded))
+	{
+		return false;
+	}
+
+	os_enterCriticalSection();
+	while (sensorSamples_count && (sensorSamples_destAddr != destAddr || sensorSamples_count == SENSOR_SAMPLES_MAX_COUNT))
+	{
+		os_leaveCriticalSection();
+		sensorSamples_flush();
+		os_enterCriticalSection();
+	}
+
+	sensor_samples_pending_t *const pending = &sensorSamples_pending[sensorSamples_count++];
+	sensorSamples_destAddr = destAddr;
+	pending->code = code;
+	pending->value = encoded;
+	pending->time = getSystemTime_ms();
+	os_leaveCriticalSection();
+	return true;
+}
+
+/*!
+ *  Sends the waiting samples in one CMD_SENSOR_SAMPLES frame. Samples that
+ *  were added at least half an age unit ago get their age attached.
+ */
+void sensorSamples_flush(void)
+{
+	uint8_t records[SENSOR_SAMPLES_MAX_COUNT * SENSOR_SAMPLES_MAX_RECORD_LENGTH];
+	uint8_t length = 0;
+
+	os_enterCriticalSection();
+	if (!sensorSamples_count)
+	{
+		os_leaveCriticalSection();
+		return;
+	}
+
+	time_t const now = getSystemTime_ms();
+	for (uint8_t i = 0; i < sensorSamples_count; i++)
+	{
+		sensor_samples_pending_t const *pending = &sensorSamples_pending[i];
+		time_t const age = (now - pending->time + SENSOR_SAMPLES_AGE_UNIT_MS / 2) / SENSOR_SAMPLES_AGE_UNIT_MS;
+
+		records[length++] = pending->code | (age ? SENSOR_SAMPLES_AGE_FLAG : 0);
+		memcpy(&records[length], &pending->value, sizeof(pending->value));
+		length += sizeof(pending->value);
+		if (age)
+		{
+			records[length++] = age < UINT8_MAX ? age : UINT8_MAX;
+		}
+	}
+	address_t const destAddr = sensorSamples_destAddr;
+	sensorSamples_count = 0;
+	os_leaveCriticalSection();
+
+	rfAdapter_sendSensorSamples(destAddr, length, records);
+}
+
+/*!
+ *  Sets the function that is called by the worker for every received
+ *  sample, e.g. to display or forward it
+ *
+ *  \param receiver The function, NULL to only log the samples
+ */
+void sensorSamples_setReceiver(void (*receiver)(address_t srcAddr, const sensor_sample_t *sample))
+{
+	os_enterCriticalSection();
+	sensorSamples_receiver = receiver;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Decodes a sample and passes it to the receiver
+ *
+ *  \param srcAddr Sender of the sample
+ *  \param code Code of sensor and parameter type, without age flag
+ *  \param value The encoded value
+ *  \param age Time in ms between taking the sample and sending it
+ */
+static void sensorSamples_deliver(address_t srcAddr, uint8_t code, int16_t value, time_t age)
+{
+	sensor_sample_t sample;
+	sample.sensor = ((code >> SENSOR_SAMPLES_SENSOR_SHIFT) & SENSOR_SAMPLES_TYPE_MASK) + 1;
+	sample.paramType = (code & SENSOR_SAMPLES_TYPE_MASK) + 1;
+	sample.age = age;
+	sensorSamples_decodeValue(sample.paramType, value, &sample.param);
+
+	if (sensorSamples_receiver)
+	{
+		sensorSamples_receiver(srcAddr, &sample);
+	}
+	else
+	{
+		DEBUG("Sample from 0x%x: sensor %u, parameter %u, value %d, age %lu ms", srcAddr, sample.sensor, sample.paramType, value, sample.age);
+	}
+}
+
+/*!
+ *  Decodes the samples of a frame and passes them to the receiver. A sample
+ *  that is cut off at the end of the frame is ignored.
+ *
+ *  \param frame Received frame with command CMD_SENSOR_SAMPLES
+ */
+void sensorSamples_receive(const frame_view_t *frame)
+{
+	uint8_t offset = sizeof(command_t);
+	while (offset + SENSOR_SAMPLES_RECORD_LENGTH <= frame->header.length)
+	{
+		uint8_t const code = serialAdapter_viewByte(frame, offset);
+		int16_t buffer;
+		int16_t const value = *(const int16_t *)serialAdapter_viewData(frame, offset + sizeof(code), sizeof(buffer), &buffer);
+		offset += SENSOR_SAMPLES_RECORD_LENGTH;
+
+		time_t age = 0;
+		if (code & SENSOR_SAMPLES_AGE_FLAG)
+		{
+			if (offset >= frame->header.length)
+			{
+				return;
+			}
+			age = (time_t)serialAdapter_viewByte(frame, offset++) * SENSOR_SAMPLES_AGE_UNIT_MS;
+		}
+
+		sensorSamples_deliver(frame->header.srcAddr, code & ~SENSOR_SAMPLES_AGE_FLAG, value, age);
+	}
+}
+
+/*!
+ *  Decodes the samples of a backlog frame and passes them to the receiver.
+ *  The base age of the frame is the age of its oldest sample, every record
+ *  tells how much newer its sample is.
+ *
+ *  \param frame Received frame with command CMD_SENSOR_BACKLOG
+ */
+void sensorSamples_receiveBacklog(const frame_view_t *frame)
+{
+	uint16_t buffer;
+	time_t const baseAge = *(const uint16_t *)serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
+
+	uint8_t offset = sizeof(command_t) + sizeof(uint16_t);
+	while (offset + SENSOR_SAMPLES_BACKLOG_RECORD_LENGTH <= frame->header.length)
+	{
+		uint8_t const code = serialAdapter_viewByte(frame, offset);
+		int16_t valueBuffer;
+		int16_t const value = *(const int16_t *)serialAdapter_viewData(frame, offset + sizeof(code), sizeof(valueBuffer), &valueBuffer);
+		uint8_t const newer = serialAdapter_viewByte(frame, offset + SENSOR_SAMPLES_RECORD_LENGTH);
+		offset += SENSOR_SAMPLES_BACKLOG_RECORD_LENGTH;
+
+		time_t const age = newer < baseAge ? baseAge - newer : 0;
+		sensorSamples_deliver(frame->header.srcAddr, code & ~SENSOR_SAMPLES_AGE_FLAG, value, age * SENSOR_SAMPLES_BACKLOG_AGE_UNIT_MS);
+	}
+}
@@ -0,0 +1,85 @@
+/*!
+ *  \brief Compact fixed-point encoding of sensor values, several samples per frame.
+ *
+ *  A sample of CMD_SENSOR_SAMPLES takes 3 bytes instead of the 8 byte payload
+ *  of CMD_SENSOR_DATA: a code for sensor and parameter type and a 16 bit
+ *  value in the unit of the parameter type (see sensorSamples.c). If the
+ *  sample has been taken before the frame was sent, the value is followed by
+ *  its age. Senders pass fixed-point values, e.g. tenths of degree Celsius,
+ *  so no floats are needed to send.
+ *
+ *  CMD_SENSOR_BACKLOG carries samples that may be hours old, see
+ *  sensorBuffer.h. Its payload starts with the age of the oldest sample in
+ *  seconds (16 bit), every record ends with the seconds its sample is newer.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef SENSOR_SAMPLES_H_
+#define SENSOR_SAMPLES_H_
+
+#include "rfAdapter.h"
+#include "rfReliable.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Unit of the age of a sample, ages are limited to 255 units
+#define SENSOR_SAMPLES_AGE_UNIT_MS 100
+
+//! Bytes of a sample without and with age
+#define SENSOR_SAMPLES_RECORD_LENGTH (sizeof(uint8_t) + sizeof(int16_t))
+#define SENSOR_SAMPLES_MAX_RECORD_LENGTH (SENSOR_SAMPLES_RECORD_LENGTH + sizeof(uint8_t))
+
+//! Samples that fit into one frame even if all of them have an age and the frame is sent reliably
+#define SENSOR_SAMPLES_MAX_COUNT ((RF_RELIABLE_MAX_INNER_FRAME_LENGTH - sizeof(command_t)) / SENSOR_SAMPLES_MAX_RECORD_LENGTH)
+
+//! Unit of the ages of CMD_SENSOR_BACKLOG
+#define SENSOR_SAMPLES_BACKLOG_AGE_UNIT_MS 1000
+
+//! Bytes of a CMD_SENSOR_BACKLOG record, it always has an age
+#define SENSOR_SAMPLES_BACKLOG_RECORD_LENGTH SENSOR_SAMPLES_MAX_RECORD_LENGTH
+
+//! Records of a reliably sent CMD_SENSOR_BACKLOG frame
+#define SENSOR_SAMPLES_BACKLOG_MAX_COUNT ((RF_RELIABLE_MAX_INNER_FRAME_LENGTH - sizeof(command_t) - sizeof(uint16_t)) / SENSOR_SAMPLES_BACKLOG_RECORD_LENGTH)
+
+//! A received sample. Parameter types with a fractional unit are decoded to fValue, the others to uValue.
+typedef struct SensorSample
+{
+	sensor_type_t sensor;
+	sensor_parameter_type_t paramType;
+	sensor_parameter_t param;
+	//! Time in ms between taking the sample and sending it
+	time_t age;
+} sensor_sample_t;
+
+//! Encodes sensor and parameter type to code and the value to encoded, returns false if they can't be encoded
+bool sensorSamples_encode(sensor_type_t sensor, sensor_parameter_type_t paramType, int32_t value, int8_t exponent, uint8_t *code, int16_t *encoded);
+
+//! Converts `value * 10^exponent` to the 16 bit unit of the parameter type, rounded and limited
+int16_t sensorSamples_encodeValue(sensor_parameter_type_t paramType, int32_t value, int8_t exponent);
+
+//! Converts a value in the unit of the parameter type back to fValue or uValue
+void sensorSamples_decodeValue(sensor_parameter_type_t paramType, int16_t value, sensor_parameter_t *param);
+
+//! Returns true if the parameter type has a fractional unit, its values are floats then
+bool sensorSamples_isFractional(sensor_parameter_type_t paramType);
+
+//! Adds a sample with the value `value * 10^exponent` to the samples waiting for destAddr
+bool sensorSamples_add(address_t destAddr, sensor_type_t sensor, sensor_parameter_type_t paramType, int32_t value, int8_t exponent);
+
+//! Sends the waiting samples in one CMD_SENSOR_SAMPLES frame
+void sensorSamples_flush(void);
+
+//! Sets the function that is called for every received sample, NULL logs them
+void sensorSamples_setReceiver(void (*receiver)(address_t srcAddr, const sensor_sample_t *sample));
+
+//! Is called by the rfAdapter on CMD_SENSOR_SAMPLES receive
+void sensorSamples_receive(const frame_view_t *frame);
+
+//! Is called by the rfAdapter on CMD_SENSOR_BACKLOG receive
+void sensorSamples_receiveBacklog(const frame_view_t *frame);
+
+#endif /* SENSOR_SAMPLES_H_ */
@@ -6,13 +6,17 @@
  *  \version  1.0
  */
 
+#define LOG_MODULE SERIAL_ADAPTER
+
 #include "serialAdapter.h"
+#include "../lib/crc16.h"
 #include "../lib/lcd.h"
 #include "../lib/util.h"
 #include "../os_core.h"
 #include "../lib/terminal.h"
 #include "../os_scheduler.h"
 #include "rfAdapter.h"
+#include "tdma.h"
 #include "xbee.h"
 
 #include <avr/interrupt.h>
@@ -28,6 +32,90 @@
 //! Timeout for receiving frames
 #define SERIAL_ADAPTER_READ_TIMEOUT_MS ((time_t)500)
 
+//! Results of serialAdapter_parseByte
+#define SERIAL_ADAPTER_PARSE_INCOMPLETE 0
+#define SERIAL_ADAPTER_PARSE_COMPLETE 1
+#define SERIAL_ADAPTER_PARSE_REJECTED 2
+#define SERIAL_ADAPTER_PARSE_FOREIGN 3
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! State of the incremental frame parser. The candidate stays in the receive buffer.
+typedef struct SerialAdapterParser
+{
+	//! Offset of the current frame candidate in the receive buffer, the bytes before belong to queued frames
+	uint8_t start;
+	//! Number of bytes that belong to the candidate
+	uint8_t count;
+	//! Header of the candidate, filled while it is received
+	frame_header_t header;
+	//! Checksum over the bytes of the candidate received so far, without footer
+	checksum_t checksum;
+	//! Bytes of a foreign frame that still have to be skipped
+	uint8_t discard;
+	//! When the first byte of the candidate arrived
+	time_t startTime;
+} serial_adapter_parser_t;
+
+serial_adapter_parser_t serialAdapter_parser;
+
+//! Validated frame that waits in the receive buffer for being processed
+typedef struct SerialAdapterQueuedFrame
+{
+	frame_view_t view;
+	//! Offset behind the frame in the receive buffer
+	uint8_t end;
+	//! Set if the arrival time of the first byte is known
+	bool timestamped;
+	//! System time (us) the first byte of the frame arrived
+	time_t rxTime;
+} serial_adapter_queued_frame_t;
+
+serial_adapter_queued_frame_t serialAdapter_frameQueue[SERIAL_ADAPTER_FRAME_QUEUE_LENGTH];
+
+//! Index of the oldest frame in serialAdapter_frameQueue
+uint8_t serialAdapter_frameQueueHead = 0;
+
+//! Number of frames in serialAdapter_frameQueue
+uint8_t serialAdapter_frameQueueCount = 0;
+
+//! Frames waiting for being transmitted, the oldest one is being transmitted
+frame_t serialAdapter_txQueue[SERIAL_ADAPTER_TX_QUEUE_LENGTH];
+
+//! Index of the oldest frame in serialAdapter_txQueue
+volatile uint8_t serialAdapter_txQueueHead = 0;
+
+//! Number of frames in serialAdapter_txQueue
+volatile uint8_t serialAdapter_txQueueCount = 0;
+
+//! Number of bytes of the oldest frame that have been transmitted
+uint8_t serialAdapter_txPosition = 0;
+
+//! Checksum over the transmitted bytes of the oldest frame
+checksum_t serialAdapter_txChecksum;
+
+//! If set, frames are sent with the legacy XOR checksum for peers without CRC support
+bool serialAdapter_legacyChecksum = false;
+
+//! If set, frames with serialAdapter_txStampCommand are stamped when their first byte is transmitted
+bool serialAdapter_txStamping = false;
+
+//! Command of the frames whose transmission time is recorded
+command_t serialAdapter_txStampCommand;
+
+//! System time (us) the first byte of the last stamped frame was transmitted
+volatile time_t serialAdapter_txStampTime;
+
+//! Set when a frame has been stamped, cleared by serialAdapter_getTxTimestamp
+volatile bool serialAdapter_txStamped = false;
+
+//! Bit address % 8 of byte address / 8 is set if this microcontroller is a member of the group address
+uint8_t serialAdapter_groups[SERIAL_ADAPTER_GROUP_BITMAP_LENGTH];
+
+serial_adapter_stats_t serialAdapter_stats;
+
 //----------------------------------------------------------------------------
 // Forward declarations
 //----------------------------------------------------------------------------
@@ -41,6 +129,19 @@ void serialAdapter_calculateFrameChecksum(checksum_t *checksum, frame_t *frame);
 //! Returns true if timestamp + timeoutMs is a timestamp in the past
 bool serialAdapter_hasTimeout(time_t timestamp, time_t timeoutMs);
 
+/*!
+ *  Adds one byte to a frame checksum
+ *
+ *  \param checksum Checksum of the previous bytes of the frame
+ *  \param byte The next byte
+ *  \param legacy True for the XOR checksum, false for the CRC
+ *  \return Checksum including byte
+ */
+static inline checksum_t serialAdapter_updateChecksum(checksum_t checksum, uint8_t byte, bool legacy)
+{
+	return legacy ? checksum ^ byte : crc16_update(checksum, byte);
+}
+
 //----------------------------------------------------------------------------
 // Given functions
 //----------------------------------------------------------------------------
@@ -72,55 +173,303 @@ void serialAdapter_waitForAnyByte()
 // Your Homework
 //----------------------------------------------------------------------------
 
+/*!
+ *  Provides the bytes of the queued frames to the UART1 transmit interrupt.
+ *  The checksum is calculated on the way. Runs in interrupt context.
+ *
+ *  \return The next byte to transmit, -1 if the queue is empty
+ */
+static int16_t serialAdapter_nextTxByte(void)
+{
+	if (!serialAdapter_txQueueCount)
+	{
+		return -1;
+	}
+
+	frame_t *const frame = &serialAdapter_txQueue[serialAdapter_txQueueHead];
+	bool const legacy = frame->header.startFlag != COMM_CRC_START_FLAG;
+	uint8_t const footerStart = COMM_HEADER_LENGTH + frame->header.length;
+
+	if (serialAdapter_txPosition == 0)
+	{
+		// While the XBee is configured the frame waits until xbee_configureLink restarts the transmission
+		if (xbee_isTransmissionHeld())
+		{
+			return -1;
+		}
+		// With TDMA the frame waits for the next slot, tdma_worker restarts the transmission then
+		if (!tdma_mayTransmit(footerStart + (legacy ? COMM_LEGACY_FOOTER_LENGTH : COMM_FOOTER_LENGTH)))
+		{
+			return -1;
+		}
+		serialAdapter_txChecksum = legacy ? INITIAL_CHECKSUM_VALUE : CRC16_INITIAL_VALUE;
+		if (serialAdapter_txStamping && frame->innerFrame.command == serialAdapter_txStampCommand)
+		{
+			serialAdapter_txStampTime = getSystemTime_us();
+			serialAdapter_txStamped = true;
+		}
+	}
+
+	// Header and inner frame are contiguous
+	if (serialAdapter_txPosition < footerStart)
+	{
+		uint8_t const byte = ((uint8_t *)frame)[serialAdapter_txPosition++];
+		serialAdapter_txChecksum = serialAdapter_updateChecksum(serialAdapter_txChecksum, byte, legacy);
+		return byte;
+	}
+
+	// Footer, low byte first, the legacy footer only has the low byte
+	uint8_t const footerIndex = serialAdapter_txPosition++ - footerStart;
+	uint8_t const byte = footerIndex ? HIGH(serialAdapter_txChecksum) : LOW(serialAdapter_txChecksum);
+	if (footerIndex + 1 == (legacy ? COMM_LEGACY_FOOTER_LENGTH : COMM_FOOTER_LENGTH))
+	{
+		serialAdapter_txPosition = 0;
+		serialAdapter_txQueueHead = (serialAdapter_txQueueHead + 1) % SERIAL_ADAPTER_TX_QUEUE_LENGTH;
+		serialAdapter_txQueueCount--;
+	}
+	return byte;
+}
+
 /*!
  *  Initializes the serialAdapter and their dependencies
  */
 void serialAdapter_init(void)
 {
 	xbee_init();
+	xbee_setTxSource(serialAdapter_nextTxByte);
+}
+
+/*!
+ *  Selects the checksum of transmitted frames. Received frames are accepted
+ *  with both checksums, so only peers that don't know the CRC need this.
+ *
+ *  \param enable True to send the legacy XOR checksum instead of the CRC
+ */
+void serialAdapter_setLegacyChecksum(bool enable)
+{
+	serialAdapter_legacyChecksum = enable;
+}
+
+/*!
+ *  Records when frames are transmitted and received, e.g. for synchronizing
+ *  clocks. Received frames are stamped when the first byte of their start
+ *  flag arrives, so only frames with the CRC start flag get a timestamp.
+ *  Transmitted frames are stamped when their first byte is handed to the
+ *  UART, only those with the given command.
+ *
+ *  \param enable True to record the times, false to stop
+ *  \param command Command of the transmitted frames that are stamped
+ */
+void serialAdapter_setTimestamping(bool enable, command_t command)
+{
+	start_flag_t const startFlag = COMM_CRC_START_FLAG;
+
+	os_enterCriticalSection();
+	serialAdapter_txStampCommand = command;
+	serialAdapter_txStamping = enable;
+	serialAdapter_txStamped = false;
+	os_leaveCriticalSection();
+
+	// The start flag is transmitted in memory order
+	xbee_setRxTimestampMarker(enable ? *(const uint8_t *)&startFlag : -1);
+}
+
+/*!
+ *  Returns when the frame that is being processed arrived. Only valid in
+ *  serialAdapter_processFrame and the inline handlers it calls.
+ *
+ *  \param time Reference parameter that receives the system time (us) the first byte arrived
+ *  \return False if the time isn't known, e.g. timestamping is off or the frame waited too long
+ */
+bool serialAdapter_getRxTimestamp(time_t *time)
+{
+	serial_adapter_queued_frame_t const *queued = &serialAdapter_frameQueue[serialAdapter_frameQueueHead];
+
+	*time = queued->rxTime;
+	return serialAdapter_frameQueueCount && queued->timestamped;
+}
+
+/*!
+ *  Returns when the last frame with the stamped command has been transmitted
+ *
+ *  \param time Reference parameter that receives the system time (us) its first byte was handed to the UART
+ *  \return False if no such frame has been transmitted since the last call
+ */
+bool serialAdapter_getTxTimestamp(time_t *time)
+{
+	// The transmit interrupt writes the time, a critical section doesn't keep it out
+	uint8_t const ie = gbi(SREG, 7);
+	cli();
+	bool const stamped = serialAdapter_txStamped;
+	*time = serialAdapter_txStampTime;
+	serialAdapter_txStamped = false;
+	if (ie)
+	{
+		sei();
+	}
+
+	return stamped;
 }
 
 /*!
- *  Sends a frame with given innerFrame
+ *  Makes this microcontroller receive the frames sent to a group address.
+ *  Any address can be used as group address, e.g. ADDRESS(teamId, subId)
+ *  with a subId no microcontroller of the team has.
+ *
+ *  \param group The group address
+ */
+void serialAdapter_joinGroup(address_t group)
+{
+	os_enterCriticalSection();
+	serialAdapter_groups[group / 8] |= 1 << (group % 8);
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Stops receiving the frames sent to a group address
+ *
+ *  \param group The group address
+ */
+void serialAdapter_leaveGroup(address_t group)
+{
+	os_enterCriticalSection();
+	serialAdapter_groups[group / 8] &= ~(1 << (group % 8));
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  \param destAddr Destination of a received frame
+ *  \return True if the frame is addressed to this microcontroller, to everyone or to one of its groups
+ */
+bool serialAdapter_acceptsAddress(address_t destAddr)
+{
+	return destAddr == serialAdapter_address || destAddr == ADDRESS_BROADCAST || (serialAdapter_groups[destAddr / 8] & (1 << (destAddr % 8)));
+}
+
+/*!
+ *  Copies the statistics at once, the counters of the receive path are
+ *  updated by the worker
+ *
+ *  \param stats Reference parameter that receives serialAdapter_stats
+ */
+void serialAdapter_getStats(serial_adapter_stats_t *stats)
+{
+	os_enterCriticalSection();
+	*stats = serialAdapter_stats;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Resets the statistics, e.g. before a measurement
+ */
+void serialAdapter_resetStats(void)
+{
+	os_enterCriticalSection();
+	memset(&serialAdapter_stats, 0, sizeof(serialAdapter_stats));
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Queues a frame for transmission without waiting, see serialAdapter_tryWriteFrame
  *
  *  \param destAddr where to send the frame to
  *  \param length how many bytes the innerFrame has
- *  \param innerFrame buffer as payload of the frame
+ *  \param innerFrame buffer as payload of the frame, can be reused right away
+ *  \param countFull True to count a full transmit queue in serialAdapter_stats
+ *  \return SERIAL_ADAPTER_SUCCESS, SERIAL_ADAPTER_TX_QUEUE_FULL if the frame has not been queued
+ *           or SERIAL_ADAPTER_INVALID if length is 0 or exceeds COMM_MAX_INNER_FRAME_LENGTH
  */
-void serialAdapter_writeFrame(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame)
+static uint8_t serialAdapter_queueFrame(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame, bool countFull)
 {
-	
+	// Checked before the copy, the slot only has room for COMM_MAX_INNER_FRAME_LENGTH bytes
+	if (length == 0 || length > COMM_MAX_INNER_FRAME_LENGTH)
+	{
+		return SERIAL_ADAPTER_INVALID;
+	}
 
-	frame_t frame;
-	frame.header.startFlag = serialAdapter_startFlag;
-	frame.header.srcAddr = serialAdapter_address;
-	frame.header.destAddr = destAddr;
-	frame.header.length = length;
-	// Kopiere innerFrame-Daten in frame.innerFrame
-	memcpy(&frame.innerFrame, innerFrame, length);
-	checksum_t checksum = INITIAL_CHECKSUM_VALUE;
-	serialAdapter_calculateFrameChecksum(&checksum, &frame);
+	os_enterCriticalSection();
 
-	
+	// The transmit interrupt advances head and count, a critical section doesn't keep it out
+	uint8_t ie = gbi(SREG, 7);
+	cli();
+	uint8_t const count = serialAdapter_txQueueCount;
+	uint8_t const slot = (serialAdapter_txQueueHead + count) % SERIAL_ADAPTER_TX_QUEUE_LENGTH;
+	if (ie)
+	{
+		sei();
+	}
 
-	// Header senden
-	xbee_writeData(&frame.header.startFlag, sizeof(frame.header.startFlag));
-	xbee_writeData(&frame.header.srcAddr, sizeof(frame.header.srcAddr));
-	xbee_writeData(&frame.header.destAddr, sizeof(frame.header.destAddr));
-	xbee_writeData(&frame.header.length, sizeof(frame.header.length));
-	
+	if (count == SERIAL_ADAPTER_TX_QUEUE_LENGTH)
+	{
+		if (countFull)
+		{
+			serialAdapter_stats.txQueueFull++;
+		}
+		os_leaveCriticalSection();
+		return SERIAL_ADAPTER_TX_QUEUE_FULL;
+	}
 
-	// InnerFrame senden
-	xbee_writeData(innerFrame, length);
+	// The frame is built in its queue slot, the slot is invisible to the interrupt until it's counted
+	frame_t *const frame = &serialAdapter_txQueue[slot];
+	frame->header.startFlag = serialAdapter_legacyChecksum ? serialAdapter_startFlag : COMM_CRC_START_FLAG;
+	frame->header.srcAddr = serialAdapter_address;
+	frame->header.destAddr = destAddr;
+	frame->header.length = length;
+	memcpy(&frame->innerFrame, innerFrame, length);
+	ie = gbi(SREG, 7);
+	cli();
+	serialAdapter_txQueueCount++;
+	if (ie)
+	{
+		sei();
+	}
+	serialAdapter_stats.txFrames++;
+	serialAdapter_stats.txBytes += COMM_HEADER_LENGTH + length + (serialAdapter_legacyChecksum ? COMM_LEGACY_FOOTER_LENGTH : COMM_FOOTER_LENGTH);
 
-	// Footer (Checksum) senden
-	frame.footer.checksum = checksum;
-	DEBUG("Frame sent with Command: %x", frame.innerFrame.command);
-	xbee_writeData(&frame.footer.checksum, sizeof(frame.footer.checksum));
+	os_leaveCriticalSection();
 
+	DEBUG("Frame queued with Command: %x", innerFrame->command);
+	xbee_startTransmission();
+	return SERIAL_ADAPTER_SUCCESS;
+}
 
+/*!
+ *  Queues a frame with given innerFrame for transmission without waiting.
+ *  The frame is transmitted by the UART1 transmit interrupt in the background,
+ *  which also calculates the checksum.
+ *
+ *  \param destAddr where to send the frame to
+ *  \param length how many bytes the innerFrame has
+ *  \param innerFrame buffer as payload of the frame, can be reused right away
+ *  \return SERIAL_ADAPTER_SUCCESS, SERIAL_ADAPTER_TX_QUEUE_FULL if the frame has not been queued
+ *           or SERIAL_ADAPTER_INVALID if length is 0 or exceeds COMM_MAX_INNER_FRAME_LENGTH
+ */
+uint8_t serialAdapter_tryWriteFrame(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame)
+{
+	return serialAdapter_queueFrame(destAddr, length, innerFrame, true);
 }
 
+/*!
+ *  Sends a frame with given innerFrame. If the transmit queue is full, the
+ *  process yields until the oldest frame has been transmitted. Never call it
+ *  from the worker, e.g. in a command handler: with TDMA only the worker
+ *  restarts the held frames, use rfAdapter_reply there. A frame with an
+ *  invalid length (see serialAdapter_tryWriteFrame) is dropped.
+ *
+ *  \param destAddr where to send the frame to
+ *  \param length how many bytes the innerFrame has
+ *  \param innerFrame buffer as payload of the frame
+ */
+void serialAdapter_writeFrame(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame)
+{
+	// A frame that waits is counted as one stall, not once per attempt
+	bool first = true;
+	while (serialAdapter_queueFrame(destAddr, length, innerFrame, first) == SERIAL_ADAPTER_TX_QUEUE_FULL)
+	{
+		first = false;
+		os_yield();
+	}
+}
 
 /*!
  *  Blocks process until byteCount bytes are available to be read.
@@ -136,7 +485,7 @@ bool serialAdapter_waitForData(uint8_t byteCount, time_t frameTimestamp)
 		 if (serialAdapter_hasTimeout(frameTimestamp, SERIAL_ADAPTER_READ_TIMEOUT_MS))
 		 {
 			 // Timeout
-			 
+			 serialAdapter_stats.timeouts++;
 			 return false;
 		 }
 		 os_yield();
@@ -146,91 +495,364 @@ bool serialAdapter_waitForData(uint8_t byteCount, time_t frameTimestamp)
 }
 
 /*!
- *  Reads incoming data and processes it. Needs to be called periodically.
- *  Don't read from UART in any other process while this is running.
+ *  Appends one byte to the current frame candidate. The state of the parser
+ *  follows from the number of bytes collected so far, so the parser can be
+ *  stopped and resumed after every byte.
+ *
+ *  \param byte The next byte in the receive buffer
+ *  \return SERIAL_ADAPTER_PARSE_COMPLETE if the candidate is a frame with a valid
+ *          checksum, SERIAL_ADAPTER_PARSE_REJECTED if it can't be one,
+ *          SERIAL_ADAPTER_PARSE_FOREIGN if its header addresses someone else
  */
-void serialAdapter_worker()
+static uint8_t serialAdapter_parseByte(uint8_t byte)
 {
-		time_t timestamp = getSystemTime_ms();
-		
-		if(!serialAdapter_waitForData(2, timestamp)){
-			return;
-		}
-		
-		uint8_t low, high;
-		
-		xbee_readBuffer(&low, 1);
-		if(low != (uint8_t) serialAdapter_startFlag){
-			return;
+	serial_adapter_parser_t *const parser = &serialAdapter_parser;
+	bool const legacy = parser->header.startFlag != COMM_CRC_START_FLAG;
+
+	if (parser->count < COMM_HEADER_LENGTH)
+	{
+		// Start flag, low byte first. Both flags share their low byte.
+		if (parser->count == 0)
+		{
+			if (byte != LOW(serialAdapter_startFlag) && byte != LOW(COMM_CRC_START_FLAG))
+			{
+				return SERIAL_ADAPTER_PARSE_REJECTED;
+			}
+			parser->startTime = getSystemTime_ms();
 		}
-		xbee_readBuffer(&high, 1);
-		if(high != (serialAdapter_startFlag >> 8)){
-			return;
+
+		((uint8_t *)&parser->header)[parser->count++] = byte;
+
+		if (parser->count == COMM_START_FLAG_LENGTH)
+		{
+			// The start flag selects the checksum
+			if (parser->header.startFlag == COMM_CRC_START_FLAG)
+			{
+				parser->checksum = crc16_updateBuffer(CRC16_INITIAL_VALUE, &parser->header.startFlag, COMM_START_FLAG_LENGTH);
+			}
+			else if (parser->header.startFlag == serialAdapter_startFlag)
+			{
+				parser->checksum = LOW(serialAdapter_startFlag) ^ HIGH(serialAdapter_startFlag);
+			}
+			else
+			{
+				return SERIAL_ADAPTER_PARSE_REJECTED;
+			}
 		}
-			
-		
-		frame_t frame;
-		frame.header.startFlag = serialAdapter_startFlag;
-		time_t startTime = getSystemTime_ms();
-		
-		
-		
-		uint8_t status ;
-		
-		
-
-		status = xbee_readBuffer((uint8_t *)&frame.header.srcAddr, sizeof(frame.header.srcAddr));
-		if (status != XBEE_SUCCESS) { return; }
-
-		status = xbee_readBuffer((uint8_t *)&frame.header.destAddr, sizeof(frame.header.destAddr));
-		if (status != XBEE_SUCCESS) { return; }
-
-		status = xbee_readBuffer((uint8_t *)&frame.header.length, sizeof(frame.header.length));
-		if (status != XBEE_SUCCESS) { return; }
-
-		if (frame.header.length > COMM_MAX_INNER_FRAME_LENGTH)
+		else if (parser->count > COMM_START_FLAG_LENGTH)
 		{
-			// Ungltige Lnge
-			return;
+			parser->checksum = serialAdapter_updateChecksum(parser->checksum, byte, legacy);
 		}
 
-		
-		uint8_t totalNeeded = frame.header.length + COMM_FOOTER_LENGTH;
-		if (!serialAdapter_waitForData(totalNeeded, startTime))
+		if (parser->count == COMM_HEADER_LENGTH)
 		{
-			// Timeout beim Lesen von InnerFrame+Footer
-			return;
+			// Header complete, the length decides whether this can be a frame at all
+			if (parser->header.length == 0 || parser->header.length > COMM_MAX_INNER_FRAME_LENGTH)
+			{
+				serialAdapter_stats.lengthErrors++;
+				return SERIAL_ADAPTER_PARSE_REJECTED;
+			}
+			// Frames for others are not looked at any further
+			if (!serialAdapter_acceptsAddress(parser->header.destAddr))
+			{
+				return SERIAL_ADAPTER_PARSE_FOREIGN;
+			}
 		}
+		return SERIAL_ADAPTER_PARSE_INCOMPLETE;
+	}
 
-		status = xbee_readBuffer((uint8_t *)&frame.innerFrame, frame.header.length);
-		if (status != XBEE_SUCCESS) { return; }
+	uint8_t const footerStart = COMM_HEADER_LENGTH + parser->header.length;
+	if (parser->count < footerStart)
+	{
+		parser->checksum = serialAdapter_updateChecksum(parser->checksum, byte, legacy);
+		parser->count++;
+		return SERIAL_ADAPTER_PARSE_INCOMPLETE;
+	}
 
-		status = xbee_readBuffer((uint8_t *)&frame.footer.checksum, sizeof(frame.footer.checksum));
-		if (status != XBEE_SUCCESS) { return; }
+	// Footer, low byte first, the legacy footer only has the low byte
+	uint8_t const footerIndex = parser->count++ - footerStart;
+	if (byte != (footerIndex ? HIGH(parser->checksum) : LOW(parser->checksum)))
+	{
+		serialAdapter_stats.checksumErrors++;
+		return SERIAL_ADAPTER_PARSE_REJECTED;
+	}
+	return footerIndex + 1 == (legacy ? COMM_LEGACY_FOOTER_LENGTH : COMM_FOOTER_LENGTH) ? SERIAL_ADAPTER_PARSE_COMPLETE : SERIAL_ADAPTER_PARSE_INCOMPLETE;
+}
 
-		checksum_t calcCheck = INITIAL_CHECKSUM_VALUE;
-		serialAdapter_calculateFrameChecksum(&calcCheck, &frame);
-		if (calcCheck != frame.footer.checksum)
-		{	
-			
-			// Prfsumme stimmt nicht
+/*!
+ *  Skips bytes in front of the candidate. They are removed from the receive
+ *  buffer right away unless queued frames are in front of them.
+ *
+ *  \param count Number of bytes to skip
+ */
+static void serialAdapter_skip(uint8_t count)
+{
+	if (serialAdapter_frameQueueCount)
+	{
+		serialAdapter_parser.start += count;
+	}
+	else
+	{
+		xbee_commit(count);
+		serialAdapter_stats.rxBytes += count;
+	}
+}
+
+/*!
+ *  Drops the current candidate. Its bytes after the first start flag byte may
+ *  contain the start of a real frame (e.g. after noise on the line). They are
+ *  still in the receive buffer, so the parser continues right behind the
+ *  first byte of the dropped candidate.
+ */
+static void serialAdapter_rejectCandidate(void)
+{
+	if (serialAdapter_parser.count)
+	{
+		serialAdapter_stats.resyncs++;
+	}
+	else
+	{
+		serialAdapter_stats.garbageBytes++;
+	}
+	serialAdapter_skip(1);
+	serialAdapter_parser.count = 0;
+	serialAdapter_parser.discard = 0;
+}
+
+/*!
+ *  Drops the candidate after its payload and footer have been skipped. The
+ *  header of a foreign frame isn't protected by its checksum before the
+ *  footer, so a corrupted destination costs this frame and, rarely, the
+ *  start of a frame that was hidden in the skipped bytes.
+ */
+static void serialAdapter_discardCandidate(void)
+{
+	serial_adapter_parser_t *const parser = &serialAdapter_parser;
+
+	serialAdapter_stats.foreignFrames++;
+	serialAdapter_stats.foreignBytes += parser->count;
+	serialAdapter_skip(parser->count);
+	parser->count = 0;
+}
+
+/*!
+ *  Queues the completed candidate. The queued frame refers to the inner frame
+ *  in the receive buffer.
+ */
+static void serialAdapter_queueCandidate(void)
+{
+	serial_adapter_parser_t *const parser = &serialAdapter_parser;
+
+	uint8_t const index = (serialAdapter_frameQueueHead + serialAdapter_frameQueueCount) % SERIAL_ADAPTER_FRAME_QUEUE_LENGTH;
+	serial_adapter_queued_frame_t *const queued = &serialAdapter_frameQueue[index];
+	frame_view_t *const view = &queued->view;
+	uint8_t const offset = parser->start + COMM_HEADER_LENGTH;
+
+	view->header = parser->header;
+	view->segmentLength[0] = xbee_peek(offset, &view->segment[0]);
+	if (view->segmentLength[0] >= parser->header.length)
+	{
+		view->segmentLength[0] = parser->header.length;
+		view->segmentLength[1] = 0;
+	}
+	else
+	{
+		// The inner frame continues at the beginning of the receive buffer
+		view->segmentLength[1] = parser->header.length - view->segmentLength[0];
+		xbee_peek(offset + view->segmentLength[0], &view->segment[1]);
+	}
+
+	queued->timestamped = xbee_getRxTimestamp(parser->start, &queued->rxTime);
+	queued->end = parser->start + parser->count;
+	serialAdapter_frameQueueCount++;
+	serialAdapter_stats.rxFrames++;
+	parser->start = queued->end;
+	parser->count = 0;
+}
+
+/*!
+ *  Removes the oldest queued frame from the queue and its bytes from the
+ *  receive buffer. Garbage that has been skipped behind it is removed as well.
+ */
+static void serialAdapter_releaseFrame(void)
+{
+	serial_adapter_queued_frame_t *const queued = &serialAdapter_frameQueue[serialAdapter_frameQueueHead];
+	uint8_t const released = serialAdapter_frameQueueCount > 1 ? queued->end : serialAdapter_parser.start;
+
+	xbee_commit(released);
+	serialAdapter_stats.rxBytes += released;
+	serialAdapter_frameQueueHead = (serialAdapter_frameQueueHead + 1) % SERIAL_ADAPTER_FRAME_QUEUE_LENGTH;
+	serialAdapter_frameQueueCount--;
+
+	// Offsets are relative to the oldest byte in the receive buffer
+	for (uint8_t i = 0; i < serialAdapter_frameQueueCount; i++)
+	{
+		serialAdapter_frameQueue[(serialAdapter_frameQueueHead + i) % SERIAL_ADAPTER_FRAME_QUEUE_LENGTH].end -= released;
+	}
+	serialAdapter_parser.start -= released;
+}
+
+/*!
+ *  Scans the received bytes until the frame queue is full or no byte is
+ *  left. Never waits for data. Bytes are only looked at in the receive
+ *  buffer, they are removed when they turn out to be garbage or after their
+ *  frame has been processed. Payload and footer of frames for others are
+ *  skipped in whole chunks without being looked at.
+ */
+static void serialAdapter_parse(void)
+{
+	serial_adapter_parser_t *const parser = &serialAdapter_parser;
+
+	// The sender stopped in the middle of a frame
+	if (parser->count && serialAdapter_hasTimeout(parser->startTime, SERIAL_ADAPTER_READ_TIMEOUT_MS))
+	{
+		serialAdapter_stats.timeouts++;
+		serialAdapter_rejectCandidate();
+	}
+
+	while (serialAdapter_frameQueueCount < SERIAL_ADAPTER_FRAME_QUEUE_LENGTH)
+	{
+		const uint8_t *data;
+		uint8_t available = xbee_peek(parser->start + parser->count, &data);
+		if (!available)
+		{
 			return;
 		}
 
-		if (frame.header.destAddr != serialAdapter_address && frame.header.destAddr != ADDRESS_BROADCAST)
+		if (parser->discard)
 		{
-			// Nicht fr uns
-			return;
+			uint8_t const count = available < parser->discard ? available : parser->discard;
+			parser->count += count;
+			parser->discard -= count;
+			if (!parser->discard)
+			{
+				serialAdapter_discardCandidate();
+			}
+			continue;
+		}
+
+		uint8_t result;
+		do
+		{
+			result = serialAdapter_parseByte(*data++);
+		} while (result == SERIAL_ADAPTER_PARSE_INCOMPLETE && --available);
+
+		switch (result)
+		{
+			case SERIAL_ADAPTER_PARSE_COMPLETE:
+				serialAdapter_queueCandidate();
+				break;
+			case SERIAL_ADAPTER_PARSE_REJECTED:
+				serialAdapter_rejectCandidate();
+				break;
+			case SERIAL_ADAPTER_PARSE_FOREIGN:
+				parser->discard = parser->header.length + (parser->header.startFlag == COMM_CRC_START_FLAG ? COMM_FOOTER_LENGTH : COMM_LEGACY_FOOTER_LENGTH);
+				break;
+			default:
+				break;
 		}
-		
-		//printFrame(&frame," ");
-		
-		serialAdapter_processFrame(&frame);
+	}
+}
 
-		
+/*!
+ *  Reads incoming data and processes it. Needs to be called periodically.
+ *  Don't read from UART in any other process while this is running.
+ *
+ *  Received bytes are consumed as far as they are available, so the worker never
+ *  waits in the middle of a frame. Processes at most one frame per call and
+ *  yields if there is none. With TDMA, the transmission of held frames is
+ *  restarted when the slot of this node begins.
+ */
+void serialAdapter_worker()
+{
+	xbee_worker();
+	if (tdma_worker() && serialAdapter_txQueueCount)
+	{
+		xbee_startTransmission();
+	}
 
-		// rest 
-	
+	serialAdapter_parse();
+
+	if (!serialAdapter_frameQueueCount)
+	{
+		os_yield();
+		return;
+	}
+
+	serialAdapter_processFrame(&serialAdapter_frameQueue[serialAdapter_frameQueueHead].view);
+	serialAdapter_releaseFrame();
+}
+
+/*!
+ *  \param frame A received frame
+ *  \param index Position in the inner frame, 0 is the command
+ *  \return The byte of the inner frame at index
+ */
+uint8_t serialAdapter_viewByte(const frame_view_t *frame, uint8_t index)
+{
+	if (index < frame->segmentLength[0])
+	{
+		return frame->segment[0][index];
+	}
+	return frame->segment[1][index - frame->segmentLength[0]];
+}
+
+/*!
+ *  Creates a view of a command that is nested in the inner frame of another
+ *  one, e.g. a wrapped or batched command
+ *
+ *  \param frame A received frame
+ *  \param offset Position of the nested command in the inner frame, at most the length of the inner frame
+ *  \param nested Receives the view of the nested command, the header is the one of frame with adjusted length
+ */
+void serialAdapter_subView(const frame_view_t *frame, uint8_t offset, frame_view_t *nested)
+{
+	uint8_t const first = frame->segmentLength[0];
+
+	nested->header = frame->header;
+	nested->header.length -= offset;
+	if (offset < first)
+	{
+		nested->segment[0] = frame->segment[0] + offset;
+		nested->segmentLength[0] = first - offset;
+		nested->segment[1] = frame->segment[1];
+		nested->segmentLength[1] = frame->segmentLength[1];
+	}
+	else
+	{
+		nested->segment[0] = frame->segment[1] + (offset - first);
+		nested->segmentLength[0] = frame->segmentLength[1] - (offset - first);
+		nested->segmentLength[1] = 0;
+	}
+}
+
+/*!
+ *  Gives contiguous access to a part of the inner frame, e.g. to a command
+ *  payload. Only if the part wraps around the end of the receive buffer,
+ *  it's copied to buffer.
+ *
+ *  \param frame A received frame
+ *  \param offset Position of the part in the inner frame, 0 is the command
+ *  \param length Size of the part
+ *  \param buffer At least length bytes that are used if the part needs to be copied
+ *  \return Pointer to the part, valid as long as frame and buffer
+ */
+const void *serialAdapter_viewData(const frame_view_t *frame, uint8_t offset, uint8_t length, void *buffer)
+{
+	uint8_t const first = frame->segmentLength[0];
+
+	if (offset + length <= first)
+	{
+		return &frame->segment[0][offset];
+	}
+	if (offset >= first)
+	{
+		return &frame->segment[1][offset - first];
+	}
+
+	memcpy(buffer, &frame->segment[0][offset], first - offset);
+	memcpy((uint8_t *)buffer + first - offset, frame->segment[1], length - (first - offset));
+	return buffer;
 }
 
 /*!
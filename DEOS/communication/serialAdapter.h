@@ -19,16 +19,38 @@ typedef uint16_t start_flag_t;
 typedef uint8_t address_t;
 typedef uint8_t command_t;
 typedef uint8_t inner_frame_length_t;
-typedef uint8_t checksum_t;
+typedef uint16_t checksum_t;
 
 // Defines
 #define COMM_START_FLAG_LENGTH sizeof(start_flag_t)
 #define COMM_HEADER_LENGTH (COMM_START_FLAG_LENGTH + sizeof(address_t) * 2 + sizeof(inner_frame_length_t))
 #define COMM_FOOTER_LENGTH sizeof(checksum_t)
+#define COMM_LEGACY_FOOTER_LENGTH sizeof(uint8_t)
 #define COMM_MAX_PAYLOAD_LENGTH 48
-#define COMM_MAX_INNER_FRAME_LENGTH (sizeof(checksum_t) + COMM_MAX_PAYLOAD_LENGTH)
+#define COMM_MAX_INNER_FRAME_LENGTH (sizeof(command_t) + COMM_MAX_PAYLOAD_LENGTH)
 #define ADDRESS_BROADCAST ((address_t)255)
 
+//! Announces a frame with CRC-16 footer, serialAdapter_startFlag one with the legacy 8 bit XOR footer
+#define COMM_CRC_START_FLAG ((start_flag_t)0x4346) // "CF"
+
+//! Number of received frames that can wait for being processed
+#ifndef SERIAL_ADAPTER_FRAME_QUEUE_LENGTH
+#define SERIAL_ADAPTER_FRAME_QUEUE_LENGTH 2
+#endif
+
+//! Number of frames that can wait for being transmitted
+#ifndef SERIAL_ADAPTER_TX_QUEUE_LENGTH
+#define SERIAL_ADAPTER_TX_QUEUE_LENGTH 2
+#endif
+
+//! Bytes of the bitmap of joined group addresses, one bit per address
+#define SERIAL_ADAPTER_GROUP_BITMAP_LENGTH ((ADDRESS_BROADCAST + 1) / 8)
+
+// Status codes
+#define SERIAL_ADAPTER_SUCCESS 0
+#define SERIAL_ADAPTER_TX_QUEUE_FULL 1
+#define SERIAL_ADAPTER_INVALID 2
+
 // Structs
 //! Specification of the header of the outer communication frame
 typedef struct FrameHeader
@@ -46,7 +68,8 @@ typedef struct InnerFrame
 	uint8_t payload[COMM_MAX_PAYLOAD_LENGTH];
 } inner_frame_t;
 
-//! Specification of the footer of the outer communication frame
+//! Specification of the footer of the outer communication frame. The CRC is
+//! transmitted low byte first, the legacy XOR checksum only has a low byte.
 typedef struct FrameFooter
 {
 	checksum_t checksum;
@@ -60,14 +83,56 @@ typedef struct Frame
 	frame_footer_t footer;
 } frame_t;
 
+//! A received frame whose inner frame is still in the receive buffer. If the
+//! inner frame wraps around the end of the buffer, it's split in two segments.
+typedef struct FrameView
+{
+	frame_header_t header;
+	const uint8_t *segment[2];
+	uint8_t segmentLength[2];
+} frame_view_t;
+
+//! Statistics of the frame layer since the last serialAdapter_resetStats
+typedef struct SerialAdapterStats
+{
+	//! Frames for other addresses, dropped after their header
+	uint16_t foreignFrames;
+	uint16_t foreignBytes;
+	//! Bytes taken from the receive buffer, garbage included
+	uint32_t rxBytes;
+	//! Bytes of the frames queued for transmission
+	uint32_t txBytes;
+	//! Received frames with a valid checksum for this microcontroller
+	uint16_t rxFrames;
+	//! Frames queued for transmission
+	uint16_t txFrames;
+	//! Candidates whose footer didn't match their checksum
+	uint16_t checksumErrors;
+	//! Candidates with a length of 0 or above COMM_MAX_INNER_FRAME_LENGTH
+	uint16_t lengthErrors;
+	//! Candidates dropped after their first start flag byte, for whatever reason
+	uint16_t resyncs;
+	//! Bytes skipped while searching for a start flag
+	uint16_t garbageBytes;
+	//! Candidates whose sender stopped in the middle, and timeouts of serialAdapter_waitForData
+	uint16_t timeouts;
+	//! Frames that found the transmit queue full, serialAdapter_writeFrame counts once per frame
+	uint16_t txQueueFull;
+} serial_adapter_stats_t;
+
+extern serial_adapter_stats_t serialAdapter_stats;
+
 //! Start-Flag that announces a new frame
 extern start_flag_t serialAdapter_startFlag;
 
 //! Configuration what address this microcontroller has
 extern address_t serialAdapter_address;
 
-//! Is called on command frame receive
-extern void serialAdapter_processFrame(frame_t *frame);
+//! If set, frames are sent with the legacy XOR checksum for peers without CRC support
+extern bool serialAdapter_legacyChecksum;
+
+//! Is called on command frame receive, the frame is released from the receive buffer afterwards
+extern void serialAdapter_processFrame(const frame_view_t *frame);
 
 //! Initializes the serial adapter
 void serialAdapter_init(void);
@@ -75,9 +140,48 @@ void serialAdapter_init(void);
 //! Reads incoming data and processes it
 void serialAdapter_worker(void);
 
-//! Sends a frame with given innerFrame
+//! Selects the legacy XOR checksum instead of the CRC for transmitted frames
+void serialAdapter_setLegacyChecksum(bool enable);
+
+//! Receives the frames sent to group from now on
+void serialAdapter_joinGroup(address_t group);
+
+//! Stops receiving the frames sent to group
+void serialAdapter_leaveGroup(address_t group);
+
+//! Returns true if frames to destAddr are received
+bool serialAdapter_acceptsAddress(address_t destAddr);
+
+//! Copies serialAdapter_stats
+void serialAdapter_getStats(serial_adapter_stats_t *stats);
+
+//! Resets serialAdapter_stats
+void serialAdapter_resetStats(void);
+
+//! Records when frames are received and when frames with command are transmitted
+void serialAdapter_setTimestamping(bool enable, command_t command);
+
+//! Returns when the frame that is being processed arrived, false if that isn't known
+bool serialAdapter_getRxTimestamp(time_t *time);
+
+//! Returns when the last stamped frame has been transmitted, false if none has been since the last call
+bool serialAdapter_getTxTimestamp(time_t *time);
+
+//! Queues a frame with given innerFrame for transmission, returns SERIAL_ADAPTER_TX_QUEUE_FULL instead of waiting, SERIAL_ADAPTER_INVALID for a bad length
+uint8_t serialAdapter_tryWriteFrame(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame);
+
+//! Sends a frame with given innerFrame, yields while the transmit queue is full, drops it if its length is bad
 void serialAdapter_writeFrame(address_t destAddr, inner_frame_length_t length, inner_frame_t *innerFrame);
 
+//! Returns the byte of the inner frame at index
+uint8_t serialAdapter_viewByte(const frame_view_t *frame, uint8_t index);
+
+//! Returns a pointer to length bytes of the inner frame, copies them to buffer only if they wrap around
+const void *serialAdapter_viewData(const frame_view_t *frame, uint8_t offset, uint8_t length, void *buffer);
+
+//! Creates a view of a command that is nested in the inner frame at offset
+void serialAdapter_subView(const frame_view_t *frame, uint8_t offset, frame_view_t *nested);
+
 //! Blocks process until byteCount bytes arrived
 bool serialAdapter_waitForData(uint8_t byteCount, time_t frameTimestamp);
 
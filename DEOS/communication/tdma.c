@@ -0,0 +1,254 @@
+/*!
+ *  \brief Optional TDMA medium access in the transmit path of the serial
+ *         adapter: every node transmits in its own slot of a superframe.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#include "tdma.h"
+#include "timeSync.h"
+#include "xbee.h"
+#include "../lib/util.h"
+#include "../os_scheduler.h"
+
+#include <avr/interrupt.h>
+#include <string.h>
+
+//----------------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------------
+
+// What the current window is for
+#define TDMA_WINDOW_NONE 0
+#define TDMA_WINDOW_SLOT 1
+#define TDMA_WINDOW_CONTENTION 2
+#define TDMA_WINDOW_UNSYNCED 3
+
+//! Length (us) of the window without the network time, renewed by every tdma_worker
+#define TDMA_UNSYNCED_WINDOW_US 0x40000000UL
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+bool tdma_enabled = false;
+
+//! Set if the slot has been set with tdma_setSlot instead of following from the address
+bool tdma_slotFixed = false;
+
+//! Slot of this node, TDMA_NO_SLOT if it only uses the contention slot
+uint8_t tdma_slot = TDMA_NO_SLOT;
+
+//! Local system time (us) the current window opens and closes, read by the transmit interrupt
+volatile time_t tdma_windowStart;
+volatile time_t tdma_windowEnd;
+volatile uint8_t tdma_windowType = TDMA_WINDOW_NONE;
+
+//! Superframe whose contention slot the backoff has been drawn for
+time_t tdma_backoffSuperframe;
+
+//! Set while the frame at the head of the transmit queue waits for a window
+volatile bool tdma_holding = false;
+
+//! State of the pseudo random numbers for the backoff
+uint16_t tdma_random = 0xACE1;
+
+tdma_stats_t tdma_stats;
+
+//----------------------------------------------------------------------------
+// Implementation
+//----------------------------------------------------------------------------
+
+/*!
+ *  Enables or disables TDMA. The slot follows from the own address unless
+ *  it has been set with tdma_setSlot.
+ *
+ *  \param enable True to transmit in the slots only
+ */
+void tdma_setEnabled(bool enable)
+{
+	os_enterCriticalSection();
+	if (!tdma_slotFixed)
+	{
+		tdma_slot = tdma_slotOf(serialAdapter_address);
+	}
+	tdma_windowType = TDMA_WINDOW_NONE;
+	tdma_backoffSuperframe = ~(time_t)0;
+	// Nodes draw different backoffs
+	tdma_random ^= serialAdapter_address << 8 | serialAdapter_address;
+	tdma_enabled = enable;
+	os_leaveCriticalSection();
+
+	// Held frames go out right away
+	if (!enable)
+	{
+		xbee_startTransmission();
+	}
+}
+
+/*!
+ *  \param address A node address
+ *  \return The slot of the node, 0 to TDMA_SLOT_COUNT - 1
+ */
+uint8_t tdma_slotOf(address_t address)
+{
+	return address % TDMA_SLOT_COUNT;
+}
+
+/*!
+ *  Gives this node another slot than the one of its address, e.g. to
+ *  resolve a collision of two addresses
+ *
+ *  \param slot The slot, TDMA_NO_SLOT to transmit in the contention slot only
+ */
+void tdma_setSlot(uint8_t slot)
+{
+	os_enterCriticalSection();
+	tdma_slotFixed = true;
+	tdma_slot = slot < TDMA_SLOT_COUNT ? slot : TDMA_NO_SLOT;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  \return The slot this node transmits in, TDMA_NO_SLOT if it only uses the contention slot
+ */
+uint8_t tdma_getSlot(void)
+{
+	return tdma_slot;
+}
+
+/*!
+ *  \return A random backoff (us) for the contention slot
+ */
+static uint16_t tdma_backoff(void)
+{
+	// xorshift, good enough to spread the nodes
+	tdma_random ^= tdma_random << 7;
+	tdma_random ^= tdma_random >> 9;
+	tdma_random ^= tdma_random << 8;
+	return tdma_random % TDMA_BACKOFF_US;
+}
+
+/*!
+ *  Passes the window to the transmit interrupt
+ *
+ *  \param start Local system time (us) the window opens
+ *  \param end Local system time (us) the window closes
+ *  \param type What the window is for
+ */
+static void tdma_setWindow(time_t start, time_t end, uint8_t type)
+{
+	// The transmit interrupt reads the window, a critical section doesn't keep it out
+	uint8_t const ie = gbi(SREG, 7);
+	cli();
+	tdma_windowStart = start;
+	tdma_windowEnd = end;
+	tdma_windowType = type;
+	if (ie)
+	{
+		sei();
+	}
+}
+
+/*!
+ *  Finds the window of the current position in the superframe. Needs to
+ *  be called periodically, which the serial adapter worker does. The
+ *  window is given in local system time, so the transmit interrupt only
+ *  compares it to the system time.
+ *
+ *  \return True if this node may transmit now, the transmission needs to be started then
+ */
+bool tdma_worker(void)
+{
+	if (!tdma_enabled)
+	{
+		return false;
+	}
+
+	time_t const local = getSystemTime_us();
+	if (!timeSync_hasNetworkTime())
+	{
+		tdma_setWindow(local, local + TDMA_UNSYNCED_WINDOW_US, TDMA_WINDOW_UNSYNCED);
+		return true;
+	}
+
+	time_t const network = os_networkTime_us() - (getSystemTime_us() - local);
+	time_t const superframe = network / TDMA_SUPERFRAME_US;
+	time_t const position = network % TDMA_SUPERFRAME_US;
+	time_t const superframeStart = local - position;
+
+	if (position < TDMA_CONTENTION_US)
+	{
+		if (tdma_backoffSuperframe != superframe)
+		{
+			tdma_backoffSuperframe = superframe;
+			tdma_setWindow(superframeStart + tdma_backoff(), superframeStart + TDMA_CONTENTION_US, TDMA_WINDOW_CONTENTION);
+		}
+		return (int32_t)(local - tdma_windowStart) >= 0;
+	}
+
+	time_t const slotStart = TDMA_CONTENTION_US + (time_t)tdma_slot * TDMA_SLOT_US;
+	if (tdma_slot != TDMA_NO_SLOT && position >= slotStart && position < slotStart + TDMA_SLOT_US)
+	{
+		tdma_setWindow(superframeStart + slotStart, superframeStart + slotStart + TDMA_SLOT_US, TDMA_WINDOW_SLOT);
+		return true;
+	}
+
+	tdma_setWindow(local, local, TDMA_WINDOW_NONE);
+	return false;
+}
+
+/*!
+ *  Decides if a frame may be started now. Runs in interrupt context.
+ *
+ *  \param length Bytes of the whole frame, including header and footer
+ *  \return True if the frame fits into the current window
+ */
+bool tdma_mayTransmit(uint8_t length)
+{
+	if (!tdma_enabled)
+	{
+		return true;
+	}
+
+	time_t const now = getSystemTime_us();
+	uint8_t const type = tdma_windowType;
+	bool const fits = type != TDMA_WINDOW_NONE && (int32_t)(now - tdma_windowStart) >= 0 && (int32_t)(tdma_windowEnd - now) >= (int32_t)length * TDMA_BYTE_US + TDMA_GUARD_US;
+
+	if (!fits)
+	{
+		if (!tdma_holding)
+		{
+			tdma_holding = true;
+			tdma_stats.heldFrames++;
+		}
+		return false;
+	}
+
+	tdma_holding = false;
+	if (type == TDMA_WINDOW_SLOT)
+	{
+		tdma_stats.slotFrames++;
+	}
+	else if (type == TDMA_WINDOW_CONTENTION)
+	{
+		tdma_stats.contentionFrames++;
+	}
+	else
+	{
+		tdma_stats.unsyncedFrames++;
+	}
+	return true;
+}
+
+/*!
+ *  Resets the statistics, e.g. before a measurement
+ */
+void tdma_resetStats(void)
+{
+	os_enterCriticalSection();
+	memset(&tdma_stats, 0, sizeof(tdma_stats));
+	os_leaveCriticalSection();
+}
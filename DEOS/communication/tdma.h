@@ -0,0 +1,107 @@
+/*!
+ *  \brief Optional TDMA medium access in the transmit path of the serial
+ *         adapter: every node transmits in its own slot of a superframe.
+ *
+ *  The superframe starts with a contention slot, followed by
+ *  TDMA_SLOT_COUNT node slots. A node's slot follows from its address, so
+ *  the nodes of a network get distinct slots as long as their addresses
+ *  lie in a block of TDMA_SLOT_COUNT consecutive addresses, e.g. the
+ *  ADDRESS(teamId, subId) of up to TDMA_SLOT_COUNT / 8 teams. Queued frames
+ *  wait until the own slot or the contention slot, where every node may
+ *  transmit its ad-hoc traffic after a random backoff. A frame is only
+ *  started if it ends TDMA_GUARD_US before its slot does, the guard
+ *  covers the synchronization error and the delay of the radio.
+ *
+ *  The superframes are aligned to the network time of timeSync, which
+ *  therefore has to run on all nodes. Before a node has the network time
+ *  it transmits whenever it has a frame, as without TDMA. The beacons of
+ *  the master are subject to the slots as well, so TIME_SYNC_PERIOD_MS
+ *  has to be longer than a superframe. The network time wraps every 71
+ *  minutes, the superframe right before the wrap is cut short.
+ *
+ *  tools/tdmasim.py simulates many nodes on a shared channel and compares
+ *  goodput and latency with and without TDMA.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef TDMA_H_
+#define TDMA_H_
+
+#include "serialAdapter.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Node slots per superframe
+#ifndef TDMA_SLOT_COUNT
+#define TDMA_SLOT_COUNT 16
+#endif
+
+//! Length (us) of a node slot, the longest frame takes 15 ms at 38400 baud
+#ifndef TDMA_SLOT_US
+#define TDMA_SLOT_US 20000UL
+#endif
+
+//! Length (us) of the contention slot at the beginning of a superframe
+#ifndef TDMA_CONTENTION_US
+#define TDMA_CONTENTION_US 40000UL
+#endif
+
+//! A frame has to end this long (us) before its slot ends
+#ifndef TDMA_GUARD_US
+#define TDMA_GUARD_US 2000
+#endif
+
+//! Longest random delay (us) before transmitting in the contention slot
+#ifndef TDMA_BACKOFF_US
+#define TDMA_BACKOFF_US 16000
+#endif
+
+//! Time (us) a byte takes at 38400 baud with 8N1
+#define TDMA_BYTE_US 260
+
+#define TDMA_SUPERFRAME_US (TDMA_CONTENTION_US + TDMA_SLOT_COUNT * TDMA_SLOT_US)
+
+//! Slot of nodes without a slot of their own, they only use the contention slot
+#define TDMA_NO_SLOT 0xFF
+
+//! Statistics since the last tdma_resetStats
+typedef struct TdmaStats
+{
+	//! Frames transmitted in the own slot
+	uint16_t slotFrames;
+	//! Frames transmitted in the contention slot
+	uint16_t contentionFrames;
+	//! Frames transmitted without the network time
+	uint16_t unsyncedFrames;
+	//! Frames that had to wait for a slot
+	uint16_t heldFrames;
+} tdma_stats_t;
+
+extern tdma_stats_t tdma_stats;
+
+//! Enables or disables TDMA, frames are transmitted right away while it's disabled
+void tdma_setEnabled(bool enable);
+
+//! Returns the slot of an address
+uint8_t tdma_slotOf(address_t address);
+
+//! Overrides the slot that follows from the own address, TDMA_NO_SLOT to use only the contention slot
+void tdma_setSlot(uint8_t slot);
+
+//! Returns the slot of this node
+uint8_t tdma_getSlot(void);
+
+//! Is called by the serial adapter worker, returns true while this node may transmit
+bool tdma_worker(void);
+
+//! Is called by the transmit interrupt before a frame of length bytes is started
+bool tdma_mayTransmit(uint8_t length);
+
+//! Resets tdma_stats
+void tdma_resetStats(void);
+
+#endif /* TDMA_H_ */
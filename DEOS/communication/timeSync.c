@@ -0,0 +1,339 @@
+/*!
+ *  \brief Network time: a master node broadcasts beacons, every other node
+ *         estimates the offset and drift of its clock to the master's.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#include "timeSync.h"
+#include "../os_scheduler.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------------
+
+//! The drift is a fixed point number with this many fractional bits, 2^-24 is about 0.06 ppb
+#define TIME_SYNC_DRIFT_FRACTION_BITS 24
+
+#define TIME_SYNC_DRIFT_ONE ((float)(1UL << TIME_SYNC_DRIFT_FRACTION_BITS))
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! Address of the node whose beacons are used
+address_t timeSync_master = ADDRESS_BROADCAST;
+
+//! Set if this node sends the beacons
+bool timeSync_isMaster = false;
+
+uint16_t timeSync_latency = TIME_SYNC_LATENCY_US;
+
+//! Offset (us) and drift (ppm) of the master clock against the local one, see timeSync_setMasterSkew
+int32_t timeSync_skewOffset = 0;
+int16_t timeSync_skewDrift = 0;
+
+//! Sequence number of the next beacon
+uint8_t timeSync_sequence = 0;
+
+//! System time (ms) the last beacon was sent
+time_t timeSync_lastBeacon;
+
+//! Set if the previous beacon has been transmitted at local time timeSync_txTime (us), kept until a beacon carries it
+bool timeSync_txValid = false;
+time_t timeSync_txTime;
+
+//! Set if the arrival of the last received beacon is known
+bool timeSync_rxValid = false;
+uint8_t timeSync_rxSequence;
+//! Local time (us) the last received beacon was transmitted, i.e. its arrival minus the latency
+time_t timeSync_rxTime;
+
+//! Set once a sample has been taken, the reference and drift are valid then
+bool timeSync_synchronized = false;
+
+//! Local and master time (us) of the last sample
+time_t timeSync_refLocal;
+time_t timeSync_refMaster;
+
+//! Drift of the master clock against the local one, fixed point with TIME_SYNC_DRIFT_FRACTION_BITS
+int32_t timeSync_drift = 0;
+
+//! Samples since the (re)start, up to TIME_SYNC_SETTLE_SAMPLES
+uint8_t timeSync_settle = 0;
+
+time_sync_stats_t timeSync_stats;
+
+//----------------------------------------------------------------------------
+// Implementation
+//----------------------------------------------------------------------------
+
+static void timeSync_receiveBeacon(const frame_view_t *frame);
+
+/*!
+ *  Starts synchronizing. The beacons of other nodes than master are ignored.
+ *
+ *  \param master Address of the node that sends the beacons, the own address to become the master
+ */
+void timeSync_init(address_t master)
+{
+	os_enterCriticalSection();
+	timeSync_master = master;
+	timeSync_isMaster = master == serialAdapter_address;
+	timeSync_synchronized = false;
+	timeSync_rxValid = false;
+	timeSync_txValid = false;
+	// The first beacon is sent right away
+	timeSync_lastBeacon = getSystemTime_ms() - TIME_SYNC_PERIOD_MS;
+	os_leaveCriticalSection();
+
+	serialAdapter_setTimestamping(true, CMD_TIME_SYNC);
+	rfAdapter_registerHandler(CMD_TIME_SYNC, timeSync_receiveBeacon, sizeof(cmd_timeSync_t), sizeof(cmd_timeSync_t), RF_HANDLER_INLINE);
+}
+
+/*!
+ *  Sets the constant delay between stamping a beacon at the master and at a
+ *  receiver. It depends on the radio and can be found by comparing a pin
+ *  toggled at os_networkTime_us on the master and a receiver.
+ *
+ *  \param latencyUs The delay in microseconds, 0 over the loopback
+ */
+void timeSync_setLatency(uint16_t latencyUs)
+{
+	os_enterCriticalSection();
+	timeSync_latency = latencyUs;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Lets the master clock, which the beacons carry, differ from the local
+ *  system time. Over the loopback the master receives its own beacons, so
+ *  this is the only way to see offset and drift being estimated.
+ *
+ *  \param offsetUs Offset of the master clock
+ *  \param driftPpm How much faster the master clock runs, in parts per million
+ */
+void timeSync_setMasterSkew(int32_t offsetUs, int16_t driftPpm)
+{
+	os_enterCriticalSection();
+	timeSync_skewOffset = offsetUs;
+	timeSync_skewDrift = driftPpm;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  \param local A local system time (us)
+ *  \return The master clock at local, the local time itself unless timeSync_setMasterSkew has been used
+ */
+static time_t timeSync_masterTime(time_t local)
+{
+	return local + timeSync_skewOffset + (int32_t)((int64_t)local * timeSync_skewDrift / 1000000);
+}
+
+/*!
+ *  Extrapolates the master time from the last sample, must be called in a
+ *  critical section
+ *
+ *  \param elapsed Local time (us) since the last sample
+ *  \return The master time
+ */
+static time_t timeSync_extrapolate(time_t elapsed)
+{
+	return timeSync_refMaster + elapsed + (int32_t)(((int64_t)elapsed * timeSync_drift) >> TIME_SYNC_DRIFT_FRACTION_BITS);
+}
+
+/*!
+ *  Takes a pair of local and master time. The error of the extrapolation
+ *  is recorded, then the drift over the interval since the last sample
+ *  goes into its average and the sample becomes the new reference.
+ *
+ *  \param local Local time (us) the master transmitted the beacon
+ *  \param master Master time (us) the master transmitted the beacon
+ */
+static void timeSync_addSample(time_t local, time_t master)
+{
+	os_enterCriticalSection();
+
+	time_t const elapsed = local - timeSync_refLocal;
+	if (timeSync_synchronized && elapsed)
+	{
+		int32_t const error = (int32_t)(master - timeSync_extrapolate(elapsed));
+
+		if (error > TIME_SYNC_STEP_US || error < -TIME_SYNC_STEP_US)
+		{
+			timeSync_stats.steps++;
+			timeSync_synchronized = false;
+		}
+		else
+		{
+			uint32_t const absError = error < 0 ? -error : error;
+			timeSync_stats.lastErrorUs = error;
+			if (timeSync_settle >= TIME_SYNC_SETTLE_SAMPLES && absError > timeSync_stats.maxErrorUs)
+			{
+				timeSync_stats.maxErrorUs = absError;
+			}
+
+			// The first interval gives the drift, later ones refine it
+			int32_t const measured = (int32_t)((float)(int32_t)(master - timeSync_refMaster - elapsed) / elapsed * TIME_SYNC_DRIFT_ONE);
+			timeSync_drift = timeSync_settle == 1 ? measured : timeSync_drift + (measured - timeSync_drift) / (1 << TIME_SYNC_DRIFT_SHIFT);
+			timeSync_stats.driftPpb = (int32_t)(timeSync_drift * (1.0e9f / TIME_SYNC_DRIFT_ONE));
+		}
+	}
+
+	if (!timeSync_synchronized)
+	{
+		timeSync_synchronized = true;
+		timeSync_drift = 0;
+		timeSync_settle = 0;
+	}
+
+	timeSync_refLocal = local;
+	timeSync_refMaster = master;
+	if (timeSync_settle < TIME_SYNC_SETTLE_SAMPLES)
+	{
+		timeSync_settle++;
+	}
+	timeSync_stats.samples++;
+
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Takes a sample from the master time of the previous beacon and the time
+ *  it arrived, and remembers when this one arrived
+ *
+ *  \param frame Received frame with command CMD_TIME_SYNC
+ */
+static void timeSync_receiveBeacon(const frame_view_t *frame)
+{
+	if (frame->header.srcAddr != timeSync_master)
+	{
+		return;
+	}
+
+	cmd_timeSync_t buffer;
+	cmd_timeSync_t const beacon = *(const cmd_timeSync_t *)serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
+	time_t rxTime;
+	bool const stamped = serialAdapter_getRxTimestamp(&rxTime);
+
+	timeSync_stats.beacons++;
+	if (timeSync_rxValid && (beacon.flags & TIME_SYNC_FLAG_PREVIOUS) && beacon.sequence == (uint8_t)(timeSync_rxSequence + 1))
+	{
+		timeSync_addSample(timeSync_rxTime, beacon.previousTime);
+	}
+	else
+	{
+		timeSync_stats.missed++;
+	}
+
+	timeSync_rxValid = stamped;
+	timeSync_rxSequence = beacon.sequence;
+	timeSync_rxTime = rxTime - timeSync_latency;
+}
+
+/*!
+ *  Broadcasts a beacon once per TIME_SYNC_PERIOD_MS if this node is the
+ *  master. The time the previous beacon has been transmitted is taken from
+ *  the serial adapter, which has long sent it within a period. The worker
+ *  must not wait for the transmit queue, so a beacon that finds it full is
+ *  tried again on the next call.
+ */
+void timeSync_worker(void)
+{
+	if (!timeSync_isMaster || getSystemTime_ms() - timeSync_lastBeacon < TIME_SYNC_PERIOD_MS)
+	{
+		return;
+	}
+
+	inner_frame_t innerFrame;
+	cmd_timeSync_t beacon;
+	time_t txTime;
+
+	if (serialAdapter_getTxTimestamp(&txTime))
+	{
+		timeSync_txTime = txTime;
+		timeSync_txValid = true;
+	}
+
+	beacon.sequence = timeSync_sequence;
+	beacon.flags = 0;
+	beacon.previousTime = 0;
+	if (timeSync_txValid)
+	{
+		beacon.flags |= TIME_SYNC_FLAG_PREVIOUS;
+		os_enterCriticalSection();
+		beacon.previousTime = timeSync_masterTime(timeSync_txTime);
+		os_leaveCriticalSection();
+	}
+
+	innerFrame.command = CMD_TIME_SYNC;
+	memcpy(innerFrame.payload, &beacon, sizeof(beacon));
+	// Sent on its own, the stamp would be lost in a batch
+	if (serialAdapter_tryWriteFrame(ADDRESS_BROADCAST, sizeof(command_t) + sizeof(beacon), &innerFrame) != SERIAL_ADAPTER_SUCCESS)
+	{
+		return;
+	}
+	timeSync_lastBeacon = getSystemTime_ms();
+	timeSync_sequence++;
+	timeSync_txValid = false;
+	timeSync_stats.sent++;
+}
+
+/*!
+ *  \return True once a sample has been taken, os_networkTime_us follows the master from then on
+ */
+bool timeSync_isSynchronized(void)
+{
+	return timeSync_synchronized;
+}
+
+/*!
+ *  \return True if os_networkTime_us is the master time, so nodes agree on it
+ */
+bool timeSync_hasNetworkTime(void)
+{
+	return timeSync_isMaster || timeSync_synchronized;
+}
+
+/*!
+ *  Returns the network time, i.e. the system time of the master. Samples
+ *  of different nodes can be compared by it.
+ *
+ *  \return The master time (us), the local system time as long as no sample has been taken
+ */
+time_t os_networkTime_us(void)
+{
+	time_t const now = getSystemTime_us();
+	time_t time;
+
+	os_enterCriticalSection();
+	if (timeSync_synchronized)
+	{
+		time = timeSync_extrapolate(now - timeSync_refLocal);
+	}
+	else if (timeSync_isMaster)
+	{
+		time = timeSync_masterTime(now);
+	}
+	else
+	{
+		time = now;
+	}
+	os_leaveCriticalSection();
+
+	return time;
+}
+
+/*!
+ *  Resets the statistics, e.g. before a measurement
+ */
+void timeSync_resetStats(void)
+{
+	os_enterCriticalSection();
+	memset(&timeSync_stats, 0, sizeof(timeSync_stats));
+	os_leaveCriticalSection();
+}
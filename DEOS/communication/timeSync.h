@@ -0,0 +1,115 @@
+/*!
+ *  \brief Network time: a master node broadcasts beacons, every other node
+ *         estimates the offset and drift of its clock to the master's.
+ *
+ *  The master broadcasts a CMD_TIME_SYNC beacon every period. The serial
+ *  adapter stamps the beacon when its first byte is handed to the UART,
+ *  the receivers stamp it in the UART1 receive interrupt when that byte
+ *  arrives. The transmission time is only known after the beacon has been
+ *  sent, so every beacon carries the master time of the previous one. A
+ *  receiver pairs it with the arrival time of the previous beacon and gets
+ *  one sample of the master time at a local time.
+ *
+ *  os_networkTime_us extrapolates the master time from the last sample
+ *  with the drift, which is averaged over the intervals between samples.
+ *  The error of the extrapolation at the next sample is the accuracy
+ *  reported in timeSync_stats. A constant delay between both stamps, e.g.
+ *  the time the XBee needs to pass the beacon on, can't be measured this
+ *  way and is subtracted as latency.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef TIME_SYNC_H_
+#define TIME_SYNC_H_
+
+#include "rfAdapter.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Time (ms) between two beacons of the master
+#ifndef TIME_SYNC_PERIOD_MS
+#define TIME_SYNC_PERIOD_MS 1000
+#endif
+
+//! Delay (us) between stamping a beacon at the master and at a receiver, one byte at 38400 baud
+#ifndef TIME_SYNC_LATENCY_US
+#define TIME_SYNC_LATENCY_US 260
+#endif
+
+//! Weight 1 / 2^TIME_SYNC_DRIFT_SHIFT of a new drift measurement in the average
+#ifndef TIME_SYNC_DRIFT_SHIFT
+#define TIME_SYNC_DRIFT_SHIFT 2
+#endif
+
+//! A sample this far (us) off the extrapolation restarts the synchronization, e.g. after the master restarted
+#ifndef TIME_SYNC_STEP_US
+#define TIME_SYNC_STEP_US 10000
+#endif
+
+//! Samples after a (re)start that don't count for the maximum error, the drift isn't known yet
+#define TIME_SYNC_SETTLE_SAMPLES 3
+
+//! The beacon carries the master time of the previous beacon
+#define TIME_SYNC_FLAG_PREVIOUS 0x01
+
+//! Command payload of command CMD_TIME_SYNC
+typedef struct cmd_timeSync
+{
+	uint8_t sequence;
+	uint8_t flags;
+	//! Master time (us) the previous beacon, sequence - 1, was transmitted
+	uint32_t previousTime;
+} cmd_timeSync_t;
+
+//! Statistics since the last timeSync_resetStats
+typedef struct TimeSyncStats
+{
+	//! Beacons sent as master
+	uint16_t sent;
+	//! Beacons received
+	uint16_t beacons;
+	//! Samples taken from the beacons
+	uint16_t samples;
+	//! Beacons that gave no sample, e.g. since the previous one was lost or not stamped
+	uint16_t missed;
+	//! Restarts after a sample was off by more than TIME_SYNC_STEP_US
+	uint16_t steps;
+	//! Error (us) of the extrapolated master time at the last sample
+	int32_t lastErrorUs;
+	//! Largest absolute error (us) after settling
+	uint32_t maxErrorUs;
+	//! Estimated drift of the master clock against the local one in parts per billion
+	int32_t driftPpb;
+} time_sync_stats_t;
+
+extern time_sync_stats_t timeSync_stats;
+
+//! Starts synchronizing to the beacons of master, sends them if master is the own address; call after rfAdapter_init
+void timeSync_init(address_t master);
+
+//! Sets the latency (us) that is subtracted from the arrival of a beacon
+void timeSync_setLatency(uint16_t latencyUs);
+
+//! Lets the master clock run off the local one, for tests over the loopback where both are the same
+void timeSync_setMasterSkew(int32_t offsetUs, int16_t driftPpm);
+
+//! Sends a beacon if the node is the master and the period has passed, call regularly
+void timeSync_worker(void);
+
+//! Returns true once a sample has been taken from the beacons
+bool timeSync_isSynchronized(void);
+
+//! Returns true if os_networkTime_us follows the master, i.e. on the master or once synchronized
+bool timeSync_hasNetworkTime(void);
+
+//! Returns the master time (us), the local time before the first sample (wraps after about 71 minutes)
+time_t os_networkTime_us(void);
+
+//! Resets timeSync_stats
+void timeSync_resetStats(void);
+
+#endif /* TIME_SYNC_H_ */
@@ -6,25 +6,541 @@
  *  \version  1.0
  */
 
+#define LOG_MODULE RF_ADAPTER
+
 #include "xbee.h"
+#include "../lib/fmt.h"
 #include "../lib/uart.h"
 #include "../lib/terminal.h"
+#include "../lib/util.h"
 #include "../os_scheduler.h"
 #include "rfAdapter.h"
 
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <string.h>
+
+//----------------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------------
+
+//! Extra silence (ms) around "+++", so the guard time is kept for sure
+#define XBEE_GUARD_MARGIN_MS 100
+
+//! Longest AT command line, e.g. "ATBD3D090"
+#define XBEE_AT_LINE_LENGTH 16
+
+//! Marks an AT command without parameter
+#define XBEE_NO_PARAMETER 0xFFFFFFFFUL
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! If set, transmitted bytes are received again instead of being sent to the XBee
+bool xbee_loopback = false;
+
+//! Percentage of bytes that get lost in loopback mode
+uint8_t xbee_loopbackLoss = 0;
+
+//! State of the pseudo random numbers that decide which bytes get lost
+uint16_t xbee_lossRandom = 0xACE1;
+
+//! Provides the bytes that are transmitted by xbee_startTransmission
+int16_t (*xbee_txSource)(void) = NULL;
+
+//! Set while the transmit source must not start another frame, see xbee_isTransmissionHeld
+volatile bool xbee_txHeld = false;
+
+//! Cleared while the transmit source hands bytes to the UART, set once it has none
+volatile bool xbee_txIdle = true;
+
+//! Baud rate of the UART connection
+uint32_t xbee_baudRate = XBEE_DEFAULT_BAUD_RATE;
+
+//! Set if RTS/CTS flow control is enabled
+bool xbee_flowControl = false;
+
+//! Baud rates of the ATBD parameters 0 to 7, larger parameters are the baud rate itself
+static const uint32_t xbee_standardBaudRates[] PROGMEM = {1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200};
+
+//! The XBee the loopback stands in for, it answers AT commands
+typedef struct XbeeStandIn
+{
+	//! If cleared, the stand-in doesn't answer, like a missing module
+	bool answers;
+	bool commandMode;
+	//! Baud rate of the module, bytes sent at another rate are garbled
+	uint32_t baudRate;
+	//! Baud rate set by ATBD, applied by ATAC or ATCN
+	uint32_t newBaudRate;
+	//! Plus signs of "+++" received so far
+	uint8_t plusCount;
+	//! System time (ms) of the last byte
+	time_t lastByteTime;
+	char line[XBEE_AT_LINE_LENGTH];
+	uint8_t lineLength;
+} xbee_stand_in_t;
+
+xbee_stand_in_t xbee_standIn = {.answers = true, .baudRate = XBEE_DEFAULT_BAUD_RATE, .newBaudRate = XBEE_DEFAULT_BAUD_RATE};
+
+//! The counters the UART doesn't keep itself: looped back bytes, loopback losses and read errors
+xbee_stats_t xbee_stats;
 
 //----------------------------------------------------------------------------
 // Your Homework
 //----------------------------------------------------------------------------
 
+/*!
+ *  Finds the UART setting that comes closest to a baud rate
+ *
+ *  \param baudRate The baud rate
+ *  \return The setting for uart1_init
+ */
+static unsigned int xbee_baudSelect(uint32_t baudRate)
+{
+	unsigned int const normal = UART_BAUD_SELECT(baudRate, F_CPU);
+	unsigned int const doubled = UART_BAUD_SELECT_DOUBLE_SPEED(baudRate, F_CPU) & 0x7FFF;
+	uint32_t const normalRate = F_CPU / (16UL * (normal + 1));
+	uint32_t const doubledRate = F_CPU / (8UL * (doubled + 1));
+	uint32_t const normalError = normalRate > baudRate ? normalRate - baudRate : baudRate - normalRate;
+	uint32_t const doubledError = doubledRate > baudRate ? doubledRate - baudRate : baudRate - doubledRate;
+
+	// Double speed has finer steps, e.g. 2.1 % instead of 3.5 % off at 115200, but samples less often
+	return doubledError < normalError ? doubled | 0x8000 : normal;
+}
+
+/*!
+ *  Sets the baud rate and flow control of the UART. Received bytes are
+ *  dropped, the ones that wait for transmission are sent at the old rate.
+ *
+ *  \param baudRate The baud rate
+ *  \param flowControl True to enable RTS/CTS
+ */
+static void xbee_setUart(uint32_t baudRate, bool flowControl)
+{
+	// CTS must not hold back the bytes that wait
+	uart1_setflowcontrol(false);
+	while (uart1_gettxcount())
+	{
+	}
+	// The last byte may still be in the shift register
+	delayMs(1);
+
+	uart1_init(xbee_baudSelect(baudRate));
+	uart1_setflowcontrol(flowControl);
+	xbee_baudRate = baudRate;
+	xbee_flowControl = flowControl;
+}
+
 /*!
  *  Initializes the XBee
  */
 void xbee_init()
 {
-	uart1_init(UART_BAUD_SELECT(38400, F_CPU));
-	
+	xbee_setUart(XBEE_DEFAULT_BAUD_RATE, false);
+}
+
+/*!
+ *  Waits for the answer "OK" to an AT command
+ *
+ *  \param timeoutMs How long to wait
+ *  \return True if "OK" has been received
+ */
+static bool xbee_readOk(uint16_t timeoutMs)
+{
+	char answer[2];
+	uint8_t length = 0;
+	time_t const start = getSystemTime_ms();
+
+	while (getSystemTime_ms() - start < timeoutMs)
+	{
+		unsigned int const data = uart1_getc();
+		if (data & UART_NO_DATA)
+		{
+			continue;
+		}
+		if ((char)data == '\r')
+		{
+			return length == 2 && answer[0] == 'O' && answer[1] == 'K';
+		}
+		if (length < sizeof(answer))
+		{
+			answer[length] = (char)data;
+		}
+		length++;
+	}
+	return false;
+}
+
+/*!
+ *  Keeps the transmit source from starting another frame and waits until
+ *  the UART has taken the rest of the current one, so no frame ends up
+ *  between the AT commands
+ */
+static void xbee_holdTransmission(void)
+{
+	xbee_txHeld = true;
+	if (xbee_loopback)
+	{
+		// The loopback takes whole frames at once
+		return;
+	}
+
+	time_t const start = getSystemTime_ms();
+	while (!xbee_txIdle && getSystemTime_ms() - start < XBEE_AT_TIMEOUT_MS)
+	{
+		// The worker that resumes after CTS may be the caller
+		uart1_pollflow();
+	}
+}
+
+/*!
+ *  Lets the transmit source send the frames that have waited
+ */
+static void xbee_releaseTransmission(void)
+{
+	xbee_txHeld = false;
+	xbee_startTransmission();
+}
+
+/*!
+ *  Enters the command mode of the XBee with "+++" between two guard times
+ *
+ *  \return True if the XBee has answered
+ */
+static bool xbee_enterCommandMode(void)
+{
+	delayMs(XBEE_GUARD_TIME_MS + XBEE_GUARD_MARGIN_MS);
+	uart1_commit(uart1_getrxcount());
+	xbee_writeData("+++", 3);
+	return xbee_readOk(XBEE_GUARD_TIME_MS + XBEE_GUARD_MARGIN_MS + XBEE_AT_TIMEOUT_MS);
+}
+
+/*!
+ *  Sends an AT command in command mode
+ *
+ *  \param command The two letters of the command, in flash
+ *  \param parameter Its parameter, XBEE_NO_PARAMETER if it has none
+ *  \return True if the XBee has answered "OK"
+ */
+static bool xbee_sendCommand(const char *command, uint32_t parameter)
+{
+	char line[XBEE_AT_LINE_LENGTH];
+	uint8_t const length = parameter == XBEE_NO_PARAMETER ? fmt_snprintf_p(line, sizeof(line), PSTR("AT%S\r"), command) : fmt_snprintf_p(line, sizeof(line), PSTR("AT%S%lX\r"), command, parameter);
+
+	uart1_commit(uart1_getrxcount());
+	xbee_writeData(line, length);
+	return xbee_readOk(XBEE_AT_TIMEOUT_MS);
+}
+
+/*!
+ *  \param baudRate A baud rate
+ *  \return The parameter of ATBD that selects it
+ */
+static uint32_t xbee_baudParameter(uint32_t baudRate)
+{
+	for (uint8_t i = 0; i < sizeof(xbee_standardBaudRates) / sizeof(xbee_standardBaudRates[0]); i++)
+	{
+		if (pgm_read_dword(&xbee_standardBaudRates[i]) == baudRate)
+		{
+			return i;
+		}
+	}
+	return baudRate;
+}
+
+/*!
+ *  Sets baud rate and flow control of the XBee in command mode, they take
+ *  effect with ATCN
+ *
+ *  \param baudRate The baud rate
+ *  \param flowControl True to enable RTS/CTS
+ *  \return True if the XBee has accepted all of them
+ */
+static bool xbee_writeSettings(uint32_t baudRate, bool flowControl)
+{
+	// ATD6 is RTS, ATD7 CTS flow control
+	return xbee_sendCommand(PSTR("BD"), xbee_baudParameter(baudRate)) && xbee_sendCommand(PSTR("D6"), flowControl) && xbee_sendCommand(PSTR("D7"), flowControl);
+}
+
+/*!
+ *  Configures the XBee and the UART, see xbee_configureLink
+ *
+ *  \param baudRate The new baud rate
+ *  \param flowControl True to enable RTS/CTS
+ *  \return XBEE_SUCCESS, XBEE_NO_ANSWER if the settings are unchanged, XBEE_LINK_FALLBACK or XBEE_LINK_UNCONFIRMED
+ */
+static uint8_t xbee_changeLink(uint32_t baudRate, bool flowControl)
+{
+	uint32_t const previousRate = xbee_baudRate;
+	bool const previousFlowControl = xbee_flowControl;
+	// The rate the XBee is found at, it keeps it if the settings are refused
+	uint32_t moduleRate = previousRate;
+
+	if (!xbee_enterCommandMode())
+	{
+		xbee_setUart(baudRate, false);
+		if (!xbee_enterCommandMode())
+		{
+			WARN("XBee doesn't answer at %lu or %lu baud", previousRate, baudRate);
+			xbee_setUart(previousRate, previousFlowControl);
+			return XBEE_NO_ANSWER;
+		}
+		moduleRate = baudRate;
+	}
+
+	// ATCN applies the settings and leaves the command mode
+	if (!xbee_writeSettings(baudRate, flowControl) || !xbee_sendCommand(PSTR("CN"), XBEE_NO_PARAMETER))
+	{
+		WARN("XBee refused the link settings");
+		// Takes back the settings accepted so far, the command mode is left in any case
+		xbee_writeSettings(moduleRate, previousFlowControl);
+		xbee_sendCommand(PSTR("CN"), XBEE_NO_PARAMETER);
+		xbee_setUart(previousRate, previousFlowControl);
+		return XBEE_NO_ANSWER;
+	}
+
+	xbee_setUart(baudRate, flowControl);
+	bool const reached = xbee_enterCommandMode();
+	if (reached && xbee_sendCommand(PSTR("CN"), XBEE_NO_PARAMETER))
+	{
+		INFO("XBee link at %lu baud, flow control %u", baudRate, flowControl);
+		return XBEE_SUCCESS;
+	}
+
+	// The XBee runs at the new rate now, it has to be moved back from there. Without
+	// flow control in case the XBee doesn't drive CTS.
+	xbee_setUart(baudRate, false);
+	if ((reached || xbee_enterCommandMode()) && xbee_writeSettings(previousRate, previousFlowControl) && xbee_sendCommand(PSTR("CN"), XBEE_NO_PARAMETER))
+	{
+		WARN("XBee doesn't answer at %lu baud, back to %lu", baudRate, previousRate);
+		xbee_setUart(previousRate, previousFlowControl);
+		return XBEE_LINK_FALLBACK;
+	}
+
+	// Both ends stay at the new settings, the XBee has taken them after all
+	WARN("XBee can't be moved back from %lu baud", baudRate);
+	xbee_setUart(baudRate, flowControl);
+	return XBEE_LINK_UNCONFIRMED;
+}
+
+/*!
+ *  Moves the link to the XBee to another baud rate, e.g. 115200 or 250000,
+ *  and enables or disables RTS/CTS flow control. The XBee is configured
+ *  with AT commands in its command mode, which takes a few seconds because
+ *  of the guard times. The settings aren't written to the XBee, so it's
+ *  back at XBEE_DEFAULT_BAUD_RATE after a power-up. Must be called before
+ *  the rfAdapter worker runs, e.g. right after rfAdapter_init in the
+ *  process of the worker, since the worker would take the answers.
+ *
+ *  If the XBee doesn't answer at the current rate, it may still be at
+ *  baudRate from an earlier call, so that's tried next. If it refuses a
+ *  setting, the ones it has accepted are taken back. If it doesn't answer
+ *  at the new rate after the change, it's moved back to the previous
+ *  settings from there (without flow control), and if that fails too both
+ *  ends stay at the new settings. Frames of the transmit source wait
+ *  meanwhile, the one in progress is completed first.
+ *
+ *  Timings that assume 38400 baud, e.g. TDMA_BYTE_US, are conservative at
+ *  a higher rate, the latency of timeSync_setLatency has to be measured
+ *  again.
+ *
+ *  \param baudRate The new baud rate
+ *  \param flowControl True to enable RTS/CTS, see uart1_setflowcontrol for the pins
+ *  \return XBEE_SUCCESS, XBEE_NO_ANSWER if the settings are unchanged, XBEE_LINK_FALLBACK or XBEE_LINK_UNCONFIRMED
+ */
+uint8_t xbee_configureLink(uint32_t baudRate, bool flowControl)
+{
+	xbee_holdTransmission();
+	uint8_t const status = xbee_changeLink(baudRate, flowControl);
+	xbee_releaseTransmission();
+	return status;
+}
+
+/*!
+ *  \return The baud rate of the UART connection
+ */
+uint32_t xbee_getBaudRate(void)
+{
+	return xbee_baudRate;
+}
+
+/*!
+ *  \return True if RTS/CTS flow control is enabled
+ */
+bool xbee_hasFlowControl(void)
+{
+	return xbee_flowControl;
+}
+
+/*!
+ *  Resumes a transmission that the XBee has paused with CTS. Needs to be
+ *  called periodically, which the serial adapter worker does. The scheduler
+ *  resumes as well, so a process that waits for the transmit queue doesn't
+ *  depend on the worker.
+ */
+void xbee_worker(void)
+{
+	if (xbee_flowControl && !xbee_loopback)
+	{
+		uart1_pollflow();
+	}
+}
+
+/*!
+ *  Answers like an XBee in command mode
+ *
+ *  \param answer The answer without "\r", in flash
+ */
+static void xbee_standInAnswer(const char *answer)
+{
+	char c;
+	while ((c = pgm_read_byte(answer++)))
+	{
+		uart1_injectc(c);
+	}
+	uart1_injectc('\r');
+}
+
+/*!
+ *  Executes the AT command line the stand-in has received. Only setting
+ *  parameters is supported, ATBD takes effect with ATAC or ATCN.
+ */
+static void xbee_standInExecute(void)
+{
+	xbee_stand_in_t *const module = &xbee_standIn;
+	uint8_t const length = module->lineLength;
+	uint32_t parameter = 0;
+
+	module->lineLength = 0;
+	if (length < 2 || module->line[0] != 'A' || module->line[1] != 'T' || length == 3)
+	{
+		xbee_standInAnswer(PSTR("ERROR"));
+		return;
+	}
+	if (length == 2)
+	{
+		xbee_standInAnswer(PSTR("OK"));
+		return;
+	}
+
+	for (uint8_t i = 4; i < length; i++)
+	{
+		char const c = module->line[i];
+		if (c == ' ')
+		{
+			continue;
+		}
+		uint8_t const digit = c >= '0' && c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+		if (digit > 0xF)
+		{
+			xbee_standInAnswer(PSTR("ERROR"));
+			return;
+		}
+		parameter = parameter << 4 | digit;
+	}
+
+	char const first = module->line[2];
+	char const second = module->line[3];
+	if (first == 'B' && second == 'D' && length > 4)
+	{
+		module->newBaudRate = parameter < sizeof(xbee_standardBaudRates) / sizeof(xbee_standardBaudRates[0]) ? pgm_read_dword(&xbee_standardBaudRates[parameter]) : parameter;
+	}
+	else if (first == 'A' && second == 'C')
+	{
+		module->baudRate = module->newBaudRate;
+	}
+	else if (first == 'C' && second == 'N')
+	{
+		module->baudRate = module->newBaudRate;
+		module->commandMode = false;
+	}
+	// Other commands, e.g. ATD6 and ATD7, are accepted without effect
+	xbee_standInAnswer(PSTR("OK"));
+}
+
+/*!
+ *  Lets the stand-in see a byte sent to the XBee. It enters the command
+ *  mode on "+++" after the guard time and answers right away, without
+ *  waiting for the guard time after it. The command mode doesn't time out.
+ *
+ *  \param byte The transmitted byte
+ *  \return True if the byte doesn't go over the air
+ */
+static bool xbee_standInReceive(uint8_t byte)
+{
+	xbee_stand_in_t *const module = &xbee_standIn;
+	time_t const now = getSystemTime_ms();
+	time_t const silence = now - module->lastByteTime;
+
+	module->lastByteTime = now;
+
+	// At another baud rate the module only gets garbage
+	if (module->baudRate != xbee_baudRate)
+	{
+		return true;
+	}
+
+	if (module->commandMode)
+	{
+		if (byte == '\r')
+		{
+			xbee_standInExecute();
+		}
+		else if (module->lineLength < sizeof(module->line))
+		{
+			module->line[module->lineLength++] = byte;
+		}
+		return true;
+	}
+
+	if (module->answers && byte == '+' && (module->plusCount || silence >= XBEE_GUARD_TIME_MS))
+	{
+		if (++module->plusCount == 3)
+		{
+			module->plusCount = 0;
+			module->lineLength = 0;
+			module->commandMode = true;
+			xbee_standInAnswer(PSTR("OK"));
+		}
+		return true;
+	}
+
+	// The plus signs were data after all
+	for (; module->plusCount; module->plusCount--)
+	{
+		uart1_injectc('+');
+	}
+	return false;
+}
+
+/*!
+ *  Receives a transmitted byte in loopback mode, unless it gets lost
+ *
+ *  \param byte the transmitted byte
+ */
+static void xbee_loopBack(uint8_t byte)
+{
+	xbee_stats.txBytes++;
+	if (xbee_standInReceive(byte))
+	{
+		return;
+	}
+
+	if (xbee_loopbackLoss)
+	{
+		// xorshift, good enough to pick lost bytes
+		xbee_lossRandom ^= xbee_lossRandom << 7;
+		xbee_lossRandom ^= xbee_lossRandom >> 9;
+		xbee_lossRandom ^= xbee_lossRandom << 8;
+		if ((uint8_t)(xbee_lossRandom % 100) < xbee_loopbackLoss)
+		{
+			xbee_stats.loopbackLost++;
+			return;
+		}
+	}
+	uart1_injectc(byte);
 }
 
 /*!
@@ -34,9 +550,108 @@ void xbee_init()
  */
 void xbee_write(uint8_t byte)
 {
+	if (xbee_loopback)
+	{
+		xbee_loopBack(byte);
+		return;
+	}
 	uart1_putc(byte);
 }
 
+/*!
+ *  Passes the bytes of the transmit source on to the UART1 transmit
+ *  interrupt and notes when it has none, see xbee_holdTransmission
+ *
+ *  \return The next byte to transmit, -1 if there is none
+ */
+static int16_t xbee_nextTxByte(void)
+{
+	int16_t const data = xbee_txSource ? xbee_txSource() : -1;
+	xbee_txIdle = data < 0;
+	return data;
+}
+
+/*!
+ *  Sets the function that provides the bytes for xbee_startTransmission. It's
+ *  called from the UART1 transmit interrupt.
+ *
+ *  \param source Returns the next byte to transmit or a negative value if there is none
+ */
+void xbee_setTxSource(int16_t (*source)(void))
+{
+	xbee_txSource = source;
+	uart1_settxsource(xbee_nextTxByte);
+}
+
+/*!
+ *  Tells the transmit source whether it may start another frame. Runs in
+ *  interrupt context.
+ *
+ *  \return True while xbee_configureLink talks to the XBee, the source returns no byte then
+ */
+bool xbee_isTransmissionHeld(void)
+{
+	return xbee_txHeld;
+}
+
+/*!
+ *  Transmits the bytes of the transmit source in the background until it
+ *  returns a negative value. In loopback mode they are received right away.
+ */
+void xbee_startTransmission(void)
+{
+	if (!xbee_loopback)
+	{
+		uart1_starttx();
+		return;
+	}
+
+	int16_t data;
+	os_enterCriticalSection();
+	while ((data = xbee_txSource()) >= 0)
+	{
+		xbee_loopBack((uint8_t)data);
+	}
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Enables or disables the loopback mode. In loopback mode every transmitted
+ *  byte ends up in the receive buffer, so frames sent to the own address are
+ *  processed locally. This serves as a stand-in peer for tests without a
+ *  second board. The loopback also stands in for the XBee itself: it
+ *  answers the AT commands of xbee_configureLink and only loops bytes back
+ *  that are sent at the baud rate it has been configured to.
+ *
+ *  \param enable True to loop transmitted bytes back
+ */
+void xbee_setLoopback(bool enable)
+{
+	xbee_loopback = enable;
+}
+
+/*!
+ *  Lets transmitted bytes get lost in loopback mode, to test how the protocol
+ *  stack copes with a noisy channel
+ *
+ *  \param percent Percentage of bytes that get lost, 0 to receive all
+ */
+void xbee_setLoopbackLoss(uint8_t percent)
+{
+	xbee_loopbackLoss = percent;
+}
+
+/*!
+ *  Lets the loopback answer AT commands like an XBee or not, like a
+ *  missing module, to test the fallback of xbee_configureLink
+ *
+ *  \param enable True to answer
+ */
+void xbee_setLoopbackCommands(bool enable)
+{
+	xbee_standIn.answers = enable;
+}
+
 /*!
  *  Receives one byte from the XBee
  *
@@ -57,7 +672,11 @@ uint8_t xbee_read(uint8_t *byte)
 	}
 	else
 	{
-		
+		if (!(status & UART_NO_DATA))
+		{
+			xbee_stats.readErrors++;
+		}
+
 		if (status & UART_FRAME_ERROR)
 		{
 			return XBEE_READ_ERROR;
@@ -78,6 +697,43 @@ uint8_t xbee_read(uint8_t *byte)
 	}
 }
 
+/*!
+ *  Copies the statistics of the UART link. The receive and transmit
+ *  interrupts count most of them, UART errors are counted even if nobody
+ *  reads the bytes through xbee_read.
+ *
+ *  \param stats Reference parameter that receives the statistics
+ */
+void xbee_getStats(xbee_stats_t *stats)
+{
+	uart1_counters_t counters;
+
+	os_enterCriticalSection();
+	uart1_getcounters(&counters, false);
+	*stats = xbee_stats;
+	os_leaveCriticalSection();
+
+	stats->rxBytes = counters.rxBytes;
+	stats->txBytes += counters.txBytes;
+	stats->frameErrors = counters.frameErrors;
+	stats->overruns = counters.overruns;
+	stats->overflows = counters.overflows;
+	stats->ctsPauses = counters.ctsPauses;
+}
+
+/*!
+ *  Resets the statistics of the UART link, e.g. before a measurement
+ */
+void xbee_resetStats(void)
+{
+	uart1_counters_t counters;
+
+	os_enterCriticalSection();
+	uart1_getcounters(&counters, true);
+	memset(&xbee_stats, 0, sizeof(xbee_stats));
+	os_leaveCriticalSection();
+}
+
 /*!
  *  Transmits the given data to the XBee
  *
@@ -95,6 +751,53 @@ void xbee_writeData(void *data, uint8_t length)
 	
 }
 
+/*!
+ *  Gives access to received bytes while they stay in the receive buffer, so
+ *  they don't need to be copied. The bytes remain valid until they are removed
+ *  with xbee_commit. Bytes at the end of the buffer continue at its beginning,
+ *  so call again with offset + the returned count for the rest.
+ *
+ *  \param offset Number of received bytes to skip
+ *  \param data Reference parameter that is pointed to the byte at offset
+ *  \return Count of bytes that follow contiguously at data, 0 if no byte has been received at offset
+ */
+uint8_t xbee_peek(uint8_t offset, const uint8_t **data)
+{
+	return (uint8_t)uart1_peek(offset, data);
+}
+
+/*!
+ *  Removes the oldest received bytes
+ *
+ *  \param count Number of bytes to remove, must not exceed the number of received bytes
+ */
+void xbee_commit(uint8_t count)
+{
+	uart1_commit(count);
+}
+
+/*!
+ *  Lets the UART1 receive interrupt record when bytes equal to marker
+ *  arrive, e.g. the first byte of a start flag. Loopback bytes are stamped
+ *  when they are looped back.
+ *
+ *  \param marker The byte to stamp, negative to stop stamping
+ */
+void xbee_setRxTimestampMarker(int16_t marker)
+{
+	uart1_setrxstamp(marker);
+}
+
+/*!
+ *  \param offset Number of received bytes to skip, as for xbee_peek
+ *  \param time Reference parameter that receives the system time (us) the byte at offset arrived
+ *  \return True if the byte at offset is a marker byte and its arrival time is still known
+ */
+bool xbee_getRxTimestamp(uint8_t offset, uint32_t *time)
+{
+	return uart1_getrxstamp(offset, time);
+}
+
 /*!
  *	Returns current filling of the buffer in byte
  *
@@ -16,10 +16,63 @@
 #define XBEE_BUFFER_INCONSISTENCY (1 << 0)
 #define XBEE_READ_ERROR (1 << 1)
 #define XBEE_DATA_MISSING (1 << 2)
+//! The module didn't answer the AT commands, see xbee_configureLink
+#define XBEE_NO_ANSWER (1 << 3)
+//! The module didn't answer at the new baud rate, the link is back at the previous one
+#define XBEE_LINK_FALLBACK (1 << 4)
+//! The module took the new settings but can't be reached with them or moved back, the link stays at them
+#define XBEE_LINK_UNCONFIRMED (1 << 5)
 
-//! Initializes the UART connection
+//! Baud rate of the XBee after a power-up, 8N1 without flow control
+#ifndef XBEE_DEFAULT_BAUD_RATE
+#define XBEE_DEFAULT_BAUD_RATE 38400UL
+#endif
+
+//! Silence (ms) the XBee needs around "+++" to enter its command mode, its ATGT
+#ifndef XBEE_GUARD_TIME_MS
+#define XBEE_GUARD_TIME_MS 1000
+#endif
+
+//! Time (ms) the XBee has to answer an AT command
+#ifndef XBEE_AT_TIMEOUT_MS
+#define XBEE_AT_TIMEOUT_MS 200
+#endif
+
+//! Statistics of the UART link since the last xbee_resetStats
+typedef struct XbeeStats
+{
+	//! Bytes received and transmitted by the UART, in loopback mode the looped back bytes
+	uint32_t rxBytes;
+	uint32_t txBytes;
+	//! Bytes received without a valid stop bit, e.g. at a wrong baud rate
+	uint16_t frameErrors;
+	//! Times received bytes were lost since the receive interrupt came too late
+	uint16_t overruns;
+	//! Bytes lost since the receive buffer was full
+	uint16_t overflows;
+	//! Times the XBee paused the transmission with CTS
+	uint16_t ctsPauses;
+	//! Errors reported by xbee_read
+	uint16_t readErrors;
+	//! Bytes dropped in loopback mode, see xbee_setLoopbackLoss
+	uint16_t loopbackLost;
+} xbee_stats_t;
+
+//! Initializes the UART connection at XBEE_DEFAULT_BAUD_RATE
 void xbee_init();
 
+//! Moves the XBee and the UART to baudRate with or without RTS/CTS, falls back if the module doesn't answer
+uint8_t xbee_configureLink(uint32_t baudRate, bool flowControl);
+
+//! Returns the baud rate of the UART connection
+uint32_t xbee_getBaudRate(void);
+
+//! Returns true if RTS/CTS flow control is enabled
+bool xbee_hasFlowControl(void);
+
+//! Keeps the flow control going, needs to be called periodically, which the serial adapter worker does
+void xbee_worker(void);
+
 //! Polls for incoming bytes at the XBee, returns error status
 uint8_t xbee_read(uint8_t *byte);
 
@@ -29,6 +82,42 @@ void xbee_write(uint8_t byte);
 //! Transmits the given data to the XBee
 void xbee_writeData(void *data, uint8_t length);
 
+//! Sets the function that provides the bytes to transmit in the background
+void xbee_setTxSource(int16_t (*source)(void));
+
+//! Transmits the bytes of the transmit source without waiting
+void xbee_startTransmission(void);
+
+//! Returns true while the transmit source must not start another frame
+bool xbee_isTransmissionHeld(void);
+
+//! Loops transmitted bytes back into the receive buffer instead of sending them
+void xbee_setLoopback(bool enable);
+
+//! Points data to received bytes without removing them, returns how many follow contiguously
+uint8_t xbee_peek(uint8_t offset, const uint8_t **data);
+
+//! Removes received bytes, e.g. after they have been used through xbee_peek
+void xbee_commit(uint8_t count);
+
+//! Records the arrival time of received bytes equal to marker, negative to disable
+void xbee_setRxTimestampMarker(int16_t marker);
+
+//! Returns the arrival time (us) of the received marker byte at offset, false if it isn't known
+bool xbee_getRxTimestamp(uint8_t offset, uint32_t *time);
+
+//! Lets the given percentage of bytes get lost in loopback mode
+void xbee_setLoopbackLoss(uint8_t percent);
+
+//! Lets the loopback answer AT commands like an XBee, enabled by default
+void xbee_setLoopbackCommands(bool enable);
+
+//! Copies the statistics of the UART link
+void xbee_getStats(xbee_stats_t *stats);
+
+//! Resets the statistics of the UART link
+void xbee_resetStats(void);
+
 //! Reads data to the buffer
 uint8_t xbee_readBuffer(uint8_t *buffer, uint8_t length);
 
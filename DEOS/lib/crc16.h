@@ -0,0 +1,38 @@
+/*! \file
+ *  CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF, not reflected).
+ *  The CRC is updated byte by byte with a 256 entry table in flash, so it
+ *  can be calculated while data is received or transmitted.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef CRC16_H_
+#define CRC16_H_
+
+#include <avr/pgmspace.h>
+#include <stdint.h>
+
+//! Value to start the calculation with
+#define CRC16_INITIAL_VALUE ((uint16_t)0xFFFF)
+
+//! CRC of every possible high byte, see crc16.c
+extern const uint16_t crc16_table[256] PROGMEM;
+
+/*!
+ *  Adds one byte to the CRC
+ *
+ *  \param crc  CRC of the previous bytes or CRC16_INITIAL_VALUE
+ *  \param byte The next byte
+ *  \return CRC including byte
+ */
+static inline uint16_t crc16_update(uint16_t crc, uint8_t byte)
+{
+	return (crc << 8) ^ pgm_read_word(&crc16_table[(uint8_t)(crc >> 8) ^ byte]);
+}
+
+//! Adds length bytes to the CRC
+uint16_t crc16_updateBuffer(uint16_t crc, const void *data, uint8_t length);
+
+#endif /* CRC16_H_ */
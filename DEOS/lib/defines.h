@@ -29,11 +29,21 @@
 // System constants
 //----------------------------------------------------------------------------
 
+//! Set to 1 on the board that collects the values of the network with the sensorGateway.
+//! Its table then takes SENSOR_GATEWAY_TABLE_LENGTH_ROLE entries, paid for with processes.
+#ifndef SENSOR_GATEWAY_ROLE
+#define SENSOR_GATEWAY_ROLE 0
+#endif
+
 //! Maximum number of processes that can be running at the same time
 //! (may be nothing > 8).
 //! This number includes the idle proc, although it is considered a system proc.
 //! The idle proc. has always id 0. The highest ID is MAX_NUMBER_OF_PROCESSES-1.
+#if SENSOR_GATEWAY_ROLE
+#define MAX_NUMBER_OF_PROCESSES 5
+#else
 #define MAX_NUMBER_OF_PROCESSES 8
+#endif
 
 //! Maximum number of programs that can be known by the os (<17, 255 is invalid).
 #define MAX_NUMBER_OF_PROGRAMS 16
@@ -61,8 +71,25 @@
 // Stack constants
 //----------------------------------------------------------------------------
 
-//! Offset needed before the Stack starts, because global variables are put on the low addresses of the SRAM
-#define STACK_OFFSET 1000
+//! Entries of the sensorGateway table on the gateway, two parameters of 48 nodes
+#define SENSOR_GATEWAY_TABLE_LENGTH_ROLE 96
+
+//! Entries of the sensorGateway table, a few more than parameters in the network keep the lookup short (< 256)
+#ifndef SENSOR_GATEWAY_TABLE_LENGTH
+#if SENSOR_GATEWAY_ROLE
+#define SENSOR_GATEWAY_TABLE_LENGTH SENSOR_GATEWAY_TABLE_LENGTH_ROLE
+#else
+#define SENSOR_GATEWAY_TABLE_LENGTH 24
+#endif
+#endif
+
+//! Bytes of the globals an entry of the sensorGateway table takes, the slot and its place in the queue
+#define SENSOR_GATEWAY_ENTRY_SIZE 20
+
+//! Offset needed before the Stack starts, because global variables are put on the low addresses of the SRAM.
+//! Covers the UART buffers, the queues and windows of the communication modules and the table of the
+//! sensorGateway, os_init checks it on boot.
+#define STACK_OFFSET (2336 + SENSOR_GATEWAY_TABLE_LENGTH * SENSOR_GATEWAY_ENTRY_SIZE)
 
 //! The stack size available for initialization and globals
 #define STACK_SIZE_MAIN 32
@@ -72,6 +99,9 @@
 //! The stack size of a process
 #define STACK_SIZE_PROC ((AVR_MEMORY_SRAM - STACK_OFFSET - STACK_SIZE_MAIN - STACK_SIZE_ISR) / MAX_NUMBER_OF_PROCESSES)
 
+//! The smallest stack size of a process STACK_OFFSET may leave, the rfAdapter worker needs most of it
+#define STACK_SIZE_PROC_MIN 640
+
 //! The bottom of the main stack. That is the highest address.
 #define BOTTOM_OF_MAIN_STACK (AVR_SRAM_LAST)
 //! The bottom of the scheduler-stack. That is the highest address.
@@ -85,4 +115,12 @@
 #error "Stack sizes exceed available SRAM"
 #endif
 
+#if STACK_SIZE_PROC < STACK_SIZE_PROC_MIN
+#error "STACK_OFFSET leaves too little stack for the processes"
+#endif
+
+#if SENSOR_GATEWAY_TABLE_LENGTH > 255
+#error "SENSOR_GATEWAY_TABLE_LENGTH has to fit the 8 bit indices of the table"
+#endif
+
 #endif
@@ -0,0 +1,399 @@
+/*! \file
+ *  Allocation free formatter, see fmt.h
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#include "fmt.h"
+#include <avr/pgmspace.h>
+#include <stdbool.h>
+#include <string.h>
+
+//! Longest conversion: ten digits of a 32 bit number plus the decimal point of %q
+#define FMT_MAX_LENGTH 12
+
+//! Highest precision %q accepts
+#define FMT_MAX_PRECISION 9
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! Powers of ten for the 32 bit part of the decimal conversion
+static const uint32_t fmt_powersOfTen32[] PROGMEM = {1000000000, 100000000, 10000000, 1000000, 100000, 10000};
+
+//! Powers of ten for the 16 bit part of the decimal conversion
+static const uint16_t fmt_powersOfTen16[] PROGMEM = {10000, 1000, 100, 10};
+
+//----------------------------------------------------------------------------
+// Implementation
+//----------------------------------------------------------------------------
+
+/*!
+ *  Converts a number to decimal digits without dividing (the ATmega has no
+ *  divide instruction). Each power of ten is subtracted as often as it fits,
+ *  which takes at most 9 subtractions per digit. Numbers that fit into 16 bit
+ *  skip the 32 bit arithmetic completely.
+ *
+ *  \param number  The number to convert
+ *  \param digits  Receives the digits (not terminated), needs room for 10 characters
+ *  \return Number of digits written, at least 1
+ */
+static uint8_t fmt_toDecimal(uint32_t number, char *digits)
+{
+	uint8_t count = 0;
+	uint8_t first16 = 0;
+
+	if (number > UINT16_MAX)
+	{
+		for (uint8_t i = 0; i < sizeof(fmt_powersOfTen32) / sizeof(*fmt_powersOfTen32); i++)
+		{
+			uint32_t const power = pgm_read_dword(&fmt_powersOfTen32[i]);
+			char digit = '0';
+			while (number >= power)
+			{
+				number -= power;
+				digit++;
+			}
+			if (digit != '0' || count)
+			{
+				digits[count++] = digit;
+			}
+		}
+		// 10000 has already been handled
+		first16 = 1;
+	}
+
+	uint16_t rest = (uint16_t)number;
+	for (uint8_t i = first16; i < sizeof(fmt_powersOfTen16) / sizeof(*fmt_powersOfTen16); i++)
+	{
+		uint16_t const power = pgm_read_word(&fmt_powersOfTen16[i]);
+		char digit = '0';
+		while (rest >= power)
+		{
+			rest -= power;
+			digit++;
+		}
+		if (digit != '0' || count)
+		{
+			digits[count++] = digit;
+		}
+	}
+
+	digits[count++] = '0' + rest;
+	return count;
+}
+
+/*!
+ *  Converts a number to hexadecimal digits without leading zeros
+ *
+ *  \param number     The number to convert
+ *  \param digits     Receives the digits (not terminated), needs room for 8 characters
+ *  \param bytes      Number of bytes of number that are significant (2 or 4)
+ *  \param upperCase  Use A-F instead of a-f
+ *  \return Number of digits written, at least 1
+ */
+static uint8_t fmt_toHex(uint32_t number, char *digits, uint8_t bytes, bool upperCase)
+{
+	char const letterBase = (upperCase ? 'A' : 'a') - 10;
+	uint8_t count = 0;
+
+	number <<= (4 - bytes) * 8;
+	for (uint8_t nibbles = bytes * 2; nibbles; nibbles--)
+	{
+		uint8_t const nibble = (uint8_t)(number >> 28);
+		number <<= 4;
+		if (nibble || count || nibbles == 1)
+		{
+			digits[count++] = nibble < 10 ? '0' + nibble : letterBase + nibble;
+		}
+	}
+	return count;
+}
+
+/*!
+ *  Turns the digits of a number scaled by 10^precision into a fixed-point
+ *  number by adding leading zeros and the decimal point.
+ *
+ *  \param digits     The digits as written by fmt_toDecimal, needs room for FMT_MAX_LENGTH characters
+ *  \param count      Number of digits
+ *  \param precision  Number of decimal places
+ *  \return New number of characters
+ */
+static uint8_t fmt_toFixedPoint(char *digits, uint8_t count, uint8_t precision)
+{
+	if (!precision)
+	{
+		return count;
+	}
+
+	// At least one digit in front of the decimal point
+	if (count <= precision)
+	{
+		uint8_t const zeros = precision + 1 - count;
+		memmove(digits + zeros, digits, count);
+		memset(digits, '0', zeros);
+		count = precision + 1;
+	}
+
+	uint8_t const point = count - precision;
+	memmove(digits + point + 1, digits + point, precision);
+	digits[point] = '.';
+	return count + 1;
+}
+
+/*!
+ *  Formats the arguments according to a format string in flash and hands
+ *  every resulting character to the sink. See fmt.h for the conversions.
+ *
+ *  \param sink     Receives the output
+ *  \param context  Passed to the sink
+ *  \param fmt      Format string (PROGMEM)
+ *  \param args     The arguments
+ */
+void fmt_vformat_p(fmt_sink_t *sink, void *context, const char *fmt, va_list args)
+{
+	char c;
+	while ((c = pgm_read_byte(fmt++)))
+	{
+		if (c != '%')
+		{
+			sink(c, context);
+			continue;
+		}
+
+		bool leftAlign = false;
+		char padding = ' ';
+		uint8_t width = 0;
+		uint8_t precision = 0;
+		bool isLong = false;
+
+		// Flags
+		for (;;)
+		{
+			c = pgm_read_byte(fmt++);
+			if (c == '-')
+			{
+				leftAlign = true;
+			}
+			else if (c == '0')
+			{
+				padding = '0';
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		// Width and precision
+		if (c == '*')
+		{
+			width = (uint8_t)va_arg(args, int);
+			c = pgm_read_byte(fmt++);
+		}
+		while (c >= '0' && c <= '9')
+		{
+			width = width * 10 + (c - '0');
+			c = pgm_read_byte(fmt++);
+		}
+		if (c == '.')
+		{
+			c = pgm_read_byte(fmt++);
+			while (c >= '0' && c <= '9')
+			{
+				precision = precision * 10 + (c - '0');
+				c = pgm_read_byte(fmt++);
+			}
+			if (precision > FMT_MAX_PRECISION)
+			{
+				precision = FMT_MAX_PRECISION;
+			}
+		}
+		if (c == 'l')
+		{
+			isLong = true;
+			c = pgm_read_byte(fmt++);
+		}
+
+		char buffer[FMT_MAX_LENGTH];
+		const char *text = buffer;
+		bool textInFlash = false;
+		char sign = 0;
+		uint8_t length;
+
+		switch (c)
+		{
+		case 'c':
+			buffer[0] = (char)va_arg(args, int);
+			length = 1;
+			break;
+
+		case 's':
+			text = va_arg(args, const char *);
+			length = strlen(text);
+			break;
+
+		case 'S':
+			text = va_arg(args, const char *);
+			length = strlen_P(text);
+			textInFlash = true;
+			break;
+
+		case 'd':
+		case 'i':
+		case 'q':
+		{
+			int32_t const value = isLong ? va_arg(args, int32_t) : va_arg(args, int);
+			if (value < 0)
+			{
+				sign = '-';
+			}
+			length = fmt_toDecimal(value < 0 ? -(uint32_t)value : (uint32_t)value, buffer);
+			if (c == 'q')
+			{
+				length = fmt_toFixedPoint(buffer, length, precision);
+			}
+			break;
+		}
+
+		case 'u':
+			length = fmt_toDecimal(isLong ? va_arg(args, uint32_t) : va_arg(args, unsigned int), buffer);
+			break;
+
+		case 'x':
+		case 'X':
+			length = fmt_toHex(isLong ? va_arg(args, uint32_t) : va_arg(args, unsigned int), buffer, isLong ? 4 : 2, c == 'X');
+			break;
+
+		case 'p':
+		{
+			// Always four digits, like tools/logdecode.py prints them
+			uint16_t const address = (uint16_t)(uintptr_t)va_arg(args, void *);
+			buffer[0] = '0';
+			buffer[1] = 'x';
+			for (uint8_t i = 0; i < 4; i++)
+			{
+				uint8_t const nibble = (address >> (12 - 4 * i)) & 0x0F;
+				buffer[2 + i] = nibble < 10 ? '0' + nibble : 'a' - 10 + nibble;
+			}
+			length = 6;
+			break;
+		}
+
+		case '%':
+			sink('%', context);
+			continue;
+
+		case '\0':
+			// Format string ends with '%'
+			return;
+
+		default:
+			// Unknown conversion: its argument size is unknown, so the
+			// remaining arguments can't be read. Print it and stop.
+			sink('%', context);
+			sink(c, context);
+			return;
+		}
+
+		uint8_t const total = length + (sign ? 1 : 0);
+		uint8_t fill = width > total ? width - total : 0;
+
+		if (!leftAlign && padding == ' ')
+		{
+			for (; fill; fill--)
+			{
+				sink(' ', context);
+			}
+		}
+		if (sign)
+		{
+			sink(sign, context);
+		}
+		if (!leftAlign)
+		{
+			for (; fill; fill--)
+			{
+				sink('0', context);
+			}
+		}
+		for (uint8_t i = 0; i < length; i++)
+		{
+			sink(textInFlash ? pgm_read_byte(text + i) : text[i], context);
+		}
+		for (; fill; fill--)
+		{
+			sink(' ', context);
+		}
+	}
+}
+
+/*!
+ *  \param sink     Receives the output
+ *  \param context  Passed to the sink
+ *  \param fmt      Format string (PROGMEM)
+ *  \param ...      The arguments
+ */
+void fmt_format_p(fmt_sink_t *sink, void *context, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	fmt_vformat_p(sink, context, fmt, args);
+	va_end(args);
+}
+
+/*!
+ *  Writes a number in decimal without leading zeros
+ *
+ *  \param sink     Receives the output
+ *  \param context  Passed to the sink
+ *  \param number   The number to write
+ */
+void fmt_writeUnsigned(fmt_sink_t *sink, void *context, uint32_t number)
+{
+	char digits[FMT_MAX_LENGTH];
+	uint8_t const length = fmt_toDecimal(number, digits);
+	for (uint8_t i = 0; i < length; i++)
+	{
+		sink(digits[i], context);
+	}
+}
+
+/*!
+ *  Appends a character to the buffer described by context (a fmt_buffer_t).
+ *  One byte is kept free for the terminating zero.
+ */
+void fmt_bufferSink(char character, void *context)
+{
+	fmt_buffer_t *const buffer = (fmt_buffer_t *)context;
+	if (buffer->length + 1 < buffer->size)
+	{
+		buffer->buffer[buffer->length++] = character;
+	}
+}
+
+/*!
+ *  \param buffer  Receives the zero-terminated result
+ *  \param size    Size of buffer, longer output is cut off
+ *  \param fmt     Format string (PROGMEM)
+ *  \param ...     The arguments
+ *  \return Length of the result without the terminating zero
+ */
+uint8_t fmt_snprintf_p(char *buffer, uint8_t size, const char *fmt, ...)
+{
+	fmt_buffer_t context = {.buffer = buffer, .size = size, .length = 0};
+
+	va_list args;
+	va_start(args, fmt);
+	fmt_vformat_p(fmt_bufferSink, &context, fmt, args);
+	va_end(args);
+
+	if (size)
+	{
+		buffer[context.length] = '\0';
+	}
+	return context.length;
+}
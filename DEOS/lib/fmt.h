@@ -0,0 +1,50 @@
+/*! \file
+ *  Small formatter for LCD, terminal and TLCD output. It writes each character
+ *  straight to a sink callback and needs neither FILE streams nor the float
+ *  printf library.
+ *
+ *  Supported conversions: %d %i %u %x %X %c %s %S (string in flash) %p %%,
+ *  the flags '-' and '0', a field width (or *) and the length modifier 'l'.
+ *  %p prints the address as "0x" and four hex digits. An unknown conversion
+ *  is printed as it is and ends the output, as its argument can't be skipped.
+ *  Fixed-point numbers are written with %.Nq (int) or %.Nlq (long), where the
+ *  argument holds the value scaled by 10^N, e.g. ("%.1q", 234) prints "23.4".
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef FMT_H_
+#define FMT_H_
+
+#include <stdarg.h>
+#include <stdint.h>
+
+//! Receives the formatted output character by character
+typedef void fmt_sink_t(char character, void *context);
+
+//! Context of fmt_bufferSink
+typedef struct FmtBuffer
+{
+	char *buffer;
+	uint8_t size;
+	uint8_t length;
+} fmt_buffer_t;
+
+//! Formats a format string that resides in flash
+void fmt_vformat_p(fmt_sink_t *sink, void *context, const char *fmt, va_list args);
+
+//! Formats a format string that resides in flash
+void fmt_format_p(fmt_sink_t *sink, void *context, const char *fmt, ...);
+
+//! Writes an unsigned decimal number
+void fmt_writeUnsigned(fmt_sink_t *sink, void *context, uint32_t number);
+
+//! Sink that writes into a fmt_buffer_t, output that doesn't fit is cut off
+void fmt_bufferSink(char character, void *context);
+
+//! Formats into a buffer (always zero-terminated), returns the length of the result
+uint8_t fmt_snprintf_p(char *buffer, uint8_t size, const char *fmt, ...);
+
+#endif /* FMT_H_ */
@@ -1,32 +1,38 @@
 #include "lcd.h"
 #include "../os_scheduler.h"
+#include "fmt.h"
 #include <avr/pgmspace.h>
-#include <stdio.h>
 
 //----------------------------------------------------------------------------
-// Configuration of stdio.h
+// Formatted output
 //----------------------------------------------------------------------------
-int lcd_stdioPutChar(char c, FILE *stream)
+
+//! Sink for fmt_vformat_p that writes to the LCD
+static void lcd_fmtSink(char character, void *context)
 {
-	lcd_writeChar(c);
-	return 0;
+	lcd_writeChar(character);
 }
 
 /*!
- * \param fmt  The format string as progstr
+ * \param fmt  The format string as progstr, see fmt.h
  * \param ...  The arguments to be formatted
  */
 void lcd_printf_p(const char *fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
-	stdout->flags |= __SPGM;
-	vfprintf_P(&lcd_stdout, fmt, args);
-	stdout->flags &= ~__SPGM;
+	fmt_vformat_p(lcd_fmtSink, NULL, fmt, args);
 	va_end(args);
 }
 
-FILE lcd_stdout = FDEV_SETUP_STREAM(lcd_stdioPutChar, NULL, _FDEV_SETUP_WRITE);
+/*!
+ * \param fmt   The format string as progstr, see fmt.h
+ * \param args  The arguments to be formatted
+ */
+void lcd_vprintf_p(const char *fmt, va_list args)
+{
+	fmt_vformat_p(lcd_fmtSink, NULL, fmt, args);
+}
 
 //----------------------------------------------------------------------------
 // Implementation
@@ -431,25 +437,8 @@ void lcd_writeHex(uint16_t number)
  */
 void lcd_writeDec(uint16_t number)
 {
-	if (!number)
-	{
-		lcd_writeChar('0');
-		return;
-	}
-
-	uint32_t pos = 10000;
-	uint8_t print = 0;
-
 	os_enterCriticalSection();
-
-	do
-	{
-		uint8_t const digit = number / pos;
-		number -= digit * pos;
-		if (print |= digit)
-			lcd_writeChar(digit + '0');
-	} while (pos /= 10);
-
+	fmt_writeUnsigned(lcd_fmtSink, NULL, number);
 	os_leaveCriticalSection();
 }
 
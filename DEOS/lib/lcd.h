@@ -4,15 +4,17 @@
 #include "../lib/util.h"
 #include <avr/io.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <util/delay.h>
 
-extern FILE lcd_stdout;
-
 //! Write a formatted string to the LCD
 void lcd_printf_p(const char *fmt, ...);
 
+//! Write a formatted string to the LCD (arguments as va_list)
+void lcd_vprintf_p(const char *fmt, va_list args);
+
 #define LCD(str, ...) lcd_printf_p(PSTR(str), ##__VA_ARGS__)
 
 // Pin Definitions
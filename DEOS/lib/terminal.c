@@ -6,42 +6,81 @@
 
 #include "terminal.h"
 #include "../os_scheduler.h"
+#include "fmt.h"
+#include "uart.h"
 #include "util.h"
+#include <avr/interrupt.h>
 #include <stdio.h>
 
 #define BAUD 250000
 #include <util/setbaud.h>
 
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! Process that currently owns the terminal (INVALID_PROCESS if free)
+process_id_t terminal_owner = INVALID_PROCESS;
+
+//! Nesting depth of terminal_lock calls of the owner
+uint8_t terminal_lockDepth = 0;
+
+//! Bytes that have been dropped because the transmit buffer was full
+uint16_t terminal_droppedBytes = 0;
+
+//! Set by terminal_panic, bypasses the transmit buffer
+bool terminal_panicMode = false;
+
+//! Allowed log messages per second and module (0: unlimited)
+uint8_t terminal_logRateLimit[LOG_MODULE_COUNT];
+
+//! Log messages per module in the current one second window
+uint8_t terminal_logCount[LOG_MODULE_COUNT];
+
+//! Start of the current rate limit window (lower 16 bits of the system time)
+uint16_t terminal_logWindowStart = 0;
+
+//! Log messages suppressed by the rate limits
+uint16_t terminal_suppressedLogs = 0;
+
 //----------------------------------------------------------------------------
 // Configuration of stdio.h
 //----------------------------------------------------------------------------
 int stdio_put_char(char c, FILE *stream)
 {
-    os_enterCriticalSection();
+    terminal_lock();
 
     terminal_writeChar(c);
     if (c == '\n') { terminal_writeProgString(PSTR("        ")); }
 
-    os_leaveCriticalSection();
+    terminal_unlock();
     return 0;
 }
 
-void terminal_log_printf_p(const char *prefix, const char *fmt, ...)
+//! Sink for fmt_vformat_p, indents continuation lines like stdio_put_char
+static void terminal_fmtSink(char character, void *context)
 {
-    os_enterCriticalSection();
-
-    terminal_writeProgString(prefix);
+    terminal_writeChar(character);
+    if (character == '\n') { terminal_writeProgString(PSTR("        ")); }
+}
 
+void terminal_log_printf_p(const char *prefix, const char *fmt, ...)
+{
     va_list args;
     va_start(args, fmt);
-    stdout->flags |= __SPGM;
-    vfprintf_P(stdout, fmt, args);
-    stdout->flags &= ~__SPGM;
+    terminal_log_vprintf_p(prefix, fmt, args);
     va_end(args);
+}
 
+void terminal_log_vprintf_p(const char *prefix, const char *fmt, va_list args)
+{
+    terminal_lock();
+
+    terminal_writeProgString(prefix);
+    fmt_vformat_p(terminal_fmtSink, NULL, fmt, args);
     terminal_newLine();
 
-    os_leaveCriticalSection();
+    terminal_unlock();
 }
 
 FILE mystdout = FDEV_SETUP_STREAM(stdio_put_char, NULL, _FDEV_SETUP_WRITE);
@@ -51,45 +90,41 @@ FILE mystdout = FDEV_SETUP_STREAM(stdio_put_char, NULL, _FDEV_SETUP_WRITE);
 //----------------------------------------------------------------------------
 
 /*!
- * Initializes UART2 connected to the USB port
+ * Initializes UART2 connected to the USB port. Transmission is interrupt driven
+ * and buffered by the UART library.
  */
 void usb2_init()
 {
 	os_enterCriticalSection();
-	
-	// Set baud
-	UBRR2 = UBRR_VALUE;
-		
-	// Set double speed if required by baud configuration
+
+	// Set baud and double speed if required by baud configuration
 	#if USE_2X
-	sbi(UCSR2A, U2X2);
+	uart2_init(UBRR_VALUE | 0x8000);
 	#else
-	cbi(UCSR2A, U2X2);
+	uart2_init(UBRR_VALUE);
 	#endif
-		
-	// Enable receiver & transmitter
-	sbi(UCSR2B, RXEN2);
-	sbi(UCSR2B, TXEN2);
-	
+
 	os_leaveCriticalSection();
 }
 
 /*!
- *  Polls for incoming bytes at the USB port
+ *  Waits for an incoming byte at the USB port
  */
 uint8_t usb2_read(void)
 {
 	// Wait for data to be received
-	while (!gbi(UCSR2A, RXC2));
+	while (!uart2_getrxcount())
+	{
+		os_yield();
+	}
 
-	// Get and return received data from buffer
-	return UDR2;
+	return (uint8_t)uart2_getc();
 }
 
 /*!
- *  Transmits one byte to the USB port
+ *  Transmits one byte to the USB port, bypassing the transmit buffer
  */
-void usb2_write(uint8_t data)
+static void usb2_writeSync(uint8_t data)
 {
 	// Wait for empty transmit buffer
 	while (!gbi(UCSR2A, UDRE2));
@@ -98,21 +133,53 @@ void usb2_write(uint8_t data)
 	UDR2 = data;
 }
 
+/*!
+ *  Queues one byte for the USB port. What happens on a full transmit buffer
+ *  depends on TERMINAL_TX_POLICY.
+ */
+void usb2_write(uint8_t data)
+{
+	if (terminal_panicMode)
+	{
+		usb2_writeSync(data);
+		return;
+	}
+
+	while (!uart2_tryputc(data))
+	{
+#if TERMINAL_TX_POLICY == TERMINAL_TX_POLICY_DROP
+		if (terminal_droppedBytes < UINT16_MAX) { terminal_droppedBytes++; }
+		return;
+#else
+		if (!gbi(SREG, 7))
+		{
+			// Nobody would drain the buffer for us (e.g. during boot)
+			uart2_flush_blocking();
+		}
+		else
+		{
+			// Only we wait, the ISR keeps sending in the meantime
+			os_yield();
+		}
+#endif
+	}
+}
+
 /*!
  *  Transmits the given string to the USB port
  */
 void usb2_writeString(char *text)
 {
-	os_enterCriticalSection();
-	
+	terminal_lock();
+
 	for (uint8_t i = 0; i < UINT8_MAX; i++)
 	{
 		if (text[i] == '\n') { usb2_write('\r'); }
 		if (text[i] == 0) { break; }
 		usb2_write(text[i]);
 	}
-	
-	os_leaveCriticalSection();
+
+	terminal_unlock();
 }
 
 /*!
@@ -120,8 +187,8 @@ void usb2_writeString(char *text)
  */
 void usb2_writeProgString(const char *text)
 {
-	os_enterCriticalSection();
-	
+	terminal_lock();
+
 	for (uint8_t i = 0; i < UINT8_MAX; i++)
 	{
 		char c = (char) pgm_read_byte(&text[i]);
@@ -130,7 +197,7 @@ void usb2_writeProgString(const char *text)
 		usb2_write(c);
 	}
 
-	os_leaveCriticalSection();
+	terminal_unlock();
 }
 
 //----------------------------------------------------------------------------
@@ -146,6 +213,88 @@ void terminal_init()
     stdout = &mystdout;
 }
 
+/*!
+ *  Reserves the terminal for the current process. Other processes that want to
+ *  write wait in terminal_lock (yielding) instead of stopping the scheduler.
+ *  Calls may be nested.
+ */
+void terminal_lock(void)
+{
+	os_enterCriticalSection();
+
+	process_id_t const self = os_getCurrentProc();
+	while (terminal_owner != INVALID_PROCESS && terminal_owner != self)
+	{
+		// Owner was killed while writing, take over
+		if (os_getProcessSlot(terminal_owner)->state == OS_PS_UNUSED)
+		{
+			terminal_lockDepth = 0;
+			break;
+		}
+		os_leaveCriticalSection();
+		// We are nested in a critical section ourselves, so waiting would never end
+		if (!gbi(TIMSK2, OCIE2A))
+		{
+			os_enterCriticalSection();
+			terminal_lockDepth = 0;
+			break;
+		}
+		os_yield();
+		os_enterCriticalSection();
+	}
+
+	terminal_owner = self;
+	terminal_lockDepth++;
+
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Releases the terminal reserved by terminal_lock
+ */
+void terminal_unlock(void)
+{
+	os_enterCriticalSection();
+
+	// The terminal might have been taken over in the meantime
+	if (terminal_owner == os_getCurrentProc() && terminal_lockDepth && !--terminal_lockDepth)
+	{
+		terminal_owner = INVALID_PROCESS;
+	}
+
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Returns how many bytes were dropped with TERMINAL_TX_POLICY_DROP
+ *
+ *  \return Number of dropped bytes (saturates at UINT16_MAX)
+ */
+uint16_t terminal_getDroppedBytes(void)
+{
+	return terminal_droppedBytes;
+}
+
+/*!
+ *  Sends everything that is still buffered by polling the UART and makes every
+ *  following output synchronous. Meant for os_error where interrupts are off.
+ */
+void terminal_panic(void)
+{
+	uint8_t ie = gbi(SREG, 7);
+	cli();
+
+	uart2_flush_blocking();
+	terminal_panicMode = true;
+	terminal_owner = INVALID_PROCESS;
+	terminal_lockDepth = 0;
+
+	if (ie)
+	{
+		sei();
+	}
+}
+
 /*!
  *  Write a half-byte (a nibble)
  *
@@ -164,12 +313,12 @@ void terminal_writeHexNibble(uint8_t number)
  */
 void terminal_writeHexByte(uint8_t number)
 {
-    os_enterCriticalSection();
+    terminal_lock();
 
     terminal_writeHexNibble(number >> 4);
     terminal_writeHexNibble(number & 0xF);
 
-    os_leaveCriticalSection();
+    terminal_unlock();
 }
 
 /*!
@@ -179,12 +328,12 @@ void terminal_writeHexByte(uint8_t number)
  */
 void terminal_writeHexWord(uint16_t number)
 {
-    os_enterCriticalSection();
+    terminal_lock();
 
     terminal_writeHexByte(number >> 8);
     terminal_writeHexByte(number);
 
-    os_leaveCriticalSection();
+    terminal_unlock();
 }
 
 /*!
@@ -194,25 +343,9 @@ void terminal_writeHexWord(uint16_t number)
  */
 void terminal_writeDec(uint16_t number)
 {
-    if (!number)
-    {
-        terminal_writeChar('0');
-        return;
-    }
-
-    uint32_t pos = 10000;
-    uint8_t print = 0;
-
-	os_enterCriticalSection();
-	
-    do
-    {
-        uint8_t const digit = number / pos;
-        number -= digit * pos;
-        if (print |= digit) { terminal_writeChar(digit + '0'); }
-    } while (pos /= 10);
-
-    os_leaveCriticalSection();
+    terminal_lock();
+    fmt_writeUnsigned(terminal_fmtSink, NULL, number);
+    terminal_unlock();
 }
 
 /*!
@@ -252,4 +385,156 @@ void terminal_writeProgString(const char *pstr)
 void terminal_newLine()
 {
     terminal_writeChar('\n');
-}
\ No newline at end of file
+}
+
+//----------------------------------------------------------------------------
+// Log levels
+//----------------------------------------------------------------------------
+
+/*!
+ *  Called by the log macros before a message is written. All modules share
+ *  one window of one second, which is restarted by the first message after
+ *  it has elapsed.
+ *
+ *  \param module  LOG_MODULE_ID_* of the calling module
+ *  \return True if the message may be written
+ */
+bool terminal_logAllowed(uint8_t module)
+{
+	if (!terminal_logRateLimit[module])
+	{
+		return true;
+	}
+
+	bool allowed = true;
+	os_enterCriticalSection();
+
+	uint16_t const now = (uint16_t)getSystemTime_ms();
+	if ((uint16_t)(now - terminal_logWindowStart) >= 1000)
+	{
+		terminal_logWindowStart = now;
+		for (uint8_t i = 0; i < LOG_MODULE_COUNT; i++)
+		{
+			terminal_logCount[i] = 0;
+		}
+	}
+
+	if (terminal_logCount[module] < terminal_logRateLimit[module])
+	{
+		terminal_logCount[module]++;
+	}
+	else
+	{
+		allowed = false;
+		if (terminal_suppressedLogs != UINT16_MAX)
+		{
+			terminal_suppressedLogs++;
+		}
+	}
+
+	os_leaveCriticalSection();
+	return allowed;
+}
+
+/*!
+ *  Limits how many messages a module may log per second. Messages above the
+ *  limit are dropped and counted (see terminal_getSuppressedLogs).
+ *
+ *  \param module             LOG_MODULE_ID_* of the module
+ *  \param messagesPerSecond  Limit, 0 disables rate limiting for the module
+ */
+void terminal_setLogRateLimit(uint8_t module, uint8_t messagesPerSecond)
+{
+	if (module >= LOG_MODULE_COUNT)
+	{
+		return;
+	}
+	terminal_logRateLimit[module] = messagesPerSecond;
+}
+
+/*!
+ *  \return Number of log messages suppressed by the rate limits (saturates at UINT16_MAX)
+ */
+uint16_t terminal_getSuppressedLogs(void)
+{
+	return terminal_suppressedLogs;
+}
+
+//----------------------------------------------------------------------------
+// Binary logging
+//----------------------------------------------------------------------------
+
+/*!
+ *  Appends raw bytes to a binary log record, truncating what doesn't fit
+ */
+static void terminal_logBinary_put(terminal_log_binary_record_t *record, const void *data, uint8_t length)
+{
+	uint8_t const *bytes = (uint8_t const *)data;
+	while (length-- && record->length < TERMINAL_LOG_BINARY_MAX_ARGS_LENGTH)
+	{
+		record->data[record->length++] = *bytes++;
+	}
+}
+
+void terminal_logBinary_putInt(terminal_log_binary_record_t *record, int value)
+{
+	terminal_logBinary_put(record, &value, sizeof(value));
+}
+
+void terminal_logBinary_putLong(terminal_log_binary_record_t *record, long value)
+{
+	terminal_logBinary_put(record, &value, sizeof(value));
+}
+
+void terminal_logBinary_putFloat(terminal_log_binary_record_t *record, float value)
+{
+	terminal_logBinary_put(record, &value, sizeof(value));
+}
+
+void terminal_logBinary_putPointer(terminal_log_binary_record_t *record, const void *value)
+{
+	terminal_logBinary_put(record, &value, sizeof(value));
+}
+
+/*!
+ *  Strings can't be looked up by the decoder, so their content is sent.
+ *  Truncated strings are still zero-terminated if there is room for the
+ *  terminator, nothing is appended to a full record.
+ */
+void terminal_logBinary_putString(terminal_log_binary_record_t *record, const char *value)
+{
+	do
+	{
+		if (record->length >= TERMINAL_LOG_BINARY_MAX_ARGS_LENGTH - 1)
+		{
+			if (record->length < TERMINAL_LOG_BINARY_MAX_ARGS_LENGTH)
+			{
+				record->data[record->length++] = '\0';
+			}
+			return;
+		}
+		record->data[record->length++] = *value;
+	} while (*value++);
+}
+
+/*!
+ *  Sends a binary log record: [sync][id low][id high][length][arguments]
+ *
+ *  \param formatId  Offset of the format string in the .logfmt section
+ *  \param record    The collected argument bytes
+ */
+void terminal_logBinary_write(uint16_t formatId, terminal_log_binary_record_t *record)
+{
+	terminal_lock();
+
+	usb2_write(TERMINAL_LOG_BINARY_SYNC);
+	usb2_write(LOW(formatId));
+	usb2_write(HIGH(formatId));
+	usb2_write(record->length);
+	for (uint8_t i = 0; i < record->length; i++)
+	{
+		usb2_write(record->data[i]);
+	}
+
+	terminal_unlock();
+}
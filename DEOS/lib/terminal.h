@@ -7,15 +7,212 @@
 #ifndef TERMINAL_H_
 #define TERMINAL_H_
 
+#include <stdarg.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
-#define INFO(str, ...) terminal_log_printf_p(PSTR("[INFO]  "), PSTR(str), ##__VA_ARGS__)
-#define WARN(str, ...) terminal_log_printf_p(PSTR("[WARN]  "), PSTR(str), ##__VA_ARGS__)
+//! Set to 1 to send log lines as binary records (format string ID + raw arguments).
+//! The format strings stay in the ELF only, decode the output with tools/logdecode.py
+#ifndef TERMINAL_LOG_BINARY
+#define TERMINAL_LOG_BINARY 0
+#endif
+
+//----------------------------------------------------------------------------
+// Log levels
+//----------------------------------------------------------------------------
+
+/*!
+ *  Log levels are selected per module at build time. A source file picks its
+ *  module by defining LOG_MODULE before its first #include, e.g.
+ *      #define LOG_MODULE SERIAL_ADAPTER
+ *  Files without LOG_MODULE use the DEFAULT module. Messages above the level
+ *  of their module are removed by the preprocessor, so neither code nor PSTR
+ *  strings end up in flash. Override a level with e.g.
+ *  -DLOG_LEVEL_SERIAL_ADAPTER=LOG_LEVEL_DEBUG.
+ */
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_WARN 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+#ifndef LOG_LEVEL_DEFAULT
+#define LOG_LEVEL_DEFAULT LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_SCHEDULER
+#define LOG_LEVEL_SCHEDULER LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_SERIAL_ADAPTER
+#define LOG_LEVEL_SERIAL_ADAPTER LOG_LEVEL_WARN
+#endif
+#ifndef LOG_LEVEL_RF_ADAPTER
+#define LOG_LEVEL_RF_ADAPTER LOG_LEVEL_WARN
+#endif
+#ifndef LOG_LEVEL_TLCD
+#define LOG_LEVEL_TLCD LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_SENSOR
+#define LOG_LEVEL_SENSOR LOG_LEVEL_DEFAULT
+#endif
+
+//! Module IDs for the runtime rate limit
+#define LOG_MODULE_ID_DEFAULT 0
+#define LOG_MODULE_ID_SCHEDULER 1
+#define LOG_MODULE_ID_SERIAL_ADAPTER 2
+#define LOG_MODULE_ID_RF_ADAPTER 3
+#define LOG_MODULE_ID_TLCD 4
+#define LOG_MODULE_ID_SENSOR 5
+#define LOG_MODULE_COUNT 6
+
+#ifndef LOG_MODULE
+#define LOG_MODULE DEFAULT
+#endif
+
+#define LOG_CAT_(a, b) a##b
+#define LOG_CAT(a, b) LOG_CAT_(a, b)
+#define LOG_CAT3(a, b, c) LOG_CAT(LOG_CAT(a, b), LOG_CAT(_, c))
+
+//! LOG_ENABLED_<module level>_<message level> is 1 if the message gets logged
+#define LOG_ENABLED_0_1 0
+#define LOG_ENABLED_0_2 0
+#define LOG_ENABLED_0_3 0
+#define LOG_ENABLED_1_1 1
+#define LOG_ENABLED_1_2 0
+#define LOG_ENABLED_1_3 0
+#define LOG_ENABLED_2_1 1
+#define LOG_ENABLED_2_2 1
+#define LOG_ENABLED_2_3 0
+#define LOG_ENABLED_3_1 1
+#define LOG_ENABLED_3_2 1
+#define LOG_ENABLED_3_3 1
+
+#define LOG_EMIT_0(...)
+#define LOG_EMIT_1(...) __VA_ARGS__
+
+//! Expands to its arguments if the current module logs messages of the given level
+#define LOG_IF(level, ...) \
+	LOG_CAT(LOG_EMIT_, LOG_CAT3(LOG_ENABLED_, LOG_CAT(LOG_LEVEL_, LOG_MODULE), level))(__VA_ARGS__)
+
+#if TERMINAL_LOG_BINARY
+#define LOG_WRITE(prefix, str, ...) TERMINAL_LOG_BINARY_RECORD(prefix str, ##__VA_ARGS__)
+#else
+#define LOG_WRITE(prefix, str, ...) terminal_log_printf_p(PSTR(prefix), PSTR(str), ##__VA_ARGS__)
+#endif
+
+#define LOG_AT(level, prefix, str, ...)                                        \
+	do                                                                         \
+	{                                                                          \
+		LOG_IF(level,                                                          \
+			if (terminal_logAllowed(LOG_CAT(LOG_MODULE_ID_, LOG_MODULE)))      \
+			{                                                                  \
+				LOG_WRITE(prefix, str, ##__VA_ARGS__);                         \
+			})                                                                 \
+	} while (0)
+
 #ifdef DEBUG
 #undef DEBUG
 #endif
-#define DEBUG(str, ...) terminal_log_printf_p(PSTR("[DEBUG] "), PSTR(str), ##__VA_ARGS__) // You could use __LINE__ or __FILE__ to include line number or file name in the log message
+#define WARN(str, ...) LOG_AT(1, "[WARN]  ", str, ##__VA_ARGS__)
+#define INFO(str, ...) LOG_AT(2, "[INFO]  ", str, ##__VA_ARGS__)
+#define DEBUG(str, ...) LOG_AT(3, "[DEBUG] ", str, ##__VA_ARGS__) // You could use __LINE__ or __FILE__ to include line number or file name in the log message
+
+//! Drop bytes that don't fit into the transmit buffer and count them
+#define TERMINAL_TX_POLICY_DROP 0
+//! Let the writing process wait (yield) until the transmit buffer has space again
+#define TERMINAL_TX_POLICY_BLOCK 1
+
+//! What to do when the UART2 transmit buffer is full
+#ifndef TERMINAL_TX_POLICY
+#define TERMINAL_TX_POLICY TERMINAL_TX_POLICY_BLOCK
+#endif
+
+//----------------------------------------------------------------------------
+// Binary logging
+//----------------------------------------------------------------------------
+
+//! First byte of a binary log record: [sync][id low][id high][length][arguments]
+#define TERMINAL_LOG_BINARY_SYNC 0xA5
+
+//! Maximum number of argument bytes per binary log record (longer strings get truncated)
+#define TERMINAL_LOG_BINARY_MAX_ARGS_LENGTH 32
+
+//! Name of the ELF section holding the format strings. The trailing ';' comments out
+//! the flags GCC appends, so the section is not allocated and never gets flashed.
+#define TERMINAL_LOG_BINARY_SECTION ".logfmt,\"\",@progbits;"
+
+//! Argument bytes of one binary log record, in the order of the format string
+typedef struct TerminalLogBinaryRecord
+{
+	uint8_t length;
+	uint8_t data[TERMINAL_LOG_BINARY_MAX_ARGS_LENGTH];
+} terminal_log_binary_record_t;
+
+/*!
+ * Emits one binary log record. The format string is placed in the non-loaded
+ * section and only its offset therein is sent as ID. Arguments are appended with
+ * the size they have after default argument promotion, so the decoder can walk
+ * them using the format string (int: 2, long: 4, float/double: 4 bytes,
+ * strings: copied zero-terminated).
+ */
+#define TERMINAL_LOG_BINARY_RECORD(fmt, ...)                                                      \
+	do                                                                                            \
+	{                                                                                             \
+		static const char terminal_logFmt[] __attribute__((section(TERMINAL_LOG_BINARY_SECTION), used)) = fmt; \
+		terminal_log_binary_record_t terminal_logRecord;                                          \
+		terminal_logRecord.length = 0;                                                            \
+		TERMINAL_LOG_BINARY_ARGS(&terminal_logRecord, ##__VA_ARGS__)                              \
+		terminal_logBinary_write((uint16_t)terminal_logFmt, &terminal_logRecord);                 \
+	} while (0)
+
+#define TERMINAL_LOG_BINARY_ARG(record, arg) \
+	_Generic((arg) + 0,                                      \
+		char *: terminal_logBinary_putString,                \
+		const char *: terminal_logBinary_putString,          \
+		float: terminal_logBinary_putFloat,                  \
+		double: terminal_logBinary_putFloat,                 \
+		long: terminal_logBinary_putLong,                    \
+		unsigned long: terminal_logBinary_putLong,           \
+		void *: terminal_logBinary_putPointer,               \
+		const void *: terminal_logBinary_putPointer,         \
+		default: terminal_logBinary_putInt)(record, arg);
+
+#define TERMINAL_LOG_BINARY_CAT_(a, b) a##b
+#define TERMINAL_LOG_BINARY_CAT(a, b) TERMINAL_LOG_BINARY_CAT_(a, b)
+#define TERMINAL_LOG_BINARY_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+#define TERMINAL_LOG_BINARY_NARGS(...) TERMINAL_LOG_BINARY_NARGS_(_, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define TERMINAL_LOG_BINARY_ARGS(record, ...) \
+	TERMINAL_LOG_BINARY_CAT(TERMINAL_LOG_BINARY_ARGS_, TERMINAL_LOG_BINARY_NARGS(__VA_ARGS__))(record, ##__VA_ARGS__)
+#define TERMINAL_LOG_BINARY_ARGS_0(r)
+#define TERMINAL_LOG_BINARY_ARGS_1(r, a) TERMINAL_LOG_BINARY_ARG(r, a)
+#define TERMINAL_LOG_BINARY_ARGS_2(r, a, ...) TERMINAL_LOG_BINARY_ARG(r, a) TERMINAL_LOG_BINARY_ARGS_1(r, __VA_ARGS__)
+#define TERMINAL_LOG_BINARY_ARGS_3(r, a, ...) TERMINAL_LOG_BINARY_ARG(r, a) TERMINAL_LOG_BINARY_ARGS_2(r, __VA_ARGS__)
+#define TERMINAL_LOG_BINARY_ARGS_4(r, a, ...) TERMINAL_LOG_BINARY_ARG(r, a) TERMINAL_LOG_BINARY_ARGS_3(r, __VA_ARGS__)
+#define TERMINAL_LOG_BINARY_ARGS_5(r, a, ...) TERMINAL_LOG_BINARY_ARG(r, a) TERMINAL_LOG_BINARY_ARGS_4(r, __VA_ARGS__)
+#define TERMINAL_LOG_BINARY_ARGS_6(r, a, ...) TERMINAL_LOG_BINARY_ARG(r, a) TERMINAL_LOG_BINARY_ARGS_5(r, __VA_ARGS__)
+#define TERMINAL_LOG_BINARY_ARGS_7(r, a, ...) TERMINAL_LOG_BINARY_ARG(r, a) TERMINAL_LOG_BINARY_ARGS_6(r, __VA_ARGS__)
+#define TERMINAL_LOG_BINARY_ARGS_8(r, a, ...) TERMINAL_LOG_BINARY_ARG(r, a) TERMINAL_LOG_BINARY_ARGS_7(r, __VA_ARGS__)
+
+//! Appends an int argument to a binary log record
+void terminal_logBinary_putInt(terminal_log_binary_record_t *record, int value);
+
+//! Appends a long argument to a binary log record
+void terminal_logBinary_putLong(terminal_log_binary_record_t *record, long value);
+
+//! Appends a float argument to a binary log record
+void terminal_logBinary_putFloat(terminal_log_binary_record_t *record, float value);
+
+//! Appends a pointer argument to a binary log record
+void terminal_logBinary_putPointer(terminal_log_binary_record_t *record, const void *value);
+
+//! Appends a string argument (zero-terminated) to a binary log record
+void terminal_logBinary_putString(terminal_log_binary_record_t *record, const char *value);
+
+//! Sends a binary log record with the given format string ID
+void terminal_logBinary_write(uint16_t formatId, terminal_log_binary_record_t *record);
+
+//----------------------------------------------------------------------------
+// Function headers
+//----------------------------------------------------------------------------
 
 //! Initialize the terminal
 void terminal_init();
@@ -53,4 +250,28 @@ void terminal_newLine();
 //! Write a formatted string to the terminal with a prefix
 void terminal_log_printf_p(const char *prefix, const char *fmt, ...);
 
+//! Write a formatted string to the terminal with a prefix (arguments as va_list)
+void terminal_log_vprintf_p(const char *prefix, const char *fmt, va_list args);
+
+//! Reserves the terminal for the current process so lines don't interleave
+void terminal_lock(void);
+
+//! Releases the terminal reserved by terminal_lock
+void terminal_unlock(void);
+
+//! Number of bytes dropped because the transmit buffer was full
+uint16_t terminal_getDroppedBytes(void);
+
+//! Checks the rate limit of a module, counts the message as suppressed if it is exceeded
+bool terminal_logAllowed(uint8_t module);
+
+//! Limits a module to the given number of log messages per second (0: unlimited)
+void terminal_setLogRateLimit(uint8_t module, uint8_t messagesPerSecond);
+
+//! Number of log messages that were suppressed by the rate limits
+uint16_t terminal_getSuppressedLogs(void);
+
+//! Flushes buffered output synchronously and switches to polled output for good
+void terminal_panic(void);
+
 #endif /* TERMINAL_H_ */
\ No newline at end of file
@@ -0,0 +1,445 @@
+/*! \file
+ *  \brief Streaming compression of timestamped samples of one parameter.
+ *
+ *  The first sample is stored with 32 bit timestamp and value. Every further
+ *  sample consists of two codes, most significant bit first:
+ *
+ *  Timestamp: zig-zag encoded delta of deltas (ms), prefix and payload bits
+ *    0 -> 0, 10 -> 5, 110 -> 9, 1110 -> 13, 1111 -> 32
+ *
+ *  Value, TIME_SERIES_DELTA: zig-zag encoded delta to the previous value
+ *    0 -> 0, 10 -> 3, 110 -> 7, 1110 -> 16, 1111 -> 32
+ *
+ *  Value, TIME_SERIES_XOR: XOR with the previous value
+ *    0                          equal
+ *    10 <bits>                  meaningful bits fit into the previous window
+ *    11 <5 leading zeros> <5 meaningful bits - 1> <bits>
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#include "timeSeries.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------------
+
+//! Number of prefix codes of timestamps and deltas
+#define TIME_SERIES_BUCKET_COUNT 5
+
+//! The bit counter of the buffer limits its size
+#define TIME_SERIES_MAX_SIZE (TIME_SERIES_HEADER_LENGTH + UINT16_MAX / 8)
+
+//! No window of meaningful bits yet, the first XOR describes its own
+#define TIME_SERIES_NO_WINDOW UINT8_MAX
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+//! Payload bits of the prefix codes of the delta of deltas of the timestamps
+static const uint8_t timeSeries_timeWidths[TIME_SERIES_BUCKET_COUNT] = {0, 5, 9, 13, 32};
+
+//! Payload bits of the prefix codes of the value deltas
+static const uint8_t timeSeries_deltaWidths[TIME_SERIES_BUCKET_COUNT] = {0, 3, 7, 16, 32};
+
+//----------------------------------------------------------------------------
+// Implementation
+//----------------------------------------------------------------------------
+
+//! Maps small negative and positive numbers to small unsigned ones: 0, -1, 1, -2, ...
+static inline uint32_t timeSeries_zigZag(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t timeSeries_unZigZag(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+//! \return Zero bits above the highest set bit, x must not be 0
+static uint8_t timeSeries_leadingZeros(uint32_t x)
+{
+	uint8_t count = 0;
+	while (!(x & 0xFF000000UL))
+	{
+		x <<= 8;
+		count += 8;
+	}
+	while (!(x & 0x80000000UL))
+	{
+		x <<= 1;
+		count++;
+	}
+	return count;
+}
+
+//! \return Zero bits below the lowest set bit, x must not be 0
+static uint8_t timeSeries_trailingZeros(uint32_t x)
+{
+	uint8_t count = 0;
+	while (!(x & 0xFF))
+	{
+		x >>= 8;
+		count += 8;
+	}
+	while (!(x & 1))
+	{
+		x >>= 1;
+		count++;
+	}
+	return count;
+}
+
+/*!
+ *  Appends the lowest count bits, most significant first. The buffer behind
+ *  the written bits has to be zero.
+ *
+ *  \return False if the bits don't fit, nothing is written then
+ */
+static bool timeSeries_writeBits(time_series_t *series, uint32_t bits, uint8_t count)
+{
+	if ((uint32_t)series->bitCount + count > (uint32_t)(series->size - TIME_SERIES_HEADER_LENGTH) * 8)
+	{
+		return false;
+	}
+
+	uint8_t *byte = &series->buffer[TIME_SERIES_HEADER_LENGTH + series->bitCount / 8];
+	uint8_t free = 8 - series->bitCount % 8;
+	series->bitCount += count;
+
+	while (count)
+	{
+		uint8_t const n = count < free ? count : free;
+		count -= n;
+		*byte |= ((uint8_t)(bits >> count) & ((1 << n) - 1)) << (free - n);
+		free -= n;
+		if (!free)
+		{
+			byte++;
+			free = 8;
+		}
+	}
+	return true;
+}
+
+/*!
+ *  Appends value with the shortest prefix code whose payload can hold it
+ *
+ *  \param widths Payload bits of the prefix codes
+ */
+static bool timeSeries_writeCode(time_series_t *series, const uint8_t *widths, uint32_t value)
+{
+	uint8_t bucket = 0;
+	while (bucket < TIME_SERIES_BUCKET_COUNT - 1 && (value >> widths[bucket]))
+	{
+		bucket++;
+	}
+
+	// bucket ones, terminated by a zero unless it's the last code
+	bool const last = bucket == TIME_SERIES_BUCKET_COUNT - 1;
+	uint8_t const prefix = ((1 << bucket) - 1) << !last;
+	return timeSeries_writeBits(series, prefix, bucket + !last) && timeSeries_writeBits(series, value, widths[bucket]);
+}
+
+/*!
+ *  Appends the XOR of a value with the previous one
+ *
+ *  \param x The XOR
+ *  \param leading Zero bits above the window, updated if a new window is written
+ *  \param trailing Zero bits below the window, updated if a new window is written
+ */
+static bool timeSeries_writeXor(time_series_t *series, uint32_t x, uint8_t *leading, uint8_t *trailing)
+{
+	if (!x)
+	{
+		return timeSeries_writeBits(series, 0, 1);
+	}
+
+	uint8_t const newLeading = timeSeries_leadingZeros(x);
+	uint8_t const newTrailing = timeSeries_trailingZeros(x);
+	if (*leading != TIME_SERIES_NO_WINDOW && newLeading >= *leading && newTrailing >= *trailing)
+	{
+		return timeSeries_writeBits(series, 0x2, 2) && timeSeries_writeBits(series, x >> *trailing, 32 - *leading - *trailing);
+	}
+
+	uint8_t const meaningful = 32 - newLeading - newTrailing;
+	*leading = newLeading;
+	*trailing = newTrailing;
+	return timeSeries_writeBits(series, 0x3, 2) && timeSeries_writeBits(series, newLeading, 5) && timeSeries_writeBits(series, meaningful - 1, 5) && timeSeries_writeBits(series, x >> newTrailing, meaningful);
+}
+
+/*!
+ *  Removes the bits behind bitCount, e.g. of a sample that didn't fit
+ */
+static void timeSeries_truncate(time_series_t *series, uint16_t bitCount)
+{
+	uint8_t *byte = &series->buffer[TIME_SERIES_HEADER_LENGTH + bitCount / 8];
+	uint8_t *const end = &series->buffer[TIME_SERIES_HEADER_LENGTH + (series->bitCount + 7) / 8];
+
+	if (bitCount % 8)
+	{
+		*byte++ &= (uint8_t)(0xFF << (8 - bitCount % 8));
+	}
+	while (byte < end)
+	{
+		*byte++ = 0;
+	}
+	series->bitCount = bitCount;
+}
+
+/*!
+ *  Starts an empty series. The whole buffer belongs to the series until
+ *  it's started again.
+ *
+ *  \param series State of the series
+ *  \param mode How the values are compressed
+ *  \param buffer Receives header and compressed samples
+ *  \param size Bytes in buffer, at least TIME_SERIES_HEADER_LENGTH, at most about 8 KiB are used
+ */
+void timeSeries_init(time_series_t *series, time_series_mode_t mode, void *buffer, uint16_t size)
+{
+	memset(series, 0, sizeof(*series));
+	series->buffer = buffer;
+	series->size = size < TIME_SERIES_MAX_SIZE ? size : TIME_SERIES_MAX_SIZE;
+	series->mode = mode;
+	series->leading = TIME_SERIES_NO_WINDOW;
+
+	memset(buffer, 0, series->size);
+	series->buffer[0] = mode;
+}
+
+/*!
+ *  Appends a sample in constant time
+ *
+ *  \param series State of the series
+ *  \param time Timestamp in ms, the timestamps have to grow by less than 2^31 per sample
+ *  \param value The value, a signed integer for TIME_SERIES_DELTA or the bits of a float for TIME_SERIES_XOR
+ *  \return False if the sample doesn't fit into the buffer anymore
+ */
+bool timeSeries_append(time_series_t *series, uint32_t time, uint32_t value)
+{
+	uint16_t const start = series->bitCount;
+	int32_t delta = 0;
+	uint8_t leading = series->leading;
+	uint8_t trailing = series->trailing;
+	bool fits;
+
+	if (!series->count)
+	{
+		fits = timeSeries_writeBits(series, time, 32) && timeSeries_writeBits(series, value, 32);
+	}
+	else
+	{
+		delta = time - series->lastTime;
+		fits = timeSeries_writeCode(series, timeSeries_timeWidths, timeSeries_zigZag(delta - series->lastDelta));
+		if (series->mode == TIME_SERIES_DELTA)
+		{
+			fits = fits && timeSeries_writeCode(series, timeSeries_deltaWidths, timeSeries_zigZag(value - series->lastValue));
+		}
+		else
+		{
+			fits = fits && timeSeries_writeXor(series, value ^ series->lastValue, &leading, &trailing);
+		}
+	}
+
+	if (!fits)
+	{
+		timeSeries_truncate(series, start);
+		return false;
+	}
+
+	series->lastTime = time;
+	series->lastDelta = delta;
+	series->lastValue = value;
+	series->leading = leading;
+	series->trailing = trailing;
+	series->count++;
+	series->buffer[1] = series->count;
+	series->buffer[2] = series->count >> 8;
+	return true;
+}
+
+/*!
+ *  \return Bytes to store or send, header included
+ */
+uint16_t timeSeries_getLength(const time_series_t *series)
+{
+	return TIME_SERIES_HEADER_LENGTH + (series->bitCount + 7) / 8;
+}
+
+/*!
+ *  Reads count bits, most significant first
+ *
+ *  \return False if the data end before
+ */
+static bool timeSeries_readBits(time_series_reader_t *reader, uint8_t count, uint32_t *bits)
+{
+	if ((uint32_t)reader->position + count > reader->bitCount)
+	{
+		return false;
+	}
+
+	*bits = 0;
+	while (count)
+	{
+		uint8_t const offset = reader->position % 8;
+		uint8_t const n = count < 8 - offset ? count : 8 - offset;
+		*bits = (*bits << n) | ((reader->buffer[reader->position / 8] >> (8 - offset - n)) & ((1 << n) - 1));
+		reader->position += n;
+		count -= n;
+	}
+	return true;
+}
+
+//! Reads a value written by timeSeries_writeCode
+static bool timeSeries_readCode(time_series_reader_t *reader, const uint8_t *widths, uint32_t *value)
+{
+	uint8_t bucket = 0;
+	uint32_t bit;
+	while (bucket < TIME_SERIES_BUCKET_COUNT - 1)
+	{
+		if (!timeSeries_readBits(reader, 1, &bit))
+		{
+			return false;
+		}
+		if (!bit)
+		{
+			break;
+		}
+		bucket++;
+	}
+	return timeSeries_readBits(reader, widths[bucket], value);
+}
+
+//! Reads an XOR written by timeSeries_writeXor
+static bool timeSeries_readXor(time_series_reader_t *reader, uint32_t *x)
+{
+	uint32_t bits;
+	if (!timeSeries_readBits(reader, 1, &bits))
+	{
+		return false;
+	}
+	if (!bits)
+	{
+		*x = 0;
+		return true;
+	}
+
+	if (!timeSeries_readBits(reader, 1, &bits))
+	{
+		return false;
+	}
+	if (bits)
+	{
+		uint32_t leading;
+		uint32_t meaningful;
+		if (!timeSeries_readBits(reader, 5, &leading) || !timeSeries_readBits(reader, 5, &meaningful))
+		{
+			return false;
+		}
+		reader->leading = leading;
+		reader->trailing = 32 - leading - (meaningful + 1);
+	}
+	else if (reader->leading == TIME_SERIES_NO_WINDOW)
+	{
+		return false;
+	}
+
+	if (!timeSeries_readBits(reader, 32 - reader->leading - reader->trailing, &bits))
+	{
+		return false;
+	}
+	*x = bits << reader->trailing;
+	return true;
+}
+
+/*!
+ *  Starts reading a series, e.g. one that has been received
+ *
+ *  \param reader State of the reading
+ *  \param data Header and compressed samples, must stay valid while reading
+ *  \param length Bytes in data
+ *  \return False if data don't start with a valid header
+ */
+bool timeSeries_startReading(time_series_reader_t *reader, const void *data, uint16_t length)
+{
+	const uint8_t *const bytes = data;
+	if (length < TIME_SERIES_HEADER_LENGTH || bytes[0] > TIME_SERIES_XOR)
+	{
+		return false;
+	}
+
+	memset(reader, 0, sizeof(*reader));
+	reader->buffer = bytes + TIME_SERIES_HEADER_LENGTH;
+	length = length < TIME_SERIES_MAX_SIZE ? length : TIME_SERIES_MAX_SIZE;
+	reader->bitCount = (length - TIME_SERIES_HEADER_LENGTH) * 8;
+	reader->mode = bytes[0];
+	reader->remaining = bytes[1] | (uint16_t)bytes[2] << 8;
+	reader->leading = TIME_SERIES_NO_WINDOW;
+	return true;
+}
+
+/*!
+ *  Reads the next sample
+ *
+ *  \param reader State of the reading
+ *  \param time Receives the timestamp
+ *  \param value Receives the value
+ *  \return False if all samples have been read or the data are cut off
+ */
+bool timeSeries_read(time_series_reader_t *reader, uint32_t *time, uint32_t *value)
+{
+	if (!reader->remaining)
+	{
+		return false;
+	}
+
+	int32_t delta = 0;
+	uint32_t code;
+	if (!reader->index)
+	{
+		if (!timeSeries_readBits(reader, 32, time) || !timeSeries_readBits(reader, 32, value))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		if (!timeSeries_readCode(reader, timeSeries_timeWidths, &code))
+		{
+			return false;
+		}
+		delta = reader->lastDelta + timeSeries_unZigZag(code);
+		*time = reader->lastTime + delta;
+
+		if (reader->mode == TIME_SERIES_DELTA)
+		{
+			if (!timeSeries_readCode(reader, timeSeries_deltaWidths, &code))
+			{
+				return false;
+			}
+			*value = reader->lastValue + timeSeries_unZigZag(code);
+		}
+		else
+		{
+			if (!timeSeries_readXor(reader, &code))
+			{
+				return false;
+			}
+			*value = reader->lastValue ^ code;
+		}
+	}
+
+	reader->lastTime = *time;
+	reader->lastDelta = delta;
+	reader->lastValue = *value;
+	reader->remaining--;
+	reader->index++;
+	return true;
+}
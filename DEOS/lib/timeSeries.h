@@ -0,0 +1,87 @@
+/*! \file
+ *  \brief Streaming compression of timestamped samples of one parameter.
+ *
+ *  Timestamps are stored as delta of deltas, so a steady sampling interval
+ *  takes a single bit per sample. Values are stored either as zig-zag
+ *  encoded deltas (TIME_SERIES_DELTA, for fixed-point integers) or as XOR
+ *  with the previous value (TIME_SERIES_XOR, for the bits of floats). Both
+ *  use short prefix codes, see timeSeries.c. Every sample is appended in
+ *  constant time, the buffer is written bit by bit with no further state.
+ *
+ *  The buffer starts with a small header, so it can be decoded on its own,
+ *  e.g. after it has been sent with rfTransfer_send. tools/seriesdecode.py
+ *  decodes it on the host.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef TIME_SERIES_H_
+#define TIME_SERIES_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Bytes in front of the compressed samples: mode and number of samples
+#define TIME_SERIES_HEADER_LENGTH 3
+
+//! How the values are compressed
+typedef enum TimeSeriesMode
+{
+	//! Values are signed integers, e.g. tenths of a degree
+	TIME_SERIES_DELTA = 0,
+	//! Values are the bits of floats, e.g. sensor_parameter_t.uValue
+	TIME_SERIES_XOR = 1
+} time_series_mode_t;
+
+//! A series that is being written into a buffer provided by the caller
+typedef struct TimeSeries
+{
+	uint8_t *buffer;
+	uint16_t size;
+	//! Bits of compressed samples behind the header
+	uint16_t bitCount;
+	time_series_mode_t mode;
+	uint16_t count;
+	uint32_t lastTime;
+	int32_t lastDelta;
+	uint32_t lastValue;
+	//! Zero bits around the meaningful bits of the last XOR, TIME_SERIES_XOR only
+	uint8_t leading;
+	uint8_t trailing;
+} time_series_t;
+
+//! Reads the samples of a compressed series one by one
+typedef struct TimeSeriesReader
+{
+	const uint8_t *buffer;
+	uint16_t bitCount;
+	uint16_t position;
+	time_series_mode_t mode;
+	//! Samples that have not been read yet
+	uint16_t remaining;
+	uint16_t index;
+	uint32_t lastTime;
+	int32_t lastDelta;
+	uint32_t lastValue;
+	uint8_t leading;
+	uint8_t trailing;
+} time_series_reader_t;
+
+//! Starts an empty series in buffer, which needs at least TIME_SERIES_HEADER_LENGTH bytes
+void timeSeries_init(time_series_t *series, time_series_mode_t mode, void *buffer, uint16_t size);
+
+//! Appends a sample, returns false if the buffer is full
+bool timeSeries_append(time_series_t *series, uint32_t time, uint32_t value);
+
+//! Returns the number of bytes of the buffer that are in use, header included
+uint16_t timeSeries_getLength(const time_series_t *series);
+
+//! Starts reading a series of length bytes, returns false if it has no valid header
+bool timeSeries_startReading(time_series_reader_t *reader, const void *data, uint16_t length);
+
+//! Reads the next sample, returns false at the end of the series
+bool timeSeries_read(time_series_reader_t *reader, uint32_t *time, uint32_t *value);
+
+#endif /* TIME_SERIES_H_ */
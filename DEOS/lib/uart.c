@@ -43,7 +43,9 @@ LICENSE:
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <string.h>
 #include "uart.h"
+#include "util.h"
 
 
 /*
@@ -70,6 +72,11 @@ LICENSE:
 #if ( UART1_TX_BUFFER_SIZE & UART1_TX_BUFFER_MASK )
 #error TX1 buffer size is not a power of 2
 #endif
+#define UART1_RX_STAMP_MASK ( UART1_RX_STAMP_COUNT - 1)
+
+#if ( UART1_RX_STAMP_COUNT & UART1_RX_STAMP_MASK )
+#error RX1 stamp count is not a power of 2
+#endif
 
 #define UART2_RX_BUFFER_MASK ( UART2_RX_BUFFER_SIZE - 1)
 #define UART2_TX_BUFFER_MASK ( UART2_TX_BUFFER_SIZE - 1)
@@ -90,6 +97,9 @@ LICENSE:
 #if ( UART3_TX_BUFFER_SIZE & UART3_TX_BUFFER_MASK )
 #error TX3 buffer size is not a power of 2
 #endif
+#if ( (UART3_RX_BUFFER_SIZE > 0) != (UART3_TX_BUFFER_SIZE > 0) )
+#error UART3 needs either both or none of its buffers
+#endif
 
 
 #if defined(__AVR_AT90S2313__) || defined(__AVR_AT90S4414__) || defined(__AVR_AT90S8515__) || \
@@ -454,6 +464,15 @@ static volatile unsigned char UART1_TxTail;
 static volatile unsigned char UART1_RxHead;
 static volatile unsigned char UART1_RxTail;
 static volatile unsigned char UART1_LastRxError;
+static int16_t (*volatile UART1_TxSource)(void);
+/* FH Aachen: arrival times of the last received marker bytes and where they are in the ringbuffer */
+static volatile int16_t UART1_RxStampMarker = -1;
+static volatile unsigned char UART1_RxStampIndex[UART1_RX_STAMP_COUNT];
+static volatile uint32_t UART1_RxStampTime[UART1_RX_STAMP_COUNT];
+static volatile unsigned char UART1_RxStampNext;
+static volatile unsigned char UART1_FlowControl;
+static volatile unsigned char UART1_TxPaused;
+static volatile uart1_counters_t UART1_Counters;
 #endif
 
 #if defined( ATMEGA_USART2 )
@@ -466,7 +485,7 @@ static volatile unsigned char UART2_RxTail;
 static volatile unsigned char UART2_LastRxError;
 #endif
 
-#if defined( ATMEGA_USART3 )
+#if defined( ATMEGA_USART3 ) && UART3_RX_BUFFER_SIZE > 0
 static volatile unsigned char UART3_TxBuf[UART3_TX_BUFFER_SIZE];
 static volatile unsigned char UART3_RxBuf[UART3_RX_BUFFER_SIZE];
 static volatile unsigned char UART3_TxHead;
@@ -732,6 +751,28 @@ void uart0_disable()
  */
 #if defined( ATMEGA_USART1 )
 
+/* FH Aachen: records the arrival of the marker byte at index, interrupts must be disabled */
+static inline void uart1_stamp(unsigned char index)
+{
+    unsigned char next = UART1_RxStampNext;
+
+    UART1_RxStampIndex[next] = index;
+    UART1_RxStampTime[next] = getSystemTime_us();
+    UART1_RxStampNext = (next + 1) & UART1_RX_STAMP_MASK;
+}
+
+/* FH Aachen: raises RTS when the receive ringbuffer is nearly full and lowers it when it has been emptied enough */
+static inline void uart1_updaterts(void)
+{
+    unsigned char filling = (UART1_RxHead - UART1_RxTail) & UART1_RX_BUFFER_MASK;
+
+    if ( filling >= UART1_RTS_OFF_LEVEL ) {
+        UART1_RTS_PORT |= _BV(UART1_RTS_BIT);
+    }else if ( filling <= UART1_RTS_ON_LEVEL ) {
+        UART1_RTS_PORT &= ~_BV(UART1_RTS_BIT);
+    }
+}
+
 ISR(UART1_RECEIVE_INTERRUPT)
 /*************************************************************************
 Function: UART1 Receive Complete interrupt
@@ -750,6 +791,14 @@ Purpose:  called when the UART1 has received a character
     
     /* get FEn (Frame Error) DORn (Data OverRun) UPEn (USART Parity Error) bits */
     lastRxError = usr & (_BV(FE1)|_BV(DOR1)|_BV(UPE1) );
+
+    /* FH Aachen: the errors are counted, UART1_LastRxError is cleared by uart1_commit before anyone looks at it */
+    if ( lastRxError & _BV(FE1) ) {
+        UART1_Counters.frameErrors++;
+    }
+    if ( lastRxError & _BV(DOR1) ) {
+        UART1_Counters.overruns++;
+    }
             
     /* calculate buffer index */ 
     tmphead = ( UART1_RxHead + 1) & UART1_RX_BUFFER_MASK;
@@ -757,11 +806,20 @@ Purpose:  called when the UART1 has received a character
     if ( tmphead == UART1_RxTail ) {
         /* error: receive buffer overflow */
         lastRxError = UART_BUFFER_OVERFLOW >> 8;
+        UART1_Counters.overflows++;
     }else{
+        UART1_Counters.rxBytes++;
         /* store new index */
         UART1_RxHead = tmphead;
         /* store received data in buffer */
         UART1_RxBuf[tmphead] = data;
+        /* FH Aachen: the arrival time is taken as close to the line as possible */
+        if ( data == UART1_RxStampMarker ) {
+            uart1_stamp(tmphead);
+        }
+    }
+    if ( UART1_FlowControl ) {
+        uart1_updaterts();
     }
     UART1_LastRxError |= lastRxError;   
 }
@@ -774,14 +832,27 @@ Purpose:  called when the UART1 is ready to transmit the next byte
 **************************************************************************/
 {
     unsigned char tmptail;
+    int16_t data;
 
-    
-    if ( UART1_TxHead != UART1_TxTail) {
+    /* FH Aachen: the peer can't take more bytes, uart1_pollflow resumes once CTS is low again */
+    if ( UART1_FlowControl && bit_is_set(UART1_CTS_PIN, UART1_CTS_BIT) ) {
+        UART1_CONTROL &= ~_BV(UART1_UDRIE);
+        UART1_TxPaused = 1;
+        UART1_Counters.ctsPauses++;
+        return;
+    }
+
+    /* FH Aachen: bytes of the transmit source come first, so they are never interrupted by buffered bytes */
+    if ( UART1_TxSource && (data = UART1_TxSource()) >= 0 ) {
+        UART1_DATA = (unsigned char)data;
+        UART1_Counters.txBytes++;
+    }else if ( UART1_TxHead != UART1_TxTail) {
         /* calculate and store new buffer index */
         tmptail = (UART1_TxTail + 1) & UART1_TX_BUFFER_MASK;
         UART1_TxTail = tmptail;
         /* get one byte from buffer and write it to UART */
         UART1_DATA = UART1_TxBuf[tmptail];  /* start transmission */
+        UART1_Counters.txBytes++;
     }else{
         /* tx buffer empty, disable UDRE interrupt */
         UART1_CONTROL &= ~_BV(UART1_UDRIE);
@@ -819,14 +890,18 @@ void uart1_init(unsigned int baudrate)
 #endif
 #endif
 
-    /* Set baud rate */
+    /* Set baud rate, FH Aachen: double speed is switched off again, the rate may change at runtime */
     if ( baudrate & 0x8000 ) 
     {
         #if UART1_BIT_U2X
     	UART1_STATUS = (1<<UART1_BIT_U2X);  //Enable 2x speed 
         #endif
     }
-    UART1_UBRRH = (unsigned char)((baudrate>>8)&0x80) ;
+    else
+    {
+        UART1_STATUS = 0;
+    }
+    UART1_UBRRH = (unsigned char)((baudrate>>8)&0x0F) ;
     UART1_UBRRL = (unsigned char) baudrate;
         
     /* Enable USART receiver and transmitter and receive complete interrupt */
@@ -870,6 +945,9 @@ unsigned int uart1_getc(void)
     UART1_RxTail = tmptail; 
     
     UART1_LastRxError = 0;
+    if ( UART1_FlowControl ) {
+        uart1_updaterts();
+    }
     return (lastRxError << 8) + data;
 
 }/* uart1_getc */
@@ -957,6 +1035,164 @@ void uart1_disable()
 	cbi(UART1_CONTROL, UART1_BIT_TXEN);
 }
 //! ===========================================================================
+
+/* -- Modifications by FH Aachen -- */
+void uart1_injectc(unsigned char data)
+{
+    unsigned char tmphead;
+    unsigned char sreg = SREG;
+
+    /* same as the receive interrupt, which must not interfere */
+    cli();
+    tmphead = ( UART1_RxHead + 1) & UART1_RX_BUFFER_MASK;
+
+    if ( tmphead == UART1_RxTail ) {
+        /* error: receive buffer overflow */
+        UART1_LastRxError |= UART_BUFFER_OVERFLOW >> 8;
+        UART1_Counters.overflows++;
+    }else{
+        UART1_RxBuf[tmphead] = data;
+        UART1_RxHead = tmphead;
+        UART1_Counters.rxBytes++;
+        if ( data == UART1_RxStampMarker ) {
+            uart1_stamp(tmphead);
+        }
+    }
+    if ( UART1_FlowControl ) {
+        uart1_updaterts();
+    }
+    SREG = sreg;
+}
+
+uint16_t uart1_peek(uint16_t offset, const unsigned char **data)
+{
+    unsigned char head = UART1_RxHead;
+    uint16_t filling = BUFFER_FILLING(head, UART1_RxTail, UART1_RX_BUFFER_SIZE);
+    uint16_t index;
+    uint16_t contiguous;
+
+    if ( offset >= filling ) {
+        return 0;   /* no data available */
+    }
+
+    /* bytes between tail and head are not touched by the receive interrupt until they are committed */
+    index = (UART1_RxTail + 1 + offset) & UART1_RX_BUFFER_MASK;
+    *data = (const unsigned char *)&UART1_RxBuf[index];
+
+    /* stop at the end of the buffer, the rest is at its beginning */
+    contiguous = UART1_RX_BUFFER_SIZE - index;
+    return (filling - offset < contiguous) ? filling - offset : contiguous;
+}
+
+void uart1_commit(uint16_t count)
+{
+    UART1_RxTail = (UART1_RxTail + count) & UART1_RX_BUFFER_MASK;
+    UART1_LastRxError = 0;
+    if ( UART1_FlowControl ) {
+        uart1_updaterts();
+    }
+}
+
+void uart1_settxsource(int16_t (*source)(void))
+{
+    UART1_TxSource = source;
+}
+
+void uart1_starttx(void)
+{
+    /* enable UDRE interrupt, it pulls from the transmit source until it returns a negative value */
+    UART1_CONTROL |= _BV(UART1_UDRIE);
+}
+
+void uart1_setrxstamp(int16_t marker)
+{
+    unsigned char sreg = SREG;
+
+    cli();
+    UART1_RxStampMarker = marker;
+    /* stamps of the previous marker must not be found for bytes that arrive later */
+    for ( unsigned char i = 0; i < UART1_RX_STAMP_COUNT; i++ ) {
+        UART1_RxStampIndex[i] = UART1_RxTail;
+    }
+    SREG = sreg;
+}
+
+unsigned char uart1_getrxstamp(uint16_t offset, uint32_t *time)
+{
+    unsigned char sreg = SREG;
+    unsigned char index = (UART1_RxTail + 1 + offset) & UART1_RX_BUFFER_MASK;
+    unsigned char next;
+    unsigned char found = 0;
+
+    cli();
+    /* newest first, an older stamp of the same index belongs to a byte that has already been removed */
+    next = UART1_RxStampNext;
+    for ( unsigned char i = 1; i <= UART1_RX_STAMP_COUNT; i++ ) {
+        unsigned char stamp = (next - i) & UART1_RX_STAMP_MASK;
+        if ( UART1_RxStampIndex[stamp] == index ) {
+            *time = UART1_RxStampTime[stamp];
+            found = UART1_RxBuf[index] == UART1_RxStampMarker;
+            break;
+        }
+    }
+    SREG = sreg;
+    return found;
+}
+
+void uart1_setflowcontrol(unsigned char enable)
+{
+    unsigned char sreg = SREG;
+
+    cli();
+    if ( enable ) {
+        UART1_CTS_DDR &= ~_BV(UART1_CTS_BIT);
+        UART1_RTS_DDR |= _BV(UART1_RTS_BIT);
+        UART1_FlowControl = 1;
+        uart1_updaterts();
+    }else{
+        /* the peer may send whenever it wants, the pins are only touched if flow control was enabled */
+        if ( UART1_FlowControl ) {
+            UART1_RTS_PORT &= ~_BV(UART1_RTS_BIT);
+        }
+        UART1_FlowControl = 0;
+        if ( UART1_TxPaused ) {
+            UART1_TxPaused = 0;
+            UART1_CONTROL |= _BV(UART1_UDRIE);
+        }
+    }
+    SREG = sreg;
+}
+
+void uart1_pollflow(void)
+{
+    unsigned char sreg = SREG;
+
+    if ( !UART1_FlowControl ) {
+        return;
+    }
+
+    cli();
+    uart1_updaterts();
+    if ( UART1_TxPaused && bit_is_clear(UART1_CTS_PIN, UART1_CTS_BIT) ) {
+        UART1_TxPaused = 0;
+        UART1_CONTROL |= _BV(UART1_UDRIE);
+    }
+    SREG = sreg;
+}
+
+void uart1_getcounters(uart1_counters_t *counters, unsigned char reset)
+{
+    unsigned char sreg = SREG;
+
+    /* the interrupts update the counters, they are copied at once */
+    cli();
+    memcpy(counters, (const void *)&UART1_Counters, sizeof(*counters));
+    if ( reset ) {
+        memset((void *)&UART1_Counters, 0, sizeof(UART1_Counters));
+    }
+    SREG = sreg;
+}
+/* --------------------------------*/
 #endif
 
 //! USART 2 =======================================================================================
@@ -1014,6 +1250,25 @@ void uart2_flush_blocking()
         UART2_DATA = UART2_TxBuf[tmptail];  /* start transmission */
     }
 }
+
+unsigned char uart2_tryputc(unsigned char data)
+{
+    unsigned char tmphead;
+
+    tmphead = (UART2_TxHead + 1) & UART2_TX_BUFFER_MASK;
+
+    if ( tmphead == UART2_TxTail ) {
+        return 0;   /* buffer full, caller decides whether to wait or drop */
+    }
+
+    UART2_TxBuf[tmphead] = data;
+    UART2_TxHead = tmphead;
+
+    /* enable UDRE interrupt */
+    UART2_CONTROL |= _BV(UART2_UDRIE);
+
+    return 1;
+}
 /* --------------------------------*/
 
 ISR(UART2_TRANSMIT_INTERRUPT)
@@ -1210,9 +1465,10 @@ void uart2_disable()
 
 //! USART 3 =======================================================================================
 /*
- * these functions are only for ATmegas with four USART
+ * these functions are only for ATmegas with four USART,
+ * and only built if UART3 has buffers (see UART3_RX_BUFFER_SIZE)
  */
-#if defined( ATMEGA_USART3 )
+#if defined( ATMEGA_USART3 ) && UART3_RX_BUFFER_SIZE > 0
 
 ISR(UART3_RECEIVE_INTERRUPT)
 /*************************************************************************
@@ -60,6 +60,37 @@ LICENSE:
 
 /* -- Modifications by FH Aachen -- */
 void uart2_flush_blocking();
+//! Puts a byte into the UART2 transmit ringbuffer without waiting, returns 0 if the ringbuffer is full
+unsigned char uart2_tryputc(unsigned char data);
+//! Puts a byte into the UART1 receive ringbuffer as if it had been received (loopback for tests)
+void uart1_injectc(unsigned char data);
+//! Returns how many received bytes are stored contiguously from the offset-th unread byte on and points data to them, without removing them
+uint16_t uart1_peek(uint16_t offset, const unsigned char **data);
+//! Removes the count oldest bytes from the UART1 receive ringbuffer, e.g. after they have been used through uart1_peek
+void uart1_commit(uint16_t count);
+//! Sets a function that the UART1 transmit interrupt calls for the next byte, it returns a negative value if there is none
+void uart1_settxsource(int16_t (*source)(void));
+//! Starts pulling bytes from the transmit source, e.g. after it has got new data
+void uart1_starttx(void);
+//! Records the arrival time (us) of every received byte equal to marker, a negative marker disables it
+void uart1_setrxstamp(int16_t marker);
+//! Returns 1 and the arrival time of the offset-th unread byte if it's a marker byte whose stamp is still kept
+unsigned char uart1_getrxstamp(uint16_t offset, uint32_t *time);
+//! Enables RTS/CTS flow control of UART1, RTS follows the fill level of the receive ringbuffer and CTS pauses transmission
+void uart1_setflowcontrol(unsigned char enable);
+//! Updates RTS and resumes a transmission that CTS has paused, needs to be called periodically while flow control is enabled, e.g. by the scheduler
+void uart1_pollflow(void);
+//! Counters of UART1 since the last reset, see uart1_getcounters
+typedef struct {
+    uint32_t rxBytes;       //!< bytes stored in the receive ringbuffer, injected ones included
+    uint32_t txBytes;       //!< bytes written to the data register
+    uint16_t frameErrors;   //!< bytes received without a valid stop bit
+    uint16_t overruns;      //!< times bytes were lost since the receive interrupt came too late
+    uint16_t overflows;     //!< bytes lost since the receive ringbuffer was full
+    uint16_t ctsPauses;     //!< times CTS paused the transmission
+} uart1_counters_t;
+//! Copies the counters of UART1, they are reset afterwards if reset is set
+void uart1_getcounters(uart1_counters_t *counters, unsigned char reset);
 /* --------------------------------*/
 
 
@@ -116,7 +147,40 @@ void uart2_flush_blocking();
  *  CDEFS += -DUART_TX_BUFFER_SIZE=nn to your Makefile.
  */
 #ifndef UART1_TX_BUFFER_SIZE
-#define UART1_TX_BUFFER_SIZE 64
+#define UART1_TX_BUFFER_SIZE 16 // frames are pulled through uart1_settxsource
+#endif
+
+/** @brief  Number of arrival times of marker bytes the UART1 keeps, must be power of 2
+ *
+ *  A stamp is lost once this many newer marker bytes have arrived, see uart1_setrxstamp.
+ */
+#ifndef UART1_RX_STAMP_COUNT
+#define UART1_RX_STAMP_COUNT 8
+#endif
+
+/** @brief  Fill level of the UART1 receive ringbuffer at which RTS asks the peer to stop sending
+ *
+ *  The peer may still send a few bytes after RTS has been raised, the rest of the ringbuffer takes them.
+ */
+#ifndef UART1_RTS_OFF_LEVEL
+#define UART1_RTS_OFF_LEVEL (UART1_RX_BUFFER_SIZE - 32)
+#endif
+
+/** @brief  Fill level of the UART1 receive ringbuffer at which RTS lets the peer send again */
+#ifndef UART1_RTS_ON_LEVEL
+#define UART1_RTS_ON_LEVEL (UART1_RX_BUFFER_SIZE / 2)
+#endif
+
+/** @brief  Pin of the UART1 RTS output and the CTS input, both active low, adapt them to the wiring */
+#ifndef UART1_RTS_PORT
+#define UART1_RTS_PORT    PORTD
+#define UART1_RTS_DDR     DDRD
+#define UART1_RTS_BIT     PD4
+#endif
+#ifndef UART1_CTS_PIN
+#define UART1_CTS_PIN     PIND
+#define UART1_CTS_DDR     DDRD
+#define UART1_CTS_BIT     PD5
 #endif
 
 /** @brief  Size of the UART2 circular receive buffer, must be power of 2, and <= 256
@@ -143,7 +207,7 @@ void uart2_flush_blocking();
  *  CDEFS += -DUART_RX_BUFFER_SIZE=nn to your Makefile.
  */
 #ifndef UART3_RX_BUFFER_SIZE
-#define UART3_RX_BUFFER_SIZE 64
+#define UART3_RX_BUFFER_SIZE 0 // UART3 is not used
 #endif
 
 /** @brief  Size of the UART3 circular transmit buffer, must be power of 2, and <= 256
@@ -152,7 +216,7 @@ void uart2_flush_blocking();
  *  CDEFS += -DUART_TX_BUFFER_SIZE=nn to your Makefile.
  */
 #ifndef UART3_TX_BUFFER_SIZE
-#define UART3_TX_BUFFER_SIZE 64
+#define UART3_TX_BUFFER_SIZE 0 // UART3 is not used
 #endif
 
 /* test if the size of the circular buffers fits into SRAM */
@@ -279,6 +343,7 @@ extern void uart2_puts_p(const char *s );
 /** @brief  Macro to automatically put a string constant into program memory */
 #define uart2_puts_P(__s)       uart2_puts_p(PSTR(__s))
 
+#if UART3_RX_BUFFER_SIZE > 0
 /** @brief  Initialize USART3 (only available on selected ATmegas) @see uart_init */
 extern void uart3_init(unsigned int baudrate);
 /** @brief  Get received byte of USART3 from ringbuffer. (only available on selected ATmega) @see uart_getc */
@@ -291,6 +356,7 @@ extern void uart3_puts(const char *s );
 extern void uart3_puts_p(const char *s );
 /** @brief  Macro to automatically put a string constant into program memory */
 #define uart3_puts_P(__s)       uart3_puts_p(PSTR(__s))
+#endif
 
 /**@}*/
 
@@ -302,8 +368,10 @@ extern uint16_t uart0_getrxcount();
 extern uint16_t uart1_getrxcount();
 //! Returns current filling of the buffer in byte
 extern uint16_t uart2_getrxcount();
+#if UART3_RX_BUFFER_SIZE > 0
 //! Returns current filling of the buffer in byte
 extern uint16_t uart3_getrxcount();
+#endif
 
 //! Returns current filling of the buffer in byte
 extern uint16_t uart0_gettxcount();
@@ -311,8 +379,10 @@ extern uint16_t uart0_gettxcount();
 extern uint16_t uart1_gettxcount();
 //! Returns current filling of the buffer in byte
 extern uint16_t uart2_gettxcount();
+#if UART3_RX_BUFFER_SIZE > 0
 //! Returns current filling of the buffer in byte
 extern uint16_t uart3_gettxcount();
+#endif
 
 //! Disables the RX/TX ports to not provide the connected device with energy
 extern void uart0_disable();
@@ -320,8 +390,10 @@ extern void uart0_disable();
 extern void uart1_disable();
 //! Disables the RX/TX ports to not provide the connected device with energy
 extern void uart2_disable();
+#if UART3_RX_BUFFER_SIZE > 0
 //! Disables the RX/TX ports to not provide the connected device with energy
 extern void uart3_disable();
+#endif
 
 
 #endif // UART_H 
@@ -77,6 +77,36 @@ time_t getSystemTime_ms(void)
 	return t;
 }
 
+/*!
+ *  Get system time with a precision of one timer 0 tick (4 us), calculated
+ *  from the millisecond counter and the current timer value.
+ *  Differences between two timestamps stay correct across the wrap around.
+ *
+ *  \return The current system time in microseconds
+ */
+time_t getSystemTime_us(void)
+{
+	uint8_t ie = gbi(SREG, 7);
+	cli();
+
+	time_t ms = os_coarseSystemTime;
+	uint8_t ticks = TCNT0;
+	// The compare match already happened, but its ISR didn't run yet.
+	// Read the timer again, it might have wrapped after the first read.
+	if (gbi(TIFR0, OCF0A))
+	{
+		ticks = TCNT0;
+		++ms;
+	}
+
+	if (ie)
+	{
+		sei();
+	}
+
+	return ms * 1000 + ticks * (1000 / (TIMER_OCR + 1));
+}
+
 /*!
  *  Function that may be used to wait for specific time intervals.
  *  Therefore, we calculate the relative time to wait. This value is added to the current system time
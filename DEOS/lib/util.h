@@ -25,6 +25,9 @@ void initSystemTime(void);
 //! Returns system time in ms
 time_t getSystemTime_ms(void);
 
+//! Returns system time in us (wraps after about 71 minutes)
+time_t getSystemTime_us(void);
+
 //----------------------------------------------------------------------------
 // Function headers
 //----------------------------------------------------------------------------
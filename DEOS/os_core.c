@@ -4,6 +4,8 @@
  *
  */
 
+#define LOG_MODULE SCHEDULER
+
 #include "os_core.h"
 #include "lib/defines.h"
 #include "lib/lcd.h"
@@ -77,18 +79,21 @@ void os_errorPstr(const char *msg, ...)
 	// Make sure we have enough stack left for sure (we can mess with it because we won't go out of this function)
 	SP = BOTTOM_OF_MAIN_STACK;
 
+	// Interrupts are off from now on, so buffered terminal output has to be sent synchronously
+	terminal_panic();
+
 	// Clear display and write error message
 	lcd_clear();
 
 	// Print error message to lcd (variadic arguments)
 	va_list args;
 	va_start(args, msg);
-	lcd_printf_p(msg, args);
+	lcd_vprintf_p(msg, args);
 	va_end(args);
 
 	// Print error message to terminal (variadic arguments)
 	va_start(args, msg);
-	terminal_log_printf_p(PSTR("[ERROR] "), msg, args);
+	terminal_log_vprintf_p(PSTR("[ERROR] "), msg, args);
 	va_end(args);
 
 	// Catch system in this infinite loop and play a small animation to indicate an error
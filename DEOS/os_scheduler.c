@@ -5,8 +5,11 @@
  *
  */
 
+#define LOG_MODULE SCHEDULER
+
 #include "os_scheduler.h"
 #include "lib/lcd.h"
+#include "lib/uart.h"
 #include "lib/util.h"
 #include "os_core.h"
 #include "os_process.h"
@@ -350,6 +353,9 @@ ISR(TIMER2_COMPA_vect)
 	// 3. Set stack pointer to the scheduler stack (BOTTOM_OF_ISR_STACK)
 	SP = BOTTOM_OF_ISR_STACK;
 
+	// Resume a transmission CTS has paused, the worker that does it otherwise may be waiting for the transmit queue itself
+	uart1_pollflow();
+
 	// Now, check if the stack of currentProc is still in bounds
 	if (!os_isStackInBounds(currentProc))
 	{
@@ -8,6 +8,8 @@
  *  -dynamic-priority-round-robin
 */
 
+#define LOG_MODULE SCHEDULER
+
 #include "os_scheduling_strategies.h"
 #include "lib/defines.h"
 #include "lib/ready_queue.h"
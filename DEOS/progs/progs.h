@@ -10,15 +10,35 @@
 #define TT_STACK_CONSISTENCY	23
 #define TT_YIELD				24
 #define TT_ISR_Benchmark		25
+#define TT_FORMAT_BENCHMARK		26
+#define TT_LOG_BINARY			27
 
 // Testtasks for exercise 3
 #define TT_COMMUNICATION		30
 #define TT_PROTOCOLSTACK        31
 #define TT_CONIFGXBEE           32
+#define TT_RF_PING              33
+#define TT_COMM_BENCHMARK       34
+#define TT_RF_RELIABLE          35
+#define TT_RF_BATCH             36
+#define TT_RF_TRANSFER          37
+#define TT_RF_HANDLERS          38
+#define TT_RF_FILTER            39
 
 // Testtasks for exercise 4
 #define TT_SENSOR_DATA			40
 #define TT_TLCD					41
+#define TT_SENSOR_SAMPLES		42
+#define TT_SENSOR_BUFFER		43
+#define TT_TIME_SERIES			44
+#define TT_ADAPTIVE_SAMPLING	45
+#define TT_SENSOR_GATEWAY		46
+#define TT_TIME_SYNC			47
+#define TT_TDMA					48
+#define TT_ROUTING				49
+#define TT_XBEE_LINK			50
+#define TT_LINK_STATS			51
+#define TT_RF_LOAD				52
 
 ///////////////////////////////////////////////////////////////////////////////
 // Configure what program-set should be active: testtasks or your user progs
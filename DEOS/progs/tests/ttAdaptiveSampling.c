@@ -0,0 +1,146 @@
+//-------------------------------------------------
+//          TestSuite: Adaptive Sampling
+//-------------------------------------------------
+// Feeds an hour of a simulated temperature (tenths)
+// through the adaptive sampling: flat with noise,
+// a step of STEP_HEIGHT and a slow ramp. The time is
+// simulated as well, so the test finishes at once.
+// Compared to sending every FIXED_INTERVAL_MS, the
+// adaptive sampling has to send at most a tenth of
+// the frames and has to report the step within
+// FIXED_INTERVAL_MS, like the fixed interval does.
+// With a longest period close to 65535 ms the
+// period of a flat signal has to reach it and stay.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_ADAPTIVE_SAMPLING
+
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_scheduler.h"
+#include "../../sensor/adaptiveSampling.h"
+
+#define DURATION_MS 3600000UL
+
+// Interval of the fixed sampling it's compared to
+#define FIXED_INTERVAL_MS 1000
+
+#define STEP_TIME_MS 1200500UL
+#define STEP_HEIGHT 30
+
+// The ramp rises by one tenth every RAMP_STEP_MS
+#define RAMP_TIME_MS 2400000UL
+#define RAMP_STEP_MS 5000
+#define RAMP_HEIGHT 60
+
+#define BASE_VALUE 215
+
+static adaptive_sampling_config_t const config = {250, FIXED_INTERVAL_MS, 2, 10, 60000};
+
+// Growing periods above 52 s must not wrap around
+#define LONG_PERIOD_MS 65000
+#define LONG_SAMPLE_COUNT 100
+static adaptive_sampling_config_t const longConfig = {250, LONG_PERIOD_MS, 2, 10, 0};
+
+static uint16_t lfsr = 0xACE1;
+
+//! \return -1, 0 or 1, 0 in half of the cases
+static int8_t noise(void)
+{
+	uint8_t const bits = lfsr & 3;
+	lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xB400);
+	lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xB400);
+	return bits == 1 ? -1 : bits == 2 ? 1 : 0;
+}
+
+//! \return The simulated temperature at time
+static int16_t simulateTemperature(time_t time)
+{
+	int16_t value = BASE_VALUE + noise();
+	if (time >= STEP_TIME_MS)
+	{
+		value += STEP_HEIGHT;
+	}
+	if (time >= RAMP_TIME_MS)
+	{
+		time_t const steps = (time - RAMP_TIME_MS) / RAMP_STEP_MS;
+		value += steps < RAMP_HEIGHT ? steps : RAMP_HEIGHT;
+	}
+	return value;
+}
+
+/*!
+ *  Feeds a flat signal with the longest period of longConfig
+ *
+ *  \return True if the period has reached it and stayed there
+ */
+static bool checkLongPeriod(void)
+{
+	adaptive_sampling_t sampling;
+	bool reached = false;
+
+	adaptiveSampling_init(&sampling, &longConfig);
+	for (uint8_t i = 0; i < LONG_SAMPLE_COUNT; i++)
+	{
+		adaptiveSampling_update(&sampling, sampling.nextTime, BASE_VALUE);
+		if (reached && sampling.periodMs != LONG_PERIOD_MS)
+		{
+			return false;
+		}
+		reached = sampling.periodMs == LONG_PERIOD_MS;
+	}
+	return reached;
+}
+
+PROGRAM(1, AUTOSTART)
+{
+	adaptive_sampling_t sampling;
+	uint16_t sent = 0;
+	uint16_t minPeriod = UINT16_MAX;
+	uint16_t maxPeriod = 0;
+	time_t stepLatency = DURATION_MS;
+
+	adaptiveSampling_resetStats();
+	adaptiveSampling_init(&sampling, &config);
+
+	for (time_t time = 0; time < DURATION_MS; time = sampling.nextTime)
+	{
+		int16_t const value = simulateTemperature(time);
+		if (adaptiveSampling_update(&sampling, time, value) != ADAPTIVE_SAMPLING_SKIP)
+		{
+			sent++;
+			if (time >= STEP_TIME_MS && stepLatency == DURATION_MS)
+			{
+				stepLatency = time - STEP_TIME_MS;
+			}
+		}
+		minPeriod = sampling.periodMs < minPeriod ? sampling.periodMs : minPeriod;
+		maxPeriod = sampling.periodMs > maxPeriod ? sampling.periodMs : maxPeriod;
+	}
+
+	uint16_t const fixedSent = DURATION_MS / FIXED_INTERVAL_MS;
+	bool const longPeriod = checkLongPeriod();
+	bool const passed = sent * 10 <= fixedSent && stepLatency <= FIXED_INTERVAL_MS && longPeriod;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Samples %u, sent %u (fixed interval: %u)", adaptiveSampling_stats.samples, sent, fixedSent);
+	INFO("Changed %u, jumps %u, heartbeats %u", adaptiveSampling_stats.changed, adaptiveSampling_stats.jumps, adaptiveSampling_stats.heartbeats);
+	INFO("Period %u to %u ms, step reported after %lu ms", minPeriod, maxPeriod, stepLatency);
+	INFO("Period held at %u ms: %u", LONG_PERIOD_MS, longPeriod);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("%u/%u sent", sent, fixedSent);
+	lcd_goto(1, 0);
+	LCD("%lums %S", stepLatency, passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
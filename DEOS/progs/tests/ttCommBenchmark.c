@@ -0,0 +1,123 @@
+//-------------------------------------------------
+//          TestSuite: Communication Benchmark
+//-------------------------------------------------
+// Compares the CRC-16 frame footer with the legacy
+// XOR checksum. The CRC has to detect the errors
+// the XOR misses and must stay cheap enough to be
+// calculated while bytes are streamed through the
+// UART interrupts.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_COMM_BENCHMARK
+
+#include "../../communication/serialAdapter.h"
+#include "../../lib/crc16.h"
+#include "../../lib/lcd.h"
+#include "../../lib/stop_watch.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_core.h"
+#include "../../os_scheduler.h"
+#include <string.h>
+
+// Internals:
+#define BENCHMARK_SAMPLE_COUNT 20
+#define DATA_LENGTH (COMM_HEADER_LENGTH + COMM_MAX_INNER_FRAME_LENGTH)
+
+// Cycles per byte the CRC may take, a byte takes about 4000 cycles on the line at 38400 baud
+#define MAX_CRC_CYCLES_PER_BYTE 32
+
+//! Legacy XOR checksum, see serialAdapter.c
+void serialAdapter_calculateChecksum(checksum_t *checksum, void *data, uint8_t length);
+
+static uint16_t xorOf(uint8_t *data)
+{
+	checksum_t checksum = 0;
+	serialAdapter_calculateChecksum(&checksum, data, DATA_LENGTH);
+	return checksum;
+}
+
+static uint16_t crcOf(uint8_t *data)
+{
+	return crc16_updateBuffer(CRC16_INITIAL_VALUE, data, DATA_LENGTH);
+}
+
+//! Measures the average cycles per byte of a checksum over a full frame
+static uint16_t cyclesPerByte(uint16_t (*checksum)(uint8_t *), uint8_t *data)
+{
+	time_t sum = 0;
+	os_enterCriticalSection();
+	for (uint8_t i = 0; i < BENCHMARK_SAMPLE_COUNT; ++i)
+	{
+		stop_watch_handler_t handler = stopWatch_start();
+		checksum(data);
+		sum += stopWatch_stop(handler);
+	}
+	os_leaveCriticalSection();
+	return sum * (F_CPU / 1000000UL) / ((uint32_t)BENCHMARK_SAMPLE_COUNT * DATA_LENGTH);
+}
+
+/*!
+ *  Corrupts a frame in two ways the XOR checksum can't see: two swapped
+ *  bytes and the same bit flipped in two bytes.
+ *
+ *  \return True if the XOR misses both errors and the CRC detects both
+ */
+static bool checkErrorDetection(uint8_t *data)
+{
+	uint8_t corrupted[DATA_LENGTH];
+	bool passed = true;
+
+	memcpy(corrupted, data, DATA_LENGTH);
+	corrupted[3] = data[7];
+	corrupted[7] = data[3];
+	passed &= xorOf(corrupted) == xorOf(data) && crcOf(corrupted) != crcOf(data);
+
+	memcpy(corrupted, data, DATA_LENGTH);
+	corrupted[10] ^= 0x04;
+	corrupted[11] ^= 0x04;
+	passed &= xorOf(corrupted) == xorOf(data) && crcOf(corrupted) != crcOf(data);
+
+	return passed;
+}
+
+// Main program
+PROGRAM(1, AUTOSTART)
+{
+	uint8_t data[DATA_LENGTH];
+	for (uint8_t i = 0; i < DATA_LENGTH; ++i)
+	{
+		data[i] = i * 37 + 11;
+	}
+
+	INFO("Welcome to the communication benchmark!");
+
+	// Check value of CRC-16/CCITT
+	bool const crcPassed = crc16_updateBuffer(CRC16_INITIAL_VALUE, "123456789", 9) == 0x29B1;
+	bool const detectionPassed = checkErrorDetection(data);
+	uint16_t const xorCycles = cyclesPerByte(xorOf, data);
+	uint16_t const crcCycles = cyclesPerByte(crcOf, data);
+	bool const speedPassed = crcCycles <= MAX_CRC_CYCLES_PER_BYTE;
+	bool const passed = crcPassed && detectionPassed && speedPassed;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Check value                  | %s", crcPassed ? "PASSED" : "FAILED");
+	INFO("Swapped bytes, double flips  | %s", detectionPassed ? "PASSED" : "FAILED");
+	INFO("XOR cycles per byte          | %u", xorCycles);
+	INFO("CRC cycles per byte          | %u (max. %u) %s", crcCycles, MAX_CRC_CYCLES_PER_BYTE, speedPassed ? "PASSED" : "FAILED");
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("XOR %u CRC %u", xorCycles, crcCycles);
+	lcd_goto(1, 0);
+	LCD("cyc/B %S", passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
@@ -0,0 +1,201 @@
+//-------------------------------------------------
+//          TestSuite: Format Benchmark
+//-------------------------------------------------
+// Compares the formatter of lib/fmt.c with the
+// printf implementation of avr-libc. Both have to
+// produce the same output, fmt has to be faster.
+// The flash usage can be compared in the .map file
+// (fmt_vformat_p vs. vfprintf).
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_FORMAT_BENCHMARK
+
+#include "../../lib/fmt.h"
+#include "../../lib/lcd.h"
+#include "../../lib/stop_watch.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_core.h"
+#include "../../os_scheduler.h"
+#include <avr/pgmspace.h>
+#include <stdio.h>
+#include <string.h>
+
+// Internals:
+#define BENCHMARK_SAMPLE_COUNT 20
+#define TESTCASE_COUNT 7
+#define OUTPUT_LENGTH 32
+
+typedef struct
+{
+	time_t fmt;
+	time_t reference;
+	bool equal;
+} format_result_t;
+
+format_result_t results[TESTCASE_COUNT];
+
+static void nullSink(char c, void *context)
+{
+}
+
+static int nullPutChar(char c, FILE *stream)
+{
+	return 0;
+}
+
+static FILE nullStream = FDEV_SETUP_STREAM(nullPutChar, NULL, _FDEV_SETUP_WRITE);
+
+/*!
+ *  Runs one format string through both formatters, compares the output and
+ *  measures the average duration. The scheduler is stopped while measuring.
+ */
+#define RUN_FORMAT_CASE(index, format, ...)                                     \
+	do                                                                          \
+	{                                                                           \
+		char fmtOutput[OUTPUT_LENGTH];                                          \
+		char referenceOutput[OUTPUT_LENGTH];                                    \
+		fmt_snprintf_p(fmtOutput, OUTPUT_LENGTH, PSTR(format), __VA_ARGS__);    \
+		snprintf_P(referenceOutput, OUTPUT_LENGTH, PSTR(format), __VA_ARGS__);  \
+		results[index].equal = !strcmp(fmtOutput, referenceOutput);             \
+                                                                                \
+		time_t fmtSum = 0;                                                      \
+		time_t referenceSum = 0;                                                \
+		os_enterCriticalSection();                                              \
+		for (uint8_t i = 0; i < BENCHMARK_SAMPLE_COUNT; ++i)                    \
+		{                                                                       \
+			stop_watch_handler_t handler = stopWatch_start();                   \
+			fmt_format_p(nullSink, NULL, PSTR(format), __VA_ARGS__);            \
+			fmtSum += stopWatch_stop(handler);                                  \
+                                                                                \
+			handler = stopWatch_start();                                        \
+			fprintf_P(&nullStream, PSTR(format), __VA_ARGS__);                  \
+			referenceSum += stopWatch_stop(handler);                            \
+		}                                                                       \
+		os_leaveCriticalSection();                                              \
+		results[index].fmt = fmtSum / BENCHMARK_SAMPLE_COUNT;                   \
+		results[index].reference = referenceSum / BENCHMARK_SAMPLE_COUNT;       \
+	} while (0)
+
+/*!
+ *  The decimal conversion lcd_writeDec and terminal_writeDec used before,
+ *  it divides once per digit
+ */
+static void divisionWriteDec(uint16_t number)
+{
+	if (!number)
+	{
+		nullSink('0', NULL);
+		return;
+	}
+
+	uint32_t pos = 10000;
+	uint8_t print = 0;
+
+	do
+	{
+		uint8_t const digit = number / pos;
+		number -= digit * pos;
+		if (print |= digit)
+			nullSink(digit + '0', NULL);
+	} while (pos /= 10);
+}
+
+void runDecimalCase(uint8_t index, uint16_t number)
+{
+	results[index].equal = true;
+
+	time_t fmtSum = 0;
+	time_t referenceSum = 0;
+	os_enterCriticalSection();
+	for (uint8_t i = 0; i < BENCHMARK_SAMPLE_COUNT; ++i)
+	{
+		stop_watch_handler_t handler = stopWatch_start();
+		fmt_writeUnsigned(nullSink, NULL, number);
+		fmtSum += stopWatch_stop(handler);
+
+		handler = stopWatch_start();
+		divisionWriteDec(number);
+		referenceSum += stopWatch_stop(handler);
+	}
+	os_leaveCriticalSection();
+	results[index].fmt = fmtSum / BENCHMARK_SAMPLE_COUNT;
+	results[index].reference = referenceSum / BENCHMARK_SAMPLE_COUNT;
+}
+
+//! Checks %q, which avr-libc doesn't know
+bool checkFixedPoint(void)
+{
+	char output[OUTPUT_LENGTH];
+	fmt_snprintf_p(output, sizeof(output), PSTR("%.1q|%.2q|%5.1q|%.3lq"), 234, -5, 7, 123456L);
+	return !strcmp_P(output, PSTR("23.4|-0.05|  0.7|123.456"));
+}
+
+// Main program
+PROGRAM(1, AUTOSTART)
+{
+	INFO("Welcome to the format benchmark!");
+
+	RUN_FORMAT_CASE(0, "%d", -12345);
+	RUN_FORMAT_CASE(1, "%lu", 4000000000UL);
+	RUN_FORMAT_CASE(2, "%04x", 0xbeef);
+	RUN_FORMAT_CASE(3, "%-8s|", "text");
+	RUN_FORMAT_CASE(4, "T=%d.%dC H=%u%% %c", 23, 4, 45, '!');
+	runDecimalCase(5, 7);
+	runDecimalCase(6, 65535);
+
+	bool const fixedPointPassed = checkFixedPoint();
+
+	// Test results
+	uint8_t passed = 0;
+	for (uint8_t i = 0; i < TESTCASE_COUNT; ++i)
+	{
+		if (results[i].equal && results[i].fmt <= results[i].reference)
+		{
+			passed++;
+		}
+	}
+
+	// Output overall test result on LCD:
+	lcd_clear();
+	if (passed == TESTCASE_COUNT && fixedPointPassed)
+	{
+		LCD("  TEST PASSED   ");
+	}
+	else
+	{
+		LCD("  TEST FAILED   ");
+	}
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Test result: %d/%d testcases passed, fixed-point %s", passed, TESTCASE_COUNT, fixedPointPassed ? "PASSED" : "FAILED");
+	INFO("");
+	INFO("Testcase   | Description                     | fmt      | reference | Result");
+	INFO("-----------|---------------------------------|----------|-----------|-------");
+	INFO("Testcase 1 | %%d negative                     | %5lu us | %6lu us | %s", (unsigned long)results[0].fmt, (unsigned long)results[0].reference, results[0].equal ? "PASSED" : "OUTPUT DIFFERS");
+	INFO("Testcase 2 | %%lu 32 bit                      | %5lu us | %6lu us | %s", (unsigned long)results[1].fmt, (unsigned long)results[1].reference, results[1].equal ? "PASSED" : "OUTPUT DIFFERS");
+	INFO("Testcase 3 | %%04x                            | %5lu us | %6lu us | %s", (unsigned long)results[2].fmt, (unsigned long)results[2].reference, results[2].equal ? "PASSED" : "OUTPUT DIFFERS");
+	INFO("Testcase 4 | %%-8s                            | %5lu us | %6lu us | %s", (unsigned long)results[3].fmt, (unsigned long)results[3].reference, results[3].equal ? "PASSED" : "OUTPUT DIFFERS");
+	INFO("Testcase 5 | mixed sensor line               | %5lu us | %6lu us | %s", (unsigned long)results[4].fmt, (unsigned long)results[4].reference, results[4].equal ? "PASSED" : "OUTPUT DIFFERS");
+	INFO("Testcase 6 | writeDec 7 (vs. division loop)  | %5lu us | %6lu us | %s", (unsigned long)results[5].fmt, (unsigned long)results[5].reference, results[5].equal ? "PASSED" : "OUTPUT DIFFERS");
+	INFO("Testcase 7 | writeDec 65535                  | %5lu us | %6lu us | %s", (unsigned long)results[6].fmt, (unsigned long)results[6].reference, results[6].equal ? "PASSED" : "OUTPUT DIFFERS");
+
+	// Delay for previous lcd output
+	delayMs(1000);
+
+	// Output results on LCD:
+	while (1)
+	{
+		for (uint8_t i = 0; i < TESTCASE_COUNT; ++i)
+		{
+			lcd_clear();
+			LCD("Case %d %S", i + 1, results[i].equal && results[i].fmt <= results[i].reference ? PSTR("PASSED") : PSTR("FAILED"));
+			lcd_goto(1, 0);
+			LCD("%lu vs %lu us", (unsigned long)results[i].fmt, (unsigned long)results[i].reference);
+			delayMs(3000);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,201 @@
+//-------------------------------------------------
+//          TestSuite: Link Statistics
+//-------------------------------------------------
+// Sends good frames over the loopback and feeds
+// it a frame with a wrong checksum, a header with
+// a length that's too long, garbage, an unknown
+// command and a command with a wrong payload
+// length. Each layer has to count what happened
+// to them. Frames written faster than the UART
+// sends them have to count as TX queue full. The
+// statistics are then queried with CMD_STATS, a
+// query with reset has to clear them.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_LINK_STATS
+
+#include "../../communication/linkStats.h"
+#include "../../communication/rfAdapter.h"
+#include "../../communication/xbee.h"
+#include "../../lib/crc16.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_scheduler.h"
+
+#include <string.h>
+
+#define FRAME_COUNT 10
+
+// A node that isn't there
+#define OTHER_ADDRESS ADDRESS(3, 5)
+
+// Command ID that can't have a handler
+#define UNKNOWN_COMMAND 0x7F
+
+// Time the worker gets to process the received frames
+#define PROCESS_DELAY_MS 100
+
+// Time the query may take
+#define QUERY_TIMEOUT_MS 500
+
+uint8_t receivedCount = 0;
+
+/*!
+ *  Counts the received frames
+ *
+ *  \param frame Received frame with command CMD_SENSOR_DATA
+ */
+static void receiveData(const frame_view_t *frame)
+{
+	receivedCount++;
+}
+
+/*!
+ *  Writes a frame to the loopback byte by byte, bypassing the transmit queue
+ *
+ *  \param length Length in the header
+ *  \param command First byte of the inner frame, it has no payload
+ *  \param corrupt True to send a wrong checksum
+ */
+static void writeRawFrame(inner_frame_length_t length, command_t command, bool corrupt)
+{
+	frame_header_t header;
+	header.startFlag = COMM_CRC_START_FLAG;
+	header.srcAddr = serialAdapter_address;
+	header.destAddr = serialAdapter_address;
+	header.length = length;
+
+	checksum_t checksum = crc16_updateBuffer(CRC16_INITIAL_VALUE, &header, sizeof(header));
+	checksum = crc16_update(checksum, command);
+	if (corrupt)
+	{
+		checksum ^= 0x0101;
+	}
+
+	xbee_writeData(&header, sizeof(header));
+	xbee_write(command);
+	xbee_writeData(&checksum, sizeof(checksum));
+}
+
+/*!
+ *  Queries the statistics of this board over the loopback
+ *
+ *  \param stats Receives the statistics
+ *  \param reset True to reset them after the last page
+ *  \return True if all pages arrived in time
+ */
+static bool queryStats(link_stats_t *stats, bool reset)
+{
+	linkStats_query(serialAdapter_address, stats, reset);
+	time_t const start = getSystemTime_ms();
+	while (!linkStats_hasArrived() && getSystemTime_ms() - start < QUERY_TIMEOUT_MS)
+	{
+		os_yield();
+	}
+	bool const arrived = linkStats_hasArrived();
+	linkStats_stop();
+	return arrived;
+}
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(true);
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+PROGRAM(2, AUTOSTART)
+{
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	rfAdapter_registerHandler(CMD_SENSOR_DATA, receiveData, sizeof(cmd_sensorData_t), sizeof(cmd_sensorData_t), RF_HANDLER_INLINE);
+	linkStats_reset();
+
+	// Good frames
+	inner_frame_t innerFrame;
+	cmd_sensorData_t data;
+	memset(&data, 0, sizeof(data));
+	innerFrame.command = CMD_SENSOR_DATA;
+	memcpy(innerFrame.payload, &data, sizeof(data));
+	for (uint8_t i = 0; i < FRAME_COUNT; i++)
+	{
+		serialAdapter_writeFrame(serialAdapter_address, sizeof(command_t) + sizeof(data), &innerFrame);
+	}
+
+	// Broken frames, garbage and commands the rfAdapter can't execute
+	writeRawFrame(1, CMD_TOGGLE_LED, true);
+	writeRawFrame(COMM_MAX_INNER_FRAME_LENGTH + 1, CMD_TOGGLE_LED, false);
+	char garbage[] = "xyz";
+	xbee_writeData(garbage, sizeof(garbage) - 1);
+	writeRawFrame(1, UNKNOWN_COMMAND, false);
+	writeRawFrame(1, CMD_SET_LED, false);
+	delayMs(PROCESS_DELAY_MS);
+
+	// Faster than the UART: the frames wait in the transmit queue until the UART has sent them
+	innerFrame.command = CMD_TOGGLE_LED;
+	xbee_setLoopback(false);
+	uint8_t refused = 0;
+	for (uint8_t i = 0; i <= SERIAL_ADAPTER_TX_QUEUE_LENGTH; i++)
+	{
+		refused += serialAdapter_tryWriteFrame(OTHER_ADDRESS, sizeof(command_t), &innerFrame) == SERIAL_ADAPTER_TX_QUEUE_FULL;
+	}
+	delayMs(PROCESS_DELAY_MS);
+	xbee_setLoopback(true);
+
+	link_stats_t local;
+	linkStats_snapshot(&local, false);
+	xbee_stats_t const *const xbee = &local.xbee;
+	serial_adapter_stats_t const *const serial = &local.serialAdapter;
+	rf_adapter_stats_t const *const rf = &local.rfAdapter;
+
+	bool const counted = receivedCount == FRAME_COUNT && serial->rxFrames == FRAME_COUNT + 2 && rfAdapter_getCommandCount(rf, CMD_SENSOR_DATA) == FRAME_COUNT
+		&& serial->checksumErrors == 1 && serial->lengthErrors == 1 && serial->resyncs >= 2 && serial->garbageBytes >= 3
+		&& rf->unknownCommands == 1 && rf->ignoredCommands == 1 && !xbee->overflows && xbee->rxBytes == serial->rxBytes;
+	bool const stalled = refused && serial->txQueueFull == refused;
+
+	// Query over the loopback, the remote copy has to match
+	link_stats_t remote;
+	bool const arrived = queryStats(&remote, false);
+	// The query itself is counted as well
+	bool const reported = arrived && rfAdapter_getCommandCount(&remote.rfAdapter, CMD_SENSOR_DATA) == FRAME_COUNT
+		&& remote.serialAdapter.checksumErrors == 1 && remote.serialAdapter.rxFrames > serial->rxFrames
+		&& rfAdapter_getCommandCount(&remote.rfAdapter, CMD_STATS);
+	bool const resetArrived = queryStats(&remote, true);
+	delayMs(PROCESS_DELAY_MS);
+	link_stats_t after;
+	linkStats_snapshot(&after, false);
+	bool const cleared = resetArrived && !rfAdapter_getCommandCount(&after.rfAdapter, CMD_SENSOR_DATA) && !after.serialAdapter.checksumErrors;
+
+	rfAdapter_registerHandler(CMD_SENSOR_DATA, NULL, 0, 0, RF_HANDLER_INLINE);
+
+	bool const passed = counted && stalled && reported && cleared;
+
+	// Output results on terminal:
+	INFO("");
+	linkStats_print(&local);
+	INFO("Received %u/%u, refused %u, pages %u", receivedCount, FRAME_COUNT, refused, LINK_STATS_PAGE_COUNT);
+	INFO("Counted %u, stalled %u, reported %u, cleared %u", counted, stalled, reported, cleared);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("crc %u len %u", serial->checksumErrors, serial->lengthErrors);
+	lcd_goto(1, 0);
+	LCD("%S", passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
@@ -0,0 +1,110 @@
+//-------------------------------------------------
+//          TestSuite: Binary Log Records
+//-------------------------------------------------
+// Fills binary log records with arguments and
+// appends strings. A string has to be truncated
+// and zero-terminated at the end of the record,
+// and nothing may be written once the record is
+// full. A guard after the record has to stay
+// untouched.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_LOG_BINARY
+
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_scheduler.h"
+
+#include <string.h>
+
+#define GUARD_LENGTH 8
+#define GUARD_BYTE 0x5A
+
+//! A record followed by bytes an overflow would hit first
+typedef struct
+{
+	terminal_log_binary_record_t record;
+	uint8_t guard[GUARD_LENGTH];
+} guarded_record_t;
+
+guarded_record_t guarded;
+
+//! Empties the record and fills it with integer arguments until fill (even) bytes are used
+static void fillRecord(uint8_t fill)
+{
+	guarded.record.length = 0;
+	memset(guarded.record.data, 0, sizeof(guarded.record.data));
+	memset(guarded.guard, GUARD_BYTE, sizeof(guarded.guard));
+	while (guarded.record.length + sizeof(long) <= fill)
+	{
+		terminal_logBinary_putLong(&guarded.record, 0x01020304L);
+	}
+	while (guarded.record.length < fill)
+	{
+		terminal_logBinary_putInt(&guarded.record, 0x0506);
+	}
+}
+
+//! True if nothing has been written behind the record
+static bool guardIntact(void)
+{
+	for (uint8_t i = 0; i < GUARD_LENGTH; i++)
+	{
+		if (guarded.guard[i] != GUARD_BYTE)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Main program
+PROGRAM(1, AUTOSTART)
+{
+	INFO("Welcome to the binary log test!");
+
+	// Integer arguments fill the record completely, then "%s" is appended
+	fillRecord(TERMINAL_LOG_BINARY_MAX_ARGS_LENGTH);
+	terminal_logBinary_putString(&guarded.record, "overflow");
+	terminal_logBinary_putString(&guarded.record, "");
+	bool const full = guarded.record.length == TERMINAL_LOG_BINARY_MAX_ARGS_LENGTH && guardIntact();
+
+	// "ab" leaves one byte: only the terminator of "cd" fits
+	fillRecord(TERMINAL_LOG_BINARY_MAX_ARGS_LENGTH - 4);
+	terminal_logBinary_putString(&guarded.record, "ab");
+	terminal_logBinary_putString(&guarded.record, "cd");
+	bool const lastByte = guarded.record.length == TERMINAL_LOG_BINARY_MAX_ARGS_LENGTH
+		&& !memcmp(&guarded.record.data[TERMINAL_LOG_BINARY_MAX_ARGS_LENGTH - 4], "ab\0", 4) && guardIntact();
+
+	// Four bytes left: the string is cut after three characters
+	fillRecord(TERMINAL_LOG_BINARY_MAX_ARGS_LENGTH - 4);
+	terminal_logBinary_putString(&guarded.record, "hello");
+	bool const truncated = guarded.record.length == TERMINAL_LOG_BINARY_MAX_ARGS_LENGTH
+		&& !memcmp(&guarded.record.data[TERMINAL_LOG_BINARY_MAX_ARGS_LENGTH - 4], "hel", 4) && guardIntact();
+
+	// Short strings are copied with their terminator
+	fillRecord(0);
+	TERMINAL_LOG_BINARY_ARGS(&guarded.record, 1, "hi", 2L);
+	bool const complete = guarded.record.length == sizeof(int) + 3 + sizeof(long) && !strcmp((const char *)&guarded.record.data[sizeof(int)], "hi") && guardIntact();
+
+	bool const passed = full && lastByte && truncated && complete;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Full %u, last byte %u, truncated %u, complete %u", full, lastByte, truncated, complete);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("Binary log");
+	lcd_goto(1, 0);
+	LCD("%S", passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
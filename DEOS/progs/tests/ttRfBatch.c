@@ -0,0 +1,136 @@
+//-------------------------------------------------
+//          TestSuite: RF Batch
+//-------------------------------------------------
+// Mirrors an LCD update (clear, goto, print) and
+// three LED toggles over the loopback, once with
+// batching off and once with all commands combined
+// into CMD_BATCH frames. The batch has to take
+// fewer bytes on the line and its commands have to
+// be executed in order, which the LED state shows.
+// With batching off the LCD update alone still has
+// to go out as one CMD_BATCH frame.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_RF_BATCH
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_core.h"
+#include "../../os_scheduler.h"
+
+#include <avr/io.h>
+
+// Time the worker gets to execute the received commands
+#define EXECUTE_DELAY_MS 100
+
+#define LCD_MESSAGE "Mirror"
+
+// One frame: CMD_BATCH, then clear, goto and print, each command preceded by its length
+#define LCD_BATCH_LENGTH (COMM_HEADER_LENGTH + sizeof(command_t) + 3 * (sizeof(uint8_t) + sizeof(command_t)) \
+	+ sizeof(cmd_lcdGoto_t) + sizeof(uint8_t) + sizeof(LCD_MESSAGE) - 1 + COMM_FOOTER_LENGTH)
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(true);
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+/*!
+ *  Sends the commands and counts the bytes they take on the line. In
+ *  loopback mode every transmitted byte ends up in the receive buffer, the
+ *  worker can't consume them during the critical section.
+ *
+ *  \param batching Whether the commands are combined
+ *  \return Number of bytes that have been transmitted
+ */
+static uint16_t sendUpdate(bool batching)
+{
+	rfAdapter_setBatching(batching);
+
+	os_enterCriticalSection();
+	uint16_t const before = xbee_getNumberOfBytesReceived();
+
+	rfAdapter_sendSetLed(serialAdapter_address, false);
+	rfAdapter_sendLcdClear(serialAdapter_address);
+	rfAdapter_sendLcdGoto(serialAdapter_address, 0, 0);
+	rfAdapter_sendLcdPrint(serialAdapter_address, batching ? "Batched" : "Unbatched");
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		rfAdapter_sendToggleLed(serialAdapter_address);
+	}
+	rfAdapter_flush();
+
+	uint16_t const bytes = xbee_getNumberOfBytesReceived() - before;
+	os_leaveCriticalSection();
+
+	delayMs(EXECUTE_DELAY_MS);
+	return bytes;
+}
+
+/*!
+ *  Sends only an LCD update with batching off
+ *
+ *  \return Number of bytes that have been transmitted
+ */
+static uint16_t sendLcdUpdate(void)
+{
+	rfAdapter_setBatching(false);
+
+	os_enterCriticalSection();
+	uint16_t const before = xbee_getNumberOfBytesReceived();
+
+	rfAdapter_sendLcdClear(serialAdapter_address);
+	rfAdapter_sendLcdGoto(serialAdapter_address, 0, 0);
+	rfAdapter_sendLcdPrint(serialAdapter_address, LCD_MESSAGE);
+	rfAdapter_flush();
+
+	uint16_t const bytes = xbee_getNumberOfBytesReceived() - before;
+	os_leaveCriticalSection();
+
+	delayMs(EXECUTE_DELAY_MS);
+	return bytes;
+}
+
+PROGRAM(2, AUTOSTART)
+{
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	uint16_t const single = sendUpdate(false);
+	bool const singleOrdered = PORTB & (1 << PB7);
+	uint16_t const batched = sendUpdate(true);
+	bool const batchedOrdered = PORTB & (1 << PB7);
+	uint16_t const lcd = sendLcdUpdate();
+	bool const passed = singleOrdered && batchedOrdered && batched < single && lcd == LCD_BATCH_LENGTH;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Batching off: %u bytes, in order: %d", single, singleOrdered);
+	INFO("Batch frames: %u bytes, in order: %d", batched, batchedOrdered);
+	INFO("LCD update with batching off: %u bytes (one batch: %u)", lcd, LCD_BATCH_LENGTH);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("%u -> %u bytes", single, batched);
+	lcd_goto(1, 0);
+	LCD("%S", passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
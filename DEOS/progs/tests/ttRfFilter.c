@@ -0,0 +1,102 @@
+//-------------------------------------------------
+//          TestSuite: RF Filter
+//-------------------------------------------------
+// Sends LED toggles over the loopback to a foreign
+// address, to a group address and to this board.
+// Foreign frames have to be dropped after their
+// header and counted, frames to a joined group
+// have to be executed like those to this board.
+// The LED state shows which toggles were executed.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_RF_FILTER
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_scheduler.h"
+
+#include <avr/io.h>
+
+// A board of another team and a group of that team
+#define FOREIGN_ADDRESS ADDRESS(3, 1)
+#define GROUP_ADDRESS ADDRESS(3, 7)
+
+#define FOREIGN_FRAMES 20
+
+// Time the worker gets to execute the received commands
+#define EXECUTE_DELAY_MS 100
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(true);
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+/*!
+ *  Sends a toggle and waits until it has been received
+ *
+ *  \param destAddr Where to send the toggle
+ *  \return LED state afterwards
+ */
+static bool toggle(address_t destAddr)
+{
+	rfAdapter_sendToggleLed(destAddr);
+	delayMs(EXECUTE_DELAY_MS);
+	return PORTB & (1 << PB7);
+}
+
+PROGRAM(2, AUTOSTART)
+{
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	rfAdapter_sendSetLed(serialAdapter_address, false);
+	delayMs(EXECUTE_DELAY_MS);
+	serialAdapter_resetStats();
+
+	// Foreign toggles must not change the LED
+	bool foreignIgnored = true;
+	for (uint8_t i = 0; i < FOREIGN_FRAMES; i++)
+	{
+		foreignIgnored &= !toggle(FOREIGN_ADDRESS);
+	}
+	uint16_t const foreignFrames = serialAdapter_stats.foreignFrames;
+
+	bool const groupIgnored = !toggle(GROUP_ADDRESS);
+	serialAdapter_joinGroup(GROUP_ADDRESS);
+	bool const groupExecuted = toggle(GROUP_ADDRESS);
+	serialAdapter_leaveGroup(GROUP_ADDRESS);
+	bool const ownExecuted = !toggle(serialAdapter_address);
+
+	bool const passed = foreignIgnored && foreignFrames == FOREIGN_FRAMES && groupIgnored && groupExecuted && ownExecuted && serialAdapter_stats.foreignFrames == FOREIGN_FRAMES + 1;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Foreign frames dropped: %u (%u bytes)", serialAdapter_stats.foreignFrames, serialAdapter_stats.foreignBytes);
+	INFO("Group: ignored before join %u, executed after join %u", groupIgnored, groupExecuted);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("dropped %u", serialAdapter_stats.foreignFrames);
+	lcd_goto(1, 0);
+	LCD("%S", passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
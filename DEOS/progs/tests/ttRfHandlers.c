@@ -0,0 +1,139 @@
+//-------------------------------------------------
+//          TestSuite: RF Handlers
+//-------------------------------------------------
+// Registers a handler that runs inline in the
+// receive path and one that is deferred to the
+// process running rfAdapter_deferredWorker. Frames
+// with valid and invalid payload lengths are sent
+// over the loopback. Only the valid ones may reach
+// the handlers, each in its own process.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_RF_HANDLERS
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_scheduler.h"
+
+// Commands of this test, not used by the rfAdapter
+#define CMD_TEST_INLINE 0x4E
+#define CMD_TEST_DEFERRED 0x4F
+
+// Payload lengths the handlers accept
+#define INLINE_LENGTH 2
+#define DEFERRED_MIN_LENGTH 1
+#define DEFERRED_MAX_LENGTH 4
+
+#define VALID_FRAMES 3
+
+// Time the workers get to handle a frame
+#define EXECUTE_DELAY_MS 100
+
+uint8_t inlineCount = 0;
+uint8_t inlineWrongProc = 0;
+uint8_t deferredCount = 0;
+uint8_t deferredWrongProc = 0;
+
+static void receiveInline(const frame_view_t *frame)
+{
+	inlineCount++;
+	inlineWrongProc += os_getCurrentProc() != 1;
+}
+
+static void receiveDeferred(const frame_view_t *frame)
+{
+	deferredCount++;
+	deferredWrongProc += os_getCurrentProc() != 3;
+}
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(true);
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+/*!
+ *  Sends a test command and waits for the workers to handle it
+ *
+ *  \param command The command
+ *  \param payloadLength Length of the payload
+ */
+static void sendTestFrame(command_t command, uint8_t payloadLength)
+{
+	inner_frame_t innerFrame;
+	innerFrame.command = command;
+	for (uint8_t i = 0; i < payloadLength; i++)
+	{
+		innerFrame.payload[i] = i;
+	}
+
+	serialAdapter_writeFrame(serialAdapter_address, sizeof(command_t) + payloadLength, &innerFrame);
+	delayMs(EXECUTE_DELAY_MS);
+}
+
+PROGRAM(2, AUTOSTART)
+{
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	bool registered = rfAdapter_registerHandler(CMD_TEST_INLINE, receiveInline, INLINE_LENGTH, INLINE_LENGTH, RF_HANDLER_INLINE);
+	registered &= rfAdapter_registerHandler(CMD_TEST_DEFERRED, receiveDeferred, DEFERRED_MIN_LENGTH, DEFERRED_MAX_LENGTH, RF_HANDLER_DEFERRED);
+	// Invalid registrations have to be rejected
+	bool const rejected = !rfAdapter_registerHandler(RF_ADAPTER_COMMAND_COUNT, receiveInline, 0, 0, RF_HANDLER_INLINE) && !rfAdapter_registerHandler(CMD_TEST_INLINE, receiveInline, 2, 1, RF_HANDLER_INLINE) && !rfAdapter_registerHandler(CMD_TEST_INLINE, receiveInline, 0, COMM_MAX_PAYLOAD_LENGTH + 1, RF_HANDLER_INLINE);
+
+	for (uint8_t i = 0; i < VALID_FRAMES; i++)
+	{
+		sendTestFrame(CMD_TEST_INLINE, INLINE_LENGTH);
+		sendTestFrame(CMD_TEST_DEFERRED, DEFERRED_MIN_LENGTH + i);
+	}
+
+	// Payload lengths out of range
+	sendTestFrame(CMD_TEST_INLINE, INLINE_LENGTH - 1);
+	sendTestFrame(CMD_TEST_INLINE, INLINE_LENGTH + 1);
+	sendTestFrame(CMD_TEST_DEFERRED, DEFERRED_MIN_LENGTH - 1);
+	sendTestFrame(CMD_TEST_DEFERRED, DEFERRED_MAX_LENGTH + 1);
+
+	// Unregistered commands are ignored
+	rfAdapter_registerHandler(CMD_TEST_INLINE, NULL, 0, 0, RF_HANDLER_INLINE);
+	sendTestFrame(CMD_TEST_INLINE, INLINE_LENGTH);
+
+	bool const passed = registered && rejected && inlineCount == VALID_FRAMES && deferredCount == VALID_FRAMES && !inlineWrongProc && !deferredWrongProc;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Inline: %u handled (%u in wrong process)", inlineCount, inlineWrongProc);
+	INFO("Deferred: %u handled (%u in wrong process)", deferredCount, deferredWrongProc);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("in %u def %u", inlineCount, deferredCount);
+	lcd_goto(1, 0);
+	LCD("%S", passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+PROGRAM(3, AUTOSTART)
+{
+	while (1)
+	{
+		rfAdapter_deferredWorker();
+	}
+}
+
+#endif
@@ -0,0 +1,490 @@
+//-------------------------------------------------
+//          TestSuite: RF Load
+//-------------------------------------------------
+// Offers CMD_LOAD frames of LOAD_PAYLOAD_LENGTH
+// bytes at each rate of LOAD_RATES for STEP_MS
+// and reports per step what the receiver got:
+// frames and bytes per second, loss, the one-way
+// latency percentiles and the CPU the stack costs
+// on both sides. Frames the transmit queue can't
+// take are lost as well, so the rates past the
+// capacity of the link show where it saturates.
+// The CPU is measured by a process that only
+// spins when nothing else has to run, compared to
+// its spins while the stack was idle.
+// With RF_LOAD_LOOPBACK the frames never leave the
+// board, so the stack can be checked for
+// regressions without a partner. Otherwise the
+// partner runs this test with RF_LOAD_SENDER 0,
+// the sender is the time sync master.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_RF_LOAD
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/rfProbe.h"
+#include "../../communication/timeSync.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_scheduler.h"
+
+#include <string.h>
+#include <util/delay.h>
+
+// Set to 0 to load PARTNER_ADDRESS over the air
+#define RF_LOAD_LOOPBACK 1
+
+// Over the air: 1 on the board that sends, 0 on its partner
+#define RF_LOAD_SENDER 1
+
+// Change PARTNER_ADDRESS to your partners address
+#if RF_LOAD_LOOPBACK
+#define PARTNER_ADDRESS serialAdapter_address
+#else
+#define PARTNER_ADDRESS ADDRESS_BROADCAST
+#endif
+
+// Offered loads in frames per second, one step each
+#define LOAD_RATES {10, 25, 50, 75, 100, 150}
+
+// Payload bytes per frame, from sizeof(cmd_load_t) up to COMM_MAX_PAYLOAD_LENGTH
+#define LOAD_PAYLOAD_LENGTH 32
+
+#define STEP_MS 2000
+
+// Time the last frames of a step get to arrive
+#define DRAIN_MS 200
+
+// Time the report of a step may take
+#define REPORT_TIMEOUT_MS 500
+
+// Time the idle spins are counted
+#define CALIBRATION_MS 1000
+
+// Time the receiver gets to synchronize to the sender (over the air only)
+#define SYNC_MS (4 * TIME_SYNC_PERIOD_MS)
+
+// Time the spinner runs before it lets the stack run again
+#define SPIN_US 20
+
+// Limits for the loopback to pass at the lowest rate, over the air only the statistics are shown
+#define MAX_P99_LATENCY_US 50000
+#define MAX_LOST 0
+
+// Commands of this test, not used by the rfAdapter
+#define CMD_LOAD_START 0x4C
+#define CMD_LOAD 0x4D
+#define CMD_LOAD_END 0x4E
+#define CMD_LOAD_REPORT 0x4F
+
+// Payload of CMD_LOAD, padded to LOAD_PAYLOAD_LENGTH
+typedef struct cmd_load
+{
+	uint8_t step;
+	//! Network time (us) the frame was offered
+	time_t timestamp;
+} cmd_load_t;
+
+// Payload of CMD_LOAD_START and CMD_LOAD_END
+typedef struct cmd_loadControl
+{
+	uint8_t step;
+} cmd_loadControl_t;
+
+// Payload of CMD_LOAD_REPORT, what the receiver got in a step
+typedef struct cmd_loadReport
+{
+	uint8_t step;
+	uint16_t received;
+	//! Payload bytes
+	uint32_t bytes;
+	time_t p50;
+	time_t p90;
+	time_t p99;
+	time_t max;
+	//! CPU load of the receiver in per mille
+	uint16_t cpu;
+} cmd_loadReport_t;
+
+// State of the receiving side, lives on the stack of the receiving process
+typedef struct LoadReceiver
+{
+	uint8_t step;
+	uint16_t received;
+	uint32_t bytes;
+	//! Histogram of the one-way latencies
+	rf_probe_t latency;
+	uint32_t startSpins;
+	time_t startTime;
+} load_receiver_t;
+
+//! Spins of the spinner process, times SPIN_US it's the CPU time nothing else needed
+uint32_t spinCount = 0;
+
+//! Spins during CALIBRATION_MS while the stack was idle
+uint32_t idleSpins = 0;
+
+//! Receiver of the CMD_LOAD frames, NULL until it has been calibrated
+load_receiver_t *loadReceiver = NULL;
+
+//! Report of the last step and whether it has arrived
+cmd_loadReport_t loadReport;
+bool loadReportArrived = false;
+
+/*!
+ *  \return The spins so far
+ */
+static uint32_t getSpins(void)
+{
+	os_enterCriticalSection();
+	uint32_t const spins = spinCount;
+	os_leaveCriticalSection();
+	return spins;
+}
+
+/*!
+ *  Waits without keeping the CPU busy, unlike delayMs
+ *
+ *  \param ms Time to wait
+ */
+static void waitMs(time_t ms)
+{
+	time_t const start = getSystemTime_ms();
+	while (getSystemTime_ms() - start < ms)
+	{
+		os_yield();
+	}
+}
+
+/*!
+ *  Measures the spins while the stack is idle, the CPU load is relative to them
+ */
+static void calibrate(void)
+{
+	uint32_t const start = getSpins();
+	waitMs(CALIBRATION_MS);
+	idleSpins = getSpins() - start;
+}
+
+/*!
+ *  Compares the spins of a period to those while the stack was idle
+ *
+ *  \param spins Spins during the period
+ *  \param elapsed Length of the period in us
+ *  \return Share of the CPU the spinner didn't get in per mille
+ */
+static uint16_t getCpuLoad(uint32_t spins, time_t elapsed)
+{
+	uint32_t const idle = (uint64_t)idleSpins * elapsed / (CALIBRATION_MS * 1000UL);
+	if (!idle || spins >= idle)
+	{
+		return 0;
+	}
+	return 1000 - (uint64_t)spins * 1000 / idle;
+}
+
+/*!
+ *  Sends a command with a one byte payload and waits for room in the queue
+ *
+ *  \param command CMD_LOAD_START or CMD_LOAD_END
+ *  \param step Number of the step
+ */
+static void sendControl(command_t command, uint8_t step)
+{
+	inner_frame_t innerFrame;
+	innerFrame.command = command;
+	innerFrame.payload[0] = step;
+	serialAdapter_writeFrame(PARTNER_ADDRESS, sizeof(command_t) + sizeof(cmd_loadControl_t), &innerFrame);
+}
+
+/*!
+ *  Starts a step at the receiver
+ *
+ *  \param frame Received frame with command CMD_LOAD_START
+ */
+static void receiveStart(const frame_view_t *frame)
+{
+	load_receiver_t *const receiver = loadReceiver;
+	if (!receiver)
+	{
+		return;
+	}
+
+	os_enterCriticalSection();
+	receiver->step = serialAdapter_viewByte(frame, sizeof(command_t));
+	receiver->received = 0;
+	receiver->bytes = 0;
+	rfProbe_reset(&receiver->latency);
+	receiver->startSpins = getSpins();
+	receiver->startTime = getSystemTime_us();
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Counts a frame of the current step and adds its latency
+ *
+ *  \param frame Received frame with command CMD_LOAD
+ */
+static void receiveLoad(const frame_view_t *frame)
+{
+	time_t const now = os_networkTime_us();
+	cmd_load_t buffer;
+	cmd_load_t const load = *(const cmd_load_t *)serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
+
+	load_receiver_t *const receiver = loadReceiver;
+	if (!receiver || load.step != receiver->step)
+	{
+		return;
+	}
+
+	os_enterCriticalSection();
+	receiver->received++;
+	receiver->bytes += frame->header.length - sizeof(command_t);
+	// Without the sender's time the latency can't be told
+	if (RF_LOAD_LOOPBACK || timeSync_hasNetworkTime())
+	{
+		rfProbe_addSample(&receiver->latency, now - load.timestamp);
+	}
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Ends a step at the receiver and reports it to the sender
+ *
+ *  \param frame Received frame with command CMD_LOAD_END
+ */
+static void receiveEnd(const frame_view_t *frame)
+{
+	load_receiver_t *const receiver = loadReceiver;
+	if (!receiver || serialAdapter_viewByte(frame, sizeof(command_t)) != receiver->step)
+	{
+		return;
+	}
+
+	cmd_loadReport_t report;
+	os_enterCriticalSection();
+	report.step = receiver->step;
+	report.received = receiver->received;
+	report.bytes = receiver->bytes;
+	report.p50 = rfProbe_getPercentile(&receiver->latency, 50);
+	report.p90 = rfProbe_getPercentile(&receiver->latency, 90);
+	report.p99 = rfProbe_getPercentile(&receiver->latency, 99);
+	report.max = receiver->latency.maxRtt;
+	report.cpu = getCpuLoad(getSpins() - receiver->startSpins, getSystemTime_us() - receiver->startTime);
+	os_leaveCriticalSection();
+
+	inner_frame_t innerFrame;
+	innerFrame.command = CMD_LOAD_REPORT;
+	memcpy(innerFrame.payload, &report, sizeof(report));
+	rfAdapter_reply(frame->header.srcAddr, sizeof(command_t) + sizeof(report), &innerFrame);
+}
+
+/*!
+ *  Takes the report of the receiver
+ *
+ *  \param frame Received frame with command CMD_LOAD_REPORT
+ */
+static void receiveReport(const frame_view_t *frame)
+{
+	cmd_loadReport_t buffer;
+	const cmd_loadReport_t *report = serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
+
+	os_enterCriticalSection();
+	loadReport = *report;
+	loadReportArrived = true;
+	os_leaveCriticalSection();
+}
+
+/*!
+ *  Offers CMD_LOAD frames at a fixed rate for STEP_MS and waits for the
+ *  report of the receiver. Frames that are due while the transmit queue
+ *  is full are refused, the rate isn't lowered.
+ *
+ *  \param step Number of the step
+ *  \param rate Frames per second
+ *  \param refused Receives the number of frames the queue refused
+ *  \param cpu Receives the CPU load of the sender in per mille
+ *  \return Number of frames offered
+ */
+static uint16_t runStep(uint8_t step, uint16_t rate, uint16_t *refused, uint16_t *cpu)
+{
+	inner_frame_t innerFrame;
+	cmd_load_t load;
+	uint16_t offered = 0;
+
+	memset(&innerFrame, 0, sizeof(innerFrame));
+	innerFrame.command = CMD_LOAD;
+	load.step = step;
+	*refused = 0;
+	loadReportArrived = false;
+
+	sendControl(CMD_LOAD_START, step);
+	uint32_t const startSpins = getSpins();
+	time_t const start = getSystemTime_us();
+	time_t const interval = 1000000UL / rate;
+	time_t due = 0;
+
+	while (getSystemTime_us() - start < STEP_MS * 1000UL)
+	{
+		if (getSystemTime_us() - start < due)
+		{
+			os_yield();
+			continue;
+		}
+
+		load.timestamp = os_networkTime_us();
+		memcpy(innerFrame.payload, &load, sizeof(load));
+		if (serialAdapter_tryWriteFrame(PARTNER_ADDRESS, sizeof(command_t) + LOAD_PAYLOAD_LENGTH, &innerFrame) != SERIAL_ADAPTER_SUCCESS)
+		{
+			(*refused)++;
+		}
+		offered++;
+		due += interval;
+	}
+
+	waitMs(DRAIN_MS);
+	sendControl(CMD_LOAD_END, step);
+	*cpu = getCpuLoad(getSpins() - startSpins, getSystemTime_us() - start);
+
+	time_t const sent = getSystemTime_ms();
+	while (!loadReportArrived && getSystemTime_ms() - sent < REPORT_TIMEOUT_MS)
+	{
+		os_yield();
+	}
+	return offered;
+}
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(RF_LOAD_LOOPBACK);
+
+	while (1)
+	{
+		rfAdapter_worker();
+		timeSync_worker();
+		// Leave the rest of the time slice to the spinner
+		os_yield();
+	}
+}
+
+PROGRAM(2, AUTOSTART)
+{
+#if RF_LOAD_LOOPBACK || !RF_LOAD_SENDER
+	load_receiver_t receiver;
+#endif
+
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	rfAdapter_registerHandler(CMD_LOAD_START, receiveStart, sizeof(cmd_loadControl_t), sizeof(cmd_loadControl_t), RF_HANDLER_INLINE);
+	rfAdapter_registerHandler(CMD_LOAD, receiveLoad, sizeof(cmd_load_t), COMM_MAX_PAYLOAD_LENGTH, RF_HANDLER_INLINE);
+	rfAdapter_registerHandler(CMD_LOAD_END, receiveEnd, sizeof(cmd_loadControl_t), sizeof(cmd_loadControl_t), RF_HANDLER_INLINE);
+	rfAdapter_registerHandler(CMD_LOAD_REPORT, receiveReport, sizeof(cmd_loadReport_t), sizeof(cmd_loadReport_t), RF_HANDLER_INLINE);
+
+	lcd_clear();
+	LCD("Calibrating...");
+	calibrate();
+
+#if RF_LOAD_LOOPBACK || !RF_LOAD_SENDER
+	memset(&receiver, 0, sizeof(receiver));
+	receiver.step = UINT8_MAX;
+	loadReceiver = &receiver;
+#endif
+
+#if !RF_LOAD_LOOPBACK
+#if RF_LOAD_SENDER
+	timeSync_init(serialAdapter_address);
+	waitMs(SYNC_MS);
+#else
+	timeSync_init(PARTNER_ADDRESS);
+	INFO("Receiving load from 0x%x, %lu idle spins", PARTNER_ADDRESS, idleSpins);
+	lcd_clear();
+	LCD("Receiving...");
+	while (1)
+	{
+		os_yield();
+	}
+#endif
+#endif
+
+	uint16_t const rates[] = LOAD_RATES;
+	uint8_t const stepCount = sizeof(rates) / sizeof(rates[0]);
+	uint8_t const wireLength = sizeof(frame_header_t) + sizeof(command_t) + LOAD_PAYLOAD_LENGTH + sizeof(checksum_t);
+	uint8_t reports = 0;
+	bool withinLimits = false;
+
+	INFO("Loading 0x%x with %u B payloads (%u B on the wire), link %lu B/s", PARTNER_ADDRESS, LOAD_PAYLOAD_LENGTH, wireLength, xbee_getBaudRate() / 10);
+	INFO("%u steps of %u ms, %lu idle spins", stepCount, STEP_MS, idleSpins);
+	lcd_clear();
+	LCD("Loading...");
+
+	for (uint8_t step = 0; step < stepCount; step++)
+	{
+		uint16_t refused;
+		uint16_t cpu;
+		uint16_t const offered = runStep(step, rates[step], &refused, &cpu);
+
+		os_enterCriticalSection();
+		bool const arrived = loadReportArrived && loadReport.step == step;
+		cmd_loadReport_t const report = loadReport;
+		os_leaveCriticalSection();
+
+		if (!arrived)
+		{
+			INFO("%u fps: offered %u, no report", rates[step], offered);
+			continue;
+		}
+		reports++;
+
+		uint16_t const lost = offered - report.received;
+		uint16_t const delivered = (uint32_t)report.received * 1000 / STEP_MS;
+		uint32_t const goodput = report.bytes * 1000 / STEP_MS;
+		if (!step)
+		{
+			withinLimits = lost <= MAX_LOST && report.p99 <= MAX_P99_LATENCY_US;
+		}
+
+		INFO("%u fps offered: %u fps, %lu B/s (%lu B/s on the wire) delivered", rates[step], delivered, goodput, (uint32_t)delivered * wireLength);
+		INFO("  lost %u/%u (%u refused), latency p50 %lu us, p90 %lu us, p99 %lu us, max %lu us", lost, offered, refused, report.p50, report.p90, report.p99, report.max);
+		INFO("  CPU %.1q %% sender, %.1q %% receiver", cpu, report.cpu);
+	}
+
+	bool const passed = reports == stepCount && (!RF_LOAD_LOOPBACK || withinLimits);
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Reports %u/%u", reports, stepCount);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("%u/%u reports", reports, stepCount);
+	lcd_goto(1, 0);
+	LCD("%S", passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+PROGRAM(3, AUTOSTART)
+{
+	while (1)
+	{
+		// Only runs when the other processes yield, so its spins are the CPU time the stack didn't need
+		_delay_us(SPIN_US);
+		os_enterCriticalSection();
+		spinCount++;
+		os_leaveCriticalSection();
+		os_yield();
+	}
+}
+
+#endif
@@ -0,0 +1,125 @@
+//-------------------------------------------------
+//          TestSuite: RF Ping
+//-------------------------------------------------
+// Measures the round-trip time of the protocol
+// stack with CMD_PING/CMD_PONG. With RF_PING_LOOPBACK
+// the frames never leave the board, so changes of
+// the stack can be checked for latency regressions
+// without a partner. Otherwise set PARTNER_ADDRESS
+// to a board that runs the rfAdapter worker.
+// With RF_PING_NOISE garbage that looks like the
+// start of a frame is received between the pings,
+// the parser has to resync without losing a pong.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_RF_PING
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/rfProbe.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_scheduler.h"
+
+// Set to 0 to ping PARTNER_ADDRESS over the air
+#define RF_PING_LOOPBACK 1
+
+// Set to 1 to receive noise between the pings (loopback only)
+#define RF_PING_NOISE 1
+
+// Change PARTNER_ADDRESS to your partners address
+#if RF_PING_LOOPBACK
+#define PARTNER_ADDRESS serialAdapter_address
+#else
+#define PARTNER_ADDRESS ADDRESS_BROADCAST
+#endif
+
+#define PING_COUNT 200
+#define PING_INTERVAL_MS 20
+
+// Time the last pong may take
+#define PONG_TIMEOUT_MS 500
+
+// Limits for the loopback to pass, over the air only the statistics are shown
+#define MAX_P99_RTT_US 20000
+#define MAX_LOST 0
+
+#if RF_PING_LOOPBACK && RF_PING_NOISE
+/*!
+ *  Lets the parser receive garbage: a lone start flag byte, a repeated
+ *  start flag byte and a header with an invalid length. The real frame
+ *  that follows must still be found.
+ */
+static void receiveNoise(uint16_t i)
+{
+	static uint8_t const noise[] = {'F', 0x00, 'F', 'F', 'R', 0x01, 'F', 'R', 0x00, 0x00, 0xFF};
+
+	// The noise must not end up in the middle of a pong
+	os_enterCriticalSection();
+	xbee_writeData((void *)noise, i % sizeof(noise) + 1);
+	os_leaveCriticalSection();
+}
+#endif
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(RF_PING_LOOPBACK);
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+PROGRAM(2, AUTOSTART)
+{
+	rf_probe_t probe;
+
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	INFO("Sending %d pings to 0x%x", PING_COUNT, PARTNER_ADDRESS);
+	lcd_clear();
+	LCD("Pinging...");
+
+	rfProbe_start(&probe, PARTNER_ADDRESS);
+	for (uint16_t i = 0; i < PING_COUNT; i++)
+	{
+#if RF_PING_LOOPBACK && RF_PING_NOISE
+		receiveNoise(i);
+#endif
+		rfProbe_sendPing();
+		delayMs(PING_INTERVAL_MS);
+	}
+	delayMs(PONG_TIMEOUT_MS);
+	rfProbe_stop();
+
+	time_t const p50 = rfProbe_getPercentile(&probe, 50);
+	time_t const p99 = rfProbe_getPercentile(&probe, 99);
+	uint16_t const lost = rfProbe_getLost(&probe);
+	bool const passed = !RF_PING_LOOPBACK || (probe.received && lost <= MAX_LOST && p99 <= MAX_P99_RTT_US);
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Sent %u, received %u, lost %u, reordered %u, duplicates %u, late %u", probe.sent, probe.received, lost, probe.reordered, probe.duplicates, probe.late);
+	INFO("RTT min %lu us, p50 %lu us, p99 %lu us, max %lu us", probe.received ? probe.minRtt : 0, p50, p99, probe.maxRtt);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("p50 %lu p99 %lu", p50, p99);
+	lcd_goto(1, 0);
+	LCD("lost %u %S", lost, passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
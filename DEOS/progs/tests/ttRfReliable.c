@@ -0,0 +1,111 @@
+//-------------------------------------------------
+//          TestSuite: RF Reliable
+//-------------------------------------------------
+// Sends commands in reliable mode over the loopback
+// while bytes are lost on the line, once for every
+// loss rate in LOSS_RATES. Every command has to be
+// executed exactly once. Goodput and the share of
+// transmissions that were lost are reported.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_RF_RELIABLE
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/rfReliable.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_scheduler.h"
+
+// Percent of the bytes that are lost on the loopback
+static uint8_t const LOSS_RATES[] = {1, 5, 10};
+
+#define COMMAND_COUNT 100
+
+// Time the last ACK may take, covers all retransmissions at the highest loss rate
+#define ACK_TIMEOUT_MS 120000
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(true);
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+/*!
+ *  Sends COMMAND_COUNT commands to the own address and waits for their ACKs
+ *
+ *  \param loss Percent of the bytes that are lost
+ *  \return True if every command has been executed exactly once
+ */
+static bool runLossRate(uint8_t loss)
+{
+	xbee_setLoopbackLoss(loss);
+	rfReliable_resetStats();
+	time_t const start = getSystemTime_ms();
+
+	for (uint16_t i = 0; i < COMMAND_COUNT; i++)
+	{
+		rfAdapter_sendToggleLed(serialAdapter_address);
+	}
+	while (!rfReliable_isIdle() && getSystemTime_ms() - start < ACK_TIMEOUT_MS)
+	{
+		os_yield();
+	}
+
+	time_t const elapsed = getSystemTime_ms() - start;
+	rf_reliable_stats_t const stats = rfReliable_stats;
+	uint16_t const transmissions = stats.sent + stats.retransmissions;
+	bool const passed = stats.delivered == stats.sent && stats.sent == COMMAND_COUNT;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Loss %u %%: sent %u, acked %u, failed %u, retransmissions %u", loss, stats.sent, stats.acked, stats.failed, stats.retransmissions);
+	INFO("Delivered %u, duplicates %u, %lu ms", stats.delivered, stats.duplicates, elapsed);
+	INFO("Goodput %lu B/s, lost transmissions %u %%", elapsed ? stats.ackedBytes * 1000 / elapsed : 0, transmissions ? (uint16_t)((uint32_t)stats.retransmissions * 100 / transmissions) : 0);
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("%u%% %luB/s", loss, elapsed ? stats.ackedBytes * 1000 / elapsed : 0);
+	lcd_goto(1, 0);
+	LCD("rtx %u %S", stats.retransmissions, passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	return passed;
+}
+
+PROGRAM(2, AUTOSTART)
+{
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	INFO("Sending %d reliable commands per loss rate", COMMAND_COUNT);
+	lcd_clear();
+	LCD("Sending...");
+
+	rfAdapter_setReliable(true);
+	bool passed = true;
+	for (uint8_t i = 0; i < sizeof(LOSS_RATES); i++)
+	{
+		passed &= runLossRate(LOSS_RATES[i]);
+	}
+	xbee_setLoopbackLoss(0);
+	rfAdapter_setReliable(false);
+
+	INFO("");
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
@@ -0,0 +1,130 @@
+//-------------------------------------------------
+//          TestSuite: RF Transfer
+//-------------------------------------------------
+// Transfers a buffer larger than a frame in
+// fragments, once for every loss rate in
+// LOSS_RATES. The received buffer has to equal the
+// sent one, lost fragments have to be repeated.
+// With RF_TRANSFER_LOOPBACK the fragments never
+// leave the board and bytes are dropped on purpose.
+// Otherwise set PARTNER_ADDRESS to a board that
+// runs this test as well, the throughput can then
+// be compared to the UART rate.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_RF_TRANSFER
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/rfTransfer.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_scheduler.h"
+
+#include <string.h>
+
+// Set to 0 to transfer to PARTNER_ADDRESS over the air
+#define RF_TRANSFER_LOOPBACK 1
+
+// Change PARTNER_ADDRESS to your partners address
+#if RF_TRANSFER_LOOPBACK
+#define PARTNER_ADDRESS serialAdapter_address
+#else
+#define PARTNER_ADDRESS ADDRESS(1, 1)
+#endif
+
+// Percent of the bytes that are lost on the loopback
+static uint8_t const LOSS_RATES[] = {0, 1, 2};
+
+#define TRANSFER_LENGTH 1024
+
+// Bytes per second at 38400 baud with 8N1
+#define UART_RATE 3840
+
+uint8_t sendBuffer[TRANSFER_LENGTH];
+uint8_t receiveBuffer[TRANSFER_LENGTH];
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(RF_TRANSFER_LOOPBACK);
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+/*!
+ *  Transfers sendBuffer and checks what has been received
+ *
+ *  \param loss Percent of the bytes that are lost
+ *  \return True if the transfer succeeded and the buffers are equal
+ */
+static bool runLossRate(uint8_t loss)
+{
+	rf_transfer_receiver_t receiver;
+
+	memset(receiveBuffer, 0, sizeof(receiveBuffer));
+	rfTransfer_startReceiving(&receiver, receiveBuffer, sizeof(receiveBuffer));
+	rfTransfer_resetStats();
+	xbee_setLoopbackLoss(loss);
+
+	time_t const start = getSystemTime_ms();
+	uint8_t const status = rfTransfer_send(PARTNER_ADDRESS, sendBuffer, sizeof(sendBuffer));
+	time_t const elapsed = getSystemTime_ms() - start;
+
+	xbee_setLoopbackLoss(0);
+	rfTransfer_stopReceiving();
+
+	bool const passed = status == RF_TRANSFER_SUCCESS && (!RF_TRANSFER_LOOPBACK || (receiver.complete && !memcmp(sendBuffer, receiveBuffer, sizeof(sendBuffer))));
+	uint32_t const throughput = elapsed ? (uint32_t)TRANSFER_LENGTH * 1000 / elapsed : 0;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Loss %u %%: status %u, %lu ms, %lu B/s (UART %u B/s)", loss, status, elapsed, throughput, UART_RATE);
+	INFO("Fragments %u, repeated %u, rounds %u", rfTransfer_stats.fragments, rfTransfer_stats.repeatedFragments, rfTransfer_stats.rounds);
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("%u%% %luB/s", loss, throughput);
+	lcd_goto(1, 0);
+	LCD("rep %u %S", rfTransfer_stats.repeatedFragments, passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	return passed;
+}
+
+PROGRAM(2, AUTOSTART)
+{
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	for (uint16_t i = 0; i < TRANSFER_LENGTH; i++)
+	{
+		sendBuffer[i] = i * 7 + (i >> 8);
+	}
+
+	INFO("Transferring %u bytes to 0x%x", TRANSFER_LENGTH, PARTNER_ADDRESS);
+	lcd_clear();
+	LCD("Transferring...");
+
+	bool passed = true;
+	for (uint8_t i = 0; i < sizeof(LOSS_RATES); i++)
+	{
+		passed &= runLossRate(RF_TRANSFER_LOOPBACK ? LOSS_RATES[i] : 0);
+	}
+
+	INFO("");
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
@@ -0,0 +1,153 @@
+//-------------------------------------------------
+//          TestSuite: Routing
+//-------------------------------------------------
+// Sends CMD_ROUTED frames over the loopback as a
+// neighbour would pass them on. A frame for this
+// board has to be executed with the origin as its
+// source, and only once. Frames for a remote node
+// have to be passed on to the next hop of its
+// route, which drops them as foreign here, unless
+// their TTL has run out. A flood is executed and
+// passed on, its echo is a duplicate. Commands the
+// rfAdapter sends to the remote node are routed.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_ROUTING
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/rfRouting.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_scheduler.h"
+
+#include <string.h>
+
+// A node two hops away, the neighbour in between and a node behind another neighbour
+#define ORIGIN_ADDRESS ADDRESS(3, 1)
+#define NEIGHBOUR_ADDRESS ADDRESS(3, 2)
+#define REMOTE_ADDRESS ADDRESS(3, 3)
+
+// Time the worker gets to process the received frames
+#define PROCESS_DELAY_MS 100
+
+uint8_t executedCount = 0;
+address_t executedSrcAddr = 0;
+time_t executedTime;
+
+/*!
+ *  Records who sent the command
+ *
+ *  \param frame Received frame with command CMD_SENSOR_DATA
+ */
+static void receiveData(const frame_view_t *frame)
+{
+	executedTime = getSystemTime_us();
+	executedSrcAddr = frame->header.srcAddr;
+	executedCount++;
+}
+
+/*!
+ *  Sends a CMD_SENSOR_DATA to this board wrapped into CMD_ROUTED and waits
+ *  until it has been processed
+ *
+ *  \param destination Final destination in the routing header
+ *  \param sequence Sequence number of the origin
+ *  \param ttl Hops the frame may still take
+ *  \return Microseconds from sending until the command has been executed
+ */
+static time_t sendRouted(address_t destination, uint8_t sequence, uint8_t ttl)
+{
+	uint8_t data[RF_ROUTING_HEADER_LENGTH + sizeof(command_t) + sizeof(cmd_sensorData_t)];
+	rf_routing_header_t header;
+	cmd_sensorData_t sensorData;
+
+	header.origin = ORIGIN_ADDRESS;
+	header.destination = destination;
+	header.sequence = sequence;
+	header.ttl = ttl;
+	memset(&sensorData, 0, sizeof(sensorData));
+
+	data[0] = CMD_ROUTED;
+	memcpy(&data[sizeof(command_t)], &header, sizeof(header));
+	data[RF_ROUTING_HEADER_LENGTH] = CMD_SENSOR_DATA;
+	memcpy(&data[RF_ROUTING_HEADER_LENGTH + sizeof(command_t)], &sensorData, sizeof(sensorData));
+
+	time_t const sentTime = getSystemTime_us();
+	serialAdapter_writeFrame(serialAdapter_address, sizeof(data), (inner_frame_t *)data);
+	delayMs(PROCESS_DELAY_MS);
+	return executedTime - sentTime;
+}
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(true);
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+PROGRAM(2, AUTOSTART)
+{
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	rfAdapter_registerHandler(CMD_SENSOR_DATA, receiveData, sizeof(cmd_sensorData_t), sizeof(cmd_sensorData_t), RF_HANDLER_INLINE);
+	rfRouting_addRoute(REMOTE_ADDRESS, NEIGHBOUR_ADDRESS);
+	rfRouting_resetStats();
+	serialAdapter_resetStats();
+
+	// For this board: executed once, as sent by the origin
+	time_t const latency = sendRouted(serialAdapter_address, 1, RF_ROUTING_DEFAULT_TTL);
+	bool const executed = executedCount == 1 && executedSrcAddr == ORIGIN_ADDRESS;
+	sendRouted(serialAdapter_address, 1, RF_ROUTING_DEFAULT_TTL);
+	bool const duplicateIgnored = executedCount == 1 && rfRouting_stats.duplicates == 1;
+
+	// For the remote node: passed on to the neighbour, not executed
+	sendRouted(REMOTE_ADDRESS, 2, RF_ROUTING_DEFAULT_TTL);
+	bool const forwarded = executedCount == 1 && rfRouting_stats.forwarded == 1 && serialAdapter_stats.foreignFrames == 1;
+	sendRouted(REMOTE_ADDRESS, 3, 1);
+	bool const expired = rfRouting_stats.ttlExpired == 1 && rfRouting_stats.forwarded == 1 && serialAdapter_stats.foreignFrames == 1;
+
+	// Flood: executed and passed on, the echo of the loopback is a duplicate
+	sendRouted(ADDRESS_BROADCAST, 4, RF_ROUTING_DEFAULT_TTL);
+	bool const flooded = executedCount == 2 && rfRouting_stats.forwarded == 2 && rfRouting_stats.duplicates == 2;
+
+	// The rfAdapter routes commands to the remote node over the neighbour
+	rfAdapter_sendToggleLed(REMOTE_ADDRESS);
+	delayMs(PROCESS_DELAY_MS);
+	bool const routed = rfRouting_stats.sent == 1 && serialAdapter_stats.foreignFrames == 2;
+
+	rfRouting_removeRoute(REMOTE_ADDRESS);
+	rfAdapter_registerHandler(CMD_SENSOR_DATA, NULL, 0, 0, RF_HANDLER_INLINE);
+
+	bool const passed = executed && duplicateIgnored && forwarded && expired && flooded && routed && rfRouting_stats.delivered == 2 && !rfRouting_stats.dropped;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Sent %u, delivered %u, forwarded %u", rfRouting_stats.sent, rfRouting_stats.delivered, rfRouting_stats.forwarded);
+	INFO("Duplicates %u, TTL expired %u, dropped %u", rfRouting_stats.duplicates, rfRouting_stats.ttlExpired, rfRouting_stats.dropped);
+	INFO("Executed %u %u, forwarded %u %u, flooded %u, routed %u", executed, duplicateIgnored, forwarded, expired, flooded, routed);
+	INFO("Latency of one hop: %lu us", latency);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("hop %lu us", latency);
+	lcd_goto(1, 0);
+	LCD("fwd %u %S", rfRouting_stats.forwarded, passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
@@ -0,0 +1,128 @@
+//-------------------------------------------------
+//          TestSuite: Sensor Buffer
+//-------------------------------------------------
+// Buffers a numbered series of samples and sends
+// it over the loopback. In the middle of the series
+// every byte is lost for OUTAGE_SAMPLES seconds,
+// long enough for rfReliable to give a frame up.
+// When the link returns, the backlog has to drain
+// and every sample has to arrive exactly once.
+// Takes about a minute.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_SENSOR_BUFFER
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/sensorBuffer.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_scheduler.h"
+
+#define LIVE_SAMPLES 5
+#define OUTAGE_SAMPLES 40
+#define SAMPLE_COUNT (LIVE_SAMPLES + OUTAGE_SAMPLES)
+
+#define LIVE_INTERVAL_MS 100
+#define OUTAGE_INTERVAL_MS 1000
+
+// Time the backlog gets to drain
+#define DRAIN_TIMEOUT_MS 10000
+
+//! Bit i is set when sample i arrived
+uint8_t received[(SAMPLE_COUNT + 7) / 8];
+uint8_t receivedCount = 0;
+uint8_t duplicates = 0;
+
+//! The samples are numbered with their value in tenths
+static void receiveSample(address_t srcAddr, const sensor_sample_t *sample)
+{
+	int16_t const i = sample->param.fValue * 10 + 0.5;
+	if (i < 0 || i >= SAMPLE_COUNT)
+	{
+		return;
+	}
+	if (received[i / 8] & (1 << (i % 8)))
+	{
+		duplicates++;
+		return;
+	}
+	received[i / 8] |= 1 << (i % 8);
+	receivedCount++;
+}
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(true);
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+PROGRAM(2, AUTOSTART)
+{
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	sensorSamples_setReceiver(receiveSample);
+	sensorBuffer_setDestination(serialAdapter_address);
+	sensorBuffer_resetStats();
+
+	uint8_t i = 0;
+	for (; i < LIVE_SAMPLES; i++)
+	{
+		sensorBuffer_add(SENSOR_AM2320, PARAM_TEMPERATURE_CELSIUS, i, -1);
+		delayMs(LIVE_INTERVAL_MS);
+	}
+	uint8_t const live = receivedCount;
+
+	INFO("Link down for %u s", OUTAGE_SAMPLES * OUTAGE_INTERVAL_MS / 1000);
+	lcd_clear();
+	LCD("Link down...");
+	xbee_setLoopbackLoss(100);
+	for (; i < SAMPLE_COUNT; i++)
+	{
+		sensorBuffer_add(SENSOR_AM2320, PARAM_TEMPERATURE_CELSIUS, i, -1);
+		delayMs(OUTAGE_INTERVAL_MS);
+	}
+	bool const detected = !sensorBuffer_isLinkUp();
+	xbee_setLoopbackLoss(0);
+
+	time_t const start = getSystemTime_ms();
+	while (sensorBuffer_getCount() && getSystemTime_ms() - start < DRAIN_TIMEOUT_MS)
+	{
+		os_yield();
+	}
+	time_t const drained = getSystemTime_ms() - start;
+	delayMs(LIVE_INTERVAL_MS);
+
+	sensorSamples_setReceiver(NULL);
+
+	bool const passed = live == LIVE_SAMPLES && detected && receivedCount == SAMPLE_COUNT && !duplicates && !sensorBuffer_stats.dropped && sensorBuffer_stats.replayed >= OUTAGE_SAMPLES;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Received %u of %u samples, %u duplicates, drained in %lu ms", receivedCount, SAMPLE_COUNT, duplicates, drained);
+	INFO("Buffered %u, dropped %u, replayed %u, outages %u", sensorBuffer_stats.buffered, sensorBuffer_stats.dropped, sensorBuffer_stats.replayed, sensorBuffer_stats.outages);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("%u/%u replay %u", receivedCount, SAMPLE_COUNT, sensorBuffer_stats.replayed);
+	lcd_goto(1, 0);
+	LCD("%S", passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
@@ -0,0 +1,168 @@
+//-------------------------------------------------
+//          TestSuite: Sensor Gateway
+//-------------------------------------------------
+// Fills the gateway table with ROUNDS values of two
+// parameters of NODE_COUNT simulated nodes and
+// measures what ingesting a value costs. The most
+// expensive ingest has to be faster than the
+// shortest sensor frame takes on the UART, so the
+// gateway keeps up with a fully loaded channel.
+// Then values are sent over the loopback as
+// CMD_SENSOR_DATA and CMD_SENSOR_SAMPLES, they have
+// to arrive in the table. The feed runs as CSV on
+// the terminal while the test runs, the export
+// follows at the end. No value may be dropped for
+// a full table. Needs SENSOR_GATEWAY_ROLE.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_SENSOR_GATEWAY
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/sensorGateway.h"
+#include "../../communication/sensorSamples.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/stop_watch.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_core.h"
+#include "../../os_scheduler.h"
+
+#include <math.h>
+
+#if !SENSOR_GATEWAY_ROLE
+#error "TT_SENSOR_GATEWAY needs SENSOR_GATEWAY_ROLE 1 (lib/defines.h) for a table that fits NODE_COUNT"
+#endif
+
+// Two parameters per node, they have to fit into SENSOR_GATEWAY_TABLE_LENGTH with the loopback values
+#define NODE_COUNT 32
+#define ROUNDS 10
+
+// Address of the first simulated node
+#define FIRST_NODE ADDRESS(2, 0)
+
+// Bytes per second at 38400 baud with 8N1
+#define UART_RATE 3840
+
+// Time the worker gets to receive the frames
+#define RECEIVE_DELAY_MS 200
+
+//! \return Simulated temperature of a node in a round
+static float temperature(uint8_t node, uint8_t round)
+{
+	return 20 + node * 0.5f + round * 0.1f;
+}
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(true);
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+PROGRAM(3, AUTOSTART)
+{
+	// Feed while the other processes run
+	while (1)
+	{
+		sensorGateway_worker();
+		os_yield();
+	}
+}
+
+//! Checks the statistics of the temperature of a simulated node
+static bool checkNode(uint8_t node)
+{
+	sensor_gateway_entry_t entry;
+	if (!sensorGateway_get(FIRST_NODE + node, SENSOR_BMP388, PARAM_TEMPERATURE_CELSIUS, &entry))
+	{
+		return false;
+	}
+	float const mean = (temperature(node, 0) + temperature(node, ROUNDS - 1)) / 2;
+	return entry.count == ROUNDS && fabs(entry.value - temperature(node, ROUNDS - 1)) < 0.01 && fabs(entry.min - temperature(node, 0)) < 0.01 && fabs(entry.max - temperature(node, ROUNDS - 1)) < 0.01 && fabs(entry.sum / entry.count - mean) < 0.01;
+}
+
+PROGRAM(2, AUTOSTART)
+{
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	sensorGateway_init(SENSOR_GATEWAY_FORMAT_CSV);
+	sensorGateway_resetStats();
+
+	uint32_t ingestSum = 0;
+	time_t ingestMax = 0;
+	for (uint8_t round = 0; round < ROUNDS; round++)
+	{
+		for (uint8_t node = 0; node < NODE_COUNT; node++)
+		{
+			os_enterCriticalSection();
+			stop_watch_handler_t handler = stopWatch_start();
+			sensorGateway_ingest(FIRST_NODE + node, SENSOR_BMP388, PARAM_TEMPERATURE_CELSIUS, temperature(node, round), 0);
+			time_t const temperatureTime = stopWatch_stop(handler);
+			handler = stopWatch_start();
+			sensorGateway_ingest(FIRST_NODE + node, SENSOR_BMP388, PARAM_PRESSURE_PASCAL, 101325 + round, 0);
+			time_t const pressureTime = stopWatch_stop(handler);
+			os_leaveCriticalSection();
+
+			ingestSum += temperatureTime + pressureTime;
+			ingestMax = temperatureTime > ingestMax ? temperatureTime : ingestMax;
+			ingestMax = pressureTime > ingestMax ? pressureTime : ingestMax;
+		}
+		os_yield();
+	}
+
+	uint8_t correct = 0;
+	for (uint8_t node = 0; node < NODE_COUNT; node++)
+	{
+		correct += checkNode(node);
+	}
+
+	// In loopback mode the transmitted bytes end up in the receive buffer
+	os_enterCriticalSection();
+	uint16_t const before = xbee_getNumberOfBytesReceived();
+	rfAdapter_sendSensorData(serialAdapter_address, SENSOR_AM2320, PARAM_TEMPERATURE_CELSIUS, 21.5);
+	uint16_t const frameLength = xbee_getNumberOfBytesReceived() - before;
+	os_leaveCriticalSection();
+	sensorSamples_add(serialAdapter_address, SENSOR_AM2320, PARAM_HUMIDITY_PERCENT, 456, -1);
+	sensorSamples_flush();
+	delayMs(RECEIVE_DELAY_MS);
+
+	sensor_gateway_entry_t entry;
+	bool received = sensorGateway_get(serialAdapter_address, SENSOR_AM2320, PARAM_TEMPERATURE_CELSIUS, &entry) && fabs(entry.value - 21.5) < 0.01;
+	received &= sensorGateway_get(serialAdapter_address, SENSOR_AM2320, PARAM_HUMIDITY_PERCENT, &entry) && fabs(entry.value - 45.6) < 0.01;
+
+	uint32_t const frameTime = (uint32_t)frameLength * 1000000 / UART_RATE;
+	time_t const ingestAverage = ingestSum / (2 * NODE_COUNT * ROUNDS);
+	bool const tableFull = sensorGateway_stats.tableFull;
+	bool const passed = correct == NODE_COUNT && received && !tableFull && ingestMax < frameTime;
+
+	sensorGateway_export();
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Ingest: %lu us average, %lu us max, frame of %u bytes takes %lu us", ingestAverage, ingestMax, frameLength, frameTime);
+	INFO("Nodes correct %u/%u, loopback values %s, table of %u entries %s", correct, NODE_COUNT, received ? "received" : "MISSING", SENSOR_GATEWAY_TABLE_LENGTH, tableFull ? "FULL" : "sufficient");
+	INFO("Updates %u, coalesced %u, records %u, table full %u", sensorGateway_stats.updates, sensorGateway_stats.coalesced, sensorGateway_stats.records, sensorGateway_stats.tableFull);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("%luus/%luus", ingestMax, frameTime);
+	lcd_goto(1, 0);
+	LCD("%u/%u %S", correct, NODE_COUNT, passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
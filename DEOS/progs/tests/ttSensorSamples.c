@@ -0,0 +1,166 @@
+//-------------------------------------------------
+//          TestSuite: Sensor Samples
+//-------------------------------------------------
+// Sends ten samples of all parameter types in one
+// CMD_SENSOR_SAMPLES frame over the loopback. They
+// have to be decoded to the values they were sent
+// with, the samples taken before the pause have to
+// arrive with their age. The bytes on the line are
+// compared to sending the same values with
+// CMD_SENSOR_DATA, one frame per value.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_SENSOR_SAMPLES
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/sensorSamples.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_core.h"
+#include "../../os_scheduler.h"
+
+#include <math.h>
+
+#define SAMPLE_COUNT 10
+
+// The first samples are taken this long before the frame is sent
+#define AGE_MS 300
+
+// Time the worker gets to decode the samples
+#define RECEIVE_DELAY_MS 100
+
+//! A sample as it's sent and the value it has to be decoded to
+typedef struct
+{
+	sensor_type_t sensor;
+	sensor_parameter_type_t paramType;
+	int32_t value;
+	int8_t exponent;
+	sensor_parameter_t expected;
+} test_sample_t;
+
+static test_sample_t const samples[SAMPLE_COUNT] = {
+	{SENSOR_BMP388, PARAM_TEMPERATURE_CELSIUS, 2345, -2, {.fValue = 23.45}},
+	{SENSOR_AM2320, PARAM_TEMPERATURE_CELSIUS, -105, -1, {.fValue = -10.5}},
+	{SENSOR_AM2320, PARAM_HUMIDITY_PERCENT, 456, -1, {.fValue = 45.6}},
+	{SENSOR_ALS_PT19, PARAM_LIGHT_INTENSITY_PERCENT, 3333, -2, {.fValue = 33.33}},
+	{SENSOR_MPL3115A2, PARAM_ALTITUDE_M, 1234, -1, {.fValue = 123.4}},
+	{SENSOR_BMP388, PARAM_PRESSURE_PASCAL, 101325, 0, {.uValue = 101325}},
+	{SENSOR_SGP30, PARAM_E_CO2_PPM, 400, 0, {.uValue = 400}},
+	{SENSOR_SGP30, PARAM_TVOC_PPB, 12000, 0, {.uValue = 12000}},
+	{SENSOR_SCD30, PARAM_CO2_PPM, 41000, 0, {.uValue = 41000}},
+	{SENSOR_LPS331AP, PARAM_PRESSURE_PASCAL, 9876, 1, {.uValue = 98760}},
+};
+
+sensor_sample_t received[SAMPLE_COUNT];
+uint8_t receivedCount = 0;
+
+static void receiveSample(address_t srcAddr, const sensor_sample_t *sample)
+{
+	if (receivedCount < SAMPLE_COUNT)
+	{
+		received[receivedCount] = *sample;
+	}
+	receivedCount++;
+}
+
+//! Checks a received sample against the one that has been sent
+static bool checkSample(uint8_t i)
+{
+	test_sample_t const *sent = &samples[i];
+	sensor_sample_t const *sample = &received[i];
+	bool const aged = i < SAMPLE_COUNT / 2;
+
+	if (sample->sensor != sent->sensor || sample->paramType != sent->paramType)
+	{
+		return false;
+	}
+	if ((sample->age >= AGE_MS - SENSOR_SAMPLES_AGE_UNIT_MS) != aged)
+	{
+		return false;
+	}
+	if (sent->exponent < 0)
+	{
+		return fabs(sample->param.fValue - sent->expected.fValue) < 0.01;
+	}
+	return sample->param.uValue == sent->expected.uValue;
+}
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(true);
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+PROGRAM(2, AUTOSTART)
+{
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	sensorSamples_setReceiver(receiveSample);
+
+	for (uint8_t i = 0; i < SAMPLE_COUNT; i++)
+	{
+		if (i == SAMPLE_COUNT / 2)
+		{
+			delayMs(AGE_MS);
+		}
+		sensorSamples_add(serialAdapter_address, samples[i].sensor, samples[i].paramType, samples[i].value, samples[i].exponent);
+	}
+
+	// In loopback mode the transmitted bytes end up in the receive buffer
+	os_enterCriticalSection();
+	uint16_t before = xbee_getNumberOfBytesReceived();
+	sensorSamples_flush();
+	uint16_t const compact = xbee_getNumberOfBytesReceived() - before;
+	os_leaveCriticalSection();
+	delayMs(RECEIVE_DELAY_MS);
+
+	os_enterCriticalSection();
+	before = xbee_getNumberOfBytesReceived();
+	for (uint8_t i = 0; i < SAMPLE_COUNT; i++)
+	{
+		rfAdapter_sendSensorData(serialAdapter_address, SENSOR_BMP388, PARAM_TEMPERATURE_CELSIUS, 23.45);
+	}
+	uint16_t const legacy = xbee_getNumberOfBytesReceived() - before;
+	os_leaveCriticalSection();
+	delayMs(RECEIVE_DELAY_MS);
+
+	sensorSamples_setReceiver(NULL);
+
+	uint8_t correct = 0;
+	for (uint8_t i = 0; i < SAMPLE_COUNT && i < receivedCount; i++)
+	{
+		correct += checkSample(i);
+	}
+	bool const passed = receivedCount == SAMPLE_COUNT && correct == SAMPLE_COUNT && compact * 3 < legacy;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Received %u samples, %u decoded correctly", receivedCount, correct);
+	INFO("Bytes for %u samples: %u compact, %u with CMD_SENSOR_DATA", SAMPLE_COUNT, compact, legacy);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("%u -> %u bytes", legacy, compact);
+	lcd_goto(1, 0);
+	LCD("%u/%u %S", correct, SAMPLE_COUNT, passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
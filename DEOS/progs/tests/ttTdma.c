@@ -0,0 +1,149 @@
+//-------------------------------------------------
+//          TestSuite: TDMA
+//-------------------------------------------------
+// The board is the time sync master and sends
+// FRAME_COUNT frames at random times with TDMA
+// over the loopback. Every frame has to start in
+// the contention slot or in the slot of the board,
+// none may wait longer than a superframe and a
+// slot. The arrival is stamped when the first byte
+// is looped back, which is when it's transmitted.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_TDMA
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/tdma.h"
+#include "../../communication/timeSync.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_core.h"
+#include "../../os_scheduler.h"
+
+#include <string.h>
+
+#define FRAME_COUNT 20
+
+// Longest random pause (ms) between two frames
+#define MAX_PAUSE_MS 200
+
+// Time the worker gets to receive the last frames
+#define RECEIVE_DELAY_MS 1000
+
+#define MAX_LATENCY_US (TDMA_SUPERFRAME_US + TDMA_SLOT_US)
+
+time_t sentAt[FRAME_COUNT];
+uint8_t receivedCount = 0;
+uint8_t outsideCount = 0;
+time_t maxLatency = 0;
+
+/*!
+ *  Checks where in the superframe a frame has been transmitted
+ *
+ *  \param frame Received frame with command CMD_SENSOR_DATA, the value is the index of the frame
+ */
+static void receiveFrame(const frame_view_t *frame)
+{
+	cmd_sensorData_t buffer;
+	cmd_sensorData_t const *data = serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
+	uint8_t const index = data->param.uValue;
+	time_t rxTime;
+
+	if (index >= FRAME_COUNT || !serialAdapter_getRxTimestamp(&rxTime))
+	{
+		return;
+	}
+
+	time_t const network = os_networkTime_us() - (getSystemTime_us() - rxTime);
+	time_t const position = network % TDMA_SUPERFRAME_US;
+	time_t const slotStart = TDMA_CONTENTION_US + (time_t)tdma_getSlot() * TDMA_SLOT_US;
+	if (position >= TDMA_CONTENTION_US && (position < slotStart || position >= slotStart + TDMA_SLOT_US))
+	{
+		outsideCount++;
+	}
+
+	time_t const latency = rxTime - sentAt[index];
+	if (latency > maxLatency)
+	{
+		maxLatency = latency;
+	}
+	receivedCount++;
+}
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(true);
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+PROGRAM(2, AUTOSTART)
+{
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	timeSync_init(serialAdapter_address);
+	rfAdapter_registerHandler(CMD_SENSOR_DATA, receiveFrame, sizeof(cmd_sensorData_t), sizeof(cmd_sensorData_t), RF_HANDLER_INLINE);
+	tdma_resetStats();
+	tdma_setEnabled(true);
+
+	INFO("Sending %u frames in slot %u of %u, superframe %lu ms", FRAME_COUNT, tdma_getSlot(), TDMA_SLOT_COUNT, TDMA_SUPERFRAME_US / 1000);
+	lcd_clear();
+	LCD("Sending...");
+
+	uint16_t random = 0xACE1;
+	for (uint8_t i = 0; i < FRAME_COUNT; i++)
+	{
+		inner_frame_t innerFrame;
+		cmd_sensorData_t data;
+
+		data.sensor = SENSOR_BMP388;
+		data.paramType = PARAM_PRESSURE_PASCAL;
+		data.param.uValue = i;
+		innerFrame.command = CMD_SENSOR_DATA;
+		memcpy(innerFrame.payload, &data, sizeof(data));
+
+		sentAt[i] = getSystemTime_us();
+		serialAdapter_writeFrame(serialAdapter_address, sizeof(command_t) + sizeof(data), &innerFrame);
+
+		random ^= random << 7;
+		random ^= random >> 9;
+		random ^= random << 8;
+		delayMs(random % MAX_PAUSE_MS);
+	}
+	delayMs(RECEIVE_DELAY_MS);
+
+	tdma_setEnabled(false);
+	rfAdapter_registerHandler(CMD_SENSOR_DATA, NULL, 0, 0, RF_HANDLER_INLINE);
+
+	bool const passed = receivedCount == FRAME_COUNT && !outsideCount && maxLatency <= MAX_LATENCY_US;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Received %u frames, %u outside the slots", receivedCount, outsideCount);
+	INFO("In own slot %u, contention %u, unsynchronized %u, held %u", tdma_stats.slotFrames, tdma_stats.contentionFrames, tdma_stats.unsyncedFrames, tdma_stats.heldFrames);
+	INFO("Max latency %lu ms (limit %lu ms)", maxLatency / 1000, MAX_LATENCY_US / 1000);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("%u/%u max %lums", receivedCount, FRAME_COUNT, maxLatency / 1000);
+	lcd_goto(1, 0);
+	LCD("out %u %S", outsideCount, passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
@@ -0,0 +1,198 @@
+//-------------------------------------------------
+//          TestSuite: Time Series
+//-------------------------------------------------
+// Compresses SAMPLE_COUNT samples of temperature and
+// humidity like the SHTC3 task takes them (tenths,
+// about once per second with some jitter) and
+// decodes them again. The data are synthetic, a
+// LFSR draws the jitter and the drift, so the run
+// is reproducible. The decoded samples have to equal
+// the appended ones and the tenths have to shrink
+// to at most a fifth of 8 bytes per sample. The
+// temperature is compressed as float as well, for
+// comparison. The buffers can be decoded on the
+// host with tools/seriesdecode.py.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_TIME_SERIES
+
+#include "../../communication/sensorData.h"
+#include "../../lib/lcd.h"
+#include "../../lib/stop_watch.h"
+#include "../../lib/terminal.h"
+#include "../../lib/timeSeries.h"
+#include "../../lib/util.h"
+#include "../../os_core.h"
+#include "../../os_scheduler.h"
+
+#include <string.h>
+
+#define SAMPLE_COUNT 500
+
+#define BUFFER_SIZE 1024
+
+// Bytes of an uncompressed sample: 32 bit timestamp and value
+#define RAW_SAMPLE_LENGTH 8
+
+// Least compression ratio of the tenths, times 100
+#define MIN_RATIO 500
+
+#define INTERVAL_MS 1000
+
+//! Which value of the synthetic samples is compressed
+typedef enum
+{
+	SERIES_TEMPERATURE,
+	SERIES_HUMIDITY,
+	SERIES_TEMPERATURE_FLOAT,
+	SERIES_COUNT
+} series_t;
+
+//! Produces the same samples every time it's reset
+typedef struct
+{
+	uint16_t lfsr;
+	uint32_t time;
+	int16_t temperature;
+	int16_t humidity;
+} generator_t;
+
+typedef struct
+{
+	uint16_t length;
+	uint16_t ratio;
+	//! Average duration of timeSeries_append in us
+	uint16_t appendTime;
+	bool equal;
+} series_result_t;
+
+uint8_t buffer[BUFFER_SIZE];
+series_result_t results[SERIES_COUNT];
+
+static void generator_reset(generator_t *generator)
+{
+	generator->lfsr = 0xACE1;
+	generator->time = 12345;
+	generator->temperature = 215;
+	generator->humidity = 480;
+}
+
+//! \return Next bits of a 16 bit Galois LFSR
+static uint8_t generator_random(generator_t *generator, uint8_t bits)
+{
+	uint8_t result = 0;
+	while (bits--)
+	{
+		uint8_t const bit = generator->lfsr & 1;
+		generator->lfsr >>= 1;
+		if (bit)
+		{
+			generator->lfsr ^= 0xB400;
+		}
+		result = (result << 1) | bit;
+	}
+	return result;
+}
+
+//! Advances to the next sample: +-3 ms jitter, tenths change by one now and then
+static void generator_next(generator_t *generator)
+{
+	generator->time += INTERVAL_MS - 3 + generator_random(generator, 3) % 7;
+	uint8_t const drift = generator_random(generator, 4);
+	generator->temperature += drift == 0 ? -1 : drift == 1 ? 1 : 0;
+	generator->humidity += drift == 2 ? -1 : drift >= 13 ? 1 : 0;
+}
+
+static uint32_t generator_value(const generator_t *generator, series_t series)
+{
+	if (series == SERIES_TEMPERATURE)
+	{
+		return (int32_t)generator->temperature;
+	}
+	if (series == SERIES_HUMIDITY)
+	{
+		return (int32_t)generator->humidity;
+	}
+	sensor_parameter_t param;
+	param.fValue = generator->temperature / 10.0f;
+	return param.uValue;
+}
+
+//! Compresses the samples, decodes them and compares them with the generated ones
+static void runSeries(series_t series)
+{
+	series_result_t *const result = &results[series];
+	time_series_t writer;
+	generator_t generator;
+	uint32_t appendTime = 0;
+	uint16_t appended = 0;
+
+	timeSeries_init(&writer, series == SERIES_TEMPERATURE_FLOAT ? TIME_SERIES_XOR : TIME_SERIES_DELTA, buffer, sizeof(buffer));
+	generator_reset(&generator);
+	for (uint16_t i = 0; i < SAMPLE_COUNT; i++)
+	{
+		generator_next(&generator);
+		uint32_t const value = generator_value(&generator, series);
+
+		os_enterCriticalSection();
+		stop_watch_handler_t const handler = stopWatch_start();
+		bool const fits = timeSeries_append(&writer, generator.time, value);
+		appendTime += stopWatch_stop(handler);
+		os_leaveCriticalSection();
+
+		appended += fits;
+	}
+
+	time_series_reader_t reader;
+	uint32_t time;
+	uint32_t value;
+	uint16_t equal = 0;
+	result->length = timeSeries_getLength(&writer);
+	if (timeSeries_startReading(&reader, buffer, result->length))
+	{
+		generator_reset(&generator);
+		while (timeSeries_read(&reader, &time, &value))
+		{
+			generator_next(&generator);
+			equal += time == generator.time && value == generator_value(&generator, series);
+		}
+	}
+
+	result->equal = appended == SAMPLE_COUNT && equal == SAMPLE_COUNT;
+	result->ratio = (uint32_t)SAMPLE_COUNT * RAW_SAMPLE_LENGTH * 100 / result->length;
+	result->appendTime = appendTime / SAMPLE_COUNT;
+}
+
+PROGRAM(1, AUTOSTART)
+{
+	static char const *const names[SERIES_COUNT] = {"temperature", "humidity", "temp. float"};
+
+	for (uint8_t i = 0; i < SERIES_COUNT; i++)
+	{
+		runSeries(i);
+	}
+
+	bool const passed = results[SERIES_TEMPERATURE].equal && results[SERIES_HUMIDITY].equal && results[SERIES_TEMPERATURE_FLOAT].equal && results[SERIES_TEMPERATURE].ratio >= MIN_RATIO && results[SERIES_HUMIDITY].ratio >= MIN_RATIO;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("%u synthetic samples, %u bytes uncompressed", SAMPLE_COUNT, SAMPLE_COUNT * RAW_SAMPLE_LENGTH);
+	for (uint8_t i = 0; i < SERIES_COUNT; i++)
+	{
+		INFO("%-11s: %4u bytes, ratio %.2q, %u us per sample, %s", names[i], results[i].length, results[i].ratio, results[i].appendTime, results[i].equal ? "decoded" : "DIFFERS");
+	}
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("T %.2q H %.2q", results[SERIES_TEMPERATURE].ratio, results[SERIES_HUMIDITY].ratio);
+	lcd_goto(1, 0);
+	LCD("%uus %S", results[SERIES_TEMPERATURE].appendTime, passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		os_yield();
+	}
+}
+
+#endif
@@ -0,0 +1,102 @@
+//-------------------------------------------------
+//          TestSuite: Time Sync
+//-------------------------------------------------
+// The board is the master and receives its own
+// beacons over the loopback. The master clock is
+// skewed by MASTER_OFFSET_US and MASTER_DRIFT_PPM,
+// which have to be estimated from the beacons. The
+// network time then has to match the skewed clock
+// within TOLERANCE_US, also at every beacon after
+// settling, and the drift within DRIFT_TOLERANCE.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_TIME_SYNC
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/timeSync.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_core.h"
+#include "../../os_scheduler.h"
+
+#define MASTER_OFFSET_US 1234567L
+#define MASTER_DRIFT_PPM 50
+
+// Samples taken before the network time is checked
+#define SAMPLE_COUNT 12
+
+#define TOLERANCE_US 50
+
+// Parts per billion
+#define DRIFT_TOLERANCE 5000L
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(true);
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+PROGRAM(2, AUTOSTART)
+{
+	// Wait for the worker to initialize the adapter
+	while (!rfAdapter_isInitialized())
+	{
+		os_yield();
+	}
+
+	timeSync_setMasterSkew(MASTER_OFFSET_US, MASTER_DRIFT_PPM);
+	// Both stamps are taken in the same loop
+	timeSync_setLatency(0);
+	timeSync_init(serialAdapter_address);
+	timeSync_resetStats();
+
+	INFO("Synchronizing to %u beacons, %u ms apart", SAMPLE_COUNT + 1, TIME_SYNC_PERIOD_MS);
+	lcd_clear();
+	LCD("Synchronizing...");
+
+	while (timeSync_stats.samples < SAMPLE_COUNT)
+	{
+		timeSync_worker();
+		os_yield();
+	}
+
+	// Compare the network time to the skewed clock at the same instant
+	os_enterCriticalSection();
+	time_t const local = getSystemTime_us();
+	time_t const network = os_networkTime_us();
+	os_leaveCriticalSection();
+	time_t const expected = local + MASTER_OFFSET_US + (int32_t)((int64_t)local * MASTER_DRIFT_PPM / 1000000);
+	int32_t const error = (int32_t)(network - expected);
+	int32_t const driftError = timeSync_stats.driftPpb - MASTER_DRIFT_PPM * 1000L;
+
+	bool const passed = timeSync_isSynchronized() && error < TOLERANCE_US && error > -TOLERANCE_US && timeSync_stats.maxErrorUs < TOLERANCE_US && driftError < DRIFT_TOLERANCE && driftError > -DRIFT_TOLERANCE;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Beacons sent %u, received %u, samples %u, missed %u, steps %u", timeSync_stats.sent, timeSync_stats.beacons, timeSync_stats.samples, timeSync_stats.missed, timeSync_stats.steps);
+	INFO("Error now %ld us, at the last beacon %ld us, max %lu us", error, timeSync_stats.lastErrorUs, timeSync_stats.maxErrorUs);
+	INFO("Drift %ld ppb (%ld ppb)", timeSync_stats.driftPpb, MASTER_DRIFT_PPM * 1000L);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("err %ldus", error);
+	lcd_goto(1, 0);
+	LCD("max %lu %S", timeSync_stats.maxErrorUs, passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	// Keep the master running for other boards
+	while (1)
+	{
+		timeSync_worker();
+		os_yield();
+	}
+}
+
+#endif
@@ -0,0 +1,124 @@
+//-------------------------------------------------
+//          TestSuite: XBee Link
+//-------------------------------------------------
+// Configures the link to the XBee that the
+// loopback stands in for. Without an answer the
+// link has to stay at the default baud rate. Then
+// it has to move to the high rate with flow
+// control, and after a reset of the UART only it
+// has to find the XBee at that rate again. Frames
+// only loop back if both sides use the same rate.
+//-------------------------------------------------
+#include "../progs.h"
+#if defined(TESTTASK_ENABLED) && TESTTASK == TT_XBEE_LINK
+
+#include "../../communication/rfAdapter.h"
+#include "../../communication/xbee.h"
+#include "../../lib/lcd.h"
+#include "../../lib/terminal.h"
+#include "../../lib/util.h"
+#include "../../os_scheduler.h"
+
+#include <string.h>
+
+#define HIGH_BAUD_RATE 250000UL
+
+#define FRAME_COUNT 10
+
+// Time the worker gets to receive the frames
+#define RECEIVE_DELAY_MS 100
+
+uint8_t receivedCount = 0;
+
+/*!
+ *  Counts the received frames
+ *
+ *  \param frame Received frame with command CMD_SENSOR_DATA
+ */
+static void receiveFrame(const frame_view_t *frame)
+{
+	receivedCount++;
+}
+
+/*!
+ *  Sends frames to this board over the loopback and runs the worker
+ *
+ *  \return How many have been received
+ */
+static uint8_t exchangeFrames(void)
+{
+	inner_frame_t innerFrame;
+	cmd_sensorData_t data;
+
+	memset(&data, 0, sizeof(data));
+	innerFrame.command = CMD_SENSOR_DATA;
+	memcpy(innerFrame.payload, &data, sizeof(data));
+
+	receivedCount = 0;
+	for (uint8_t i = 0; i < FRAME_COUNT; i++)
+	{
+		serialAdapter_writeFrame(serialAdapter_address, sizeof(command_t) + sizeof(data), &innerFrame);
+	}
+
+	time_t const start = getSystemTime_ms();
+	while (getSystemTime_ms() - start < RECEIVE_DELAY_MS)
+	{
+		rfAdapter_worker();
+	}
+	return receivedCount;
+}
+
+PROGRAM(1, AUTOSTART)
+{
+	rfAdapter_init();
+	xbee_setLoopback(true);
+	rfAdapter_registerHandler(CMD_SENSOR_DATA, receiveFrame, sizeof(cmd_sensorData_t), sizeof(cmd_sensorData_t), RF_HANDLER_INLINE);
+
+	lcd_clear();
+	LCD("Configuring...");
+
+	// No module: the link stays as it is
+	xbee_setLoopbackCommands(false);
+	uint8_t const missingStatus = xbee_configureLink(HIGH_BAUD_RATE, true);
+	uint32_t const missingRate = xbee_getBaudRate();
+	uint8_t const missingReceived = exchangeFrames();
+	xbee_setLoopbackCommands(true);
+
+	// Module answers: high rate with flow control
+	time_t const start = getSystemTime_ms();
+	uint8_t const status = xbee_configureLink(HIGH_BAUD_RATE, true);
+	time_t const duration = getSystemTime_ms() - start;
+	bool const flowControl = xbee_hasFlowControl();
+	uint8_t const received = exchangeFrames();
+
+	// Only the UART is reset, the module stays at the high rate
+	xbee_init();
+	uint8_t const mismatchReceived = exchangeFrames();
+	uint8_t const resumeStatus = xbee_configureLink(HIGH_BAUD_RATE, false);
+	uint8_t const resumeReceived = exchangeFrames();
+
+	bool const passed = missingStatus == XBEE_NO_ANSWER && missingRate == XBEE_DEFAULT_BAUD_RATE && missingReceived == FRAME_COUNT
+		&& status == XBEE_SUCCESS && flowControl && received == FRAME_COUNT
+		&& !mismatchReceived && resumeStatus == XBEE_SUCCESS && xbee_getBaudRate() == HIGH_BAUD_RATE && resumeReceived == FRAME_COUNT;
+
+	// Output results on terminal:
+	INFO("");
+	INFO("Without module: status %u, %lu baud, %u/%u frames", missingStatus, missingRate, missingReceived, FRAME_COUNT);
+	INFO("With module: status %u in %lu ms, flow control %u, %u/%u frames", status, duration, flowControl, received, FRAME_COUNT);
+	INFO("After UART reset: %u frames before, status %u, %u/%u frames", mismatchReceived, resumeStatus, resumeReceived, FRAME_COUNT);
+	INFO("Link ceiling %lu B/s instead of %lu B/s", xbee_getBaudRate() / 10, XBEE_DEFAULT_BAUD_RATE / 10);
+	INFO("Test result: %s", passed ? "PASSED" : "FAILED");
+
+	// Output results on LCD:
+	lcd_clear();
+	LCD("%lu baud", xbee_getBaudRate());
+	lcd_goto(1, 0);
+	LCD("%S", passed ? PSTR("PASSED") : PSTR("FAILED"));
+
+	while (1)
+	{
+		rfAdapter_worker();
+	}
+}
+
+#endif
@@ -0,0 +1,171 @@
+/*!
+ *  \brief Adapts the sampling period of a sensor parameter to its signal.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#include "adaptiveSampling.h"
+#include "../os_scheduler.h"
+
+#include <string.h>
+
+//----------------------------------------------------------------------------
+// Defines
+//----------------------------------------------------------------------------
+
+//! Deviations from the mean are clamped to this (fixed point), so their square fits 32 bit
+#define ADAPTIVE_SAMPLING_MAX_DEVIATION 4095
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+adaptive_sampling_stats_t adaptiveSampling_stats;
+
+//----------------------------------------------------------------------------
+// Implementation
+//----------------------------------------------------------------------------
+
+/*!
+ *  Prepares a parameter. The first sample is due immediately and is always
+ *  sent.
+ *
+ *  \param sampling State of the parameter
+ *  \param config Limits of the parameter, must stay valid
+ */
+void adaptiveSampling_init(adaptive_sampling_t *sampling, const adaptive_sampling_config_t *config)
+{
+	memset(sampling, 0, sizeof(*sampling));
+	sampling->config = config;
+	sampling->periodMs = config->minPeriodMs;
+	sampling->nextTime = getSystemTime_ms();
+}
+
+/*!
+ *  \param sampling State of the parameter
+ *  \param now Current time (ms)
+ *  \return True if the next sample is due
+ */
+bool adaptiveSampling_isDue(const adaptive_sampling_t *sampling, time_t now)
+{
+	return (int32_t)(now - sampling->nextTime) >= 0;
+}
+
+/*!
+ *  \param sampling State of the parameter
+ *  \param now Current time (ms)
+ *  \return Time (ms) until the next sample is due, 0 if it's due
+ */
+time_t adaptiveSampling_getWait(const adaptive_sampling_t *sampling, time_t now)
+{
+	return adaptiveSampling_isDue(sampling, now) ? 0 : sampling->nextTime - now;
+}
+
+/*!
+ *  Updates the running mean and variance and adapts the period to them
+ */
+static void adaptiveSampling_adaptPeriod(adaptive_sampling_t *sampling, int16_t value)
+{
+	const adaptive_sampling_config_t *const config = sampling->config;
+	int32_t deviation = ((int32_t)value << ADAPTIVE_SAMPLING_FRACTION_BITS) - sampling->mean;
+
+	if (!sampling->started)
+	{
+		sampling->mean = (int32_t)value << ADAPTIVE_SAMPLING_FRACTION_BITS;
+		return;
+	}
+
+	sampling->mean += deviation >> ADAPTIVE_SAMPLING_SHIFT;
+	if (deviation > ADAPTIVE_SAMPLING_MAX_DEVIATION)
+	{
+		deviation = ADAPTIVE_SAMPLING_MAX_DEVIATION;
+	}
+	else if (deviation < -ADAPTIVE_SAMPLING_MAX_DEVIATION)
+	{
+		deviation = -ADAPTIVE_SAMPLING_MAX_DEVIATION;
+	}
+	sampling->variance += ((int32_t)(deviation * deviation) - (int32_t)sampling->variance) >> ADAPTIVE_SAMPLING_SHIFT;
+
+	// Dead band squared, with the fractional bits of the variance
+	uint32_t const noise = ((uint32_t)config->deadBand * config->deadBand) << (2 * ADAPTIVE_SAMPLING_FRACTION_BITS);
+	// 32 bits, periods above 52 s would wrap around when they grow
+	uint32_t periodMs = sampling->periodMs;
+	if (sampling->variance > noise)
+	{
+		periodMs /= 2;
+	}
+	else if (sampling->variance < noise / 4)
+	{
+		periodMs += periodMs / 4 + 1;
+	}
+
+	if (periodMs < config->minPeriodMs)
+	{
+		periodMs = config->minPeriodMs;
+	}
+	else if (periodMs > config->maxPeriodMs)
+	{
+		periodMs = config->maxPeriodMs;
+	}
+	sampling->periodMs = periodMs;
+}
+
+/*!
+ *  Takes a sample and decides whether it is to be sent. The next sample is
+ *  due one period after this one.
+ *
+ *  \param sampling State of the parameter
+ *  \param time Time (ms) the sample was taken
+ *  \param value The sample
+ *  \return ADAPTIVE_SAMPLING_SKIP, or why the sample is to be sent:
+ *          ADAPTIVE_SAMPLING_CHANGED, ADAPTIVE_SAMPLING_JUMP or ADAPTIVE_SAMPLING_HEARTBEAT
+ */
+uint8_t adaptiveSampling_update(adaptive_sampling_t *sampling, time_t time, int16_t value)
+{
+	const adaptive_sampling_config_t *const config = sampling->config;
+	int32_t const difference = (int32_t)value - sampling->lastSent;
+	uint16_t const change = difference < 0 ? -difference : difference;
+	uint8_t result = ADAPTIVE_SAMPLING_SKIP;
+
+	adaptiveSampling_adaptPeriod(sampling, value);
+	adaptiveSampling_stats.samples++;
+
+	if (!sampling->started || change > config->jumpThreshold)
+	{
+		// A jump is likely followed by more movement
+		sampling->periodMs = config->minPeriodMs;
+		result = ADAPTIVE_SAMPLING_JUMP;
+		adaptiveSampling_stats.jumps++;
+	}
+	else if (change > config->deadBand)
+	{
+		result = ADAPTIVE_SAMPLING_CHANGED;
+		adaptiveSampling_stats.changed++;
+	}
+	else if (config->heartbeatMs && time - sampling->lastSentTime >= config->heartbeatMs)
+	{
+		result = ADAPTIVE_SAMPLING_HEARTBEAT;
+		adaptiveSampling_stats.heartbeats++;
+	}
+
+	if (result != ADAPTIVE_SAMPLING_SKIP)
+	{
+		sampling->lastSent = value;
+		sampling->lastSentTime = time;
+	}
+	sampling->started = true;
+	sampling->nextTime = time + sampling->periodMs;
+	return result;
+}
+
+/*!
+ *  Resets the statistics, e.g. before a measurement
+ */
+void adaptiveSampling_resetStats(void)
+{
+	os_enterCriticalSection();
+	memset(&adaptiveSampling_stats, 0, sizeof(adaptiveSampling_stats));
+	os_leaveCriticalSection();
+}
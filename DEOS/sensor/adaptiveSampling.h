@@ -0,0 +1,100 @@
+/*!
+ *  \brief Adapts the sampling period of a sensor parameter to its signal.
+ *
+ *  Every sample updates a running mean and variance (exponentially weighted,
+ *  fixed point). While the standard deviation stays well below the dead band
+ *  the period grows by a quarter per sample up to maxPeriodMs, when it
+ *  exceeds the dead band the period halves down to minPeriodMs.
+ *
+ *  Sampling and sending are decided separately: a sample is only worth a
+ *  frame if it moved by more than the dead band since the last sent value, if
+ *  it jumped by more than jumpThreshold (sent at once and the period drops to
+ *  minPeriodMs) or if nothing has been sent for heartbeatMs. Measuring is
+ *  cheap compared to the radio, so maxPeriodMs should not exceed the fixed
+ *  interval it replaces; changes are then detected at least as fast as
+ *  before, while flat signals cost no airtime.
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#ifndef ADAPTIVE_SAMPLING_H_
+#define ADAPTIVE_SAMPLING_H_
+
+#include "../lib/util.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Weight of a new sample in the running mean and variance is 2^-ADAPTIVE_SAMPLING_SHIFT
+#ifndef ADAPTIVE_SAMPLING_SHIFT
+#define ADAPTIVE_SAMPLING_SHIFT 3
+#endif
+
+//! Fractional bits of the running mean
+#define ADAPTIVE_SAMPLING_FRACTION_BITS 4
+
+// Results of adaptiveSampling_update, everything but ADAPTIVE_SAMPLING_SKIP is to be sent
+#define ADAPTIVE_SAMPLING_SKIP 0
+#define ADAPTIVE_SAMPLING_CHANGED 1
+#define ADAPTIVE_SAMPLING_JUMP 2
+#define ADAPTIVE_SAMPLING_HEARTBEAT 3
+
+//! Limits of one parameter, values in the unit the samples are taken in (e.g. tenths)
+typedef struct AdaptiveSamplingConfig
+{
+	uint16_t minPeriodMs;
+	uint16_t maxPeriodMs;
+	//! Changes up to this are noise
+	uint16_t deadBand;
+	//! Changes above this are sent at once
+	uint16_t jumpThreshold;
+	//! Longest time without sending, 0 for no heartbeat
+	uint16_t heartbeatMs;
+} adaptive_sampling_config_t;
+
+//! State of one parameter
+typedef struct AdaptiveSampling
+{
+	const adaptive_sampling_config_t *config;
+	uint16_t periodMs;
+	time_t nextTime;
+	time_t lastSentTime;
+	//! Running mean, fixed point with ADAPTIVE_SAMPLING_FRACTION_BITS
+	int32_t mean;
+	//! Running variance, fixed point with 2 * ADAPTIVE_SAMPLING_FRACTION_BITS
+	uint32_t variance;
+	int16_t lastSent;
+	//! False until the first sample
+	bool started;
+} adaptive_sampling_t;
+
+//! Statistics since the last adaptiveSampling_resetStats
+typedef struct AdaptiveSamplingStats
+{
+	uint16_t samples;
+	//! Samples that are to be sent, by reason
+	uint16_t changed;
+	uint16_t jumps;
+	uint16_t heartbeats;
+} adaptive_sampling_stats_t;
+
+extern adaptive_sampling_stats_t adaptiveSampling_stats;
+
+//! Starts sampling at minPeriodMs, the config must stay valid
+void adaptiveSampling_init(adaptive_sampling_t *sampling, const adaptive_sampling_config_t *config);
+
+//! Returns true if the next sample is due at time now
+bool adaptiveSampling_isDue(const adaptive_sampling_t *sampling, time_t now);
+
+//! Returns the time (ms) until the next sample is due, 0 if it's due already
+time_t adaptiveSampling_getWait(const adaptive_sampling_t *sampling, time_t now);
+
+//! Takes a sample, adapts the period and returns whether it is to be sent (ADAPTIVE_SAMPLING_*)
+uint8_t adaptiveSampling_update(adaptive_sampling_t *sampling, time_t time, int16_t value);
+
+//! Resets adaptiveSampling_stats
+void adaptiveSampling_resetStats(void);
+
+#endif /* ADAPTIVE_SAMPLING_H_ */
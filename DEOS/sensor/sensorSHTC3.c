@@ -6,15 +6,18 @@
  *  \date   2024
  */
 
+#define LOG_MODULE SENSOR
+
 #include "sensorSHTC3.h"
 #include "../lib/lcd.h"            // lcd_writeString, lcd_clear, lcd_goto...
 #include "../lib/terminal.h"       // DEBUG(...) / INFO(...)
 #include "../lib/util.h"           // delayMs(...) ??? ?????????????
-#include "sensorData.h"            // ????????? cmd_sensorData_t, enums
-#include "../adapter/rfAdapter.h"  // rfAdapter_sendSensorData(...)
+#include "../communication/sensorData.h" // ????????? cmd_sensorData_t, enums
+#include "../communication/rfAdapter.h" // rfAdapter_sendSensorData(...)
+#include "../communication/sensorBuffer.h" // sensorBuffer_add(...)
+#include "adaptiveSampling.h"
 #include <avr/io.h>
 #include <util/delay.h>
-#include <stdio.h>   // sprintf
 #include <string.h>  // memcpy
 #include <stdbool.h>
 
@@ -48,6 +51,16 @@ extern unsigned char i2c_readNak(void);
 // ????? ?? ????????? (Datasheet ~12ms ? Normal Mode)
 #define SHTC3_MEAS_DURATION_MS 12
 
+//! Receiver of the measurements
+#define SHTC3_DEST_ADDR ADDRESS(1, 0)
+
+//! Limits of the adaptive sampling (tenths): periods, dead band, jump, heartbeat
+static const adaptive_sampling_config_t shtc3_temperatureConfig = {SHTC3_MIN_PERIOD_MS, SHTC3_MAX_PERIOD_MS, 2, 10, SHTC3_HEARTBEAT_MS};
+static const adaptive_sampling_config_t shtc3_humidityConfig = {SHTC3_MIN_PERIOD_MS, SHTC3_MAX_PERIOD_MS, 5, 30, SHTC3_HEARTBEAT_MS};
+
+static adaptive_sampling_t shtc3_temperature;
+static adaptive_sampling_t shtc3_humidity;
+
 //------------------------------------------------------------------------------
 // ??????????????? ??????? ??? CRC-8, ???? ????? ????????? ??????????? ?????
 // (??. 5.10 ? ????????: Polynomial 0x31, Init 0xFF, ??? ?????????).
@@ -174,12 +187,31 @@ void sensorSHTC3_init(void)
     // ?????????????? I2C (?????? ???? ??? ?? ??? ?????????? ??????)
     i2c_init();
 
+    // Measurements are buffered while the receiver can't be reached
+    sensorBuffer_setDestination(SHTC3_DEST_ADDR);
+    adaptiveSampling_init(&shtc3_temperature, &shtc3_temperatureConfig);
+    adaptiveSampling_init(&shtc3_humidity, &shtc3_humidityConfig);
+
     // ????? ??????? ??????? ????????? ??? ????????? ID (?????????????)
     // ...
 
     DEBUG("SHTC3 init done");
 }
 
+/*!
+ * \brief Converts the raw values to tenths of a degree Celsius / percent
+ *
+ * Uses the formulas of the data sheet (5.11) in fixed point, so neither
+ * float math nor the float printf library is needed:
+ *   T[0.1 C]   = -450 + 1750 * ST / 65536
+ *   RH[0.1 %]  = 1000 * SRH / 65536
+ */
+static void shtc3_convert(uint16_t rawT, uint16_t rawRH, int16_t *tempTenths, uint16_t *humTenths)
+{
+    *tempTenths = (int16_t)((1750UL * rawT) >> 16) - 450;
+    *humTenths = (uint16_t)((1000UL * rawRH) >> 16);
+}
+
 //------------------------------------------------------------------------------
 // 2) ??????? ???????? ? ??????? ?? LCD (4.3.6 Messwerte auslesen & Display)
 //------------------------------------------------------------------------------
@@ -198,22 +230,20 @@ void sensorSHTC3_measureAndDisplay(void)
     // ??????? ?????? (?? ????????, ??. 5.11):
     //   T[C] = -45 + 175 * (ST / 65536)
     //   RH[%] = 100 * (SRH / 65536)
-    float tempC = -45.0f + 175.0f * ((float)rawT / 65535.0f);
-    float humRH = 100.0f * ((float)rawRH / 65535.0f);
+    int16_t tempTenths;
+    uint16_t humTenths;
+    shtc3_convert(rawT, rawRH, &tempTenths, &humTenths);
 
     // ????? ?? LCD
     lcd_clear();
     lcd_goto(0,0);
-    char buf[17];
 
     // ??????: "T=23.4C"
-    snprintf(buf, sizeof(buf), "T=%.1fC", tempC);
-    lcd_writeString(buf);
+    LCD("T=%.1qC", tempTenths);
 
     // ?? ?????? ??????: "RH=45.6%"
     lcd_goto(0,1);
-    snprintf(buf, sizeof(buf), "RH=%.1f%%", humRH);
-    lcd_writeString(buf);
+    LCD("RH=%.1q%%", humTenths);
 }
 
 //------------------------------------------------------------------------------
@@ -230,25 +260,56 @@ void sensorSHTC3_measureAndSend(void)
     }
 
     // ????????? ? C / %RH
-    float tempC = -45.0f + 175.0f * ((float)rawT / 65535.0f);
-    float humRH = 100.0f * ((float)rawRH / 65535.0f);
-
-    // ?????????? ??? ?????? ????? rfAdapter_sendSensorData
-    // 1) ???????????
-    rfAdapter_sendSensorData(
-        ADDRESS(1, 0),           // ???? ??????????; ????????, self ??? ?????? ????
-        SENSOR_AM2320,           // ? ??? ? enum'e ??? SHTC3, ????? ???????? ??????? SENSOR_AM2320 ??? ????? ??????, ???? ????????? enum
-        PARAM_TEMPERATURE_CELSIUS,
-        tempC
-    );
-
-    // 2) ?????????
-    rfAdapter_sendSensorData(
-        ADDRESS(1, 0),
-        SENSOR_AM2320,
-        PARAM_HUMIDITY_PERCENT,
-        humRH
-    );
-
-    DEBUG("SHTC3 T=%.1fC  RH=%.1f%% sent!", tempC, humRH);
+    int16_t tempTenths;
+    uint16_t humTenths;
+    shtc3_convert(rawT, rawRH, &tempTenths, &humTenths);
+
+    // Both values as fixed-point tenths, the rfAdapter worker sends them in
+    // one frame and keeps them until they are acknowledged
+    // (SHTC3 has no own sensor type, SENSOR_AM2320 measures the same)
+    sensorBuffer_add(SENSOR_AM2320, PARAM_TEMPERATURE_CELSIUS, tempTenths, -1);
+    sensorBuffer_add(SENSOR_AM2320, PARAM_HUMIDITY_PERCENT, humTenths, -1);
+
+    DEBUG("SHTC3 T=%.1qC  RH=%.1q%% buffered (%u waiting)", tempTenths, humTenths, sensorBuffer_getCount());
+}
+
+/*!
+ * \brief Measures when one of the parameters is due and buffers the values
+ *        that changed, see adaptiveSampling.h
+ *
+ * Both values come from one measurement, so the parameter with the shorter
+ * period sets the pace. Call it in a loop and wait for the returned time:
+ *   while (1) delayMs(sensorSHTC3_measureAndSendAdaptive());
+ *
+ * \return Time (ms) until the next measurement is due
+ */
+time_t sensorSHTC3_measureAndSendAdaptive(void)
+{
+    time_t const now = getSystemTime_ms();
+    if (adaptiveSampling_isDue(&shtc3_temperature, now) || adaptiveSampling_isDue(&shtc3_humidity, now))
+    {
+        uint16_t rawT = 0;
+        uint16_t rawRH = 0;
+        if (!shtc3_measureRaw(&rawT, &rawRH)) {
+            DEBUG("SHTC3 read error, retry");
+            return SHTC3_MIN_PERIOD_MS;
+        }
+
+        int16_t tempTenths;
+        uint16_t humTenths;
+        shtc3_convert(rawT, rawRH, &tempTenths, &humTenths);
+
+        if (adaptiveSampling_update(&shtc3_temperature, now, tempTenths) != ADAPTIVE_SAMPLING_SKIP)
+        {
+            sensorBuffer_add(SENSOR_AM2320, PARAM_TEMPERATURE_CELSIUS, tempTenths, -1);
+        }
+        if (adaptiveSampling_update(&shtc3_humidity, now, humTenths) != ADAPTIVE_SAMPLING_SKIP)
+        {
+            sensorBuffer_add(SENSOR_AM2320, PARAM_HUMIDITY_PERCENT, humTenths, -1);
+        }
+    }
+
+    time_t const temperatureWait = adaptiveSampling_getWait(&shtc3_temperature, now);
+    time_t const humidityWait = adaptiveSampling_getWait(&shtc3_humidity, now);
+    return temperatureWait < humidityWait ? temperatureWait : humidityWait;
 }
@@ -9,8 +9,25 @@
 #ifndef SENSORSHTC3_H_
 #define SENSORSHTC3_H_
 
+#include "../lib/util.h"
+
 #include <stdbool.h>
 
+//! Shortest period (ms) of the adaptive sampling, taken after jumps
+#ifndef SHTC3_MIN_PERIOD_MS
+#define SHTC3_MIN_PERIOD_MS 250
+#endif
+
+//! Longest period (ms) of the adaptive sampling, like the fixed interval it replaces
+#ifndef SHTC3_MAX_PERIOD_MS
+#define SHTC3_MAX_PERIOD_MS 1000
+#endif
+
+//! Longest time (ms) without sending a value
+#ifndef SHTC3_HEARTBEAT_MS
+#define SHTC3_HEARTBEAT_MS 60000
+#endif
+
 /*!
  * \brief ????????????? ??????? SHTC3
  */
@@ -26,4 +43,9 @@ void sensorSHTC3_measureAndDisplay(void);
  */
 void sensorSHTC3_measureAndSend(void);
 
+/*!
+ * \brief Measures with an adaptive period and sends only changed values
+ */
+time_t sensorSHTC3_measureAndSendAdaptive(void);
+
 #endif /* SENSORSHTC3_H_ */
@@ -4,6 +4,8 @@
  *  \version  1.0
  */
 
+#define LOG_MODULE TLCD
+
 #include "tlcd_button.h"
 #include "tlcd_event_parser.h"
 #include "tlcd_graphic.h"
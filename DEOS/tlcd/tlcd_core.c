@@ -4,6 +4,8 @@
  *  \version  1.0
  */
 
+#define LOG_MODULE TLCD
+
 #include "tlcd_core.h"
 #include "../lib/atmega2560constants.h"
 #include "../lib/lcd.h"
@@ -4,7 +4,10 @@
  *  \version  1.0
  */
 
+#define LOG_MODULE TLCD
+
 #include "tlcd_graphic.h"
+#include "../lib/fmt.h"
 #include "../lib/util.h"
 #include "../os_core.h"
 #include "../os_scheduler.h"
@@ -118,6 +121,28 @@ void tlcd_drawProgString(uint16_t x1, uint16_t y1, const char *text)
 	os_leaveCriticalSection();
 }
 
+/*!
+ *  Draw a formatted text at position (x1,y1). The TLCD needs the length of
+ *  the text up front, so the text is formatted into a buffer on the stack.
+ *
+ *  \param x1 X coordinate
+ *  \param y1 Y coordinate
+ *  \param fmt Format string (PROGMEM), see fmt.h. Output beyond TLCD_PRINTF_BUFFER_SIZE - 1 characters is cut off
+ */
+void tlcd_printf_p(uint16_t x1, uint16_t y1, const char *fmt, ...)
+{
+	char text[TLCD_PRINTF_BUFFER_SIZE];
+	fmt_buffer_t buffer = {.buffer = text, .size = sizeof(text), .length = 0};
+
+	va_list args;
+	va_start(args, fmt);
+	fmt_vformat_p(fmt_bufferSink, &buffer, fmt, args);
+	va_end(args);
+
+	text[buffer.length] = '\0';
+	tlcd_drawString(x1, y1, text);
+}
+
 //----------------------------------------------------------------------------
 // Your Homework
 //----------------------------------------------------------------------------
@@ -7,8 +7,17 @@
 #ifndef TLCD_GRAPHIC_H_
 #define TLCD_GRAPHIC_H_
 
+#include <avr/pgmspace.h>
 #include <stdint.h>
 
+//! Size of the stack buffer tlcd_printf_p formats into (including the terminating zero)
+#ifndef TLCD_PRINTF_BUFFER_SIZE
+#define TLCD_PRINTF_BUFFER_SIZE 32
+#endif
+
+//! Draws a formatted string on the display
+#define TLCD(x, y, str, ...) tlcd_printf_p(x, y, PSTR(str), ##__VA_ARGS__)
+
 //! Struct to define a color
 typedef struct TLCD_Color
 {
@@ -47,6 +56,9 @@ void tlcd_drawString(uint16_t x1, uint16_t y1, const char *text);
 //! Draws a string on the display from program memory
 void tlcd_drawProgString(uint16_t x1, uint16_t y1, const char *text);
 
+//! Draws a formatted string (format string from program memory) on the display
+void tlcd_printf_p(uint16_t x1, uint16_t y1, const char *fmt, ...);
+
 //! Clears the display
 void tlcd_clearDisplay();
 
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Decodes the binary feed of the sensor gateway (communication/sensorGateway.h).
+
+An update record looks like [0xA6]['U'][address][sensor][parameter][time uint32]
+[value float][crc uint16], an export record ('E') adds [min float][max float]
+[mean float][count uint16] before the CRC. All numbers are little endian, the
+CRC-16/CCITT covers the bytes between sync and CRC. Records are printed as CSV
+lines like the gateway writes them with SENSOR_GATEWAY_FORMAT_CSV, everything
+outside of records (e.g. log messages) is passed through.
+
+Usage:
+    gatewayfeed.py [input]
+
+input is a file or serial device (default: stdin), e.g. /dev/ttyUSB0.
+Serial devices must already be configured (e.g. stty -F /dev/ttyUSB0 250000 raw).
+"""
+
+import struct
+import sys
+
+SYNC = 0xA6
+UPDATE = struct.Struct("<cBBBIf")
+EXPORT = struct.Struct("<cBBBIffffH")
+
+# Parameter types with a fractional unit (see sensorSamples_isFractional)
+FRACTIONAL = {1, 2, 3, 4}
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1) & 0xFFFF
+    return crc
+
+
+def format_value(param_type, value):
+    return "%.2f" % value if param_type in FRACTIONAL else "%d" % round(value)
+
+
+def format_record(fields):
+    kind, address, sensor, param_type, time = fields[:5]
+    values = [format_value(param_type, value) for value in fields[5:9]]
+    count = ["%u" % fields[9]] if len(fields) > 9 else []
+    return ",".join([kind.decode(), "%u" % address, "%u" % sensor, "%u" % param_type, "%u" % time] + values + count)
+
+
+def record_length(buffer):
+    """Returns the length of the record at the start of buffer, 0 if unknown, None if incomplete."""
+    if len(buffer) < 2:
+        return None
+    layout = {ord("U"): UPDATE, ord("E"): EXPORT}.get(buffer[1])
+    return 1 + layout.size + 2 if layout else 0
+
+
+def run(stream, output):
+    buffer = b""
+    while True:
+        chunk = stream.read(1)
+        if not chunk:
+            break
+        buffer += chunk
+        while buffer:
+            if buffer[0] != SYNC:
+                output.write(buffer[:1].decode("latin-1"))
+                buffer = buffer[1:]
+                continue
+            length = record_length(buffer)
+            if length is None or len(buffer) < length:
+                break
+            body = buffer[1:length - 2]
+            crc, = struct.unpack_from("<H", buffer, length - 2) if length else (None,)
+            if not length or crc != crc16(body):
+                # Not a record, pass the byte through
+                output.write(buffer[:1].decode("latin-1"))
+                buffer = buffer[1:]
+                continue
+            layout = UPDATE if body[0] == ord("U") else EXPORT
+            output.write(format_record(layout.unpack(body)) + "\n")
+            buffer = buffer[length:]
+        output.flush()
+
+
+def main():
+    if len(sys.argv) > 2:
+        print(__doc__, file=sys.stderr)
+        return 1
+    if len(sys.argv) == 2:
+        with open(sys.argv[1], "rb", buffering=0) as stream:
+            run(stream, sys.stdout)
+    else:
+        run(sys.stdin.buffer, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""Decodes the binary log records DEOS emits with TERMINAL_LOG_BINARY=1.
+
+A record looks like [0xA5][id low][id high][length][arguments]. The id is the
+offset of the format string in the .logfmt section of the firmware ELF, the
+arguments are little endian with AVR sizes (int: 2, long: 4, float: 4 bytes,
+strings zero-terminated). Everything outside of records is passed through.
+
+Usage:
+    logdecode.py DEOS.elf [input]
+
+input is a file or serial device (default: stdin), e.g. /dev/ttyUSB0.
+Serial devices must already be configured (e.g. stty -F /dev/ttyUSB0 250000 raw).
+"""
+
+import re
+import struct
+import sys
+
+SYNC = 0xA5
+SECTION = ".logfmt"
+
+FORMAT_SPEC = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|l)?([diouxXcsSpqfFeEgG%])")
+
+
+def read_format_section(elf_path):
+    """Returns the raw content of the .logfmt section of a 32 bit ELF file."""
+    with open(elf_path, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF" or elf[4] != 1:
+        raise ValueError("%s is not a 32 bit ELF file" % elf_path)
+
+    shoff, = struct.unpack_from("<I", elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2E)
+
+    def section(index):
+        # name, type, flags, addr, offset, size
+        return struct.unpack_from("<IIIIII", elf, shoff + index * shentsize)
+
+    names_offset = section(shstrndx)[4]
+    for index in range(shnum):
+        name, _, _, _, offset, size = section(index)
+        end = elf.index(b"\0", names_offset + name)
+        if elf[names_offset + name:end].decode() == SECTION:
+            return elf[offset:offset + size]
+    raise ValueError("%s has no %s section (built without TERMINAL_LOG_BINARY?)" % (elf_path, SECTION))
+
+
+def format_string(section, format_id):
+    end = section.index(b"\0", format_id)
+    return section[format_id:end].decode("latin-1")
+
+
+def take(data, pos, size):
+    if pos + size > len(data):
+        raise IndexError
+    return data[pos:pos + size], pos + size
+
+
+def decode(fmt, data):
+    """Renders fmt with the arguments in data like fmt_vformat_p (lib/fmt.c) would."""
+    out = []
+    pos = 0
+    last = 0
+    for match in FORMAT_SPEC.finditer(fmt):
+        out.append(fmt[last:match.start()])
+        last = match.end()
+        flags, width, precision, length, conv = match.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+        try:
+            if width == "*":
+                raw, pos = take(data, pos, 2)
+                width = str(struct.unpack("<h", raw)[0])
+            if precision == "*":
+                raw, pos = take(data, pos, 2)
+                precision = str(struct.unpack("<h", raw)[0])
+
+            if conv == "s":
+                end = data.index(b"\0", pos) if b"\0" in data[pos:] else len(data)
+                value = data[pos:end].decode("latin-1")
+                pos = end + 1
+            elif conv in "fFeEgG":
+                raw, pos = take(data, pos, 4)
+                value = struct.unpack("<f", raw)[0]
+            elif conv == "S" or conv == "p":
+                raw, pos = take(data, pos, 2)
+                value = struct.unpack("<H", raw)[0]
+                out.append("0x%04x" % value)
+                continue
+            else:
+                size = 4 if length == "l" else 2
+                raw, pos = take(data, pos, size)
+                signed = conv in "diq"
+                value = int.from_bytes(raw, "little", signed=signed)
+                if length == "hh":
+                    value = ((value & 0xFF) ^ 0x80) - 0x80 if signed else value & 0xFF
+                if conv == "c":
+                    value = chr(value & 0xFF)
+                elif conv == "u":
+                    conv = "d"
+                elif conv == "q":
+                    # Fixed-point number scaled by 10^precision (see lib/fmt.h)
+                    digits = int(precision or 0)
+                    value = value / 10 ** digits
+                    conv = "f"
+                    precision = str(digits)
+        except IndexError:
+            out.append("<missing>")
+            continue
+
+        spec = "%" + flags + (width or "") + ("." + precision if precision else "") + conv
+        out.append(spec % value)
+    out.append(fmt[last:])
+    return "".join(out)
+
+
+def run(section, stream, output):
+    buffer = b""
+    while True:
+        chunk = stream.read(1)
+        if not chunk:
+            break
+        buffer += chunk
+        while buffer:
+            if buffer[0] != SYNC:
+                output.write(buffer[:1].decode("latin-1"))
+                buffer = buffer[1:]
+                continue
+            if len(buffer) < 4 or len(buffer) < 4 + buffer[3]:
+                break
+            format_id = buffer[1] | (buffer[2] << 8)
+            args = buffer[4:4 + buffer[3]]
+            try:
+                text = decode(format_string(section, format_id), args)
+            except ValueError:
+                text = "<unknown format id 0x%04x>" % format_id
+            # Like terminal_log_printf_p, every record is one line
+            output.write(text + "\n")
+            buffer = buffer[4 + buffer[3]:]
+        output.flush()
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        print(__doc__, file=sys.stderr)
+        return 1
+    section = read_format_section(sys.argv[1])
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], "rb", buffering=0) as stream:
+            run(section, stream, sys.stdout)
+    else:
+        run(section, sys.stdin.buffer, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+"""Simulates a chain of nodes that pass routed frames on to a gateway with
+the firmware's own communication/rfRouting.c, serialAdapter.c and xbee.c,
+and reports latency and throughput per hop.
+
+Every node is a process of tools/routesim/node.c, which is built for the
+host with the firmware sources. The first node of the chain routes
+CMD_ROUTED frames to the last one over the nodes in between, whose routing
+tables hold the next hop, so TTL, duplicate suppression and forwarding are
+the ones of rfRouting. With --flood the frames go to ADDRESS_BROADCAST and
+every node passes them on until their TTL runs out or they have been seen.
+
+The nodes are connected by virtual serial links: this script advances all
+of them in lockstep, one byte time of the UART per step, and carries the
+bytes a node's UART1 transmits to the UART1 of every node within --range
+hops. Like an XBee in transparent mode, the bytes of a node are collected
+into a packet until --packet bytes are reached or the node stays silent for
+--idle byte times, and the packet is then put at the end of the receive
+queue of the other XBees, which pass one byte per byte time on to their
+UART. The radio is assumed to be much faster than the UARTs and lossless,
+neither its airtime nor collisions are simulated. The nodes need no time to
+process a frame, so the latency is a lower bound.
+
+Usage:
+    routesim.py [--hops 1,2,3,4,6,8] [--interval ms] [--payload bytes]
+                [--frames n] [--ttl n] [--flood] [--range hops]
+                [--packet bytes] [--idle bytes] [--cc compiler]
+
+--interval 0 sends as fast as the transmit queue of the sender allows, which
+measures the throughput. A longer interval measures the latency of a lightly
+loaded chain.
+"""
+
+import argparse
+import collections
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+# One byte at 38400 baud with 8N1
+BYTE_US = 260
+SOURCES = [
+    "tools/routesim/node.c",
+    "communication/rfRouting.c",
+    "communication/serialAdapter.c",
+    "communication/xbee.c",
+    "lib/crc16.c",
+    "lib/fmt.c",
+]
+# First address of the chain, the following nodes count up
+FIRST_ADDRESS = 8
+ADDRESS_BROADCAST = 255
+
+STEP_RX = 0x01
+STEP_QUIT = 0x02
+STEP_TX = 0x01
+STEP_DELIVERED = 0x02
+STEP_BUSY = 0x04
+ANSWER_LENGTH = 8
+
+# Steps without traffic after which the chain is considered idle
+SETTLE_STEPS = 200
+STATS = ["sent", "forwarded", "delivered", "duplicates", "ttlExpired", "dropped", "overflows", "checksumErrors"]
+
+
+def build(cc, directory):
+    """Builds the node program from the firmware sources, returns its path."""
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    node = os.path.join(directory, "node")
+    command = [cc, "-std=gnu99", "-O2", "-fpack-struct", "-Wno-address-of-packed-member", "-DF_CPU=16000000UL",
+               "-I", os.path.join(root, "tools", "routesim", "include"), "-o", node]
+    subprocess.run(command + [os.path.join(root, source) for source in SOURCES], check=True)
+    return node
+
+
+def read_exactly(stream, length):
+    data = b""
+    while len(data) < length:
+        chunk = os.read(stream.fileno(), length - len(data))
+        if not chunk:
+            raise RuntimeError("node stopped")
+        data += chunk
+    return data
+
+
+class Simulation:
+    def __init__(self, args, node, hops):
+        self.args = args
+        self.hops = hops
+        count = hops + 1
+        sink = FIRST_ADDRESS + hops
+        destination = ADDRESS_BROADCAST if args.flood else sink
+        ttl = args.ttl or hops
+        self.nodes = []
+        for index in range(count):
+            command = [node, "-a", str(FIRST_ADDRESS + index), "-t", str(ttl), "-b", str(BYTE_US)]
+            if not args.flood and index < hops:
+                command += ["-r", "%d:%d" % (sink, FIRST_ADDRESS + index + 1)]
+            if index == 0:
+                command += ["-s", str(destination), "-n", str(args.frames), "-i", str(int(args.interval * 1000)),
+                            "-p", str(args.payload)]
+            self.nodes.append(subprocess.Popen(command, stdin=subprocess.PIPE, stdout=subprocess.PIPE, bufsize=0))
+        # Packets the XBee of a node is collecting, how long it has been silent and the bytes it has received
+        self.packets = [bytearray() for _ in range(count)]
+        self.silent = [0] * count
+        self.received = [collections.deque() for _ in range(count)]
+        # Latencies (us) of the frames that arrived at the sink, with the step they arrived in
+        self.latencies = {}
+        self.repeated = 0
+        self.arrivals = []
+
+    def flush(self, index):
+        """Sends the packet a node's XBee has collected to the nodes in range."""
+        for other in range(max(0, index - self.args.range), min(len(self.nodes), index + self.args.range + 1)):
+            if other != index:
+                self.received[other].extend(self.packets[index])
+        self.packets[index].clear()
+
+    def step(self, time):
+        busy = False
+        for index, node in enumerate(self.nodes):
+            if self.received[index]:
+                node.stdin.write(bytes([STEP_RX, self.received[index].popleft()]))
+            else:
+                node.stdin.write(bytes([0, 0]))
+        for index, node in enumerate(self.nodes):
+            answer = read_exactly(node.stdout, ANSWER_LENGTH)
+            flags = answer[0]
+            busy |= bool(flags & STEP_BUSY) or bool(self.received[index]) or bool(self.packets[index])
+            if flags & STEP_TX:
+                self.packets[index].append(answer[1])
+                self.silent[index] = 0
+                if len(self.packets[index]) == self.args.packet:
+                    self.flush(index)
+            elif self.packets[index]:
+                self.silent[index] += 1
+                if self.silent[index] >= self.args.idle:
+                    self.flush(index)
+            if flags & STEP_DELIVERED and index == len(self.nodes) - 1:
+                frame = int.from_bytes(answer[2:4], "little")
+                if frame in self.latencies:
+                    self.repeated += 1
+                else:
+                    self.latencies[frame] = int.from_bytes(answer[4:8], "little")
+                    self.arrivals.append(time)
+        return busy
+
+    def run(self):
+        time = 0
+        quiet = 0
+        while quiet < SETTLE_STEPS:
+            time += BYTE_US
+            quiet = 0 if self.step(time) else quiet + 1
+        stats = collections.Counter()
+        for node in self.nodes:
+            node.stdin.write(bytes([STEP_QUIT, 0]))
+            values = node.stdout.readline().split()
+            node.wait()
+            stats.update(dict(zip(STATS, map(int, values))))
+
+        latencies = list(self.latencies.values())
+        delivered = len(latencies)
+        span = self.arrivals[-1] - self.arrivals[0] if delivered > 1 else 0
+        return {
+            "delivered": delivered,
+            "lost": self.args.frames - delivered,
+            "repeated": self.repeated,
+            # Frames after the first, the chain fills up until it arrives
+            "throughput": (delivered - 1) * self.args.payload * 1e6 / span if span else 0,
+            "mean": sum(latencies) / delivered / 1000 if delivered else 0,
+            "worst": max(latencies) / 1000 if delivered else 0,
+            "per_hop": sum(latencies) / delivered / self.hops / 1000 if delivered else 0,
+            "stats": stats,
+        }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Latency and throughput of routed frames over a chain of nodes running rfRouting")
+    parser.add_argument("--hops", default="1,2,3,4,6,8", help="comma separated chain lengths")
+    parser.add_argument("--interval", type=float, default=0, help="ms between two frames of the sender, 0 for as fast as possible")
+    parser.add_argument("--payload", type=int, default=12, help="bytes of the wrapped command, at least 7")
+    parser.add_argument("--frames", type=int, default=100, help="frames the sender sends")
+    parser.add_argument("--ttl", type=int, default=0, help="TTL of the frames, 0 for the hops of the chain")
+    parser.add_argument("--flood", action="store_true", help="send to ADDRESS_BROADCAST instead of routing to the last node")
+    parser.add_argument("--range", type=int, default=1, help="hops a node's transmissions reach")
+    parser.add_argument("--packet", type=int, default=100, help="bytes an XBee sends in one packet at most")
+    parser.add_argument("--idle", type=int, default=3, help="byte times of silence after which an XBee sends the packet, ATRO")
+    parser.add_argument("--cc", default=os.environ.get("CC", "cc"), help="host C compiler")
+    args = parser.parse_args()
+
+    directory = tempfile.mkdtemp(prefix="routesim")
+    try:
+        node = build(args.cc, directory)
+        print("hops delivered lost repeated throughput(B/s) latency(ms) worst(ms) per hop(ms)"
+              " forwarded dropped ttlExpired duplicates overflows checksumErrors")
+        for hops in (int(h) for h in args.hops.split(",")):
+            result = Simulation(args, node, hops).run()
+            stats = result["stats"]
+            print("%4d %9d %4d %8d %15.1f %11.1f %9.1f %11.2f %9d %7d %10d %10d %9d %14d" % (
+                hops, result["delivered"], result["lost"], result["repeated"], result["throughput"],
+                result["mean"], result["worst"], result["per_hop"], stats["forwarded"], stats["dropped"],
+                stats["ttlExpired"], stats["duplicates"], stats["overflows"], stats["checksumErrors"]))
+            sys.stdout.flush()
+    finally:
+        shutil.rmtree(directory)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,12 @@
+/*! \file
+ *  \brief Host replacement of <avr/interrupt.h>, the node runs in a single thread without interrupts.
+ */
+#ifndef ROUTESIM_AVR_INTERRUPT_H_
+#define ROUTESIM_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+#define cli() (SREG &= ~_BV(7))
+#define sei() (SREG |= _BV(7))
+
+#endif
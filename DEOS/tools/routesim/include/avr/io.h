@@ -0,0 +1,17 @@
+/*! \file
+ *  \brief Host replacement of <avr/io.h> with the registers the communication modules touch.
+ */
+#ifndef ROUTESIM_AVR_IO_H_
+#define ROUTESIM_AVR_IO_H_
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+//! Last address of the SRAM of the ATmega2560
+#define RAMEND 0x21FF
+
+//! Status register, bit 7 is the global interrupt flag
+extern volatile uint8_t SREG;
+
+#endif
@@ -0,0 +1,22 @@
+/*! \file
+ *  \brief Host replacement of <avr/pgmspace.h>, the flash is ordinary memory.
+ */
+#ifndef ROUTESIM_AVR_PGMSPACE_H_
+#define ROUTESIM_AVR_PGMSPACE_H_
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) ((const char *)(s))
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_ptr(address) (*(void *const *)(address))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+
+#endif
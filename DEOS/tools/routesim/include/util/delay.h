@@ -0,0 +1,10 @@
+/*! \file
+ *  \brief Host replacement of <util/delay.h>
+ */
+#ifndef ROUTESIM_UTIL_DELAY_H_
+#define ROUTESIM_UTIL_DELAY_H_
+
+void _delay_ms(double ms);
+void _delay_us(double us);
+
+#endif
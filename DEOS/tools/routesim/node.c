@@ -0,0 +1,511 @@
+/*!
+ *  \brief One node of tools/routesim.py: rfRouting, serialAdapter and xbee
+ *         of the firmware, built for the host, over a UART1 whose bytes are
+ *         exchanged with the simulation through stdin and stdout.
+ *
+ *  The simulation advances all nodes in lockstep, one step per byte time
+ *  of the UART. A step is a request of 2 bytes on stdin:
+ *    [flags][byte]   NODE_STEP_RX: byte has been received, NODE_STEP_QUIT: stop
+ *  The node advances its clock, stores the byte in the receive ringbuffer
+ *  of UART1, lets the sender route its next command if it is due and runs
+ *  the serialAdapter worker, which passes CMD_ROUTED on to rfRouting. The
+ *  answer of 8 bytes on stdout is
+ *    [flags][byte][id uint16][latency uint32]
+ *  with NODE_STEP_TX if UART1 has transmitted byte, NODE_STEP_DELIVERED if
+ *  a routed command for this node has been executed, id and latency (us)
+ *  are its own then, and NODE_STEP_BUSY while the sender has commands
+ *  left or frames wait for transmission. All numbers are little endian.
+ *  On NODE_STEP_QUIT the node writes its statistics as a line of text:
+ *    sent forwarded delivered duplicates ttlExpired dropped overflows checksumErrors
+ *
+ *  The routed commands are CMD_SENSOR_DATA with the number of the command
+ *  and the time it was created as payload, padded to the requested length.
+ *
+ *  Usage:
+ *    node -a address [-r destination:nextHop]... [-t ttl] [-b byteUs]
+ *         [-s destination -n count [-i intervalUs] [-p payload]]
+ *
+ *  \author   Fachbereich 5 - FH Aachen
+ *  \date     2024
+ *  \version  1.0
+ */
+
+#include "../../communication/rfRouting.h"
+#include "../../communication/serialAdapter.h"
+#include "../../communication/tdma.h"
+#include "../../lib/uart.h"
+#include "../../lib/util.h"
+#include "../../os_scheduler.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NODE_STEP_RX 0x01
+#define NODE_STEP_QUIT 0x02
+
+#define NODE_STEP_TX 0x01
+#define NODE_STEP_DELIVERED 0x02
+#define NODE_STEP_BUSY 0x04
+
+//! Length of the answer to a step
+#define NODE_ANSWER_LENGTH 8
+
+//! Payload of the routed commands, the rest up to the requested length is padding
+typedef struct NodeProbe
+{
+	uint16_t id;
+	uint32_t created;
+} node_probe_t;
+
+//! Commands executed in a step that have not been reported yet
+#define NODE_DELIVERED_LENGTH 8
+
+//----------------------------------------------------------------------------
+// Globals
+//----------------------------------------------------------------------------
+
+// Defined by rfAdapter.c on the microcontroller
+start_flag_t serialAdapter_startFlag = 0x5246; // "RF"
+address_t serialAdapter_address;
+
+volatile uint8_t SREG = _BV(7);
+
+//! Simulated time (us)
+uint64_t node_time = 0;
+
+//! Duration of a step, one byte at 38400 baud with 8N1
+uint32_t node_byteUs = 260;
+
+//! Receive ringbuffer of UART1, indices count up and are taken modulo its size
+uint8_t node_rxBuffer[UART1_RX_BUFFER_SIZE];
+uint16_t node_rxHead = 0;
+uint16_t node_rxTail = 0;
+
+//! Bytes written with uart1_putc, sent before the transmit source
+uint8_t node_txBuffer[UART1_TX_BUFFER_SIZE];
+uint8_t node_txHead = 0;
+uint8_t node_txCount = 0;
+
+int16_t (*node_txSource)(void) = NULL;
+
+//! Set by uart1_starttx, cleared once the transmit source has no byte left like the UDRE interrupt
+bool node_txActive = false;
+
+uart1_counters_t node_counters;
+
+//! The commands this node routes
+address_t node_destination;
+uint16_t node_count = 0;
+uint16_t node_sent = 0;
+uint32_t node_intervalUs = 0;
+uint8_t node_payload = sizeof(command_t) + sizeof(node_probe_t);
+uint64_t node_due = 0;
+
+node_probe_t node_delivered[NODE_DELIVERED_LENGTH];
+uint8_t node_deliveredHead = 0;
+uint8_t node_deliveredCount = 0;
+
+//----------------------------------------------------------------------------
+// UART1
+//----------------------------------------------------------------------------
+
+void uart1_init(unsigned int baudrate)
+{
+	node_rxHead = node_rxTail = 0;
+	node_txCount = 0;
+}
+
+void uart1_injectc(unsigned char data)
+{
+	if ((uint16_t)(node_rxHead - node_rxTail) == UART1_RX_BUFFER_SIZE)
+	{
+		node_counters.overflows++;
+		return;
+	}
+	node_rxBuffer[node_rxHead++ % UART1_RX_BUFFER_SIZE] = data;
+	node_counters.rxBytes++;
+}
+
+unsigned int uart1_getc(void)
+{
+	if (node_rxHead == node_rxTail)
+	{
+		return UART_NO_DATA;
+	}
+	return node_rxBuffer[node_rxTail++ % UART1_RX_BUFFER_SIZE];
+}
+
+uint16_t uart1_peek(uint16_t offset, const unsigned char **data)
+{
+	uint16_t const count = node_rxHead - node_rxTail;
+	if (offset >= count)
+	{
+		return 0;
+	}
+	uint16_t const index = (node_rxTail + offset) % UART1_RX_BUFFER_SIZE;
+	uint16_t const contiguous = UART1_RX_BUFFER_SIZE - index;
+	*data = &node_rxBuffer[index];
+	return count - offset < contiguous ? count - offset : contiguous;
+}
+
+void uart1_commit(uint16_t count)
+{
+	node_rxTail += count;
+}
+
+uint16_t uart1_getrxcount(void)
+{
+	return node_rxHead - node_rxTail;
+}
+
+void uart1_putc(unsigned char data)
+{
+	if (node_txCount < UART1_TX_BUFFER_SIZE)
+	{
+		node_txBuffer[(node_txHead + node_txCount++) % UART1_TX_BUFFER_SIZE] = data;
+	}
+	node_txActive = true;
+}
+
+uint16_t uart1_gettxcount(void)
+{
+	// The simulation has sent them before the settings change
+	return 0;
+}
+
+void uart1_settxsource(int16_t (*source)(void))
+{
+	node_txSource = source;
+}
+
+void uart1_starttx(void)
+{
+	node_txActive = true;
+}
+
+// Frames are not timestamped
+void uart1_setrxstamp(int16_t marker)
+{
+}
+
+unsigned char uart1_getrxstamp(uint16_t offset, uint32_t *time)
+{
+	return 0;
+}
+
+// The simulated XBee takes every byte right away
+void uart1_setflowcontrol(unsigned char enable)
+{
+}
+
+void uart1_pollflow(void)
+{
+}
+
+void uart1_getcounters(uart1_counters_t *counters, unsigned char reset)
+{
+	*counters = node_counters;
+	if (reset)
+	{
+		memset(&node_counters, 0, sizeof(node_counters));
+	}
+}
+
+/*!
+ *  Transmits the byte of this step like the UDRE interrupt does
+ *
+ *  \return The byte, negative if the UART is idle
+ */
+static int16_t node_transmit(void)
+{
+	if (!node_txActive)
+	{
+		return -1;
+	}
+	if (node_txCount)
+	{
+		node_txCount--;
+		node_counters.txBytes++;
+		return node_txBuffer[node_txHead++ % UART1_TX_BUFFER_SIZE];
+	}
+	int16_t const byte = node_txSource ? node_txSource() : -1;
+	if (byte < 0)
+	{
+		node_txActive = false;
+		return -1;
+	}
+	node_counters.txBytes++;
+	return byte;
+}
+
+//----------------------------------------------------------------------------
+// System
+//----------------------------------------------------------------------------
+
+time_t getSystemTime_ms(void)
+{
+	return node_time / 1000;
+}
+
+time_t getSystemTime_us(void)
+{
+	return node_time;
+}
+
+// Only waited for while the UART is set up, before the first step
+void delayMs(uint16_t ms)
+{
+}
+
+void os_yield(void)
+{
+}
+
+void os_enterCriticalSection(void)
+{
+}
+
+void os_leaveCriticalSection(void)
+{
+}
+
+bool terminal_logAllowed(uint8_t module)
+{
+	return true;
+}
+
+void terminal_log_printf_p(const char *prefix, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	fprintf(stderr, "%u %s", serialAdapter_address, prefix);
+	vfprintf(stderr, format, args);
+	fputc('\n', stderr);
+	va_end(args);
+}
+
+// TDMA is not simulated, every node may transmit at any time
+bool tdma_mayTransmit(uint8_t length)
+{
+	return true;
+}
+
+bool tdma_worker(void)
+{
+	return false;
+}
+
+//----------------------------------------------------------------------------
+// Commands
+//----------------------------------------------------------------------------
+
+/*!
+ *  Dispatches a received frame like the rfAdapter, only CMD_ROUTED is known
+ *
+ *  \param frame A received frame for this node
+ */
+void serialAdapter_processFrame(const frame_view_t *frame)
+{
+	if (frame->header.length && serialAdapter_viewByte(frame, 0) == CMD_ROUTED)
+	{
+		rfRouting_receive(frame);
+	}
+}
+
+/*!
+ *  Records a routed command that has reached this node
+ *
+ *  \param frame The wrapped command, the routed one with a node_probe_t
+ */
+void rfAdapter_processWrapped(const frame_view_t *frame)
+{
+	if (frame->header.length < sizeof(command_t) + sizeof(node_probe_t) || node_deliveredCount == NODE_DELIVERED_LENGTH)
+	{
+		return;
+	}
+	node_probe_t buffer;
+	node_delivered[(node_deliveredHead + node_deliveredCount++) % NODE_DELIVERED_LENGTH] = *(const node_probe_t *)serialAdapter_viewData(frame, sizeof(command_t), sizeof(buffer), &buffer);
+}
+
+/*!
+ *  Routes the next command if it is due. If the transmit queue is full,
+ *  it's tried again in the next step, like rfRouting_send would yield.
+ */
+static void node_send(void)
+{
+	if (node_sent == node_count || node_time < node_due)
+	{
+		return;
+	}
+
+	uint8_t data[COMM_MAX_INNER_FRAME_LENGTH] = {CMD_SENSOR_DATA};
+	node_probe_t const probe = {node_sent, node_intervalUs ? node_due : node_time};
+	memcpy(&data[sizeof(command_t)], &probe, sizeof(probe));
+
+	if (rfRouting_trySend(node_destination, node_payload, (inner_frame_t *)data) == RF_ROUTING_SUCCESS)
+	{
+		node_sent++;
+		node_due += node_intervalUs;
+	}
+}
+
+//----------------------------------------------------------------------------
+// Simulation
+//----------------------------------------------------------------------------
+
+/*!
+ *  Reads exactly length bytes
+ *
+ *  \return False at the end of the input
+ */
+static bool node_read(uint8_t *data, size_t length)
+{
+	while (length)
+	{
+		ssize_t const count = read(STDIN_FILENO, data, length);
+		if (count <= 0)
+		{
+			return false;
+		}
+		data += count;
+		length -= count;
+	}
+	return true;
+}
+
+/*!
+ *  Runs one byte time of the node
+ *
+ *  \param request The request of the simulation
+ *  \param answer Receives the answer
+ */
+static void node_step(const uint8_t request[2], uint8_t answer[NODE_ANSWER_LENGTH])
+{
+	node_time += node_byteUs;
+	if (request[0] & NODE_STEP_RX)
+	{
+		uart1_injectc(request[1]);
+	}
+
+	node_send();
+	// The worker processes one frame per call, the microcontroller calls it more often than a byte arrives
+	for (uint8_t i = 0; i <= SERIAL_ADAPTER_FRAME_QUEUE_LENGTH; i++)
+	{
+		serialAdapter_worker();
+	}
+
+	memset(answer, 0, NODE_ANSWER_LENGTH);
+	int16_t const byte = node_transmit();
+	if (byte >= 0)
+	{
+		answer[0] |= NODE_STEP_TX;
+		answer[1] = byte;
+	}
+	if (node_deliveredCount)
+	{
+		node_probe_t const *const probe = &node_delivered[node_deliveredHead];
+		uint32_t const latency = node_time - probe->created;
+		answer[0] |= NODE_STEP_DELIVERED;
+		answer[2] = LOW(probe->id);
+		answer[3] = HIGH(probe->id);
+		for (uint8_t i = 0; i < sizeof(latency); i++)
+		{
+			answer[4 + i] = latency >> (8 * i);
+		}
+		node_deliveredHead = (node_deliveredHead + 1) % NODE_DELIVERED_LENGTH;
+		node_deliveredCount--;
+	}
+	if (node_sent < node_count || node_txActive)
+	{
+		answer[0] |= NODE_STEP_BUSY;
+	}
+}
+
+/*!
+ *  \return The number an option argument holds, 0 if it holds none
+ */
+static unsigned long node_number(const char *argument)
+{
+	unsigned long number = 0;
+	sscanf(argument, "%lu", &number);
+	return number;
+}
+
+/*!
+ *  \return The exit status after an invalid command line
+ */
+static int node_usage(void)
+{
+	fprintf(stderr, "usage: node -a address [-r destination:nextHop]... [-t ttl] [-b byteUs]\n"
+					"            [-s destination -n count [-i intervalUs] [-p payload]]\n");
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned destination, nextHop;
+	int option;
+	bool addressed = false;
+
+	serialAdapter_init();
+
+	while ((option = getopt(argc, argv, "a:r:t:b:s:n:i:p:")) != -1)
+	{
+		switch (option)
+		{
+			case 'a':
+				serialAdapter_address = node_number(optarg);
+				addressed = true;
+				break;
+			case 'r':
+				if (sscanf(optarg, "%u:%u", &destination, &nextHop) != 2 || !rfRouting_addRoute(destination, nextHop))
+				{
+					return node_usage();
+				}
+				break;
+			case 't':
+				rfRouting_setTtl(node_number(optarg));
+				break;
+			case 'b':
+				node_byteUs = node_number(optarg);
+				break;
+			case 's':
+				node_destination = node_number(optarg);
+				break;
+			case 'n':
+				node_count = node_number(optarg);
+				break;
+			case 'i':
+				node_intervalUs = node_number(optarg);
+				break;
+			case 'p':
+				node_payload = node_number(optarg);
+				break;
+			default:
+				return node_usage();
+		}
+	}
+	if (!addressed || node_payload < sizeof(command_t) + sizeof(node_probe_t) || node_payload > RF_ROUTING_MAX_INNER_FRAME_LENGTH)
+	{
+		return node_usage();
+	}
+
+	uint8_t request[2];
+	uint8_t answer[NODE_ANSWER_LENGTH];
+	while (node_read(request, sizeof(request)) && !(request[0] & NODE_STEP_QUIT))
+	{
+		node_step(request, answer);
+		if (write(STDOUT_FILENO, answer, sizeof(answer)) != sizeof(answer))
+		{
+			return 1;
+		}
+	}
+
+	serial_adapter_stats_t stats;
+	serialAdapter_getStats(&stats);
+	printf("%u %u %u %u %u %u %u %u\n", rfRouting_stats.sent, rfRouting_stats.forwarded, rfRouting_stats.delivered, rfRouting_stats.duplicates,
+		rfRouting_stats.ttlExpired, rfRouting_stats.dropped, node_counters.overflows, stats.checksumErrors);
+	return 0;
+}
@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""Decodes a time series compressed by lib/timeSeries.c.
+
+The series starts with [mode][count low][count high], followed by the samples
+as a bit stream, most significant bit first. The first sample has a 32 bit
+timestamp and value, every further sample a prefix code for the delta of the
+timestamp deltas and one for the value (see lib/timeSeries.c).
+
+Usage:
+    seriesdecode.py [--scale N] [input]
+
+input is a file with the raw series (default: stdin). Prints one line
+"time_ms value" per sample. Integer values (delta mode) are divided by
+--scale, e.g. 10 for tenths; values in XOR mode are printed as floats.
+"""
+
+import struct
+import sys
+
+HEADER_LENGTH = 3
+MODE_DELTA = 0
+MODE_XOR = 1
+
+# Payload bits of the prefix codes 0, 10, 110, 1110 and 1111
+TIME_WIDTHS = (0, 5, 9, 13, 32)
+DELTA_WIDTHS = (0, 3, 7, 16, 32)
+
+
+class BitReader:
+    def __init__(self, data):
+        self.data = data
+        self.position = 0
+
+    def read(self, count):
+        if self.position + count > len(self.data) * 8:
+            raise EOFError
+        bits = 0
+        for _ in range(count):
+            byte = self.data[self.position // 8]
+            bits = (bits << 1) | ((byte >> (7 - self.position % 8)) & 1)
+            self.position += 1
+        return bits
+
+    def read_code(self, widths):
+        bucket = 0
+        while bucket < len(widths) - 1 and self.read(1):
+            bucket += 1
+        return self.read(widths[bucket])
+
+
+def un_zig_zag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def to_int32(value):
+    value &= 0xFFFFFFFF
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def decode(data):
+    """Returns the mode and the list of (time, raw 32 bit value) samples."""
+    if len(data) < HEADER_LENGTH or data[0] not in (MODE_DELTA, MODE_XOR):
+        raise ValueError("no valid time series header")
+    mode = data[0]
+    count = data[1] | (data[2] << 8)
+    reader = BitReader(data[HEADER_LENGTH:])
+
+    samples = []
+    time = value = delta = 0
+    leading = trailing = None
+    try:
+        for index in range(count):
+            if not index:
+                time = reader.read(32)
+                value = reader.read(32)
+            else:
+                delta = to_int32(delta + un_zig_zag(reader.read_code(TIME_WIDTHS)))
+                time = (time + delta) & 0xFFFFFFFF
+                if mode == MODE_DELTA:
+                    value = (value + un_zig_zag(reader.read_code(DELTA_WIDTHS))) & 0xFFFFFFFF
+                elif reader.read(1):
+                    if reader.read(1):
+                        leading = reader.read(5)
+                        trailing = 32 - leading - (reader.read(5) + 1)
+                    elif leading is None:
+                        raise ValueError("XOR without window")
+                    value ^= reader.read(32 - leading - trailing) << trailing
+            samples.append((time, value))
+    except EOFError:
+        print("series is cut off after %u of %u samples" % (len(samples), count), file=sys.stderr)
+    return mode, samples
+
+
+def main():
+    args = sys.argv[1:]
+    scale = 1
+    if len(args) >= 2 and args[0] == "--scale":
+        scale = int(args[1])
+        args = args[2:]
+    if len(args) > 1:
+        print(__doc__, file=sys.stderr)
+        return 1
+    if args:
+        with open(args[0], "rb") as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    mode, samples = decode(data)
+    for time, value in samples:
+        if mode == MODE_XOR:
+            print("%u %g" % (time, struct.unpack("<f", struct.pack("<I", value))[0]))
+        elif scale != 1:
+            print("%u %g" % (time, to_int32(value) / scale))
+        else:
+            print("%u %d" % (time, to_int32(value)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+"""Simulates many nodes sending sensor frames over a shared channel, with and
+without the TDMA slots of communication/tdma.h.
+
+Every node generates a frame every interval (with some jitter) and queues it.
+Without TDMA a node transmits as soon as it has a frame, with the carrier sense
+and retries of the XBee: the channel looks idle until a transmission has been
+going on for CCA_US, frames that overlap are lost and repeated after a random
+backoff, up to RETRIES times. With TDMA a node only starts a frame in its own
+slot or, after a random backoff, in the contention slot, and only if it ends
+GUARD_US before the slot does, like tdma_mayTransmit. The nodes' idea of the
+network time is off by up to --sync-error us.
+
+The channel is modelled as one serial link at the UART rate, which is what the
+slots are dimensioned for. Goodput counts the payload bytes of the frames that
+got through, the latency runs from generating a frame to the end of its
+successful transmission.
+
+Usage:
+    tdmasim.py [--nodes 8,16,24,32] [--interval ms] [--payload bytes]
+               [--duration s] [--slots n] [--sync-error us] [--seed n]
+
+--slots defaults to the number of nodes, so every node has a slot of its own.
+"""
+
+import argparse
+import heapq
+import random
+
+BYTE_US = 260
+# Start flag, addresses, length, command and CRC
+OVERHEAD = 8
+
+SLOT_US = 20000
+CONTENTION_US = 40000
+GUARD_US = 2000
+BACKOFF_US = 16000
+
+# Carrier sense and retries of the XBee
+CCA_US = 320
+BACKOFF_UNIT_US = 320
+MIN_BE = 3
+MAX_BE = 5
+MAX_CSMA_BACKOFFS = 4
+RETRIES = 3
+
+
+class Node:
+    def __init__(self, index, offset):
+        self.index = index
+        self.offset = offset
+        self.queue = []
+        self.busy = False
+        self.retries = 0
+        self.backoffs = 0
+        self.backoff_superframe = None
+        self.backoff = 0
+
+
+class Simulation:
+    def __init__(self, args, node_count, tdma):
+        self.args = args
+        self.tdma = tdma
+        self.random = random.Random(args.seed)
+        self.slots = args.slots or node_count
+        self.superframe = CONTENTION_US + self.slots * SLOT_US
+        self.airtime = (args.payload + OVERHEAD) * BYTE_US
+        self.nodes = [Node(i, self.random.uniform(-args.sync_error, args.sync_error)) for i in range(node_count)]
+        self.events = []
+        self.sequence = 0
+        self.active = {}
+        self.offered = 0
+        self.delivered = 0
+        self.lost = 0
+        self.latencies = []
+
+    def schedule(self, time, action, node):
+        self.sequence += 1
+        heapq.heappush(self.events, (time, self.sequence, action, node))
+
+    def contention_backoff(self, node, superframe):
+        if node.backoff_superframe != superframe:
+            node.backoff_superframe = superframe
+            node.backoff = self.random.randrange(BACKOFF_US)
+        return node.backoff
+
+    def next_window(self, node, time):
+        """Returns the earliest time >= time the node may start a frame."""
+        network = time + node.offset
+        superframe = int(network // self.superframe)
+        while True:
+            start = superframe * self.superframe
+            windows = [
+                (start + self.contention_backoff(node, superframe), start + CONTENTION_US),
+                (start + CONTENTION_US + (node.index % self.slots) * SLOT_US, start + CONTENTION_US + (node.index % self.slots + 1) * SLOT_US),
+            ]
+            for opens, closes in windows:
+                latest = closes - GUARD_US - self.airtime
+                begin = max(opens, network)
+                if begin <= latest:
+                    return begin - node.offset
+            superframe += 1
+
+    def try_send(self, node, time):
+        if node.busy or not node.queue:
+            return
+        node.busy = True
+        node.backoffs = 0
+        self.schedule(self.next_window(node, time) if self.tdma else time, self.attempt, node)
+
+    def csma_backoff(self, node):
+        exponent = min(MIN_BE + node.backoffs, MAX_BE)
+        return self.random.randrange(1 << exponent) * BACKOFF_UNIT_US
+
+    def attempt(self, time, node):
+        # A backoff may have pushed the frame out of its window
+        if self.tdma:
+            opens = self.next_window(node, time)
+            if opens > time + 1:
+                self.schedule(opens, self.attempt, node)
+                return
+
+        # The channel looks busy once a transmission has been going on for CCA_US
+        if any(start + CCA_US <= time < end for start, end, _ in self.active.values()):
+            node.backoffs += 1
+            if node.backoffs > MAX_CSMA_BACKOFFS:
+                self.failed(time, node)
+            else:
+                self.schedule(time + self.csma_backoff(node), self.attempt, node)
+            return
+
+        end = time + self.airtime
+        transmission = [time, end, False]
+        for other in self.active.values():
+            if other[1] > time:
+                other[2] = True
+                transmission[2] = True
+        self.active[node.index] = transmission
+        self.schedule(end, self.finish, node)
+
+    def finish(self, time, node):
+        _, _, collided = self.active.pop(node.index)
+        if collided:
+            self.failed(time, node)
+            return
+        self.latencies.append(time - node.queue.pop(0))
+        self.delivered += 1
+        node.retries = 0
+        node.busy = False
+        self.try_send(node, time)
+
+    def failed(self, time, node):
+        node.retries += 1
+        if node.retries > RETRIES:
+            node.queue.pop(0)
+            node.retries = 0
+            node.busy = False
+            self.lost += 1
+            self.try_send(node, time)
+            return
+        node.backoffs = 0
+        retry = time + self.csma_backoff(node)
+        self.schedule(self.next_window(node, retry) if self.tdma else retry, self.attempt, node)
+
+    def generate(self, time, node):
+        self.offered += 1
+        node.queue.append(time)
+        interval = self.args.interval * 1000
+        self.schedule(time + self.random.uniform(0.9, 1.1) * interval, self.generate, node)
+        self.try_send(node, time)
+
+    def run(self):
+        for node in self.nodes:
+            self.schedule(self.random.uniform(0, self.args.interval * 1000), self.generate, node)
+        duration = self.args.duration * 1000000
+        while self.events and self.events[0][0] < duration:
+            time, _, action, node = heapq.heappop(self.events)
+            action(time, node)
+        return {
+            "offered": self.offered,
+            "delivered": self.delivered,
+            "lost": self.lost,
+            "goodput": self.delivered * self.args.payload / self.args.duration,
+            "mean": sum(self.latencies) / len(self.latencies) / 1000 if self.latencies else 0,
+            "worst": max(self.latencies) / 1000 if self.latencies else 0,
+        }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compares goodput and latency of many nodes with and without TDMA")
+    parser.add_argument("--nodes", default="8,16,24,32", help="comma separated node counts")
+    parser.add_argument("--interval", type=float, default=250, help="ms between two frames of a node")
+    parser.add_argument("--payload", type=int, default=12, help="payload bytes per frame")
+    parser.add_argument("--duration", type=float, default=60, help="simulated seconds")
+    parser.add_argument("--slots", type=int, default=0, help="node slots per superframe")
+    parser.add_argument("--sync-error", type=float, default=100, help="largest error (us) of the network time")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    print("nodes mode  offered delivered  lost goodput(B/s) mean(ms) worst(ms)")
+    for count in (int(n) for n in args.nodes.split(",")):
+        for tdma in (False, True):
+            result = Simulation(args, count, tdma).run()
+            print("%5d %-5s %7d %9d %5d %12.1f %8.1f %9.1f" % (
+                count, "tdma" if tdma else "csma", result["offered"], result["delivered"], result["lost"],
+                result["goodput"], result["mean"], result["worst"]))
+
+
+if __name__ == "__main__":
+    main()